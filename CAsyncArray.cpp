@@ -0,0 +1,269 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CAsyncArray.cpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CAsyncArray class definition
+ ************************************************************************/
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include "CAsyncArray.hpp"
+#include "CEventLoop.hpp"
+
+#include <stdexcept>
+#include <utility>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+/**
+ * @brief Result shared between copies of CAsyncArray
+ */
+struct CAsyncArray::State
+{
+   State( void )
+      : isReady( false )
+      , error()
+      , value()
+      , handlers()
+      , guard()
+      , readyCondition()
+   {
+
+   }
+
+   bool isReady;                                ///< Whether result is set
+   boost::exception_ptr error;                  ///< Result error
+   DoubleArray value;                           ///< Result value
+   std::vector<ReadyHandler> handlers;          ///< Callbacks waiting for result
+   boost::mutex guard;                          ///< Mutex for result
+   boost::condition_variable readyCondition;    ///< Signalled when result is set
+};
+
+/**
+ * @brief State of whenAll() and whenAny()
+ */
+struct CAsyncArray::Group
+{
+   explicit Group( std::size_t count )
+      : result()
+      , values( count )
+      , pendingCount( count )
+      , guard()
+   {
+
+   }
+
+   CAsyncArray result;                    ///< Combined result
+   std::vector<DoubleArray> values;       ///< Values of ready results, whenAll() only
+   std::size_t pendingCount;              ///< Number of results which are not ready yet
+   boost::mutex guard;                    ///< Mutex for group state
+};
+
+CAsyncArray::CAsyncArray( void )
+   : mState( new State() )
+{
+
+}
+
+CAsyncArray::~CAsyncArray( void )
+{
+
+}
+
+CAsyncArray CAsyncArray::fromValue( const DoubleArray& value )
+{
+   CAsyncArray result;
+   DoubleArray copy( value );
+   result.resolve( boost::exception_ptr(), copy );
+   return result;
+}
+
+CAsyncArray CAsyncArray::fromError( const boost::exception_ptr& error )
+{
+   CAsyncArray result;
+   DoubleArray empty;
+   result.resolve( error, empty );
+   return result;
+}
+
+void CAsyncArray::resolve( const boost::exception_ptr& error, DoubleArray& value ) const
+{
+   std::vector<ReadyHandler> handlers;
+   {
+      boost::lock_guard<boost::mutex> lock( mState->guard );
+      if ( mState->isReady )
+      {
+         return;
+      }
+      mState->isReady = true;
+      mState->error = error;
+      mState->value = std::move( value );
+      handlers.swap( mState->handlers );
+   }
+   mState->readyCondition.notify_all();
+
+   // Result is not changed after it is set, so handlers read it without lock.
+   for ( std::vector<ReadyHandler>::iterator it = handlers.begin(); it != handlers.end(); ++it )
+   {
+      ( *it )( mState->error, mState->value );
+   }
+}
+
+bool CAsyncArray::isReady( void ) const
+{
+   boost::lock_guard<boost::mutex> lock( mState->guard );
+   return mState->isReady;
+}
+
+DoubleArray CAsyncArray::get( void ) const
+{
+   boost::unique_lock<boost::mutex> lock( mState->guard );
+   while ( !mState->isReady )
+   {
+      mState->readyCondition.wait( lock );
+   }
+   if ( mState->error )
+   {
+      boost::rethrow_exception( mState->error );
+   }
+   return mState->value;
+}
+
+void CAsyncArray::onReady( const ReadyHandler& handler ) const
+{
+   {
+      boost::lock_guard<boost::mutex> lock( mState->guard );
+      if ( !mState->isReady )
+      {
+         mState->handlers.push_back( handler );
+         return;
+      }
+   }
+
+   // Handler is not called inline, so that long chains of ready results do not grow the stack.
+   CEventLoop::instance().getService().post( boost::bind( &CAsyncArray::callHandler, mState, handler ) );
+}
+
+void CAsyncArray::callHandler( const boost::shared_ptr<State>& state, const ReadyHandler& handler )
+{
+   handler( state->error, state->value );
+}
+
+CAsyncArray CAsyncArray::then( const Stage& stage ) const
+{
+   CAsyncArray next;
+   onReady( boost::bind( &CAsyncArray::runStage, stage, next, _1, _2 ) );
+   return next;
+}
+
+void CAsyncArray::runStage( const Stage& stage,
+                            const CAsyncArray& next,
+                            const boost::exception_ptr& error,
+                            const DoubleArray& value )
+{
+   if ( error )
+   {
+      forward( next, error, value );
+      return;
+   }
+
+   try
+   {
+      stage( value ).onReady( boost::bind( &CAsyncArray::forward, next, _1, _2 ) );
+   }
+   catch ( ... )
+   {
+      forward( next, boost::current_exception(), DoubleArray() );
+   }
+}
+
+void CAsyncArray::forward( const CAsyncArray& next, const boost::exception_ptr& error, const DoubleArray& value )
+{
+   DoubleArray copy( value );
+   next.resolve( error, copy );
+}
+
+CAsyncArray CAsyncArray::whenAll( const std::vector<CAsyncArray>& results )
+{
+   if ( results.empty() )
+   {
+      return fromValue( DoubleArray() );
+   }
+
+   const boost::shared_ptr<Group> group( new Group( results.size() ) );
+   for ( std::size_t i = 0; i < results.size(); ++i )
+   {
+      results[i].onReady( boost::bind( &CAsyncArray::onAllItem, group, i, _1, _2 ) );
+   }
+   return group->result;
+}
+
+void CAsyncArray::onAllItem( const boost::shared_ptr<Group>& group,
+                             std::size_t index,
+                             const boost::exception_ptr& error,
+                             const DoubleArray& value )
+{
+   if ( error )
+   {
+      forward( group->result, error, value );
+      return;
+   }
+
+   {
+      boost::lock_guard<boost::mutex> lock( group->guard );
+      group->values[index] = value;
+      if ( --group->pendingCount > 0 )
+      {
+         return;
+      }
+   }
+
+   DoubleArray combined;
+   std::size_t size = 0;
+   for ( std::vector<DoubleArray>::const_iterator it = group->values.begin(); it != group->values.end(); ++it )
+   {
+      size += it->size();
+   }
+   combined.reserve( size );
+   for ( std::vector<DoubleArray>::const_iterator it = group->values.begin(); it != group->values.end(); ++it )
+   {
+      combined.insert( combined.end(), it->begin(), it->end() );
+   }
+   group->result.resolve( boost::exception_ptr(), combined );
+}
+
+CAsyncArray CAsyncArray::whenAny( const std::vector<CAsyncArray>& results )
+{
+   if ( results.empty() )
+   {
+      return fromError( boost::copy_exception( std::invalid_argument( "No results to wait for" ) ) );
+   }
+
+   const boost::shared_ptr<Group> group( new Group( results.size() ) );
+   for ( std::size_t i = 0; i < results.size(); ++i )
+   {
+      results[i].onReady( boost::bind( &CAsyncArray::onAnyItem, group, _1, _2 ) );
+   }
+   return group->result;
+}
+
+void CAsyncArray::onAnyItem( const boost::shared_ptr<Group>& group,
+                             const boost::exception_ptr& error,
+                             const DoubleArray& value )
+{
+   if ( error )
+   {
+      boost::lock_guard<boost::mutex> lock( group->guard );
+      if ( --group->pendingCount > 0 )
+      {
+         return;
+      }
+   }
+
+   // The first success wins, later results are ignored by resolve().
+   forward( group->result, error, value );
+}
+/** @}*/
@@ -0,0 +1,179 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CAsyncArray.hpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CAsyncArray class declaration
+ ************************************************************************/
+#ifndef CASYNCARRAY_HPP
+#define CASYNCARRAY_HPP
+
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include <vector>
+
+#include <boost/exception_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "CComputationNode.hpp"
+
+/**
+ * @brief This class represents DoubleArray which will be computed later. \n
+ * Unlike FutureDoubleArray it is composed with continuations instead of \n
+ * waiting: then(), whenAll() and whenAny() register callbacks which run \n
+ * on the shared event loop threads as soon as inputs are ready, so a graph \n
+ * of node calls proceeds without parking a thread for every call. \n
+ * Copies of the object share the same result.
+ * @sa CNodeDispatcher::multiplyPairs(), CNodeDispatcher::sum()
+ */
+class CAsyncArray
+{
+public:
+   /**
+    * @brief Callback which receives result. Error is null on success.
+    */
+   typedef boost::function<void( const boost::exception_ptr& error, const DoubleArray& value )> ReadyHandler;
+
+   /**
+    * @brief Next stage of computation which starts when its input is ready
+    */
+   typedef boost::function<CAsyncArray( const DoubleArray& value )> Stage;
+
+   /**
+    * @brief Constructor. Creates pending result which is set by resolve().
+    */
+   CAsyncArray( void );
+
+   /**
+    * @brief Destructor
+    */
+   ~CAsyncArray( void );
+
+   /**
+    * @brief Create ready result
+    * @param value - result value
+    * @return Ready result
+    */
+   static CAsyncArray fromValue( const DoubleArray& value );
+
+   /**
+    * @brief Create failed result
+    * @param error - result error
+    * @return Failed result
+    */
+   static CAsyncArray fromError( const boost::exception_ptr& error );
+
+   /**
+    * @brief Set result. Only the first call has effect. \n
+    * Signature matches ResultHandler, so it may be passed to CNodeDispatcher::asyncCall().
+    * @param error - error or null on success
+    * @param value - value, moved out
+    */
+   void resolve( const boost::exception_ptr& error, DoubleArray& value ) const;
+
+   /**
+    * @brief Check whether result is set
+    * @return True - if result is set
+    */
+   bool isReady( void ) const;
+
+   /**
+    * @brief Block until result is set and return it. \n
+    * Intended for the end of the graph, stages should use then().
+    * @return Result value
+    * @throw std::exception if result is failed
+    */
+   DoubleArray get( void ) const;
+
+   /**
+    * @brief Call handler once result is set. Handler is called from the thread \n
+    * which sets result, or from the event loop thread if result is already set.
+    * @param handler - result callback
+    */
+   void onReady( const ReadyHandler& handler ) const;
+
+   /**
+    * @brief Start next stage once this result is ready
+    * @param stage - function which starts next stage with this result, \n
+    * it is not called if this result is failed
+    * @return Result of the next stage, failed if this result, or stage itself, fails
+    */
+   CAsyncArray then( const Stage& stage ) const;
+
+   /**
+    * @brief Combine results
+    * @param results - results to wait for
+    * @return Values of all results concatenated in order, \n
+    * failed as soon as any of results fails
+    */
+   static CAsyncArray whenAll( const std::vector<CAsyncArray>& results );
+
+   /**
+    * @brief Take the first successful result
+    * @param results - results to wait for
+    * @return Value of the first result which succeeds, \n
+    * failed with the last error if all of them fail
+    */
+   static CAsyncArray whenAny( const std::vector<CAsyncArray>& results );
+
+private:
+   struct State;
+   struct Group;
+
+   /**
+    * @brief Call handler with the result of ready state
+    * @param state - ready state
+    * @param handler - result callback
+    */
+   static void callHandler( const boost::shared_ptr<State>& state, const ReadyHandler& handler );
+
+   /**
+    * @brief then() callback
+    * @param stage - next stage
+    * @param next - result of the next stage
+    * @param error - error of this result
+    * @param value - value of this result
+    */
+   static void runStage( const Stage& stage,
+                         const CAsyncArray& next,
+                         const boost::exception_ptr& error,
+                         const DoubleArray& value );
+
+   /**
+    * @brief Forward result of the stage
+    * @param next - result to set
+    * @param error - error of the stage
+    * @param value - value of the stage
+    */
+   static void forward( const CAsyncArray& next, const boost::exception_ptr& error, const DoubleArray& value );
+
+   /**
+    * @brief whenAll() callback
+    * @param group - combined results state
+    * @param index - index of the ready result
+    * @param error - result error
+    * @param value - result value
+    */
+   static void onAllItem( const boost::shared_ptr<Group>& group,
+                          std::size_t index,
+                          const boost::exception_ptr& error,
+                          const DoubleArray& value );
+
+   /**
+    * @brief whenAny() callback
+    * @param group - combined results state
+    * @param error - result error
+    * @param value - result value
+    */
+   static void onAnyItem( const boost::shared_ptr<Group>& group,
+                          const boost::exception_ptr& error,
+                          const DoubleArray& value );
+
+private:
+   boost::shared_ptr<State> mState;    ///< Result shared between copies
+};
+/** @}*/
+#endif // CASYNCARRAY_HPP
@@ -0,0 +1,129 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CBlockStore.cpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CBlockStore class definition
+ ************************************************************************/
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include "CBlockStore.hpp"
+
+const std::size_t CBlockStore::DEFAULT_CAPACITY;
+
+/**
+ * @brief Get memory used by the block
+ * @param block - stored block
+ * @return Size in bytes
+ */
+static std::size_t getBlockSize( const CBlockStore::Block& block )
+{
+   return sizeof( block ) + block.columns.size() * sizeof( double );
+}
+
+CBlockStore::CBlockStore( std::size_t capacityBytes )
+   : mCapacity( capacityBytes )
+   , mSize( 0 )
+   , mEntries()
+   , mIndex()
+   , mGuard()
+{
+
+}
+
+CBlockStore::~CBlockStore( void )
+{
+
+}
+
+bool CBlockStore::store( const std::string& handle, std::size_t depth, std::vector<double>& columns )
+{
+   if ( depth == 0 || columns.size() % depth != 0 )
+   {
+      return false;
+   }
+
+   const boost::shared_ptr<Block> block( new Block() );
+   block->depth = depth;
+   block->columns.swap( columns );
+   const std::size_t blockSize = getBlockSize( *block );
+   if ( blockSize > mCapacity )
+   {
+      return false;
+   }
+
+   boost::lock_guard<boost::mutex> lock( mGuard );
+   const Index::iterator it = mIndex.find( handle );
+   if ( it != mIndex.end() )
+   {
+      mSize -= getBlockSize( *it->second->block );
+      mEntries.erase( it->second );
+      mIndex.erase( it );
+   }
+
+   // Blocks which are being multiplied stay alive until their requests are answered.
+   while ( mSize + blockSize > mCapacity && !mEntries.empty() )
+   {
+      mSize -= getBlockSize( *mEntries.back().block );
+      mIndex.erase( mEntries.back().handle );
+      mEntries.pop_back();
+   }
+
+   Entry entry;
+   entry.handle = handle;
+   entry.block = block;
+   mEntries.push_front( entry );
+   mIndex[handle] = mEntries.begin();
+   mSize += blockSize;
+   return true;
+}
+
+CBlockStore::BlockPtr CBlockStore::find( const std::string& handle )
+{
+   boost::lock_guard<boost::mutex> lock( mGuard );
+   const Index::iterator it = mIndex.find( handle );
+   if ( it == mIndex.end() )
+   {
+      return BlockPtr();
+   }
+   mEntries.splice( mEntries.begin(), mEntries, it->second );
+   return it->second->block;
+}
+
+bool CBlockStore::multiply( const Block& block, const std::vector<double>& rows, std::vector<double>& result )
+{
+   const std::size_t depth = block.depth;
+   if ( rows.size() % depth != 0 )
+   {
+      return false;
+   }
+
+   const std::size_t rowsCount = rows.size() / depth;
+   const std::size_t colsCount = block.columns.size() / depth;
+   result.resize( rowsCount * colsCount );
+   for ( std::size_t i = 0; i < rowsCount; ++i )
+   {
+      const double* row = &rows[i * depth];
+      for ( std::size_t j = 0; j < colsCount; ++j )
+      {
+         // Products are added in order, as the sum of /multiply results is.
+         const double* column = &block.columns[j * depth];
+         double total = 0.0;
+         for ( std::size_t k = 0; k < depth; ++k )
+         {
+            total += row[k] * column[k];
+         }
+         result[i * colsCount + j] = total;
+      }
+   }
+   return true;
+}
+
+std::size_t CBlockStore::getBlocksCount( void ) const
+{
+   boost::lock_guard<boost::mutex> lock( mGuard );
+   return mEntries.size();
+}
+/** @}*/
@@ -0,0 +1,113 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CBlockStore.hpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CBlockStore class declaration
+ ************************************************************************/
+#ifndef CBLOCKSTORE_HPP
+#define CBLOCKSTORE_HPP
+
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include <list>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/unordered_map.hpp>
+
+/**
+ * @brief This class keeps blocks of matrix columns uploaded to the computation node, \n
+ * so that multiplication requests refer to a block by its handle instead of \n
+ * sending its values again. Least recently used blocks are evicted over capacity, \n
+ * and requests for them fail, so that the client uploads them again.
+ * @sa CComputationNode::asyncStoreBlock(), CComputationNode::asyncMultiplyBlock()
+ */
+class CBlockStore : private boost::noncopyable
+{
+public:
+   /**
+    * @brief Stored block of columns
+    */
+   struct Block
+   {
+      std::size_t depth;            ///< Values per column
+      std::vector<double> columns;  ///< Columns one after another
+   };
+
+   typedef boost::shared_ptr<const Block> BlockPtr;
+
+   /**
+    * @brief Default limit of memory used by stored blocks
+    */
+   static const std::size_t DEFAULT_CAPACITY = 256u << 20;
+
+   /**
+    * @brief Constructor
+    * @param capacityBytes - limit of memory used by stored blocks
+    */
+   explicit CBlockStore( std::size_t capacityBytes = DEFAULT_CAPACITY );
+
+   /**
+    * @brief Destructor
+    */
+   ~CBlockStore( void );
+
+   /**
+    * @brief Store block. Block with the same handle is replaced.
+    * @param handle - block handle chosen by the client
+    * @param depth - values per column
+    * @param[in,out] columns - columns one after another, moved out
+    * @return False - if columns count is not whole or block is larger than capacity
+    */
+   bool store( const std::string& handle, std::size_t depth, std::vector<double>& columns );
+
+   /**
+    * @brief Find block and mark it as recently used
+    * @param handle - block handle
+    * @return Block, null if it is unknown or evicted
+    */
+   BlockPtr find( const std::string& handle );
+
+   /**
+    * @brief Multiply rows by the block columns
+    * @param block - stored block
+    * @param rows - rows one after another, each of block depth values
+    * @param[out] result - dot product of every row with every column, row by row
+    * @return False - if rows count is not whole
+    */
+   static bool multiply( const Block& block, const std::vector<double>& rows, std::vector<double>& result );
+
+   /**
+    * @brief Get number of stored blocks
+    * @return Blocks count
+    */
+   std::size_t getBlocksCount( void ) const;
+
+private:
+   /**
+    * @brief Block with its handle
+    */
+   struct Entry
+   {
+      std::string handle;  ///< Block handle
+      BlockPtr block;      ///< Block values
+   };
+
+   typedef std::list<Entry> Entries;
+   typedef boost::unordered_map<std::string, Entries::iterator> Index;
+
+private:
+   std::size_t mCapacity;        ///< Limit of memory used by stored blocks
+   std::size_t mSize;            ///< Memory used by stored blocks
+   Entries mEntries;             ///< Stored blocks, most recently used first
+   Index mIndex;                 ///< Stored blocks by handle
+   mutable boost::mutex mGuard;  ///< Mutex for blocks
+};
+/** @}*/
+#endif // CBLOCKSTORE_HPP
@@ -0,0 +1,155 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CCancelToken.cpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CCancelToken class definition
+ ************************************************************************/
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include "CCancelToken.hpp"
+#include "CEventLoop.hpp"
+
+#include <boost/bind.hpp>
+
+CCancelToken::CCancelToken( void )
+   : mGuard()
+   , mIsCancelled( false )
+   , mReason()
+   , mCallbacks()
+   , mNextId( 1 )
+   , mParent()
+   , mParentId( 0 )
+   , mTimer()
+{
+
+}
+
+CCancelToken::~CCancelToken( void )
+{
+   if ( mTimer )
+   {
+      boost::system::error_code ignored;
+      mTimer->cancel( ignored );
+   }
+   if ( mParent )
+   {
+      mParent->unsubscribe( mParentId );
+   }
+}
+
+CancelTokenPtr CCancelToken::createChild( void )
+{
+   const CancelTokenPtr child( new CCancelToken() );
+   child->mParent = shared_from_this();
+   child->mParentId = subscribe( boost::bind( &CCancelToken::onParentCancelled,
+                                              boost::weak_ptr<CCancelToken>( child ) ) );
+   if ( child->mParentId == 0 )
+   {
+      child->cancel( getReason() );
+   }
+   return child;
+}
+
+void CCancelToken::cancel( const std::string& reason )
+{
+   std::map<std::size_t, Callback> callbacks;
+   {
+      boost::lock_guard<boost::mutex> lock( mGuard );
+      if ( mIsCancelled )
+      {
+         return;
+      }
+      mIsCancelled = true;
+      mReason = reason;
+      callbacks.swap( mCallbacks );
+   }
+
+   // Callbacks are called without the lock, so they may unsubscribe or check the token.
+   for ( std::map<std::size_t, Callback>::iterator it = callbacks.begin(); it != callbacks.end(); ++it )
+   {
+      it->second();
+   }
+}
+
+void CCancelToken::cancelAfter( boost::posix_time::time_duration timeout, const std::string& reason )
+{
+   boost::lock_guard<boost::mutex> lock( mGuard );
+   if ( !mTimer )
+   {
+      mTimer.reset( new boost::asio::deadline_timer( CEventLoop::instance().getService() ) );
+   }
+   mTimer->expires_from_now( timeout );
+   mTimer->async_wait( boost::bind( &CCancelToken::onDeadline,
+                                    boost::weak_ptr<CCancelToken>( shared_from_this() ),
+                                    reason,
+                                    boost::asio::placeholders::error ) );
+}
+
+bool CCancelToken::isCancelled( void ) const
+{
+   boost::lock_guard<boost::mutex> lock( mGuard );
+   return mIsCancelled;
+}
+
+boost::exception_ptr CCancelToken::getError( void ) const
+{
+   boost::lock_guard<boost::mutex> lock( mGuard );
+   return boost::copy_exception( CCancelledError( mReason ) );
+}
+
+std::size_t CCancelToken::subscribe( const Callback& callback )
+{
+   boost::lock_guard<boost::mutex> lock( mGuard );
+   if ( mIsCancelled )
+   {
+      return 0;
+   }
+   const std::size_t id = mNextId++;
+   mCallbacks.insert( std::make_pair( id, callback ) );
+   return id;
+}
+
+void CCancelToken::unsubscribe( std::size_t id )
+{
+   if ( id == 0 )
+   {
+      return;
+   }
+   boost::lock_guard<boost::mutex> lock( mGuard );
+   mCallbacks.erase( id );
+}
+
+std::string CCancelToken::getReason( void ) const
+{
+   boost::lock_guard<boost::mutex> lock( mGuard );
+   return mReason;
+}
+
+void CCancelToken::onParentCancelled( const boost::weak_ptr<CCancelToken>& child )
+{
+   const CancelTokenPtr lockedChild = child.lock();
+   if ( lockedChild )
+   {
+      lockedChild->cancel( lockedChild->mParent->getReason() );
+   }
+}
+
+void CCancelToken::onDeadline( const boost::weak_ptr<CCancelToken>& token,
+                               const std::string& reason,
+                               const boost::system::error_code& error )
+{
+   if ( error == boost::asio::error::operation_aborted )
+   {
+      return;
+   }
+
+   const CancelTokenPtr lockedToken = token.lock();
+   if ( lockedToken )
+   {
+      lockedToken->cancel( reason );
+   }
+}
+/** @}*/
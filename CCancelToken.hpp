@@ -0,0 +1,154 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CCancelToken.hpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CCancelToken class declaration
+ ************************************************************************/
+#ifndef CCANCELTOKEN_HPP
+#define CCANCELTOKEN_HPP
+
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include <map>
+#include <stdexcept>
+#include <string>
+
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/exception_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/weak_ptr.hpp>
+
+/**
+ * @brief Error of the operation which was cancelled by its token, \n
+ * either explicitly or because its deadline was exceeded
+ */
+class CCancelledError : public std::runtime_error
+{
+public:
+   explicit CCancelledError( const std::string& message )
+      : std::runtime_error( message )
+   {
+
+   }
+};
+
+/**
+ * @brief This class requests cancellation of the operations which hold it. \n
+ * Operations check the token before they start and subscribe to it while \n
+ * they are in flight, so that cancellation aborts them at once: sockets \n
+ * are closed and queued requests are dropped. Cancellation is permanent. \n
+ * Child token is cancelled together with its parent, but may also be \n
+ * cancelled alone, as a single attempt of the call is. \n
+ * Token is always held by boost::shared_ptr.
+ * @sa CNodeDispatcher::createCancellableDispatcher()
+ */
+class CCancelToken : public boost::enable_shared_from_this<CCancelToken>
+                   , private boost::noncopyable
+{
+public:
+   /**
+    * @brief Cancellation callback. It is called by the thread which cancels \n
+    * the token and should only hand the work over to the owner of the operation.
+    */
+   typedef boost::function<void( void )> Callback;
+
+   /**
+    * @brief Constructor. Creates token which is not cancelled.
+    */
+   CCancelToken( void );
+
+   /**
+    * @brief Destructor. Stops deadline timer and unsubscribes from the parent.
+    */
+   ~CCancelToken( void );
+
+   /**
+    * @brief Create token which is cancelled together with this one
+    * @return Child token, already cancelled if this one is
+    */
+   boost::shared_ptr<CCancelToken> createChild( void );
+
+   /**
+    * @brief Cancel token and call all subscribed callbacks. Only the first reason is kept.
+    * @param reason - message of the error operations are finished with
+    */
+   void cancel( const std::string& reason );
+
+   /**
+    * @brief Cancel token when timeout expires, by the shared event loop
+    * @param timeout - time from now
+    * @param reason - message of the error operations are finished with
+    */
+   void cancelAfter( boost::posix_time::time_duration timeout, const std::string& reason );
+
+   /**
+    * @brief Check whether token is cancelled
+    * @return True - if operations should not be started or continued
+    */
+   bool isCancelled( void ) const;
+
+   /**
+    * @brief Get error which cancelled operations are finished with
+    * @return CCancelledError with the reason of cancellation
+    */
+   boost::exception_ptr getError( void ) const;
+
+   /**
+    * @brief Subscribe to cancellation
+    * @param callback - called once when token is cancelled
+    * @return Subscription identifier, 0 if token is already cancelled and callback will not be called
+    */
+   std::size_t subscribe( const Callback& callback );
+
+   /**
+    * @brief Unsubscribe finished operation. Callback which is being called \n
+    * by other thread at the moment may still run.
+    * @param id - subscription identifier, 0 is ignored
+    */
+   void unsubscribe( std::size_t id );
+
+private:
+   /**
+    * @brief Get reason of cancellation
+    * @return Reason, empty if token is not cancelled
+    */
+   std::string getReason( void ) const;
+
+   /**
+    * @brief Parent cancellation callback
+    * @param child - child token, it unsubscribes when destroyed
+    */
+   static void onParentCancelled( const boost::weak_ptr<CCancelToken>& child );
+
+   /**
+    * @brief Deadline timer callback
+    * @param token - token to cancel
+    * @param reason - reason of cancellation
+    * @param error - timer error
+    */
+   static void onDeadline( const boost::weak_ptr<CCancelToken>& token,
+                           const std::string& reason,
+                           const boost::system::error_code& error );
+
+private:
+   mutable boost::mutex mGuard;                            ///< Mutex for fields below
+   bool mIsCancelled;                                      ///< Whether token is cancelled
+   std::string mReason;                                    ///< Reason of cancellation
+   std::map<std::size_t, Callback> mCallbacks;             ///< Subscribed callbacks by identifier
+   std::size_t mNextId;                                    ///< Identifier of the next subscription
+   boost::shared_ptr<CCancelToken> mParent;                ///< Parent token, null for root token
+   std::size_t mParentId;                                  ///< Subscription to the parent
+   boost::scoped_ptr<boost::asio::deadline_timer> mTimer;  ///< Deadline timer, null until deadline is set
+};
+
+typedef boost::shared_ptr<CCancelToken> CancelTokenPtr;
+/** @}*/
+#endif // CCANCELTOKEN_HPP
@@ -0,0 +1,416 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CCheckpoint.cpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CCheckpoint class definition
+ ************************************************************************/
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include "CCheckpoint.hpp"
+
+#include <cstdio>
+#include <iostream>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <jsoncpp/include/json/json.h>
+
+const std::size_t CCheckpoint::DEFAULT_INTERVAL_MS;
+const std::size_t CCheckpoint::MAX_QUEUED_CELLS;
+
+/**
+ * @brief Version of the checkpoint format
+ */
+static const int CHECKPOINT_VERSION = 1;
+
+/**
+ * @brief Size of the tile header in bytes: first and last rows and columns
+ */
+static const std::size_t TILE_HEADER_SIZE = 4 * sizeof( boost::uint64_t );
+
+CCheckpoint::CCheckpoint( const std::string& outputFileName,
+                          const std::string& inputs,
+                          boost::posix_time::time_duration interval,
+                          bool isResume )
+   : mFileName( outputFileName + ".checkpoint" )
+   , mManifestName( outputFileName + ".checkpoint.json" )
+   , mInputs( inputs )
+   , mInterval( interval )
+   , mIsResume( isResume )
+   , mRows( 0 )
+   , mCols( 0 )
+   , mDepth( 0 )
+   , mIsDone()
+   , mDoneCount( 0 )
+   , mFile()
+   , mLength( 0 )
+   , mTilesCount( 0 )
+   , mQueue()
+   , mQueuedCells( 0 )
+   , mIsFailed( false )
+   , mIsStopped( false )
+   , mGuard()
+   , mCondition()
+   , mThread()
+{
+
+}
+
+CCheckpoint::~CCheckpoint( void )
+{
+   stop();
+}
+
+bool CCheckpoint::isDone( std::size_t rowBegin, std::size_t rowEnd, std::size_t colBegin, std::size_t colEnd ) const
+{
+   if ( mDoneCount == 0 )
+   {
+      return false;
+   }
+
+   for ( std::size_t i = rowBegin; i < rowEnd; ++i )
+   {
+      for ( std::size_t j = colBegin; j < colEnd; ++j )
+      {
+         if ( !mIsDone[i * mCols + j] )
+         {
+            return false;
+         }
+      }
+   }
+   return true;
+}
+
+void CCheckpoint::getPendingParts( std::size_t rowBegin,
+                                   std::size_t rowEnd,
+                                   std::size_t colBegin,
+                                   std::size_t colEnd,
+                                   bool isWholeRows,
+                                   Parts& parts ) const
+{
+   parts.clear();
+   if ( mDoneCount == 0 )
+   {
+      const Part whole = { rowBegin, rowEnd, colBegin, colEnd };
+      parts.push_back( whole );
+      return;
+   }
+
+   // Runs of pending cells of every row extend rectangles of the previous row which have the same columns.
+   std::vector<std::size_t> previous;
+   std::vector<std::size_t> current;
+   for ( std::size_t i = rowBegin; i < rowEnd; ++i )
+   {
+      const std::vector<bool>::const_iterator row = mIsDone.begin() + i * mCols;
+      current.clear();
+      for ( std::size_t j = colBegin; j < colEnd; )
+      {
+         while ( j < colEnd && row[j] )
+         {
+            ++j;
+         }
+         if ( j == colEnd )
+         {
+            break;
+         }
+         std::size_t runBegin = j;
+         while ( j < colEnd && !row[j] )
+         {
+            ++j;
+         }
+         std::size_t runEnd = j;
+         if ( isWholeRows )
+         {
+            runBegin = colBegin;
+            runEnd = colEnd;
+            j = colEnd;
+         }
+
+         std::size_t k = 0;
+         while ( k < previous.size()
+                 && ( parts[previous[k]].colBegin != runBegin || parts[previous[k]].colEnd != runEnd ) )
+         {
+            ++k;
+         }
+         if ( k < previous.size() )
+         {
+            parts[previous[k]].rowEnd = i + 1;
+            current.push_back( previous[k] );
+         }
+         else
+         {
+            const Part part = { i, i + 1, runBegin, runEnd };
+            current.push_back( parts.size() );
+            parts.push_back( part );
+         }
+      }
+      previous.swap( current );
+   }
+}
+
+void CCheckpoint::addTile( std::size_t rowBegin,
+                           std::size_t rowEnd,
+                           std::size_t colBegin,
+                           std::size_t colEnd,
+                           DoubleArray& cells )
+{
+   if ( mDoneCount == 0 )
+   {
+      queueTile( rowBegin, rowEnd, colBegin, colEnd, cells );
+      return;
+   }
+
+   // Tile may cover restored cells, e.g. whole rows of block call, they are already in the file.
+   Parts parts;
+   getPendingParts( rowBegin, rowEnd, colBegin, colEnd, false, parts );
+   const std::size_t tileCols = colEnd - colBegin;
+   for ( Parts::const_iterator it = parts.begin(); it != parts.end(); ++it )
+   {
+      DoubleArray partCells;
+      partCells.reserve( ( it->rowEnd - it->rowBegin ) * ( it->colEnd - it->colBegin ) );
+      for ( std::size_t i = it->rowBegin; i < it->rowEnd; ++i )
+      {
+         const DoubleArray::const_iterator first = cells.begin()
+                                                   + ( i - rowBegin ) * tileCols
+                                                   + ( it->colBegin - colBegin );
+         partCells.insert( partCells.end(), first, first + ( it->colEnd - it->colBegin ) );
+      }
+      queueTile( it->rowBegin, it->rowEnd, it->colBegin, it->colEnd, partCells );
+   }
+}
+
+void CCheckpoint::queueTile( std::size_t rowBegin,
+                             std::size_t rowEnd,
+                             std::size_t colBegin,
+                             std::size_t colEnd,
+                             DoubleArray& cells )
+{
+   boost::lock_guard<boost::mutex> lock( mGuard );
+   mQueue.push_back( Tile() );
+   Tile& tile = mQueue.back();
+   tile.rowBegin = rowBegin;
+   tile.rowEnd = rowEnd;
+   tile.colBegin = colBegin;
+   tile.colEnd = colEnd;
+   tile.cells.swap( cells );
+
+   mQueuedCells += tile.cells.size();
+   if ( mQueuedCells >= MAX_QUEUED_CELLS )
+   {
+      mCondition.notify_all();
+   }
+}
+
+void CCheckpoint::remove( void )
+{
+   stop();
+   mFile.close();
+   std::remove( mManifestName.c_str() );
+   std::remove( mFileName.c_str() );
+}
+
+const std::string& CCheckpoint::getFileName( void ) const
+{
+   return mFileName;
+}
+
+boost::uint64_t CCheckpoint::readManifest( void ) const
+{
+   std::ifstream file( mManifestName.c_str() );
+   if ( !file )
+   {
+      // Nothing was checkpointed yet, so the job starts from scratch.
+      return 0;
+   }
+
+   Json::Value root;
+   Json::Reader reader;
+   if ( !reader.parse( file, root ) || !root.isObject() )
+   {
+      throw std::runtime_error( "Checkpoint manifest " + mManifestName + " is malformed" );
+   }
+
+   if ( root.get( "version", 0 ).asInt() != CHECKPOINT_VERSION
+        || root.get( "rows", 0 ).asUInt64() != mRows
+        || root.get( "cols", 0 ).asUInt64() != mCols
+        || root.get( "depth", 0 ).asUInt64() != mDepth
+        || root.get( "inputs", "" ).asString() != mInputs )
+   {
+      throw std::runtime_error( "Checkpoint " + mManifestName + " belongs to another job" );
+   }
+   return root.get( "bytes", 0 ).asUInt64();
+}
+
+bool CCheckpoint::readTile( std::ifstream& file, boost::uint64_t end, Tile& tile ) const
+{
+   const boost::uint64_t position = static_cast<boost::uint64_t>( file.tellg() );
+   if ( position >= end )
+   {
+      return false;
+   }
+
+   boost::uint64_t header[4];
+   if ( position + TILE_HEADER_SIZE > end || !file.read( reinterpret_cast<char*>( header ), TILE_HEADER_SIZE ) )
+   {
+      throw std::runtime_error( "Checkpoint file " + mFileName + " is malformed" );
+   }
+
+   tile.rowBegin = header[0];
+   tile.rowEnd = header[1];
+   tile.colBegin = header[2];
+   tile.colEnd = header[3];
+   if ( tile.rowBegin >= tile.rowEnd || tile.rowEnd > mRows || tile.colBegin >= tile.colEnd || tile.colEnd > mCols )
+   {
+      throw std::runtime_error( "Checkpoint file " + mFileName + " is malformed" );
+   }
+
+   const boost::uint64_t cellsCount = ( tile.rowEnd - tile.rowBegin ) * ( tile.colEnd - tile.colBegin );
+   tile.cells.resize( cellsCount );
+   if ( position + TILE_HEADER_SIZE + cellsCount * sizeof( double ) > end
+        || !file.read( reinterpret_cast<char*>( tile.cells.data() ), cellsCount * sizeof( double ) ) )
+   {
+      throw std::runtime_error( "Checkpoint file " + mFileName + " is malformed" );
+   }
+   return true;
+}
+
+void CCheckpoint::markDone( const Tile& tile )
+{
+   for ( std::size_t i = tile.rowBegin; i < tile.rowEnd; ++i )
+   {
+      for ( std::size_t j = tile.colBegin; j < tile.colEnd; ++j )
+      {
+         if ( !mIsDone[i * mCols + j] )
+         {
+            mIsDone[i * mCols + j] = true;
+            ++mDoneCount;
+         }
+      }
+   }
+}
+
+void CCheckpoint::start( boost::uint64_t length )
+{
+   mLength = length;
+   if ( length > 0 )
+   {
+      // Tiles after the complete part may be torn, they are overwritten.
+      mFile.open( mFileName.c_str(), std::ios::binary | std::ios::in | std::ios::out );
+      mFile.seekp( static_cast<std::streamoff>( length ) );
+   }
+   else
+   {
+      // Manifest of the previous run goes first, so it never describes the truncated file.
+      std::remove( mManifestName.c_str() );
+      mFile.open( mFileName.c_str(), std::ios::binary | std::ios::out | std::ios::trunc );
+   }
+   if ( !mFile )
+   {
+      throw std::runtime_error( "Can not write checkpoint file " + mFileName );
+   }
+   if ( length > 0 )
+   {
+      std::cout << "Restored " << mDoneCount << " of " << mRows * mCols << " cells from checkpoint "
+                << mFileName << std::endl;
+   }
+
+   mThread = boost::thread( &CCheckpoint::write, this );
+}
+
+void CCheckpoint::write( void )
+{
+   boost::unique_lock<boost::mutex> lock( mGuard );
+   while ( true )
+   {
+      const boost::system_time deadline = boost::get_system_time() + mInterval;
+      while ( !mIsStopped && mQueuedCells < MAX_QUEUED_CELLS && boost::get_system_time() < deadline )
+      {
+         mCondition.timed_wait( lock, deadline );
+      }
+
+      std::deque<Tile> tiles;
+      tiles.swap( mQueue );
+      mQueuedCells = 0;
+      const bool isStopped = mIsStopped;
+
+      if ( !tiles.empty() && !mIsFailed )
+      {
+         // Compute path keeps queueing tiles while these are written.
+         lock.unlock();
+         const bool isWritten = writeTiles( tiles );
+         lock.lock();
+         if ( !isWritten )
+         {
+            mIsFailed = true;
+            std::cout << "Error. Can not write checkpoint file " << mFileName << ", checkpointing is stopped." << std::endl;
+         }
+      }
+
+      if ( isStopped && mQueue.empty() )
+      {
+         return;
+      }
+   }
+}
+
+bool CCheckpoint::writeTiles( const std::deque<Tile>& tiles )
+{
+   for ( std::deque<Tile>::const_iterator it = tiles.begin(); it != tiles.end(); ++it )
+   {
+      const boost::uint64_t header[4] = { it->rowBegin, it->rowEnd, it->colBegin, it->colEnd };
+      mFile.write( reinterpret_cast<const char*>( header ), TILE_HEADER_SIZE );
+      mFile.write( reinterpret_cast<const char*>( it->cells.data() ), it->cells.size() * sizeof( double ) );
+      mLength += TILE_HEADER_SIZE + it->cells.size() * sizeof( double );
+   }
+   mTilesCount += tiles.size();
+
+   // Manifest covers the tiles only when they have reached the file.
+   return mFile.flush() && writeManifest();
+}
+
+bool CCheckpoint::writeManifest( void ) const
+{
+   Json::Value root( Json::objectValue );
+   root["version"] = CHECKPOINT_VERSION;
+   root["rows"] = static_cast<Json::UInt64>( mRows );
+   root["cols"] = static_cast<Json::UInt64>( mCols );
+   root["depth"] = static_cast<Json::UInt64>( mDepth );
+   root["inputs"] = mInputs;
+   root["tiles"] = static_cast<Json::UInt64>( mTilesCount );
+   root["bytes"] = static_cast<Json::UInt64>( mLength );
+
+   Json::StyledWriter writer;
+   const std::string text = writer.write( root );
+   const std::string temporaryName = mManifestName + ".tmp";
+   {
+      std::ofstream file( temporaryName.c_str(), std::ios::trunc );
+      if ( !file.write( text.data(), text.size() ) )
+      {
+         std::remove( temporaryName.c_str() );
+         return false;
+      }
+   }
+   if ( std::rename( temporaryName.c_str(), mManifestName.c_str() ) != 0 )
+   {
+      std::remove( temporaryName.c_str() );
+      return false;
+   }
+   return true;
+}
+
+void CCheckpoint::stop( void )
+{
+   {
+      boost::lock_guard<boost::mutex> lock( mGuard );
+      mIsStopped = true;
+   }
+   mCondition.notify_all();
+
+   if ( mThread.joinable() )
+   {
+      mThread.join();
+   }
+}
+/** @}*/
@@ -0,0 +1,289 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CCheckpoint.hpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CCheckpoint class declaration
+ ************************************************************************/
+#ifndef CCHECKPOINT_HPP
+#define CCHECKPOINT_HPP
+
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include <deque>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "CComputationNode.hpp"
+
+/**
+ * @brief This class keeps finished tiles of the result matrix on disk, \n
+ * so that failed or interrupted multiplication continues where it stopped. \n
+ * Tiles are appended to the checkpoint file next to the output file \n
+ * by a background thread, and a small JSON manifest records the job \n
+ * (sizes and inputs) and how much of the checkpoint file is complete. \n
+ * Manifest is replaced atomically after the tiles are written, so a crash \n
+ * during the write loses only the tiles which are not in the manifest yet. \n
+ * Tiles of the checkpoint file are: uint64 first row, row after the last one, \n
+ * first column, column after the last one, then float64 cells row by row, \n
+ * all in host byte order.
+ * @sa CGemmEngine::setCheckpoint()
+ */
+class CCheckpoint : private boost::noncopyable
+{
+public:
+   /**
+    * @brief Rectangle of the result matrix
+    */
+   struct Part
+   {
+      std::size_t rowBegin;  ///< First row
+      std::size_t rowEnd;    ///< Row after the last one
+      std::size_t colBegin;  ///< First column
+      std::size_t colEnd;    ///< Column after the last one
+   };
+
+   typedef std::vector<Part> Parts;
+
+   /**
+    * @brief Default time between checkpoint writes in milliseconds
+    */
+   static const std::size_t DEFAULT_INTERVAL_MS = 10000;
+
+   /**
+    * @brief Number of queued cells after which they are written without waiting for the interval
+    */
+   static const std::size_t MAX_QUEUED_CELLS = 1 << 22;
+
+   /**
+    * @brief Constructor. Checkpoint is not opened until the job starts.
+    * @param outputFileName - output file of the job, checkpoint is written to outputFileName.checkpoint \n
+    * and its manifest to outputFileName.checkpoint.json
+    * @param inputs - description of the job inputs, checkpoint is resumed only by the job with the same inputs
+    * @param interval - time between checkpoint writes
+    * @param isResume - whether tiles of the previous run are restored
+    */
+   CCheckpoint( const std::string& outputFileName,
+                const std::string& inputs,
+                boost::posix_time::time_duration interval,
+                bool isResume );
+
+   /**
+    * @brief Destructor. Writes queued tiles and stops background thread, checkpoint files are kept.
+    */
+   ~CCheckpoint( void );
+
+   /**
+    * @brief Start checkpoint of the job. Tiles of the previous run are copied into the result \n
+    * matrix if resume was requested, otherwise previous checkpoint is dropped.
+    * @param C - result matrix of any type which provides getRowsCount(), getColsCount() \n
+    * and operator()( row, col ) as matrix::CMatrix does
+    * @param depth - number of products per cell
+    * @return Number of restored cells
+    * @throw std::runtime_error if checkpoint of the previous run belongs to another job or can not be read
+    */
+   template<typename MatrixC>
+   std::size_t open( MatrixC& C, std::size_t depth );
+
+   /**
+    * @brief Check whether all cells of the tile were restored from the previous run
+    * @param rowBegin - first row of the tile
+    * @param rowEnd - row after the last one
+    * @param colBegin - first column of the tile
+    * @param colEnd - column after the last one
+    * @return True - if tile may be skipped
+    */
+   bool isDone( std::size_t rowBegin, std::size_t rowEnd, std::size_t colBegin, std::size_t colEnd ) const;
+
+   /**
+    * @brief Split tile into rectangles which cover its cells not restored from the previous run. \n
+    * Tiles of the previous run rarely match tiles of this one, since tile shape follows tuning.
+    * @param rowBegin - first row of the tile
+    * @param rowEnd - row after the last one
+    * @param colBegin - first column of the tile
+    * @param colEnd - column after the last one
+    * @param isWholeRows - whether rows which have such cells are taken whole, as block calls need
+    * @param[out] parts - rectangles in row order, whole tile if nothing was restored, empty if tile is done
+    */
+   void getPendingParts( std::size_t rowBegin,
+                         std::size_t rowEnd,
+                         std::size_t colBegin,
+                         std::size_t colEnd,
+                         bool isWholeRows,
+                         Parts& parts ) const;
+
+   /**
+    * @brief Queue finished tile for the next write, returns at once. \n
+    * Cells restored from the previous run are dropped, so that resume does not grow the file.
+    * @param rowBegin - first row of the tile
+    * @param rowEnd - row after the last one
+    * @param colBegin - first column of the tile
+    * @param colEnd - column after the last one
+    * @param[in,out] cells - cells of the tile row by row, moved into the queue
+    */
+   void addTile( std::size_t rowBegin, std::size_t rowEnd, std::size_t colBegin, std::size_t colEnd, DoubleArray& cells );
+
+   /**
+    * @brief Stop writing and delete checkpoint files, once the output file is complete
+    */
+   void remove( void );
+
+   /**
+    * @brief Get name of the checkpoint file
+    * @return File name
+    */
+   const std::string& getFileName( void ) const;
+
+private:
+   /**
+    * @brief Finished tile of the result matrix
+    */
+   struct Tile
+   {
+      boost::uint64_t rowBegin;  ///< First row
+      boost::uint64_t rowEnd;    ///< Row after the last one
+      boost::uint64_t colBegin;  ///< First column
+      boost::uint64_t colEnd;    ///< Column after the last one
+      DoubleArray cells;         ///< Cells row by row
+   };
+
+   /**
+    * @brief Read manifest of the previous run and check that it belongs to this job
+    * @return Length of the complete part of the checkpoint file, 0 if there is nothing to restore
+    * @throw std::runtime_error if manifest belongs to another job
+    */
+   boost::uint64_t readManifest( void ) const;
+
+   /**
+    * @brief Read next tile of the checkpoint file
+    * @param file - checkpoint file
+    * @param end - length of the complete part of the file
+    * @param[out] tile - tile
+    * @return True - if tile was read, false - if complete part is over
+    * @throw std::runtime_error if tile is malformed
+    */
+   bool readTile( std::ifstream& file, boost::uint64_t end, Tile& tile ) const;
+
+   /**
+    * @brief Mark cells of the tile as done
+    * @param tile - restored tile
+    */
+   void markDone( const Tile& tile );
+
+   /**
+    * @brief Queue tile for the next write
+    * @param rowBegin - first row of the tile
+    * @param rowEnd - row after the last one
+    * @param colBegin - first column of the tile
+    * @param colEnd - column after the last one
+    * @param[in,out] cells - cells of the tile row by row, moved into the queue
+    */
+   void queueTile( std::size_t rowBegin,
+                   std::size_t rowEnd,
+                   std::size_t colBegin,
+                   std::size_t colEnd,
+                   DoubleArray& cells );
+
+   /**
+    * @brief Open checkpoint file for appending and start background thread
+    * @param length - length of the complete part of the file, writing continues from it
+    * @throw std::runtime_error if file can not be opened
+    */
+   void start( boost::uint64_t length );
+
+   /**
+    * @brief Background thread function. Writes queued tiles every interval.
+    */
+   void write( void );
+
+   /**
+    * @brief Append tiles to the checkpoint file and replace the manifest
+    * @param tiles - tiles to append
+    * @return True - if tiles and manifest were written
+    */
+   bool writeTiles( const std::deque<Tile>& tiles );
+
+   /**
+    * @brief Replace the manifest with the one which describes complete part of the checkpoint file
+    * @return True - if manifest was written
+    */
+   bool writeManifest( void ) const;
+
+   /**
+    * @brief Stop background thread after it writes queued tiles
+    */
+   void stop( void );
+
+private:
+   std::string mFileName;                       ///< Checkpoint file
+   std::string mManifestName;                   ///< Manifest file
+   std::string mInputs;                         ///< Description of the job inputs
+   boost::posix_time::time_duration mInterval;  ///< Time between writes
+   bool mIsResume;                              ///< Whether previous run is restored
+   std::size_t mRows;                           ///< Result rows count
+   std::size_t mCols;                           ///< Result columns count
+   std::size_t mDepth;                          ///< Number of products per cell
+   std::vector<bool> mIsDone;                   ///< Whether cell is restored, row by row
+   std::size_t mDoneCount;                      ///< Number of restored cells
+   std::fstream mFile;                          ///< Checkpoint file, used by background thread only
+   boost::uint64_t mLength;                     ///< Length of the complete part of the checkpoint file
+   std::size_t mTilesCount;                     ///< Number of tiles in the complete part
+   std::deque<Tile> mQueue;                     ///< Tiles waiting for the write
+   std::size_t mQueuedCells;                    ///< Number of cells waiting for the write
+   bool mIsFailed;                              ///< Whether any write has failed
+   bool mIsStopped;                             ///< Whether background thread should finish
+   boost::mutex mGuard;                         ///< Mutex for the queue and flags
+   boost::condition_variable mCondition;        ///< Signalled when many cells are queued or thread is stopped
+   boost::thread mThread;                       ///< Background thread
+};
+
+template<typename MatrixC>
+std::size_t CCheckpoint::open( MatrixC& C, std::size_t depth )
+{
+   mRows = C.getRowsCount();
+   mCols = C.getColsCount();
+   mDepth = depth;
+   const boost::uint64_t length = mIsResume ? readManifest() : 0;
+
+   mIsDone.assign( mRows * mCols, false );
+   mDoneCount = 0;
+   mTilesCount = 0;
+   if ( length > 0 )
+   {
+      std::ifstream file( mFileName.c_str(), std::ios::binary );
+      if ( !file )
+      {
+         throw std::runtime_error( "Can not read checkpoint file " + mFileName );
+      }
+
+      // Tiles are restored one by one, so the checkpoint is never held in memory as a whole.
+      Tile tile;
+      while ( readTile( file, length, tile ) )
+      {
+         DoubleArray::const_iterator cell = tile.cells.begin();
+         for ( std::size_t i = tile.rowBegin; i < tile.rowEnd; ++i )
+         {
+            for ( std::size_t j = tile.colBegin; j < tile.colEnd; ++j )
+            {
+               C( i, j ) = *cell++;
+            }
+         }
+         markDone( tile );
+         ++mTilesCount;
+      }
+   }
+
+   start( length );
+   return mDoneCount;
+}
+/** @}*/
+#endif // CCHECKPOINT_HPP
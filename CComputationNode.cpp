@@ -10,35 +10,430 @@
  *  @{
  */
 #include "CComputationNode.hpp"
+#include "CBlockStore.hpp"
+#include "CConnectionPool.hpp"
+#include "CEventLoop.hpp"
+#include "CMetrics.hpp"
+#include "CRequestBatcher.hpp"
+#include "Kernels.hpp"
+#include "WireFormat.hpp"
 
 #include <algorithm>
-#include <strstream>
+#include <stdexcept>
 #include <utility>
 
-#include <boost/asio.hpp>
-#include <boost/algorithm/string.hpp>
-#include <boost/algorithm/string/regex.hpp>
-#include <boost/range/adaptor/transformed.hpp>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
 
-#include <jsoncpp/include/json/json.h>
+/**
+ * @brief Default port of the remote computation service
+ */
+static const char* const SERVICE_PORT = "8080";
 
-#include <stdexcept>
+/**
+ * @brief Status code which remote service returns for unsupported payload format
+ */
+static const unsigned int HTTP_UNSUPPORTED_MEDIA_TYPE = 415;
+
+/**
+ * @brief Status codes which remote service returns if it does not accept chunked request
+ */
+static const unsigned int HTTP_LENGTH_REQUIRED = 411;
+static const unsigned int HTTP_NOT_IMPLEMENTED = 501;
+
+/**
+ * @brief Status code which remote service returns for unknown method or block
+ */
+static const unsigned int HTTP_NOT_FOUND = 404;
+
+/**
+ * @brief URIs of the block methods, block handle follows
+ */
+static const std::string STORE_BLOCK_URI = "/store?block=";
+static const std::string MULTIPLY_BLOCK_URI = "/multiply-block?block=";
+
+/**
+ * @brief Accept header which lets remote service choose binary response
+ */
+static const std::string ACCEPT_BINARY_OR_JSON = std::string( wire::BINARY_CONTENT_TYPE ) + ", "
+                                                 + wire::JSON_CONTENT_TYPE + ";q=0.5";
+
+const std::size_t CComputationNode::DEFAULT_CONNECTIONS_COUNT;
+const std::size_t CComputationNode::DEFAULT_BATCH_VALUES;
+const std::size_t CComputationNode::DEFAULT_STREAM_CHUNK_VALUES;
+const char* const CComputationNode::LOCAL_HOST = "local";
+
+/**
+ * @brief State shared between copies of the same computation node
+ */
+struct CComputationNode::Context
+{
+   Context( void )
+      : pool()
+      , metrics( CMetrics::instance().getNode( LOCAL_HOST ) )
+      , wireFormat( WIRE_AUTO )
+      , negotiatedFormat( WIRE_AUTO )
+      , streamChunkValues( 0 )
+      , blocks( new CBlockStore() )
+   {
+
+   }
+
+   Context( const std::string& host, const std::string& port, std::size_t maxConnections )
+      : pool()
+      , metrics( CMetrics::instance().getNode( host + ":" + port ) )
+      , wireFormat( WIRE_AUTO )
+      , negotiatedFormat( WIRE_AUTO )
+      , streamChunkValues( 0 )
+   {
+      pool.reset( new CConnectionPool( CEventLoop::instance().getService(), host, port, maxConnections, metrics ) );
+   }
+
+   boost::shared_ptr<CConnectionPool> pool;   ///< Keep-alive connections to the remote service, null for local node
+   boost::shared_ptr<CNodeMetrics> metrics;   ///< Node metrics
+   boost::atomic<int> wireFormat;             ///< Format which was set by user
+   boost::atomic<int> negotiatedFormat;       ///< Format supported by the remote service, WIRE_AUTO until known
+   boost::shared_ptr<CRequestBatcher> batcher;///< Collects small calls, null if batching is disabled
+   boost::mutex batcherGuard;                 ///< Mutex for batcher pointer
+   boost::atomic<std::size_t> streamChunkValues; ///< Values per chunk of streamed call, 0 - streaming is disabled
+   boost::shared_ptr<CBlockStore> blocks;     ///< Blocks stored on the local node, null for remote node
+};
+
+/**
+ * @brief State of the single node call
+ */
+struct CComputationNode::Call
+{
+   boost::shared_ptr<Context> context;       ///< Node context
+   Operation operation;                      ///< Operation to perform
+   std::string uri;                          ///< URI of the block call, empty for operations
+   WireFormat format;                        ///< Format of the request body
+   std::size_t resultSize;                   ///< Expected number of values in the result
+   boost::posix_time::ptime startTime;       ///< Time when call was sent
+   ResultHandler handler;                    ///< Completion callback
+   CancelTokenPtr cancelToken;               ///< Aborts the call when cancelled, may be null
+   std::size_t chunkValues;                  ///< Values per request chunk, 0 - call is not streamed
+   DoubleArray param;                        ///< Argument of streamed call, read while it is sent
+   wire::CBinaryDecoder decoder;             ///< Parser of streamed result
+   DoubleArray result;                       ///< Values of streamed result
+   bool isMalformed;                         ///< Whether streamed result is malformed
+};
+
+/**
+ * @brief State of the call performed by the local node
+ */
+struct CComputationNode::LocalCall
+{
+   LocalCall( const boost::shared_ptr<Context>& context_, const ResultHandler& handler_ )
+      : context( context_ )
+      , operation( OP_SUM )
+      , handle()
+      , depth( 0 )
+      , array()
+      , handler( handler_ )
+      , error()
+      , result()
+   {
+
+   }
+
+   boost::shared_ptr<Context> context;       ///< Node context
+   Operation operation;                      ///< Operation to perform
+   std::string handle;                       ///< Block handle, empty for operations
+   std::size_t depth;                        ///< Values per column of the stored block
+   DoubleArray array;                        ///< Operation argument, block columns or rows
+   ResultHandler handler;                    ///< Completion callback
+   boost::exception_ptr error;               ///< Call error or null on success
+   DoubleArray result;                       ///< Call result
+};
+
+/**
+ * @brief Get pool of threads running local kernels, so that they do not hold up \n
+ * network operations of the shared event loop. It is created on first call.
+ * @return Reference to the compute pool
+ */
+static CEventLoop& getComputePool( void )
+{
+   // Shared event loop is created first, so it outlives the pool which posts completions to it.
+   CEventLoop::instance();
+   static CEventLoop computePool( std::max( boost::thread::hardware_concurrency(), 1u ) );
+   return computePool;
+}
+
+/**
+ * @brief Get URI of remote REST method which performs operation
+ * @param operation - operation
+ * @return Method URI
+ */
+static const char* getUri( CComputationNode::Operation operation )
+{
+   return ( operation == CComputationNode::OP_MULTIPLY_PAIRS ) ? "/multiply" : "/sum";
+}
+
+/**
+ * @brief Get expected number of values in operation result
+ * @param operation - operation
+ * @param array - operation argument
+ * @return Result size
+ */
+static std::size_t getResultSize( CComputationNode::Operation operation, const DoubleArray& array )
+{
+   return ( operation == CComputationNode::OP_MULTIPLY_PAIRS ) ? array.size() / 2 : 1;
+}
 
-using boost::asio::ip::tcp;
+/**
+ * @brief Helper function that passes result of the call to the promise
+ * @param promise - promise to fulfill
+ * @param error - call error or null on success
+ * @param result - call result
+ */
+static void fulfillPromise( const boost::shared_ptr< boost::promise<DoubleArray> >& promise,
+                            const boost::exception_ptr& error,
+                            DoubleArray& result )
+{
+   if ( error )
+   {
+      promise->set_exception( error );
+   }
+   else
+   {
+      promise->set_value( std::move( result ) );
+   }
+}
+
+/**
+ * @brief Helper function that accounts duration of the batched call and passes its result further
+ * @param metrics - node metrics
+ * @param startTime - time when call was added to the batch
+ * @param handler - call completion callback
+ * @param error - call error or null on success
+ * @param result - call result
+ */
+static void recordBatchedCall( const boost::shared_ptr<CNodeMetrics>& metrics,
+                               boost::posix_time::ptime startTime,
+                               const ResultHandler& handler,
+                               const boost::exception_ptr& error,
+                               DoubleArray& result )
+{
+   metrics->record( CNodeMetrics::PHASE_TOTAL, startTime );
+   handler( error, result );
+}
+
+void CComputationNode::finishCall( const CallPtr& call, const boost::exception_ptr& error, DoubleArray& result )
+{
+   call->context->metrics->record( CNodeMetrics::PHASE_TOTAL, call->startTime );
+   call->handler( error, result );
+}
+
+void CComputationNode::onResponse( const CallPtr& call,
+                                   const boost::exception_ptr& error,
+                                   const HttpResponse& response )
+{
+   DoubleArray resultDoubleArray;
+
+   if ( error )
+   {
+      finishCall( call, error, resultDoubleArray );
+      return;
+   }
+
+   const bool isBinary = wire::isBinaryContentType( response.contentType );
+
+   if ( call->chunkValues > 0
+        && ( response.statusCode == HTTP_LENGTH_REQUIRED || response.statusCode == HTTP_NOT_IMPLEMENTED ) )
+   {
+      // Remote service does not accept chunked requests. Remember it and resend at once.
+      DoubleArray param;
+      param.swap( call->param );
+      call->context->streamChunkValues = 0;
+      call->chunkValues = 0;
+      call->context->metrics->addRetry();
+      sendCall( call, param );
+      return;
+   }
+
+   if ( response.statusCode == HTTP_UNSUPPORTED_MEDIA_TYPE
+        && call->format == WIRE_BINARY
+        && call->context->wireFormat == WIRE_AUTO )
+   {
+      // Remote service does not understand binary payload. Remember it and resend as JSON.
+      // Parameter is restored from the sent body, so it is not kept for this rare case.
+      DoubleArray param;
+      if ( call->chunkValues > 0 )
+      {
+         param.swap( call->param );
+         call->chunkValues = 0;
+      }
+      else
+      {
+         const std::string& requestBody = *response.requestBody;
+         wire::decodeBinary( requestBody.data(), requestBody.data() + requestBody.size(), param );
+      }
+      call->context->negotiatedFormat = WIRE_JSON;
+      call->format = WIRE_JSON;
+      call->context->metrics->addRetry();
+      sendCall( call, param );
+      return;
+   }
+
+   if ( response.statusCode == HTTP_NOT_FOUND && !call->uri.empty() )
+   {
+      const std::string message( response.body, response.bodySize );
+      if ( call->uri.compare( 0, STORE_BLOCK_URI.size(), STORE_BLOCK_URI ) == 0 )
+      {
+         finishCall( call,
+                     boost::copy_exception( std::runtime_error( "Node does not keep matrix blocks: \n" + message ) ),
+                     resultDoubleArray );
+      }
+      else
+      {
+         finishCall( call, boost::copy_exception( CUnknownBlockError( "Unknown block: \n" + message ) ), resultDoubleArray );
+      }
+      return;
+   }
+
+   if ( response.statusCode != 200 )
+   {
+      const std::string message( response.body, response.bodySize );
+      finishCall( call, boost::copy_exception( std::runtime_error( "Wrong request: \n" + message ) ), resultDoubleArray );
+      return;
+   }
+
+   if ( call->context->negotiatedFormat == WIRE_AUTO )
+   {
+      call->context->negotiatedFormat = isBinary ? WIRE_BINARY : WIRE_JSON;
+   }
+
+   if ( response.isStreamed )
+   {
+      // Result was parsed while it was arriving.
+      if ( call->isMalformed || !call->decoder.isComplete() )
+      {
+         finishCall( call, boost::copy_exception( std::runtime_error( "Malformed streamed response" ) ), resultDoubleArray );
+         return;
+      }
+      finishCall( call, boost::exception_ptr(), call->result );
+      return;
+   }
+
+   // Numbers are decoded right from the receive buffer into preallocated result.
+   resultDoubleArray.reserve( call->resultSize );
+
+   const boost::posix_time::ptime parseStart = CNodeMetrics::now();
+   const char* bodyEnd = response.body + response.bodySize;
+   const bool isParsed = isBinary ? wire::decodeBinary( response.body, bodyEnd, resultDoubleArray )
+                                  : wire::decodeJson( response.body, bodyEnd, resultDoubleArray );
+   call->context->metrics->record( CNodeMetrics::PHASE_PARSE, parseStart );
+   if ( !isParsed )
+   {
+      const std::string message( response.body, response.bodySize );
+      finishCall( call, boost::copy_exception( std::runtime_error( "Malformed response: \n" + message ) ), resultDoubleArray );
+      return;
+   }
+
+   finishCall( call, boost::exception_ptr(), resultDoubleArray );
+}
+
+void CComputationNode::sendCall( const CallPtr& call, const DoubleArray& param )
+{
+   HttpRequest request;
+   request.uri = call->uri.empty() ? getUri( call->operation ) : call->uri.c_str();
+
+   if ( call->chunkValues > 0 )
+   {
+      // Argument is serialized chunk by chunk while it is sent, result is parsed while it arrives.
+      request.contentType = wire::BINARY_CONTENT_TYPE;
+      request.accept = wire::BINARY_CONTENT_TYPE;
+      request.bodySource = boost::bind( &CComputationNode::writeChunk, call, _1, _2 );
+      request.bodySink = boost::bind( &CComputationNode::readChunk, call, _1, _2 );
+      call->decoder.reset();
+      call->result.clear();
+      call->result.reserve( call->resultSize );
+      call->isMalformed = false;
+   }
+   else if ( call->format == WIRE_BINARY )
+   {
+      request.contentType = wire::BINARY_CONTENT_TYPE;
+      request.accept = ACCEPT_BINARY_OR_JSON.c_str();
+      call->context->pool->acquireBody( request.body );
+      wire::encodeBinary( param, request.body );
+   }
+   else
+   {
+      request.contentType = wire::JSON_CONTENT_TYPE;
+      request.accept = wire::JSON_CONTENT_TYPE;
+      if ( call->context->wireFormat == WIRE_AUTO
+           && call->context->negotiatedFormat == WIRE_AUTO )
+      {
+         // Let remote service reveal whether it speaks binary format.
+         request.accept = ACCEPT_BINARY_OR_JSON.c_str();
+      }
+      call->context->pool->acquireBody( request.body );
+      wire::encodeJson( param, request.body );
+   }
+
+   request.cancelToken = call->cancelToken;
+   CHttpConnection::ResponseHandler handler( boost::bind( &CComputationNode::onResponse, call, _1, _2 ) );
+   call->context->pool->asyncPost( request, handler );
+}
+
+bool CComputationNode::writeChunk( const CallPtr& call, std::size_t index, std::string& chunk )
+{
+   const DoubleArray& param = call->param;
+   if ( index == 0 )
+   {
+      wire::encodeBinaryHeader( param.size(), chunk );
+   }
+
+   const std::size_t begin = std::min( index * call->chunkValues, param.size() );
+   const std::size_t count = std::min( call->chunkValues, param.size() - begin );
+   if ( count > 0 )
+   {
+      wire::appendBinaryValues( &param[begin], count, chunk );
+   }
+   return begin + count < param.size();
+}
+
+void CComputationNode::readChunk( const CallPtr& call, const char* data, std::size_t size )
+{
+   if ( !call->isMalformed )
+   {
+      call->isMalformed = !call->decoder.feed( data, data + size, call->result );
+   }
+}
 
 CComputationNode::CComputationNode( void )
    : mHost()
    , mIsValid( false )
+   , mContext()
 {
 
 }
 
-CComputationNode::CComputationNode( const std::string& host )
+CComputationNode::CComputationNode( const std::string& host, std::size_t maxConnections )
    : mHost( host )
    , mIsValid( true )
+   , mContext()
 {
-
+   if ( host == LOCAL_HOST )
+   {
+      mContext.reset( new Context() );
+      return;
+   }
+
+   std::string hostName = host;
+   std::string port = SERVICE_PORT;
+
+   const std::string::size_type colon = host.find( ':' );
+   if ( colon != std::string::npos && host.find( ':', colon + 1 ) == std::string::npos )
+   {
+      hostName = host.substr( 0, colon );
+      port = host.substr( colon + 1 );
+   }
+
+   mContext.reset( new Context( hostName, port, maxConnections ) );
 }
 
 CComputationNode::~CComputationNode( void )
@@ -51,138 +446,379 @@ std::string CComputationNode::getName( void ) const
    return mHost;
 }
 
+boost::shared_ptr<CNodeMetrics> CComputationNode::getMetrics( void ) const
+{
+   return mContext ? mContext->metrics : boost::shared_ptr<CNodeMetrics>();
+}
+
 bool CComputationNode::isValid( void ) const
 {
    return mIsValid;
 }
 
-/**
- * @brief Helper function that performs HTTP request to remote service
- * @param host - host name
- * @param uri - URI of remote REST method
- * @param param - DoubleArray for passing to the remote service
- * @return Calculation result from remote service
- */
-static DoubleArray asyncRequest( std::string host, std::string uri, DoubleArray param )
-{
-
-   using boost::adaptors::transformed;
-   using boost::algorithm::join;
-
-   std::stringstream ss;
-
-   ss << "["
-      << join( param |
-                  transformed( static_cast<std::string(*)(long double)>(std::to_string) ),
-                  ", " )
-      << "]";
-
-   std::string jsonString = ss.str();
-
-   boost::asio::io_service io_service;
-
-   // Get a list of endpoints corresponding to the server name.
-   tcp::resolver resolver( io_service );
-   tcp::resolver::query query( host, boost::lexical_cast<std::string>(8080) );
-   tcp::resolver::iterator endpoint_iterator = resolver.resolve( query );
-
-   // Try each endpoint until we successfully establish a connection.
-   tcp::socket socket( io_service );
-   boost::asio::connect( socket, endpoint_iterator );
-
-   // Form the request. We specify the "Connection: close" header so that the
-   // server will close the socket after transmitting the response. This will
-   // allow us to treat all data up until the EOF as the content.
-   boost::asio::streambuf request;
-   std::ostream request_stream( &request );
-   request_stream << "POST " << uri << " HTTP/1.0\r\n";
-   request_stream << "Host: " << host << "\r\n";
-   request_stream << "Accept: application/json\r\n";
-   request_stream << "Content-Type: application/json\r\n";
-   request_stream << "Content-Length: " << jsonString.size() << "\r\n";
-   request_stream << "Connection: close\r\n\r\n";
-   request_stream << jsonString;
-   // Send the request.
-    boost::asio::write( socket, request );
-
-    // Read the response status line. The response streambuf will automatically
-    // grow to accommodate the entire line. The growth may be limited by passing
-    // a maximum size to the streambuf constructor.
-    boost::asio::streambuf response;
-    boost::asio::read_until( socket, response, "\r\n" );
-
-    // Check that response is OK.
-    std::istream response_stream( &response );
-    std::string http_version;
-    response_stream >> http_version;
-    unsigned int status_code;
-    response_stream >> status_code;
-    std::string status_message;
-    std::getline( response_stream, status_message );
-    if ( !response_stream || http_version.substr( 0, 5 ) != "HTTP/" )
-    {
-      throw std::runtime_error( "Invalid HTTP response" );
-
-    }
-
-    // Read the response headers, which are terminated by a blank line.
-    boost::asio::read_until( socket, response, "\r\n\r\n" );
-
-    // Read until EOF, writing data to output as we go.
-    boost::system::error_code error;
-    while ( boost::asio::read( socket, response,
-          boost::asio::transfer_at_least( 1 ), error ) );
-
-    std::stringstream dataStream;
-    dataStream << &response;
-
-    std::vector<std::string> strs;
-    boost::algorithm::split_regex( strs, dataStream.str(), boost::regex( "\r\n\r\n" ) );
-
-    DoubleArray resultDoubleArray;
-
-    if ( strs.size() == 2 )
-    {
-
-       if ( status_code != 200 )
-       {
-          throw std::runtime_error( "Wrong request: \n" + strs[1] );
-       }
-
-       Json::Reader reader;
-       Json::Value resultArray;
-       if ( reader.parse( strs[1], resultArray ) )
-       {
-          if ( resultArray.isArray() )
-          {
-             std::transform( resultArray.begin(),
-                             resultArray.end(),
-                             std::back_inserter( resultDoubleArray ),
-                             boost::bind( &Json::Value::asDouble, _1 ) );
-          }
-       }
-    }
-    else
-    {
-       throw std::runtime_error( "Wrong request: \n" + dataStream.str() );
-    }
-
-    if ( error != boost::asio::error::eof )
-    {
-      throw boost::system::system_error(error);
-    }
-
-   return resultDoubleArray;
+bool CComputationNode::isLocal( void ) const
+{
+   return mContext && !mContext->pool;
+}
+
+std::size_t CComputationNode::getMaxConnections( void ) const
+{
+   return ( mContext && mContext->pool ) ? mContext->pool->getMaxConnections() : 1;
+}
+
+void CComputationNode::setWireFormat( WireFormat format )
+{
+   if ( mContext )
+   {
+      mContext->wireFormat = format;
+   }
+}
+
+CComputationNode::WireFormat CComputationNode::getWireFormat( void ) const
+{
+   return mContext ? static_cast<WireFormat>( mContext->wireFormat.load() ) : WIRE_AUTO;
+}
+
+void CComputationNode::enableBatching( boost::posix_time::time_duration maxDelay, std::size_t maxValues )
+{
+   if ( !mContext || isLocal() )
+   {
+      return;
+   }
+
+   boost::shared_ptr<CRequestBatcher> batcher(
+            new CRequestBatcher( CEventLoop::instance().getService(),
+                                 boost::bind( &CConnectionPool::asyncPost, mContext->pool, _1, _2 ),
+                                 boost::bind( &CComputationNode::sendUnbatched,
+                                              boost::weak_ptr<Context>( mContext ),
+                                              _1, _2, _3, _4 ),
+                                 maxDelay,
+                                 maxValues ) );
+
+   {
+      boost::lock_guard<boost::mutex> lock( mContext->batcherGuard );
+      batcher.swap( mContext->batcher );
+   }
+
+   if ( batcher )
+   {
+      batcher->flush();
+   }
+}
+
+void CComputationNode::disableBatching( void )
+{
+   if ( !mContext )
+   {
+      return;
+   }
+
+   boost::shared_ptr<CRequestBatcher> batcher;
+   {
+      boost::lock_guard<boost::mutex> lock( mContext->batcherGuard );
+      batcher.swap( mContext->batcher );
+   }
+
+   if ( batcher )
+   {
+      batcher->flush();
+   }
+}
+
+void CComputationNode::enableStreaming( std::size_t chunkValues )
+{
+   if ( mContext && !isLocal() )
+   {
+      mContext->streamChunkValues = chunkValues;
+   }
+}
+
+void CComputationNode::disableStreaming( void )
+{
+   if ( mContext )
+   {
+      mContext->streamChunkValues = 0;
+   }
+}
+
+void CComputationNode::asyncCall( Operation operation,
+                                  const DoubleArray& array,
+                                  const ResultHandler& handler,
+                                  const CancelTokenPtr& token ) const
+{
+   if ( !mContext )
+   {
+      DoubleArray empty;
+      handler( boost::copy_exception( std::runtime_error( "Invalid computation node" ) ), empty );
+      return;
+   }
+
+   if ( token && token->isCancelled() )
+   {
+      CEventLoop::instance().getService().post( boost::bind( &CComputationNode::failCancelled, token, handler ) );
+      return;
+   }
+
+   if ( isLocal() )
+   {
+      // Computation is moved off the calling thread as remote calls are, the argument is copied only once.
+      const LocalCallPtr call( new LocalCall( mContext, handler ) );
+      call->operation = operation;
+      call->array = array;
+      getComputePool().getService().post( boost::bind( &CComputationNode::computeLocal, call ) );
+      return;
+   }
+
+   boost::shared_ptr<CRequestBatcher> batcher;
+   {
+      boost::lock_guard<boost::mutex> lock( mContext->batcherGuard );
+      batcher = mContext->batcher;
+   }
+
+   if ( batcher && batcher->accepts( array ) )
+   {
+      batcher->add( operation,
+                    array,
+                    boost::bind( &recordBatchedCall, mContext->metrics, CNodeMetrics::now(), handler, _1, _2 ),
+                    token );
+   }
+   else
+   {
+      sendDirect( mContext, operation, array, handler, token );
+   }
+}
+
+void CComputationNode::sendDirect( const boost::shared_ptr<Context>& context,
+                                   Operation operation,
+                                   const DoubleArray& array,
+                                   const ResultHandler& handler,
+                                   const CancelTokenPtr& token )
+{
+   const CallPtr call = boost::make_shared<Call>();
+   call->context = context;
+   call->operation = operation;
+   call->resultSize = getResultSize( operation, array );
+   call->handler = handler;
+   call->cancelToken = token;
+   startCall( call, array );
+}
+
+void CComputationNode::sendBlockCall( const boost::shared_ptr<Context>& context,
+                                      const std::string& uri,
+                                      const DoubleArray& array,
+                                      std::size_t resultSize,
+                                      const ResultHandler& handler,
+                                      const CancelTokenPtr& token )
+{
+   const CallPtr call = boost::make_shared<Call>();
+   call->context = context;
+   call->operation = OP_MULTIPLY_PAIRS;
+   call->uri = uri;
+   call->resultSize = resultSize;
+   call->handler = handler;
+   call->cancelToken = token;
+   startCall( call, array );
+}
+
+void CComputationNode::failCancelled( const CancelTokenPtr& token, const ResultHandler& handler )
+{
+   DoubleArray empty;
+   handler( token->getError(), empty );
+}
+
+void CComputationNode::startCall( const CallPtr& call, const DoubleArray& array )
+{
+   const boost::shared_ptr<Context>& context = call->context;
+   call->startTime = CNodeMetrics::now();
+   call->chunkValues = 0;
+   call->isMalformed = false;
+
+   const int wireFormat = context->wireFormat;
+   if ( wireFormat == WIRE_AUTO )
+   {
+      call->format = ( context->negotiatedFormat == WIRE_BINARY ) ? WIRE_BINARY : WIRE_JSON;
+   }
+   else
+   {
+      call->format = static_cast<WireFormat>( wireFormat );
+   }
+
+   const std::size_t chunkValues = context->streamChunkValues;
+   if ( chunkValues > 0 && call->format == WIRE_BINARY && array.size() > chunkValues )
+   {
+      // Argument is read while the request is sent, so the call keeps it.
+      call->chunkValues = chunkValues;
+      call->param = array;
+   }
+
+   sendCall( call, array );
+}
+
+void CComputationNode::sendUnbatched( const boost::weak_ptr<Context>& context,
+                                      Operation operation,
+                                      const DoubleArray& array,
+                                      const ResultHandler& handler,
+                                      const CancelTokenPtr& token )
+{
+   const boost::shared_ptr<Context> lockedContext = context.lock();
+   if ( !lockedContext )
+   {
+      DoubleArray empty;
+      handler( boost::copy_exception( std::runtime_error( "Computation node is destroyed" ) ), empty );
+      return;
+   }
+
+   sendDirect( lockedContext, operation, array, handler, token );
+}
+
+void CComputationNode::computeLocal( const LocalCallPtr& call )
+{
+   const boost::posix_time::ptime startTime = CNodeMetrics::now();
+   call->context->metrics->addRequest();
+
+   const DoubleArray& array = call->array;
+   DoubleArray& result = call->result;
+   if ( call->operation == OP_MULTIPLY_PAIRS )
+   {
+      result.resize( array.size() / 2 );
+      if ( !result.empty() )
+      {
+         kernels::multiplyPairs( &array[0], result.size(), &result[0] );
+      }
+   }
+   else
+   {
+      result.assign( 1, array.empty() ? 0.0 : kernels::sum( &array[0], array.size() ) );
+   }
+   call->context->metrics->record( CNodeMetrics::PHASE_TOTAL, startTime );
+
+   CEventLoop::instance().getService().post( boost::bind( &CComputationNode::finishLocal, call ) );
+}
+
+void CComputationNode::storeLocal( const LocalCallPtr& call )
+{
+   const boost::posix_time::ptime startTime = CNodeMetrics::now();
+   call->context->metrics->addRequest();
+
+   if ( !call->context->blocks->store( call->handle, call->depth, call->array ) )
+   {
+      call->error = boost::copy_exception( std::runtime_error( "Malformed block " + call->handle ) );
+   }
+   call->context->metrics->record( CNodeMetrics::PHASE_TOTAL, startTime );
+
+   CEventLoop::instance().getService().post( boost::bind( &CComputationNode::finishLocal, call ) );
+}
+
+void CComputationNode::multiplyLocal( const LocalCallPtr& call )
+{
+   const boost::posix_time::ptime startTime = CNodeMetrics::now();
+   call->context->metrics->addRequest();
+
+   const CBlockStore::BlockPtr block = call->context->blocks->find( call->handle );
+   if ( !block )
+   {
+      call->error = boost::copy_exception( CUnknownBlockError( "Unknown block " + call->handle ) );
+   }
+   else
+   {
+      if ( !CBlockStore::multiply( *block, call->array, call->result ) )
+      {
+         call->error = boost::copy_exception( std::runtime_error( "Rows do not match block depth" ) );
+      }
+      call->context->metrics->record( CNodeMetrics::PHASE_TOTAL, startTime );
+   }
+
+   CEventLoop::instance().getService().post( boost::bind( &CComputationNode::finishLocal, call ) );
+}
+
+void CComputationNode::finishLocal( const LocalCallPtr& call )
+{
+   call->handler( call->error, call->result );
+}
+
+FutureDoubleArray CComputationNode::asyncRequest( Operation operation, const DoubleArray& array ) const
+{
+   boost::shared_ptr< boost::promise<DoubleArray> > promise( new boost::promise<DoubleArray>() );
+   FutureDoubleArray result = promise->get_future();
+   asyncCall( operation, array, boost::bind( &fulfillPromise, promise, _1, _2 ) );
+   return result;
 }
 
 FutureDoubleArray CComputationNode::asyncMultiplyPairs( const DoubleArray& array ) const
 {
-   return boost::async( boost::launch::async, boost::bind( asyncRequest, mHost, "/multiply", array ) );
+   return asyncRequest( OP_MULTIPLY_PAIRS, array );
 }
 
 FutureDoubleArray CComputationNode::asyncSum( const DoubleArray& array ) const
 {
-   return boost::async( boost::launch::async, boost::bind( asyncRequest, mHost, "/sum", array ) );
+   return asyncRequest( OP_SUM, array );
+}
+
+void CComputationNode::asyncStoreBlock( const MatrixBlock& block,
+                                        const ResultHandler& handler,
+                                        const CancelTokenPtr& token ) const
+{
+   if ( !mContext )
+   {
+      DoubleArray empty;
+      handler( boost::copy_exception( std::runtime_error( "Invalid computation node" ) ), empty );
+      return;
+   }
+
+   if ( token && token->isCancelled() )
+   {
+      CEventLoop::instance().getService().post( boost::bind( &CComputationNode::failCancelled, token, handler ) );
+      return;
+   }
+
+   if ( isLocal() )
+   {
+      const LocalCallPtr call( new LocalCall( mContext, handler ) );
+      call->handle = block.handle;
+      call->depth = block.depth;
+      call->array = block.columns;
+      getComputePool().getService().post( boost::bind( &CComputationNode::storeLocal, call ) );
+      return;
+   }
+
+   sendBlockCall( mContext,
+                  STORE_BLOCK_URI + block.handle + "&depth=" + boost::lexical_cast<std::string>( block.depth ),
+                  block.columns,
+                  0,
+                  handler,
+                  token );
 }
-/** @}*/
 
+void CComputationNode::asyncMultiplyBlock( const MatrixBlock& block,
+                                           const DoubleArray& rows,
+                                           const ResultHandler& handler,
+                                           const CancelTokenPtr& token ) const
+{
+   if ( !mContext )
+   {
+      DoubleArray empty;
+      handler( boost::copy_exception( std::runtime_error( "Invalid computation node" ) ), empty );
+      return;
+   }
+
+   if ( token && token->isCancelled() )
+   {
+      CEventLoop::instance().getService().post( boost::bind( &CComputationNode::failCancelled, token, handler ) );
+      return;
+   }
+
+   if ( isLocal() )
+   {
+      const LocalCallPtr call( new LocalCall( mContext, handler ) );
+      call->handle = block.handle;
+      call->array = rows;
+      getComputePool().getService().post( boost::bind( &CComputationNode::multiplyLocal, call ) );
+      return;
+   }
+
+   // Block calls are never batched, they are large and each refers to its own block.
+   const std::size_t rowsCount = block.depth > 0 ? rows.size() / block.depth : 0;
+   const std::size_t colsCount = block.depth > 0 ? block.columns.size() / block.depth : 0;
+   sendBlockCall( mContext, MULTIPLY_BLOCK_URI + block.handle, rows, rowsCount * colsCount, handler, token );
+}
+/** @}*/
@@ -12,13 +12,26 @@
 /** @addtogroup scheduler Distributed operations scheduler
  *  @{
  */
+#ifndef BOOST_THREAD_PROVIDES_FUTURE
 #define BOOST_THREAD_PROVIDES_FUTURE
+#endif
 
 #include <string>
 #include <list>
+#include <stdexcept>
 #include <vector>
+#include <boost/exception_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
 #include <boost/thread.hpp>
 #include <boost/thread/future.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "CCancelToken.hpp"
+
+struct HttpResponse;
+class CNodeMetrics;
 
 /**
  * @brief Vector of double values
@@ -32,14 +45,93 @@ typedef std::vector<double> DoubleArray;
  */
 typedef boost::future<DoubleArray> FutureDoubleArray;
 
+/**
+ * @brief Completion callback of CComputationNode::asyncCall(). \n
+ * Error is null on success, result may be moved out by the callback.
+ */
+typedef boost::function<void( const boost::exception_ptr& error, DoubleArray& result )> ResultHandler;
+
+/**
+ * @brief Block of matrix columns which is uploaded to the node once \n
+ * and then referred to by its handle
+ * @sa CComputationNode::asyncStoreBlock()
+ */
+struct MatrixBlock
+{
+   std::string handle;     ///< Block handle, unique for its values
+   std::size_t depth;      ///< Values per column
+   DoubleArray columns;    ///< Columns one after another
+};
+
+typedef boost::shared_ptr<const MatrixBlock> MatrixBlockPtr;
+
+/**
+ * @brief Error of the call which refers to a block the node does not keep, \n
+ * because it was evicted or was never stored there
+ */
+class CUnknownBlockError : public std::runtime_error
+{
+public:
+   explicit CUnknownBlockError( const std::string& message )
+      : std::runtime_error( message )
+   {
+
+   }
+};
+
 /**
  * @brief This class represents remote web service \n
  * that provides two operations on DoubleArray: \n
- * multiply pairs of numbers and sum all numbers in the array.
+ * multiply pairs of numbers and sum all numbers in the array. \n
+ * Nodes which keep uploaded matrix blocks also multiply rows by a stored block.
  */
 class CComputationNode
 {
 public:
+   /**
+    * @brief Default number of persistent connections per computation node
+    */
+   static const std::size_t DEFAULT_CONNECTIONS_COUNT = 8;
+
+   /**
+    * @brief Payload serialization format used to talk to the remote service
+    */
+   enum WireFormat
+   {
+      WIRE_AUTO,     ///< Prefer binary format, fall back to JSON if remote service does not support it
+      WIRE_JSON,     ///< Always use JSON
+      WIRE_BINARY    ///< Always use binary format
+   };
+
+   /**
+    * @brief Operations provided by the remote service
+    */
+   enum Operation
+   {
+      OP_MULTIPLY_PAIRS = 1,  ///< Multiply pairs of numbers
+      OP_SUM = 2              ///< Sum all numbers
+   };
+
+   /**
+    * @brief Default size of the batch after which it is sent without waiting
+    * @sa enableBatching()
+    */
+   static const std::size_t DEFAULT_BATCH_VALUES = 4096;
+
+   /**
+    * @brief Default number of values in a chunk of streamed call
+    * @sa enableStreaming()
+    */
+   static const std::size_t DEFAULT_STREAM_CHUNK_VALUES = 65536;
+
+   /**
+    * @brief Host name of the in-process node. \n
+    * Such node computes operations locally with vectorized kernels, on its own \n
+    * pool of threads, so that event loop threads are left to network operations.
+    * @sa kernels::sum()
+    */
+   static const char* const LOCAL_HOST;
+
    /**
     * @brief Default constructor. Creates invalid object
     */
@@ -47,9 +139,12 @@ public:
 
    /**
     * @brief Constructor. Initialize object with remote service host name.
-    * @param host - remote service host name
+    * @param host - remote service host name, optionally followed by ":port", \n
+    * or LOCAL_HOST for the in-process node
+    * @param maxConnections - maximum number of persistent connections to the remote service
     */
-   explicit CComputationNode( const std::string& host );
+   explicit CComputationNode( const std::string& host,
+                              std::size_t maxConnections = DEFAULT_CONNECTIONS_COUNT );
 
    /**
     * @brief Destructor
@@ -62,12 +157,92 @@ public:
     */
    std::string getName( void ) const;
 
+   /**
+    * @brief Get metrics of the node, shared between copies of the node
+    * @return Node metrics, null for invalid node
+    */
+   boost::shared_ptr<CNodeMetrics> getMetrics( void ) const;
+
    /**
     * @brief Determine whether this object is valid or not
     * @return True - if this is valid object, false - otherwise
     */
    bool isValid( void ) const;
 
+   /**
+    * @brief Check whether node computes operations in process
+    * @return True - if node is local, false - if it is remote service
+    */
+   bool isLocal( void ) const;
+
+   /**
+    * @brief Get number of calls node can serve at the same time without queueing
+    * @return Maximum number of persistent connections, 1 for local node
+    */
+   std::size_t getMaxConnections( void ) const;
+
+   /**
+    * @brief Set payload serialization format. Shared between copies of the node.
+    * @param format - serialization format
+    */
+   void setWireFormat( WireFormat format );
+
+   /**
+    * @brief Get payload serialization format
+    * @return Serialization format which was set by setWireFormat()
+    */
+   WireFormat getWireFormat( void ) const;
+
+   /**
+    * @brief Enable coalescing of small calls into batched requests. \n
+    * Calls issued within maxDelay after the first call of a batch are sent \n
+    * in one round trip to the /batch method of the remote service. \n
+    * If remote service does not provide it, calls are sent one by one. \n
+    * Shared between copies of the node.
+    * @param maxDelay - how long the first call of a batch may wait for others
+    * @param maxValues - batch is sent at once when it holds that many values, \n
+    * calls with at least that many values are never batched
+    */
+   void enableBatching( boost::posix_time::time_duration maxDelay,
+                        std::size_t maxValues = DEFAULT_BATCH_VALUES );
+
+   /**
+    * @brief Disable batching. Calls which are already collected are sent at once.
+    */
+   void disableBatching( void );
+
+   /**
+    * @brief Enable streaming of calls with large arguments. \n
+    * Such calls are sent and answered with HTTP chunked transfer coding, \n
+    * so that serialized payload is never held as a whole and remote service \n
+    * may start answering before the request is fully sent. \n
+    * Only binary payloads are streamed. If remote service does not accept \n
+    * chunked requests, streaming is disabled and calls are resent at once. \n
+    * Shared between copies of the node.
+    * @param chunkValues - calls with more values are sent in chunks of that many values
+    */
+   void enableStreaming( std::size_t chunkValues = DEFAULT_STREAM_CHUNK_VALUES );
+
+   /**
+    * @brief Disable streaming. Calls which are already in flight are not affected.
+    */
+   void disableStreaming( void );
+
+   /**
+    * @brief Asynchronously perform operation on the remote service
+    * @param operation - operation to perform
+    * @param array - operation argument
+    * @param handler - completion callback, called from the event loop thread
+    * @param token - aborts the call with CCancelledError when cancelled, may be null. \n
+    * Batch is shared with other callers, so cancelled call which is already sent fails at once \n
+    * and its result is ignored when the batch is answered.
+    * @sa CEventLoop
+    */
+   void asyncCall( Operation operation,
+                   const DoubleArray& array,
+                   const ResultHandler& handler,
+                   const CancelTokenPtr& token = CancelTokenPtr() ) const;
+
    /**
     * @brief Asynchronously multiply pairs of numbers from passed array
     * @param array - DoubleArray with numbers to multiply
@@ -82,9 +257,174 @@ public:
     */
    FutureDoubleArray asyncSum( const DoubleArray& array ) const;
 
+   /**
+    * @brief Asynchronously upload block, so that asyncMultiplyBlock() may refer to it. \n
+    * Node keeps the block as long as its memory allows, then evicts it.
+    * @param block - block to upload
+    * @param handler - completion callback, result is empty
+    * @param token - aborts the upload with CCancelledError when cancelled, may be null
+    */
+   void asyncStoreBlock( const MatrixBlock& block,
+                         const ResultHandler& handler,
+                         const CancelTokenPtr& token = CancelTokenPtr() ) const;
+
+   /**
+    * @brief Asynchronously multiply rows by the columns of the block stored on the node
+    * @param block - stored block, only its handle is sent
+    * @param rows - rows one after another, each of block depth values
+    * @param handler - completion callback, result holds dot product of every row with \n
+    * every column, row by row, error is CUnknownBlockError if node does not keep the block
+    * @param token - aborts the call with CCancelledError when cancelled, may be null
+    */
+   void asyncMultiplyBlock( const MatrixBlock& block,
+                            const DoubleArray& rows,
+                            const ResultHandler& handler,
+                            const CancelTokenPtr& token = CancelTokenPtr() ) const;
+
+private:
+   struct Context;
+   struct Call;
+   struct LocalCall;
+   typedef boost::shared_ptr<Call> CallPtr;
+   typedef boost::shared_ptr<LocalCall> LocalCallPtr;
+
+   /**
+    * @brief Perform operation with a single request to the remote service, bypassing batching
+    * @param context - node context
+    * @param operation - operation to perform
+    * @param array - operation argument
+    * @param handler - completion callback
+    * @param token - cancel token of the call, may be null
+    */
+   static void sendDirect( const boost::shared_ptr<Context>& context,
+                           Operation operation,
+                           const DoubleArray& array,
+                           const ResultHandler& handler,
+                           const CancelTokenPtr& token = CancelTokenPtr() );
+
+   /**
+    * @brief Send block call with a single request to the remote service
+    * @param context - node context
+    * @param uri - URI of the block method with its parameters
+    * @param array - call argument
+    * @param resultSize - expected number of values in the result
+    * @param handler - completion callback
+    * @param token - cancel token of the call, may be null
+    */
+   static void sendBlockCall( const boost::shared_ptr<Context>& context,
+                              const std::string& uri,
+                              const DoubleArray& array,
+                              std::size_t resultSize,
+                              const ResultHandler& handler,
+                              const CancelTokenPtr& token = CancelTokenPtr() );
+
+   /**
+    * @brief Choose format of the call and send it
+    * @param call - node call state
+    * @param array - call argument
+    */
+   static void startCall( const CallPtr& call, const DoubleArray& array );
+
+   /**
+    * @brief Batcher fallback. Holds weak reference to the context, \n
+    * so that the batcher owned by the context does not keep it alive.
+    * @param context - node context
+    * @param operation - operation to perform
+    * @param array - operation argument
+    * @param handler - completion callback
+    * @param token - cancel token of the call, may be null
+    */
+   static void sendUnbatched( const boost::weak_ptr<Context>& context,
+                              Operation operation,
+                              const DoubleArray& array,
+                              const ResultHandler& handler,
+                              const CancelTokenPtr& token );
+
+   /**
+    * @brief Fail call whose token was cancelled before it was sent
+    * @param token - cancelled token
+    * @param handler - completion callback
+    */
+   static void failCancelled( const CancelTokenPtr& token, const ResultHandler& handler );
+
+   /**
+    * @brief Perform operation with local kernels, runs on the compute pool
+    * @param call - local call
+    */
+   static void computeLocal( const LocalCallPtr& call );
+
+   /**
+    * @brief Store block in the local block store, runs on the compute pool
+    * @param call - local call, its argument holds block columns
+    */
+   static void storeLocal( const LocalCallPtr& call );
+
+   /**
+    * @brief Multiply rows by the block of the local block store, runs on the compute pool
+    * @param call - local call, its argument holds rows
+    */
+   static void multiplyLocal( const LocalCallPtr& call );
+
+   /**
+    * @brief Pass result of the local call to its handler, runs on the event loop
+    * @param call - finished local call
+    */
+   static void finishLocal( const LocalCallPtr& call );
+
+   /**
+    * @brief Perform operation and return its result as future
+    * @param operation - operation to perform
+    * @param array - operation argument
+    * @return Async operation result
+    */
+   FutureDoubleArray asyncRequest( Operation operation, const DoubleArray& array ) const;
+
+   /**
+    * @brief Serialize call parameter and send it to the remote service
+    * @param call - node call state
+    * @param param - operation argument
+    */
+   static void sendCall( const CallPtr& call, const DoubleArray& param );
+
+   /**
+    * @brief Produce chunk of the streamed call argument
+    * @param call - node call state
+    * @param index - chunk index
+    * @param[out] chunk - serialized chunk
+    * @return True - if more chunks follow, false - otherwise
+    */
+   static bool writeChunk( const CallPtr& call, std::size_t index, std::string& chunk );
+
+   /**
+    * @brief Parse piece of the streamed call result
+    * @param call - node call state
+    * @param data - piece begin
+    * @param size - piece size
+    */
+   static void readChunk( const CallPtr& call, const char* data, std::size_t size );
+
+   /**
+    * @brief Account finished call and pass its result to the call handler
+    * @param call - node call state
+    * @param error - call error or null on success
+    * @param result - call result
+    */
+   static void finishCall( const CallPtr& call, const boost::exception_ptr& error, DoubleArray& result );
+
+   /**
+    * @brief Parse remote service response and pass result to the call handler
+    * @param call - node call state
+    * @param error - exchange error or null on success
+    * @param response - remote service response
+    */
+   static void onResponse( const CallPtr& call,
+                           const boost::exception_ptr& error,
+                           const HttpResponse& response );
+
 private:
-   std::string mHost; ///< Remote service host name
-   bool mIsValid;     ///< Valid/Invalid flag
+   std::string mHost;                        ///< Remote service host name
+   bool mIsValid;                            ///< Valid/Invalid flag
+   boost::shared_ptr<Context> mContext;      ///< Connections and settings shared between copies of the node
 };
 /** @}*/
 #endif // CCOMPUTATIONNODE_HPP
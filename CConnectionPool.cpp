@@ -0,0 +1,201 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CConnectionPool.cpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CConnectionPool class definition
+ ************************************************************************/
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include "CConnectionPool.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include <boost/bind.hpp>
+
+CConnectionPool::CConnectionPool( boost::asio::io_service& service,
+                                  const std::string& host,
+                                  const std::string& port,
+                                  std::size_t maxConnections,
+                                  const boost::shared_ptr<CNodeMetrics>& metrics )
+   : mService( service )
+   , mHost( host )
+   , mPort( port )
+   , mMaxConnections( std::max<std::size_t>( maxConnections, 1 ) )
+   , mConnectionsCount( 0 )
+   , mIdle()
+   , mPending()
+   , mSpareBodies()
+   , mGuard()
+   , mMetrics( metrics )
+{
+   // Released bodies never make the vector grow.
+   mSpareBodies.reserve( mMaxConnections );
+
+}
+
+CConnectionPool::~CConnectionPool( void )
+{
+
+}
+
+std::size_t CConnectionPool::getMaxConnections( void ) const
+{
+   return mMaxConnections;
+}
+
+void CConnectionPool::acquireBody( std::string& body )
+{
+   body.clear();
+
+   boost::lock_guard<boost::mutex> lock( mGuard );
+   if ( !mSpareBodies.empty() )
+   {
+      body.swap( mSpareBodies.back() );
+      mSpareBodies.pop_back();
+   }
+}
+
+void CConnectionPool::asyncPost( HttpRequest& request, CHttpConnection::ResponseHandler& handler )
+{
+   ConnectionPtr connection;
+   {
+      boost::lock_guard<boost::mutex> lock( mGuard );
+      if ( !mIdle.empty() )
+      {
+         // Most recently used connection is the least likely to be dropped by server.
+         connection = mIdle.back();
+         mIdle.pop_back();
+      }
+      else if ( mConnectionsCount < mMaxConnections )
+      {
+         ++mConnectionsCount;
+         connection = createConnection();
+      }
+      else
+      {
+         mPending.push_back( PendingRequest() );
+         PendingRequest& pending = mPending.back();
+         if ( request.cancelToken )
+         {
+            // Cancelled request is dropped by the io_service, as handlers are called there.
+            const boost::weak_ptr<CConnectionPool> pool( shared_from_this() );
+            pending.cancelId = request.cancelToken->subscribe( boost::bind( &CConnectionPool::onCancelRequested, pool ) );
+            if ( pending.cancelId == 0 )
+            {
+               onCancelRequested( pool );
+            }
+         }
+         pending.request = std::move( request );
+         pending.handler.swap( handler );
+         return;
+      }
+   }
+
+   connection->asyncPost( request, handler );
+}
+
+CConnectionPool::ConnectionPtr CConnectionPool::createConnection( void )
+{
+   return ConnectionPtr( new CHttpConnection( mService,
+                                              mHost,
+                                              mPort,
+                                              mMetrics,
+                                              boost::bind( &CConnectionPool::onReleased,
+                                                           boost::weak_ptr<CConnectionPool>( shared_from_this() ),
+                                                           _1 ) ) );
+}
+
+void CConnectionPool::release( const ConnectionPtr& connection )
+{
+   std::string body;
+   connection->takeRequestBody( body );
+
+   ConnectionPtr next = connection;
+   PendingRequest pending;
+   {
+      boost::lock_guard<boost::mutex> lock( mGuard );
+      if ( body.capacity() > 0 && mSpareBodies.size() < mMaxConnections )
+      {
+         mSpareBodies.push_back( std::string() );
+         mSpareBodies.back().swap( body );
+      }
+
+      if ( mPending.empty() )
+      {
+         if ( connection->isOpen() )
+         {
+            mIdle.push_back( connection );
+         }
+         else
+         {
+            --mConnectionsCount;
+         }
+         return;
+      }
+      pending = std::move( mPending.front() );
+      mPending.pop_front();
+   }
+
+   if ( pending.request.cancelToken )
+   {
+      pending.request.cancelToken->unsubscribe( pending.cancelId );
+   }
+
+   // Reads of the aborted exchange may still land in the buffer of the closed connection, so it is replaced.
+   if ( !connection->isOpen() )
+   {
+      next = createConnection();
+   }
+   next->asyncPost( pending.request, pending.handler );
+}
+
+void CConnectionPool::onCancelRequested( const boost::weak_ptr<CConnectionPool>& pool )
+{
+   const boost::shared_ptr<CConnectionPool> lockedPool = pool.lock();
+   if ( lockedPool )
+   {
+      lockedPool->mService.post( boost::bind( &CConnectionPool::dropCancelled, lockedPool ) );
+   }
+}
+
+void CConnectionPool::dropCancelled( void )
+{
+   std::vector<PendingRequest> cancelled;
+   {
+      boost::lock_guard<boost::mutex> lock( mGuard );
+      std::deque<PendingRequest> pending;
+      for ( std::deque<PendingRequest>::iterator it = mPending.begin(); it != mPending.end(); ++it )
+      {
+         if ( it->request.cancelToken && it->request.cancelToken->isCancelled() )
+         {
+            cancelled.push_back( std::move( *it ) );
+         }
+         else
+         {
+            pending.push_back( std::move( *it ) );
+         }
+      }
+      mPending.swap( pending );
+   }
+
+   HttpResponse response = HttpResponse();
+   for ( std::size_t i = 0; i < cancelled.size(); ++i )
+   {
+      response.requestBody = &cancelled[i].request.body;
+      cancelled[i].handler( cancelled[i].request.cancelToken->getError(), response );
+   }
+}
+
+void CConnectionPool::onReleased( const boost::weak_ptr<CConnectionPool>& pool, const ConnectionPtr& connection )
+{
+   const boost::shared_ptr<CConnectionPool> lockedPool = pool.lock();
+   if ( lockedPool )
+   {
+      lockedPool->release( connection );
+   }
+}
+/** @}*/
@@ -0,0 +1,150 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CConnectionPool.hpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CConnectionPool class declaration
+ ************************************************************************/
+#ifndef CCONNECTIONPOOL_HPP
+#define CCONNECTIONPOOL_HPP
+
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include <string>
+#include <deque>
+#include <list>
+#include <vector>
+
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include "CHttpConnection.hpp"
+#include "CNodeMetrics.hpp"
+
+/**
+ * @brief This class represents bounded pool of persistent \n
+ * connections to the single remote service. \n
+ * Connections are created on demand and reused across requests. \n
+ * If all connections are busy, request is queued until the first one is released. \n
+ * Queued request is dropped as soon as its cancel token is cancelled. \n
+ * Bodies of finished requests are kept for reuse, so that steady stream \n
+ * of requests serializes payloads into already allocated memory.
+ */
+class CConnectionPool : public boost::enable_shared_from_this<CConnectionPool>
+                      , private boost::noncopyable
+{
+public:
+   /**
+    * @brief Constructor
+    * @param service - io_service which drives connections
+    * @param host - remote service host name
+    * @param port - remote service port
+    * @param maxConnections - maximum number of simultaneously opened connections
+    * @param metrics - metrics of the remote service, may be null
+    */
+   CConnectionPool( boost::asio::io_service& service,
+                    const std::string& host,
+                    const std::string& port,
+                    std::size_t maxConnections,
+                    const boost::shared_ptr<CNodeMetrics>& metrics = boost::shared_ptr<CNodeMetrics>() );
+
+   /**
+    * @brief Destructor
+    */
+   ~CConnectionPool( void );
+
+   /**
+    * @brief Get maximum number of simultaneously opened connections
+    * @return Pool size
+    */
+   std::size_t getMaxConnections( void ) const;
+
+   /**
+    * @brief Get empty buffer for the request body, \n
+    * memory of previously sent body if there is one
+    * @param[out] body - cleared buffer
+    */
+   void acquireBody( std::string& body );
+
+   /**
+    * @brief Asynchronously send POST request over pooled connection. \n
+    * Request body and handler are moved out, so nothing is copied.
+    * @param request - request to send, its body is left empty
+    * @param handler - completion callback, called from the io_service thread, left empty
+    * @sa CHttpConnection::asyncPost()
+    */
+   void asyncPost( HttpRequest& request, CHttpConnection::ResponseHandler& handler );
+
+private:
+   typedef boost::shared_ptr<CHttpConnection> ConnectionPtr;
+
+   /**
+    * @brief Request waiting for a free connection
+    */
+   struct PendingRequest
+   {
+      PendingRequest( void )
+         : request()
+         , handler()
+         , cancelId( 0 )
+      {
+
+      }
+
+      HttpRequest request;                         ///< Request to send
+      CHttpConnection::ResponseHandler handler;    ///< Completion callback
+      std::size_t cancelId;                        ///< Subscription to the cancel token of the request
+   };
+
+   /**
+    * @brief Create connection which is released back to the pool
+    * @return New connection, not established yet
+    */
+   ConnectionPtr createConnection( void );
+
+   /**
+    * @brief Return connection to the pool or hand it to the queued request. \n
+    * Closed connections are dropped, queued request gets a new one instead.
+    * @param connection - connection which finished exchange
+    */
+   void release( const ConnectionPtr& connection );
+
+   /**
+    * @brief Connection release callback. Holds weak reference to the pool, \n
+    * so that idle connections do not keep it alive. Pool with queued \n
+    * or sent requests is kept alive by their handlers.
+    * @param pool - owner of the connection
+    * @param connection - connection which finished exchange
+    */
+   static void onReleased( const boost::weak_ptr<CConnectionPool>& pool, const ConnectionPtr& connection );
+
+   /**
+    * @brief Cancel token callback of the queued request. Hands dropping over to the io_service.
+    * @param pool - owner of the queue
+    */
+   static void onCancelRequested( const boost::weak_ptr<CConnectionPool>& pool );
+
+   /**
+    * @brief Drop queued requests whose tokens are cancelled and fail them with CCancelledError
+    */
+   void dropCancelled( void );
+
+private:
+   boost::asio::io_service& mService;        ///< IO service for connections
+   std::string mHost;                        ///< Remote service host name
+   std::string mPort;                        ///< Remote service port
+   std::size_t mMaxConnections;              ///< Pool size
+   std::size_t mConnectionsCount;            ///< Number of created connections (idle and busy)
+   std::list<ConnectionPtr> mIdle;           ///< Connections ready for reuse
+   std::deque<PendingRequest> mPending;      ///< Requests waiting for a free connection
+   std::vector<std::string> mSpareBodies;    ///< Bodies of finished requests, at most one per connection
+   boost::mutex mGuard;                      ///< Mutex for pool state
+   boost::shared_ptr<CNodeMetrics> mMetrics; ///< Metrics passed to connections
+};
+/** @}*/
+#endif // CCONNECTIONPOOL_HPP
@@ -0,0 +1,149 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CCostModel.cpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CCostModel class definition
+ ************************************************************************/
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include "CCostModel.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+const std::size_t CCostModel::CLASSES_COUNT;
+const double CCostModel::SMOOTHING = 0.2;
+const double CCostModel::TARGET_OVERHEAD_SHARE = 0.1;
+const std::size_t CCostModel::MIN_SAMPLES;
+const std::size_t CCostModel::MIN_CHUNK_VALUES;
+
+CCostModel::CCostModel( void )
+   : mSamplesCount( 0 )
+   , mIsKnown( false )
+   , mOverhead( 0.0 )
+   , mCostPerValue( 0.0 )
+{
+   for ( std::size_t i = 0; i < CLASSES_COUNT; ++i )
+   {
+      mClasses[i].count = 0;
+      mClasses[i].values = 0.0;
+      mClasses[i].latency = 0.0;
+   }
+}
+
+void CCostModel::record( std::size_t valuesCount, double microseconds )
+{
+   std::size_t index = 0;
+   for ( std::size_t bits = valuesCount; bits > 0 && index + 1 < CLASSES_COUNT; bits >>= 1 )
+   {
+      ++index;
+   }
+
+   SizeClass& sizeClass = mClasses[index];
+   const double values = static_cast<double>( valuesCount );
+   if ( sizeClass.count++ == 0 )
+   {
+      sizeClass.values = values;
+      sizeClass.latency = microseconds;
+   }
+   else
+   {
+      sizeClass.values = SMOOTHING * values + ( 1.0 - SMOOTHING ) * sizeClass.values;
+      sizeClass.latency = SMOOTHING * microseconds + ( 1.0 - SMOOTHING ) * sizeClass.latency;
+   }
+
+   ++mSamplesCount;
+   fit();
+}
+
+bool CCostModel::isKnown( void ) const
+{
+   return mIsKnown;
+}
+
+double CCostModel::getOverhead( void ) const
+{
+   return mOverhead;
+}
+
+double CCostModel::getCostPerValue( void ) const
+{
+   return mCostPerValue;
+}
+
+std::size_t CCostModel::getChunkValues( std::size_t maxValues ) const
+{
+   if ( !mIsKnown )
+   {
+      return 0;
+   }
+
+   // Overhead of share s of the latency needs overhead * (1 - s) / s microseconds of work per call.
+   const double chunk = ( mCostPerValue > 0.0 )
+                        ? mOverhead * ( 1.0 - TARGET_OVERHEAD_SHARE ) / ( TARGET_OVERHEAD_SHARE * mCostPerValue )
+                        : static_cast<double>( maxValues );
+   return static_cast<std::size_t>( std::min( std::max( chunk, static_cast<double>( MIN_CHUNK_VALUES ) ),
+                                              static_cast<double>( maxValues ) ) );
+}
+
+std::size_t CCostModel::getDepth( std::size_t chunkValues, std::size_t maxDepth ) const
+{
+   if ( !mIsKnown )
+   {
+      return 0;
+   }
+
+   // While one call computes, the others travel: every call in flight covers its own share of the overhead.
+   const double work = mCostPerValue * static_cast<double>( chunkValues );
+   const double depth = ( work > 0.0 ) ? std::ceil( 1.0 + mOverhead / work ) : static_cast<double>( maxDepth );
+   return static_cast<std::size_t>( std::max( 1.0, std::min( depth, static_cast<double>( maxDepth ) ) ) );
+}
+
+void CCostModel::fit( void )
+{
+   std::size_t pointsCount = 0;
+   double meanValues = 0.0;
+   double meanLatency = 0.0;
+   for ( std::size_t i = 0; i < CLASSES_COUNT; ++i )
+   {
+      if ( mClasses[i].count > 0 )
+      {
+         ++pointsCount;
+         meanValues += mClasses[i].values;
+         meanLatency += mClasses[i].latency;
+      }
+   }
+
+   if ( mSamplesCount < MIN_SAMPLES || pointsCount < 2 )
+   {
+      return;
+   }
+   meanValues /= pointsCount;
+   meanLatency /= pointsCount;
+
+   // Every class is one point, so frequent sizes do not outweigh rare ones.
+   double covariance = 0.0;
+   double variance = 0.0;
+   for ( std::size_t i = 0; i < CLASSES_COUNT; ++i )
+   {
+      if ( mClasses[i].count > 0 )
+      {
+         const double dx = mClasses[i].values - meanValues;
+         covariance += dx * ( mClasses[i].latency - meanLatency );
+         variance += dx * dx;
+      }
+   }
+   if ( variance <= 0.0 )
+   {
+      return;
+   }
+
+   // Noise may tilt the line, but neither overhead nor cost can be negative.
+   mCostPerValue = std::max( covariance / variance, 0.0 );
+   mOverhead = std::max( meanLatency - mCostPerValue * meanValues, 0.0 );
+   mIsKnown = true;
+}
+/** @}*/
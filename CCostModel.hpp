@@ -0,0 +1,125 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CCostModel.hpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CCostModel class declaration
+ ************************************************************************/
+#ifndef CCOSTMODEL_HPP
+#define CCOSTMODEL_HPP
+
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include <cstddef>
+
+/**
+ * @brief This class estimates latency of the node call as fixed overhead \n
+ * plus cost per value, and derives call granularity from them. \n
+ * Calls are grouped by size into power of two classes, latency of every \n
+ * class is smoothed (EWMA), and a line is fitted through all classes, \n
+ * so the estimate follows the node when it slows down, while classes \n
+ * of rare sizes still anchor the overhead. \n
+ * Not thread-safe, owner serializes access.
+ * @sa CNodeDispatcher::setAutoTuning()
+ */
+class CCostModel
+{
+public:
+   /**
+    * @brief Number of size classes, class i holds calls with i significant bits of values count
+    */
+   static const std::size_t CLASSES_COUNT = 48;
+
+   /**
+    * @brief Weight of the latest call in the smoothed latency of its class
+    */
+   static const double SMOOTHING;
+
+   /**
+    * @brief Share of the call latency which may be spent on the fixed overhead
+    */
+   static const double TARGET_OVERHEAD_SHARE;
+
+   /**
+    * @brief Number of calls after which the estimate is trusted
+    */
+   static const std::size_t MIN_SAMPLES = 8;
+
+   /**
+    * @brief Smallest chunk which is chosen
+    */
+   static const std::size_t MIN_CHUNK_VALUES = 256;
+
+   /**
+    * @brief Constructor. Creates model without samples.
+    */
+   CCostModel( void );
+
+   /**
+    * @brief Account finished call
+    * @param valuesCount - number of values in the call argument, greater than 0
+    * @param microseconds - call latency
+    */
+   void record( std::size_t valuesCount, double microseconds );
+
+   /**
+    * @brief Check whether overhead and cost per value are estimated. \n
+    * It needs MIN_SAMPLES calls of at least two size classes.
+    * @return True - if estimate is available
+    */
+   bool isKnown( void ) const;
+
+   /**
+    * @brief Get fixed overhead of the call: round trip, headers and scheduling
+    * @return Overhead in microseconds
+    */
+   double getOverhead( void ) const;
+
+   /**
+    * @brief Get cost of the single value: transfer, serialization and computation
+    * @return Cost in microseconds
+    */
+   double getCostPerValue( void ) const;
+
+   /**
+    * @brief Get number of values per call at which overhead takes TARGET_OVERHEAD_SHARE of the call
+    * @param maxValues - upper bound of the result
+    * @return Chunk size, at least MIN_CHUNK_VALUES, 0 if estimate is not available
+    */
+   std::size_t getChunkValues( std::size_t maxValues ) const;
+
+   /**
+    * @brief Get number of calls in flight which hide the overhead behind computation of other calls
+    * @param chunkValues - values per call
+    * @param maxDepth - upper bound of the result
+    * @return Number of calls in flight, 0 if estimate is not available
+    */
+   std::size_t getDepth( std::size_t chunkValues, std::size_t maxDepth ) const;
+
+private:
+   /**
+    * @brief Fit line through latencies of all size classes
+    */
+   void fit( void );
+
+   /**
+    * @brief Calls of one size class
+    */
+   struct SizeClass
+   {
+      std::size_t count;   ///< Number of calls
+      double values;       ///< Smoothed values count
+      double latency;      ///< Smoothed latency in microseconds
+   };
+
+private:
+   SizeClass mClasses[CLASSES_COUNT];  ///< Calls by size class
+   std::size_t mSamplesCount;          ///< Number of recorded calls
+   bool mIsKnown;                      ///< Whether fitted line is available
+   double mOverhead;                   ///< Fixed overhead in microseconds
+   double mCostPerValue;               ///< Cost per value in microseconds
+};
+/** @}*/
+#endif // CCOSTMODEL_HPP
@@ -0,0 +1,63 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CEventLoop.cpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CEventLoop class definition
+ ************************************************************************/
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include "CEventLoop.hpp"
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
+const std::size_t CEventLoop::DEFAULT_THREADS_COUNT;
+
+std::size_t CEventLoop::sSharedThreadsCount = CEventLoop::DEFAULT_THREADS_COUNT;
+
+CEventLoop::CEventLoop( std::size_t threadsCount )
+   : mService()
+   , mWork( new boost::asio::io_service::work( mService ) )
+   , mThreads()
+   , mThreadsCount( std::max<std::size_t>( threadsCount, 1 ) )
+{
+   typedef std::size_t ( boost::asio::io_service::*RunFunction )( void );
+
+   for ( std::size_t i = 0; i < mThreadsCount; ++i )
+   {
+      mThreads.create_thread( boost::bind( static_cast<RunFunction>( &boost::asio::io_service::run ), &mService ) );
+   }
+}
+
+CEventLoop::~CEventLoop( void )
+{
+   mWork.reset();
+   mService.stop();
+   mThreads.join_all();
+}
+
+boost::asio::io_service& CEventLoop::getService( void )
+{
+   return mService;
+}
+
+std::size_t CEventLoop::getThreadsCount( void ) const
+{
+   return mThreadsCount;
+}
+
+CEventLoop& CEventLoop::instance( void )
+{
+   static CEventLoop sharedLoop( sSharedThreadsCount );
+   return sharedLoop;
+}
+
+void CEventLoop::setSharedThreadsCount( std::size_t threadsCount )
+{
+   sSharedThreadsCount = threadsCount;
+}
+/** @}*/
@@ -0,0 +1,80 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CEventLoop.hpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CEventLoop class declaration
+ ************************************************************************/
+#ifndef CEVENTLOOP_HPP
+#define CEVENTLOOP_HPP
+
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+/**
+ * @brief This class represents pool of threads running single io_service. \n
+ * All network operations of computation nodes are driven by the shared instance, \n
+ * so number of in-flight requests does not depend on number of threads.
+ * @sa CEventLoop::instance()
+ */
+class CEventLoop : private boost::noncopyable
+{
+public:
+   /**
+    * @brief Default number of threads in the shared event loop
+    */
+   static const std::size_t DEFAULT_THREADS_COUNT = 2;
+
+   /**
+    * @brief Constructor. Starts threads which run io_service.
+    * @param threadsCount - number of threads
+    */
+   explicit CEventLoop( std::size_t threadsCount );
+
+   /**
+    * @brief Destructor. Stops io_service and joins threads.
+    */
+   ~CEventLoop( void );
+
+   /**
+    * @brief Get io_service driven by this event loop
+    * @return Reference to io_service
+    */
+   boost::asio::io_service& getService( void );
+
+   /**
+    * @brief Get number of threads running io_service
+    * @return Threads count
+    */
+   std::size_t getThreadsCount( void ) const;
+
+   /**
+    * @brief Get shared event loop. It is created on first call.
+    * @return Reference to the shared event loop
+    * @sa setSharedThreadsCount()
+    */
+   static CEventLoop& instance( void );
+
+   /**
+    * @brief Set number of threads of the shared event loop.
+    * @remark Has effect only if called before first call of instance().
+    * @param threadsCount - number of threads
+    */
+   static void setSharedThreadsCount( std::size_t threadsCount );
+
+private:
+   boost::asio::io_service mService;                        ///< Event loop io_service
+   boost::scoped_ptr<boost::asio::io_service::work> mWork;  ///< Keeps io_service running while there is no work
+   boost::thread_group mThreads;                            ///< Threads running io_service
+   std::size_t mThreadsCount;                               ///< Number of threads
+
+   static std::size_t sSharedThreadsCount;                  ///< Number of threads of the shared event loop
+};
+/** @}*/
+#endif // CEVENTLOOP_HPP
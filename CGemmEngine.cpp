@@ -0,0 +1,346 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CGemmEngine.cpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CGemmEngine class definition
+ ************************************************************************/
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include "CGemmEngine.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+
+const std::size_t CGemmEngine::DEFAULT_TILE_VALUES;
+const std::size_t CGemmEngine::DEFAULT_TILES_PER_NODE;
+
+/**
+ * @brief State of the single multiplication
+ */
+struct CGemmEngine::Job
+{
+   Job( const CNodeDispatcher& nodes, std::size_t products, const CellStore& cellStore, const TileStore& tileStore )
+      : dispatcher( nodes )
+      , depth( products )
+      , store( cellStore )
+      , save( tileStore )
+      , tilesInFlight( 0 )
+      , maxTilesInFlight( 1 )
+      , error()
+   {
+
+   }
+
+   const CNodeDispatcher& dispatcher;  ///< Computation nodes dispatcher
+   std::size_t depth;                  ///< Number of products per cell
+   CellStore store;                    ///< Stores computed cells into the result matrix
+   TileStore save;                     ///< Saves finished tiles, may be empty
+
+   boost::mutex guard;                 ///< Mutex for fields below
+   boost::condition_variable finished; ///< Notified when tile is finished
+   std::size_t tilesInFlight;          ///< Number of tiles being computed
+   std::size_t maxTilesInFlight;       ///< Limit of tiles being computed
+   boost::exception_ptr error;         ///< First error of node calls
+};
+
+/**
+ * @brief Rectangular part of the result matrix
+ */
+struct CGemmEngine::Tile
+{
+   std::size_t rowBegin;                     ///< First row
+   std::size_t rowEnd;                       ///< Row after the last one
+   std::size_t colBegin;                     ///< First column
+   std::size_t colEnd;                       ///< Column after the last one
+   boost::atomic<std::size_t> pendingCells;  ///< Number of cells which are not computed yet
+   boost::atomic<bool> isFailed;             ///< Whether any cell has failed
+};
+
+CGemmEngine::CGemmEngine( const CNodeDispatcher& dispatcher, std::size_t tileValues, std::size_t tilesPerNode )
+   : mDispatcher( dispatcher )
+   , mTileValues( tileValues )
+   , mTilesPerNode( std::max<std::size_t>( tilesPerNode, 1 ) )
+   , mIsResident( false )
+   , mCheckpoint()
+{
+
+}
+
+CGemmEngine::~CGemmEngine( void )
+{
+
+}
+
+void CGemmEngine::setResidentBlocks( bool isResident )
+{
+   mIsResident = isResident;
+}
+
+void CGemmEngine::setCheckpoint( const boost::shared_ptr<CCheckpoint>& checkpoint )
+{
+   mCheckpoint = checkpoint;
+}
+
+void CGemmEngine::multiply( const matrix::CMatrix& A, const matrix::CMatrix& B, matrix::CMatrix& C ) const
+{
+   if ( A.getColsCount() != B.getRowsCount() )
+   {
+      throw std::invalid_argument( "Matrix A columns count differs from matrix B rows count" );
+   }
+
+   C = matrix::CMatrix( A.getRowsCount(), B.getColsCount() );
+   multiplyInto( A, B, C );
+}
+
+std::size_t CGemmEngine::getTileValues( void ) const
+{
+   const std::size_t chunkValues = mDispatcher.isAutoTuning() ? mDispatcher.getChunkValues() : 0;
+   return ( chunkValues > 0 ) ? chunkValues : mTileValues;
+}
+
+std::size_t CGemmEngine::getTileCols( std::size_t cols, std::size_t depth, std::size_t tileValues ) const
+{
+   if ( mIsResident )
+   {
+      // Block is uploaded once per node, so it is as large as a tile payload.
+      return std::min( cols, std::max<std::size_t>( tileValues / depth, 1 ) );
+   }
+
+   const std::size_t tileCells = std::max<std::size_t>( tileValues / ( 2 * depth ), 1 );
+   return std::min( cols, std::max<std::size_t>( static_cast<std::size_t>( std::sqrt( static_cast<double>( tileCells ) ) ),
+                                                 1 ) );
+}
+
+std::size_t CGemmEngine::getTileRows( std::size_t rows,
+                                      std::size_t depth,
+                                      std::size_t tileCols,
+                                      std::size_t tileValues ) const
+{
+   if ( mIsResident )
+   {
+      // Rows of A sent by the tile fill the same limit as the block.
+      return std::min( rows, std::max<std::size_t>( tileValues / depth, 1 ) );
+   }
+
+   const std::size_t tileCells = std::max<std::size_t>( tileValues / ( 2 * depth ), 1 );
+   return std::min( rows, std::max<std::size_t>( tileCells / tileCols, 1 ) );
+}
+
+std::size_t CGemmEngine::getMaxTilesInFlight( void ) const
+{
+   const std::size_t nodesCount = mDispatcher.getNodesCount();
+   if ( !mDispatcher.isAutoTuning() )
+   {
+      return mTilesPerNode * std::max<std::size_t>( nodesCount, 1 );
+   }
+
+   std::size_t tilesCount = 0;
+   for ( std::size_t i = 0; i < nodesCount; ++i )
+   {
+      const std::size_t depth = mDispatcher.getInFlightDepth( i );
+      tilesCount += ( depth > 0 ) ? depth : mTilesPerNode;
+   }
+   return std::max<std::size_t>( tilesCount, 1 );
+}
+
+boost::shared_ptr<CGemmEngine::Job> CGemmEngine::startJob( std::size_t depth,
+                                                           const CellStore& store,
+                                                           const TileStore& tileStore ) const
+{
+   boost::shared_ptr<Job> job( new Job( mDispatcher, depth, store, tileStore ) );
+   job->maxTilesInFlight = getMaxTilesInFlight();
+   return job;
+}
+
+bool CGemmEngine::acquireSlot( const boost::shared_ptr<Job>& job ) const
+{
+   // Tuned nodes change their depth while the job runs.
+   const std::size_t maxTilesInFlight = getMaxTilesInFlight();
+
+   boost::unique_lock<boost::mutex> lock( job->guard );
+   job->maxTilesInFlight = maxTilesInFlight;
+   while ( job->tilesInFlight >= job->maxTilesInFlight && !job->error )
+   {
+      job->finished.wait( lock );
+   }
+   if ( job->error )
+   {
+      return false;
+   }
+   ++job->tilesInFlight;
+   return true;
+}
+
+void CGemmEngine::startTile( const boost::shared_ptr<Job>& job,
+                             std::size_t rowBegin,
+                             std::size_t rowEnd,
+                             std::size_t colBegin,
+                             std::size_t colEnd,
+                             const DoubleArray& pairs )
+{
+   boost::shared_ptr<Tile> tile( new Tile() );
+   tile->rowBegin = rowBegin;
+   tile->rowEnd = rowEnd;
+   tile->colBegin = colBegin;
+   tile->colEnd = colEnd;
+   tile->pendingCells = ( rowEnd - rowBegin ) * ( colEnd - colBegin );
+   tile->isFailed = false;
+
+   job->dispatcher.asyncCall( CComputationNode::OP_MULTIPLY_PAIRS,
+                              pairs,
+                              boost::bind( &CGemmEngine::onProducts, job, tile, _1, _2 ) );
+}
+
+void CGemmEngine::startBlockTile( const boost::shared_ptr<Job>& job,
+                                  std::size_t rowBegin,
+                                  std::size_t rowEnd,
+                                  std::size_t colBegin,
+                                  std::size_t colEnd,
+                                  const MatrixBlockPtr& block,
+                                  const DoubleArray& rows )
+{
+   boost::shared_ptr<Tile> tile( new Tile() );
+   tile->rowBegin = rowBegin;
+   tile->rowEnd = rowEnd;
+   tile->colBegin = colBegin;
+   tile->colEnd = colEnd;
+   tile->pendingCells = ( rowEnd - rowBegin ) * ( colEnd - colBegin );
+   tile->isFailed = false;
+
+   job->dispatcher.asyncMultiplyBlock( block, rows, boost::bind( &CGemmEngine::onCells, job, tile, _1, _2 ) );
+}
+
+void CGemmEngine::finishJob( const boost::shared_ptr<Job>& job )
+{
+   boost::unique_lock<boost::mutex> lock( job->guard );
+   while ( job->tilesInFlight > 0 )
+   {
+      job->finished.wait( lock );
+   }
+
+   if ( job->error )
+   {
+      boost::rethrow_exception( job->error );
+   }
+}
+
+void CGemmEngine::onProducts( const boost::shared_ptr<Job>& job,
+                              const boost::shared_ptr<Tile>& tile,
+                              const boost::exception_ptr& error,
+                              DoubleArray& products )
+{
+   const std::size_t depth = job->depth;
+   const std::size_t cellsCount = tile->pendingCells;
+
+   if ( error || products.size() != cellsCount * depth )
+   {
+      finishCells( job,
+                   tile,
+                   cellsCount,
+                   error ? error : boost::copy_exception( std::runtime_error( "Wrong number of products" ) ) );
+      return;
+   }
+
+   DoubleArray::const_iterator cellBegin = products.begin();
+   for ( std::size_t i = tile->rowBegin; i < tile->rowEnd; ++i )
+   {
+      for ( std::size_t j = tile->colBegin; j < tile->colEnd; ++j )
+      {
+         job->dispatcher.asyncCall( CComputationNode::OP_SUM,
+                                    DoubleArray( cellBegin, cellBegin + depth ),
+                                    boost::bind( &CGemmEngine::onSum, job, tile, i, j, _1, _2 ) );
+         cellBegin += depth;
+      }
+   }
+}
+
+void CGemmEngine::onCells( const boost::shared_ptr<Job>& job,
+                           const boost::shared_ptr<Tile>& tile,
+                           const boost::exception_ptr& error,
+                           DoubleArray& cells )
+{
+   const std::size_t cellsCount = tile->pendingCells;
+
+   if ( error || cells.size() != cellsCount )
+   {
+      finishCells( job,
+                   tile,
+                   cellsCount,
+                   error ? error : boost::copy_exception( std::runtime_error( "Wrong number of cells" ) ) );
+      return;
+   }
+
+   DoubleArray::const_iterator cell = cells.begin();
+   for ( std::size_t i = tile->rowBegin; i < tile->rowEnd; ++i )
+   {
+      for ( std::size_t j = tile->colBegin; j < tile->colEnd; ++j )
+      {
+         job->store( i, j, *cell++ );
+      }
+   }
+   finishCells( job, tile, cellsCount, boost::exception_ptr() );
+}
+
+void CGemmEngine::onSum( const boost::shared_ptr<Job>& job,
+                         const boost::shared_ptr<Tile>& tile,
+                         std::size_t row,
+                         std::size_t col,
+                         const boost::exception_ptr& error,
+                         DoubleArray& sum )
+{
+   if ( error || sum.size() != 1 )
+   {
+      finishCells( job,
+                   tile,
+                   1,
+                   error ? error : boost::copy_exception( std::runtime_error( "Wrong sum result" ) ) );
+      return;
+   }
+
+   job->store( row, col, sum[0] );
+   finishCells( job, tile, 1, boost::exception_ptr() );
+}
+
+void CGemmEngine::finishCells( const boost::shared_ptr<Job>& job,
+                               const boost::shared_ptr<Tile>& tile,
+                               std::size_t cellsCount,
+                               const boost::exception_ptr& error )
+{
+   if ( error )
+   {
+      tile->isFailed = true;
+   }
+   const bool isTileFinished = ( tile->pendingCells.fetch_sub( cellsCount ) == cellsCount );
+   if ( !error && !isTileFinished )
+   {
+      return;
+   }
+
+   if ( isTileFinished && !tile->isFailed && job->save )
+   {
+      // Tile is saved before its slot is released, so the job does not finish without it.
+      job->save( tile->rowBegin, tile->rowEnd, tile->colBegin, tile->colEnd );
+   }
+
+   {
+      boost::lock_guard<boost::mutex> lock( job->guard );
+      if ( error && !job->error )
+      {
+         job->error = error;
+      }
+      if ( isTileFinished )
+      {
+         --job->tilesInFlight;
+      }
+   }
+
+   job->finished.notify_all();
+}
+/** @}*/
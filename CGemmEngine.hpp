@@ -0,0 +1,479 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CGemmEngine.hpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CGemmEngine class declaration
+ ************************************************************************/
+#ifndef CGEMMENGINE_HPP
+#define CGEMMENGINE_HPP
+
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include <algorithm>
+#include <stdexcept>
+
+#include "CCheckpoint.hpp"
+#include "CMatrix.hpp"
+#include "CNodeDispatcher.hpp"
+#include "CTiledMatrix.hpp"
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+/**
+ * @brief This class multiplies matrices with the remote computation nodes. \n
+ * Result matrix is split into rectangular tiles. For every tile pairs \n
+ * of A row and B column elements are multiplied by one /multiply call, \n
+ * and products of every cell are added up by /sum call as soon as they arrive, \n
+ * so the multiply and sum phases of different tiles overlap on all nodes. \n
+ * With resident blocks columns of B are uploaded to nodes once per column of tiles, \n
+ * and every tile sends only its rows of A and gets its cells back at once. \n
+ * When dispatcher tunes nodes, tile size and tiles in flight follow its decisions. \n
+ * With checkpoint finished tiles are saved, and cells restored from it are not computed again.
+ */
+class CGemmEngine : private boost::noncopyable
+{
+public:
+   /**
+    * @brief Default number of values in the /multiply call of a single tile
+    */
+   static const std::size_t DEFAULT_TILE_VALUES = 32768;
+
+   /**
+    * @brief Default number of tiles processed at the same time per node
+    */
+   static const std::size_t DEFAULT_TILES_PER_NODE = 4;
+
+   /**
+    * @brief Callback which blocks until leading rows of matrix A are available
+    * @param rowsCount - number of rows
+    * @return False if rows will never be available
+    */
+   typedef boost::function<bool( std::size_t rowsCount )> RowsReady;
+
+   /**
+    * @brief Constructor
+    * @param dispatcher - dispatcher of calls between computation nodes
+    * @param tileValues - limit of values in the /multiply call of a single tile, \n
+    * tiles have at least one cell
+    * @param tilesPerNode - number of tiles processed at the same time per node
+    */
+   explicit CGemmEngine( const CNodeDispatcher& dispatcher,
+                         std::size_t tileValues = DEFAULT_TILE_VALUES,
+                         std::size_t tilesPerNode = DEFAULT_TILES_PER_NODE );
+
+   /**
+    * @brief Destructor
+    */
+   ~CGemmEngine( void );
+
+   /**
+    * @brief Keep columns of B on nodes instead of sending them with every tile. \n
+    * Network volume falls from the order of rows * cols * depth values to the order \n
+    * of (rows + nodes * depth) * cols values, and /sum calls are not needed.
+    * @param isResident - whether blocks are kept on nodes
+    * @sa CNodeDispatcher::asyncMultiplyBlock()
+    */
+   void setResidentBlocks( bool isResident );
+
+   /**
+    * @brief Save finished tiles to the checkpoint and skip tiles restored from it
+    * @param checkpoint - checkpoint of the next multiplication, may be null to disable checkpointing
+    * @sa CCheckpoint
+    */
+   void setCheckpoint( const boost::shared_ptr<CCheckpoint>& checkpoint );
+
+   /**
+    * @brief Compute C = A * B. Blocks until all tiles are finished.
+    * @param A - input matrix A
+    * @param B - input matrix B, its rows count must be equal to A columns count
+    * @param[out] C - result matrix, resized to A rows by B columns
+    * @throw std::invalid_argument if matrices can not be multiplied
+    * @throw std::exception if any node call fails
+    */
+   void multiply( const matrix::CMatrix& A, const matrix::CMatrix& B, matrix::CMatrix& C ) const;
+
+   /**
+    * @brief Compute C = A * B into already sized matrix. Blocks until all tiles are finished. \n
+    * Matrices may be of any type which provides getRowsCount(), getColsCount() \n
+    * and operator()( row, col ) as matrix::CMatrix does. Cells of C are written \n
+    * as soon as they are computed, so C may be a view of a mapped file.
+    * @param A - input matrix A
+    * @param B - input matrix B, its rows count must be equal to A columns count
+    * @param[out] C - result matrix of A rows by B columns
+    * @param rowsReady - called before rows of A are used, so that A may still be loading, \n
+    * may be empty if A is complete
+    * @throw std::invalid_argument if matrices can not be multiplied
+    * @throw std::exception if any node call fails or rows of A are not available
+    * @throw std::runtime_error if checkpoint of the previous run can not be restored
+    * @sa CMappedMatrix, CMatrixLoader
+    */
+   template<typename MatrixA, typename MatrixB, typename MatrixC>
+   void multiplyInto( const MatrixA& A,
+                      const MatrixB& B,
+                      MatrixC& C,
+                      const RowsReady& rowsReady = RowsReady() ) const;
+
+private:
+   struct Job;
+   struct Tile;
+
+   /**
+    * @brief Callback which stores computed cell of the result matrix
+    */
+   typedef boost::function<void( std::size_t row, std::size_t col, double value )> CellStore;
+
+   /**
+    * @brief Callback which saves finished tile of the result matrix
+    */
+   typedef boost::function<void( std::size_t rowBegin, std::size_t rowEnd, std::size_t colBegin, std::size_t colEnd )>
+   TileStore;
+
+   /**
+    * @brief Get limit of values in the call of a single tile
+    * @return Chunk size tuned by the dispatcher, or tile values given to the constructor \n
+    * if auto-tuning is disabled or no node is tuned yet
+    * @sa CNodeDispatcher::setAutoTuning()
+    */
+   std::size_t getTileValues( void ) const;
+
+   /**
+    * @brief Compute columns per tile. Tile of pairs is close to square and its /multiply \n
+    * payload fits into tileValues. Block of resident columns has at most tileValues values.
+    * @param cols - result columns count
+    * @param depth - number of products per cell
+    * @param tileValues - limit of values in the call of a single tile
+    * @return Columns per tile and block
+    */
+   std::size_t getTileCols( std::size_t cols, std::size_t depth, std::size_t tileValues ) const;
+
+   /**
+    * @brief Compute rows per tile for the column of tiles of known width. \n
+    * Payload of the tile, pairs or rows of A, fits into tileValues.
+    * @param rows - result rows count
+    * @param depth - number of products per cell
+    * @param tileCols - columns per tile
+    * @param tileValues - limit of values in the call of a single tile
+    * @return Rows per tile
+    */
+   std::size_t getTileRows( std::size_t rows, std::size_t depth, std::size_t tileCols, std::size_t tileValues ) const;
+
+   /**
+    * @brief Get limit of tiles being computed
+    * @return Tiles per node summed over nodes, tuned nodes count their tuned calls in flight
+    */
+   std::size_t getMaxTilesInFlight( void ) const;
+
+   /**
+    * @brief Create state of the multiplication
+    * @param depth - number of products per cell
+    * @param store - callback which stores computed cells
+    * @param tileStore - callback which saves finished tiles, may be empty
+    * @return Multiplication state
+    */
+   boost::shared_ptr<Job> startJob( std::size_t depth, const CellStore& store, const TileStore& tileStore ) const;
+
+   /**
+    * @brief Wait until number of tiles in flight allows to start one more tile
+    * @param job - multiplication state
+    * @return False if some call has already failed and no more tiles should be started
+    */
+   bool acquireSlot( const boost::shared_ptr<Job>& job ) const;
+
+   /**
+    * @brief Send /multiply call for the tile
+    * @param job - multiplication state
+    * @param rowBegin - first row of the tile
+    * @param rowEnd - row after the last one
+    * @param colBegin - first column of the tile
+    * @param colEnd - column after the last one
+    * @param pairs - packed element pairs of all tile cells, row by row
+    */
+   static void startTile( const boost::shared_ptr<Job>& job,
+                          std::size_t rowBegin,
+                          std::size_t rowEnd,
+                          std::size_t colBegin,
+                          std::size_t colEnd,
+                          const DoubleArray& pairs );
+
+   /**
+    * @brief Send rows of A for the tile to be multiplied by the block of B columns
+    * @param job - multiplication state
+    * @param rowBegin - first row of the tile
+    * @param rowEnd - row after the last one
+    * @param colBegin - first column of the tile
+    * @param colEnd - column after the last one
+    * @param block - columns of B from colBegin to colEnd
+    * @param rows - rows of A from rowBegin to rowEnd
+    */
+   static void startBlockTile( const boost::shared_ptr<Job>& job,
+                               std::size_t rowBegin,
+                               std::size_t rowEnd,
+                               std::size_t colBegin,
+                               std::size_t colEnd,
+                               const MatrixBlockPtr& block,
+                               const DoubleArray& rows );
+
+   /**
+    * @brief Wait until all tiles are finished
+    * @param job - multiplication state
+    * @throw std::exception if any node call has failed
+    */
+   static void finishJob( const boost::shared_ptr<Job>& job );
+
+   /**
+    * @brief /multiply completion callback. Sends /sum call for every cell of the tile.
+    * @param job - multiplication state
+    * @param tile - computed tile
+    * @param error - call error or null on success
+    * @param products - products of element pairs, grouped by cell
+    */
+   static void onProducts( const boost::shared_ptr<Job>& job,
+                           const boost::shared_ptr<Tile>& tile,
+                           const boost::exception_ptr& error,
+                           DoubleArray& products );
+
+   /**
+    * @brief Block call completion callback. Stores all cells of the tile.
+    * @param job - multiplication state
+    * @param tile - computed tile
+    * @param error - call error or null on success
+    * @param cells - cells of the tile, row by row
+    */
+   static void onCells( const boost::shared_ptr<Job>& job,
+                        const boost::shared_ptr<Tile>& tile,
+                        const boost::exception_ptr& error,
+                        DoubleArray& cells );
+
+   /**
+    * @brief /sum completion callback. Stores cell value into the result matrix.
+    * @param job - multiplication state
+    * @param tile - tile of the cell
+    * @param row - cell row
+    * @param col - cell column
+    * @param error - call error or null on success
+    * @param sum - cell value
+    */
+   static void onSum( const boost::shared_ptr<Job>& job,
+                      const boost::shared_ptr<Tile>& tile,
+                      std::size_t row,
+                      std::size_t col,
+                      const boost::exception_ptr& error,
+                      DoubleArray& sum );
+
+   /**
+    * @brief Account finished cells of the tile
+    * @param job - multiplication state
+    * @param tile - tile of the cells
+    * @param cellsCount - number of finished cells
+    * @param error - error of the cells or null on success
+    */
+   static void finishCells( const boost::shared_ptr<Job>& job,
+                            const boost::shared_ptr<Tile>& tile,
+                            std::size_t cellsCount,
+                            const boost::exception_ptr& error );
+
+   /**
+    * @brief Store cell into the result matrix
+    * @param C - result matrix
+    * @param row - cell row
+    * @param col - cell column
+    * @param value - cell value
+    */
+   template<typename MatrixC>
+   static void storeCell( MatrixC* C, std::size_t row, std::size_t col, double value )
+   {
+      // Cells are distinct, so they are written without locking.
+      ( *C )( row, col ) = value;
+   }
+
+   /**
+    * @brief Copy finished tile from the result matrix into the checkpoint
+    * @param checkpoint - checkpoint of the multiplication
+    * @param C - result matrix
+    * @param rowBegin - first row of the tile
+    * @param rowEnd - row after the last one
+    * @param colBegin - first column of the tile
+    * @param colEnd - column after the last one
+    */
+   template<typename MatrixC>
+   static void saveTile( CCheckpoint* checkpoint,
+                         const MatrixC* C,
+                         std::size_t rowBegin,
+                         std::size_t rowEnd,
+                         std::size_t colBegin,
+                         std::size_t colEnd )
+   {
+      DoubleArray cells;
+      cells.reserve( ( rowEnd - rowBegin ) * ( colEnd - colBegin ) );
+      for ( std::size_t i = rowBegin; i < rowEnd; ++i )
+      {
+         for ( std::size_t j = colBegin; j < colEnd; ++j )
+         {
+            cells.push_back( ( *C )( i, j ) );
+         }
+      }
+      checkpoint->addTile( rowBegin, rowEnd, colBegin, colEnd, cells );
+   }
+
+private:
+   const CNodeDispatcher& mDispatcher;          ///< Computation nodes dispatcher
+   std::size_t mTileValues;                     ///< Limit of values in the /multiply call
+   std::size_t mTilesPerNode;                   ///< Number of tiles in flight per node
+   bool mIsResident;                            ///< Whether columns of B are kept on nodes
+   boost::shared_ptr<CCheckpoint> mCheckpoint;  ///< Checkpoint of finished tiles or null
+};
+
+template<typename MatrixA, typename MatrixB, typename MatrixC>
+void CGemmEngine::multiplyInto( const MatrixA& A,
+                                const MatrixB& B,
+                                MatrixC& C,
+                                const RowsReady& rowsReady ) const
+{
+   const std::size_t rows = A.getRowsCount();
+   const std::size_t cols = B.getColsCount();
+   const std::size_t depth = A.getColsCount();
+
+   if ( depth != B.getRowsCount() )
+   {
+      throw std::invalid_argument( "Matrix A columns count differs from matrix B rows count" );
+   }
+   if ( C.getRowsCount() != rows || C.getColsCount() != cols )
+   {
+      throw std::invalid_argument( "Matrix C size differs from A rows count by B columns count" );
+   }
+
+   if ( rows == 0 || cols == 0 )
+   {
+      return;
+   }
+   if ( depth == 0 )
+   {
+      for ( std::size_t i = 0; i < rows; ++i )
+      {
+         for ( std::size_t j = 0; j < cols; ++j )
+         {
+            C( i, j ) = 0.0;
+         }
+      }
+      return;
+   }
+
+   TileStore tileStore;
+   if ( mCheckpoint )
+   {
+      const std::size_t restoredCells = mCheckpoint->open( C, depth );
+      if ( restoredCells == rows * cols )
+      {
+         return;
+      }
+      tileStore = boost::bind( &CGemmEngine::saveTile<MatrixC>, mCheckpoint.get(), &C, _1, _2, _3, _4 );
+   }
+
+   const boost::shared_ptr<Job> job = startJob( depth,
+                                                boost::bind( &CGemmEngine::storeCell<MatrixC>, &C, _1, _2, _3 ),
+                                                tileStore );
+
+   // Only columns of B used by the current column of tiles are kept transposed,
+   // so that memory does not grow with B size.
+   DoubleArray transposedB;
+   DoubleArray pairs;
+   MatrixBlockPtr block;
+   CCheckpoint::Parts parts;
+   bool isRunning = true;
+   bool isLoaded = true;
+   // Shape is chosen per column of tiles and rows per tile, so it follows the tuned chunk size.
+   std::size_t colEnd = 0;
+   for ( std::size_t colBegin = 0; colBegin < cols && isRunning; colBegin = colEnd )
+   {
+      colEnd = std::min( colBegin + getTileCols( cols, depth, getTileValues() ), cols );
+      if ( mCheckpoint && mCheckpoint->isDone( 0, rows, colBegin, colEnd ) )
+      {
+         continue;
+      }
+
+      transposedB.resize( ( colEnd - colBegin ) * depth );
+      CTiledMatrix::pack( B, 0, depth, colBegin, colEnd, CTiledMatrix::COLUMN_MAJOR, transposedB.data() );
+      if ( mIsResident )
+      {
+         // Columns are moved into the block, which lives until its last tile is answered.
+         block = CNodeDispatcher::createBlock( depth, transposedB );
+      }
+
+      std::size_t rowEnd = 0;
+      for ( std::size_t rowBegin = 0; rowBegin < rows && isRunning; rowBegin = rowEnd )
+      {
+         rowEnd = std::min( rowBegin + getTileRows( rows, depth, colEnd - colBegin, getTileValues() ), rows );
+
+         // Cells restored from the checkpoint are skipped, block calls still take their rows whole.
+         parts.clear();
+         if ( mCheckpoint )
+         {
+            mCheckpoint->getPendingParts( rowBegin, rowEnd, colBegin, colEnd, block != MatrixBlockPtr(), parts );
+         }
+         else
+         {
+            const CCheckpoint::Part whole = { rowBegin, rowEnd, colBegin, colEnd };
+            parts.push_back( whole );
+         }
+         if ( parts.empty() )
+         {
+            continue;
+         }
+         if ( rowsReady && !rowsReady( rowEnd ) )
+         {
+            isRunning = false;
+            isLoaded = false;
+            break;
+         }
+
+         for ( CCheckpoint::Parts::const_iterator part = parts.begin(); part != parts.end(); ++part )
+         {
+            if ( !acquireSlot( job ) )
+            {
+               isRunning = false;
+               break;
+            }
+
+            if ( block )
+            {
+               pairs.resize( depth * ( part->rowEnd - part->rowBegin ) );
+               CTiledMatrix::pack( A, part->rowBegin, part->rowEnd, 0, depth, CTiledMatrix::ROW_MAJOR, pairs.data() );
+               startBlockTile( job, part->rowBegin, part->rowEnd, colBegin, colEnd, block, pairs );
+               continue;
+            }
+
+            pairs.clear();
+            pairs.reserve( 2 * depth * ( part->rowEnd - part->rowBegin ) * ( part->colEnd - part->colBegin ) );
+            for ( std::size_t i = part->rowBegin; i < part->rowEnd; ++i )
+            {
+               for ( std::size_t j = part->colBegin; j < part->colEnd; ++j )
+               {
+                  const double* column = &transposedB[( j - colBegin ) * depth];
+                  for ( std::size_t k = 0; k < depth; ++k )
+                  {
+                     pairs.push_back( A( i, k ) );
+                     pairs.push_back( column[k] );
+                  }
+               }
+            }
+
+            startTile( job, part->rowBegin, part->rowEnd, part->colBegin, part->colEnd, pairs );
+         }
+      }
+   }
+
+   finishJob( job );
+
+   if ( !isLoaded )
+   {
+      throw std::runtime_error( "Matrix A rows are not available" );
+   }
+}
+/** @}*/
+#endif // CGEMMENGINE_HPP
@@ -0,0 +1,92 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CHistogram.cpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CHistogram class definition
+ ************************************************************************/
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include "CHistogram.hpp"
+
+const std::size_t CHistogram::BUCKETS_COUNT;
+
+CHistogram::CHistogram( void )
+   : mCount( 0 )
+   , mSum( 0 )
+{
+   for ( std::size_t i = 0; i < BUCKETS_COUNT; ++i )
+   {
+      mBuckets[i] = 0;
+   }
+}
+
+CHistogram::~CHistogram( void )
+{
+
+}
+
+void CHistogram::record( boost::uint64_t value )
+{
+   std::size_t bucket = 0;
+   for ( boost::uint64_t rest = value; rest != 0 && bucket + 1 < BUCKETS_COUNT; rest >>= 1 )
+   {
+      ++bucket;
+   }
+
+   // Counters are independent, so readers may see them slightly out of sync.
+   mBuckets[bucket].fetch_add( 1, boost::memory_order_relaxed );
+   mCount.fetch_add( 1, boost::memory_order_relaxed );
+   mSum.fetch_add( value, boost::memory_order_relaxed );
+}
+
+boost::uint64_t CHistogram::getCount( void ) const
+{
+   return mCount.load( boost::memory_order_relaxed );
+}
+
+boost::uint64_t CHistogram::getSum( void ) const
+{
+   return mSum.load( boost::memory_order_relaxed );
+}
+
+boost::uint64_t CHistogram::getBucketCount( std::size_t bucket ) const
+{
+   return mBuckets[bucket].load( boost::memory_order_relaxed );
+}
+
+boost::uint64_t CHistogram::getUpperBound( std::size_t bucket )
+{
+   return ( static_cast<boost::uint64_t>( 1 ) << bucket ) - 1;
+}
+
+boost::uint64_t CHistogram::getPercentile( double fraction ) const
+{
+   boost::uint64_t total = 0;
+   boost::uint64_t counts[BUCKETS_COUNT];
+   for ( std::size_t i = 0; i < BUCKETS_COUNT; ++i )
+   {
+      counts[i] = getBucketCount( i );
+      total += counts[i];
+   }
+
+   if ( total == 0 )
+   {
+      return 0;
+   }
+
+   const double rank = fraction * total;
+   boost::uint64_t seen = 0;
+   for ( std::size_t i = 0; i < BUCKETS_COUNT; ++i )
+   {
+      seen += counts[i];
+      if ( seen > 0 && seen >= rank )
+      {
+         return getUpperBound( i );
+      }
+   }
+   return getUpperBound( BUCKETS_COUNT - 1 );
+}
+/** @}*/
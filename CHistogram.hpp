@@ -0,0 +1,88 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CHistogram.hpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CHistogram class declaration
+ ************************************************************************/
+#ifndef CHISTOGRAM_HPP
+#define CHISTOGRAM_HPP
+
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+
+/**
+ * @brief This class represents lock-free histogram of durations. \n
+ * Bucket i counts values which have i significant bits, \n
+ * so its upper bound is 2^i - 1 and relative error is below 2x. \n
+ * Values may be recorded concurrently from any thread.
+ */
+class CHistogram : private boost::noncopyable
+{
+public:
+   /**
+    * @brief Number of buckets, the last one also counts all larger values
+    */
+   static const std::size_t BUCKETS_COUNT = 40;
+
+   /**
+    * @brief Constructor. Creates empty histogram.
+    */
+   CHistogram( void );
+
+   /**
+    * @brief Destructor
+    */
+   ~CHistogram( void );
+
+   /**
+    * @brief Record value
+    * @param value - value to record
+    */
+   void record( boost::uint64_t value );
+
+   /**
+    * @brief Get number of recorded values
+    * @return Values count
+    */
+   boost::uint64_t getCount( void ) const;
+
+   /**
+    * @brief Get sum of recorded values
+    * @return Values sum
+    */
+   boost::uint64_t getSum( void ) const;
+
+   /**
+    * @brief Get number of values in the bucket
+    * @param bucket - bucket index, less than BUCKETS_COUNT
+    * @return Values count
+    */
+   boost::uint64_t getBucketCount( std::size_t bucket ) const;
+
+   /**
+    * @brief Get maximal value which falls into the bucket
+    * @param bucket - bucket index, less than BUCKETS_COUNT
+    * @return Bucket upper bound
+    */
+   static boost::uint64_t getUpperBound( std::size_t bucket );
+
+   /**
+    * @brief Estimate percentile by upper bound of the bucket which contains it
+    * @param fraction - percentile in range [0, 1]
+    * @return Percentile estimation, 0 if histogram is empty
+    */
+   boost::uint64_t getPercentile( double fraction ) const;
+
+private:
+   boost::atomic<boost::uint64_t> mBuckets[BUCKETS_COUNT];  ///< Values count by bucket
+   boost::atomic<boost::uint64_t> mCount;                   ///< Number of values
+   boost::atomic<boost::uint64_t> mSum;                     ///< Sum of values
+};
+/** @}*/
+#endif // CHISTOGRAM_HPP
@@ -0,0 +1,979 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CHttpConnection.cpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CHttpConnection class definition
+ ************************************************************************/
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include "CHttpConnection.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include <boost/array.hpp>
+#include <boost/bind.hpp>
+
+using boost::asio::ip::tcp;
+
+/**
+ * @brief HTTP line terminator
+ */
+static const char CRLF[] = "\r\n";
+
+/**
+ * @brief Last chunk and empty trailer of chunked body
+ */
+static const char LAST_CHUNK[] = "0\r\n\r\n";
+
+/**
+ * @brief Maximal length of chunk size line which is accepted
+ */
+static const std::size_t MAX_CHUNK_LINE = 1024;
+
+/**
+ * @brief Maximal size of response body or of its single chunk which is accepted
+ */
+static const std::size_t MAX_BODY_SIZE = static_cast<std::size_t>( 1 ) << 30;
+
+/**
+ * @brief Maximal size of response status line and headers which is accepted
+ */
+static const std::size_t MAX_HEADERS_SIZE = 64 * 1024;
+
+/**
+ * @brief Blank line which terminates response headers
+ */
+static const char HEADERS_END[] = "\r\n\r\n";
+
+/**
+ * @brief Match condition of async_read_until which looks for the delimiter only within the limit. \n
+ * If the limit is buffered without the delimiter, the whole limit is matched, \n
+ * so that the read finishes instead of buffering the overlong line further.
+ */
+class CLimitedMatch
+{
+public:
+   typedef boost::asio::buffers_iterator<boost::asio::streambuf::const_buffers_type> Iterator;
+
+   CLimitedMatch( const char* delimiter, std::size_t limit )
+      : mDelimiter( delimiter )
+      , mLength( std::strlen( delimiter ) )
+      , mLimit( limit )
+   {
+
+   }
+
+   std::pair<Iterator, bool> operator()( Iterator begin, Iterator end ) const
+   {
+      const Iterator last = ( static_cast<std::size_t>( end - begin ) > mLimit ) ? begin + mLimit : end;
+      const Iterator match = std::search( begin, last, mDelimiter, mDelimiter + mLength );
+      if ( match != last )
+      {
+         return std::make_pair( match + mLength, true );
+      }
+      if ( last != end )
+      {
+         return std::make_pair( last, true );
+      }
+
+      // Search starts over from the line begin, so that the limit counts the whole line.
+      return std::make_pair( begin, false );
+   }
+
+private:
+   const char* mDelimiter;    ///< Delimiter which finishes the match
+   std::size_t mLength;       ///< Delimiter length
+   std::size_t mLimit;        ///< Maximal length of the match, including the delimiter
+};
+
+namespace boost
+{
+namespace asio
+{
+template<> struct is_match_condition<CLimitedMatch> : public boost::true_type {};
+}
+}
+
+/**
+ * @brief Check whether the line read with CLimitedMatch is complete rather than cut at the limit
+ * @param buffer - buffer which starts with the line
+ * @param size - line size
+ * @param delimiter - delimiter the line must end with
+ * @return True - if line ends with the delimiter
+ */
+static bool isComplete( const boost::asio::streambuf& buffer, std::size_t size, const char* delimiter )
+{
+   const std::size_t length = std::strlen( delimiter );
+   const char* data = boost::asio::buffer_cast<const char*>( buffer.data() );
+   return size >= length && std::memcmp( data + size - length, delimiter, length ) == 0;
+}
+
+CHttpConnection::CHttpConnection( boost::asio::io_service& service,
+                                  const std::string& host,
+                                  const std::string& port,
+                                  const boost::shared_ptr<CNodeMetrics>& metrics,
+                                  const ReleaseHandler& released )
+   : mHost( host )
+   , mPort( port )
+   , mResolver( service )
+   , mSocket( service )
+   , mStrand( service )
+   , mResponseBuffer( MAX_HEADERS_SIZE + MAX_BODY_SIZE )
+   , mReused( false )
+   , mRetried( false )
+   , mRequestHeaders()
+   , mRequest()
+   , mHandler()
+   , mReleased( released )
+   , mResponse()
+   , mKeepAlive( false )
+   , mHasContentLength( false )
+   , mContentLength( 0 )
+   , mIsChunked( false )
+   , mChunkSize( 0 )
+   , mChunkedBody()
+   , mChunkIndex( 0 )
+   , mChunk()
+   , mExchange( 0 )
+   , mRequestId( 0 )
+   , mIsWritten( false )
+   , mIsRead( false )
+   , mHasResponse( false )
+   , mCancelToken()
+   , mCancelId( 0 )
+   , mMetrics( metrics )
+   , mPhaseStart()
+{
+
+}
+
+CHttpConnection::~CHttpConnection( void )
+{
+   close();
+}
+
+bool CHttpConnection::isOpen( void ) const
+{
+   return mSocket.is_open();
+}
+
+void CHttpConnection::close( void )
+{
+   boost::system::error_code ignored;
+   mSocket.shutdown( tcp::socket::shutdown_both, ignored );
+   mSocket.close( ignored );
+   mResponseBuffer.consume( mResponseBuffer.size() );
+   mReused = false;
+}
+
+void CHttpConnection::asyncPost( HttpRequest& request, ResponseHandler& handler )
+{
+   // Late callbacks of the previous exchange still run in the strand, so its members are replaced there.
+   const boost::shared_ptr<PostedRequest> posted( new PostedRequest() );
+   posted->request = std::move( request );
+   posted->handler.swap( handler );
+   mStrand.dispatch( boost::bind( &CHttpConnection::startPost, shared_from_this(), posted ) );
+}
+
+void CHttpConnection::startPost( const boost::shared_ptr<PostedRequest>& posted )
+{
+   HttpRequest& request = posted->request;
+   char contentLength[24];
+   std::snprintf( contentLength,
+                  sizeof( contentLength ),
+                  "%lu",
+                  static_cast<unsigned long>( request.body.size() ) );
+
+   // Headers are rebuilt in place, so after the first request they need no allocation.
+   mRequestHeaders.clear();
+   mRequestHeaders.append( "POST " ).append( request.uri ).append( " HTTP/1.1\r\n" );
+   mRequestHeaders.append( "Host: " ).append( mHost ).append( CRLF );
+   mRequestHeaders.append( "Accept: " ).append( request.accept ).append( CRLF );
+   mRequestHeaders.append( "Content-Type: " ).append( request.contentType ).append( CRLF );
+   if ( request.bodySource )
+   {
+      mRequestHeaders.append( "Transfer-Encoding: chunked\r\n" );
+   }
+   else
+   {
+      mRequestHeaders.append( "Content-Length: " ).append( contentLength ).append( CRLF );
+   }
+   mRequestHeaders.append( "Connection: keep-alive\r\n\r\n" );
+
+   mRequest.uri = request.uri;
+   mRequest.contentType = request.contentType;
+   mRequest.accept = request.accept;
+   mRequest.body.swap( request.body );
+   mRequest.bodySource.swap( request.bodySource );
+   mRequest.bodySink.swap( request.bodySink );
+   mHandler.swap( posted->handler );
+   mCancelToken.swap( request.cancelToken );
+   mCancelId = 0;
+   mRetried = false;
+   ++mRequestId;
+
+   if ( mMetrics )
+   {
+      mMetrics->addRequest();
+   }
+
+   startExchange();
+}
+
+void CHttpConnection::startExchange( void )
+{
+   if ( mCancelToken )
+   {
+      mCancelId = mCancelToken->subscribe( boost::bind( &CHttpConnection::onCancelRequested,
+                                                        boost::weak_ptr<CHttpConnection>( shared_from_this() ),
+                                                        mRequestId,
+                                                        mCancelToken ) );
+      if ( mCancelId == 0 )
+      {
+         // Completed later, so that queued requests of the cancelled job do not nest their handlers.
+         mStrand.post( boost::bind( &CHttpConnection::onCancelled, shared_from_this(), mRequestId, mCancelToken ) );
+         return;
+      }
+   }
+
+   if ( isOpen() )
+   {
+      startWrite();
+   }
+   else
+   {
+      startConnect();
+   }
+}
+
+void CHttpConnection::onCancelRequested( const boost::weak_ptr<CHttpConnection>& connection,
+                                         std::size_t requestId,
+                                         const CancelTokenPtr& token )
+{
+   const boost::shared_ptr<CHttpConnection> lockedConnection = connection.lock();
+   if ( lockedConnection )
+   {
+      lockedConnection->mStrand.post( boost::bind( &CHttpConnection::onCancelled,
+                                                   lockedConnection,
+                                                   requestId,
+                                                   token ) );
+   }
+}
+
+void CHttpConnection::onCancelled( std::size_t requestId, const CancelTokenPtr& token )
+{
+   // Cancellation queued just as its request finished must not abort the next one.
+   if ( requestId != mRequestId || !mHandler )
+   {
+      return;
+   }
+
+   mResolver.cancel();
+   complete( token->getError() );
+}
+
+void CHttpConnection::startConnect( void )
+{
+   mPhaseStart = CNodeMetrics::now();
+
+   // Get a list of endpoints corresponding to the server name.
+   tcp::resolver::query query( mHost, mPort );
+   mResolver.async_resolve( query,
+                            mStrand.wrap( boost::bind( &CHttpConnection::onResolve,
+                                                       shared_from_this(),
+                                                       mExchange,
+                                                       boost::asio::placeholders::error,
+                                                       boost::asio::placeholders::iterator ) ) );
+}
+
+void CHttpConnection::onResolve( std::size_t exchange,
+                                 const boost::system::error_code& error,
+                                 tcp::resolver::iterator endpointIterator )
+{
+   if ( exchange != mExchange )
+   {
+      return;
+   }
+   if ( error )
+   {
+      complete( boost::copy_exception( boost::system::system_error( error ) ) );
+      return;
+   }
+   recordPhase( CNodeMetrics::PHASE_RESOLVE );
+
+   // Try each endpoint until we successfully establish a connection.
+   boost::asio::async_connect( mSocket,
+                               endpointIterator,
+                               mStrand.wrap( boost::bind( &CHttpConnection::onConnect,
+                                                          shared_from_this(),
+                                                          mExchange,
+                                                          boost::asio::placeholders::error ) ) );
+}
+
+void CHttpConnection::onConnect( std::size_t exchange, const boost::system::error_code& error )
+{
+   if ( exchange != mExchange )
+   {
+      return;
+   }
+   if ( error )
+   {
+      complete( boost::copy_exception( boost::system::system_error( error ) ) );
+      return;
+   }
+
+   recordPhase( CNodeMetrics::PHASE_CONNECT );
+
+   boost::system::error_code ignored;
+   mSocket.set_option( tcp::no_delay( true ), ignored );
+   startWrite();
+}
+
+void CHttpConnection::startWrite( void )
+{
+   mPhaseStart = CNodeMetrics::now();
+   mIsWritten = false;
+   mIsRead = false;
+   mHasResponse = false;
+
+   if ( mRequest.bodySource )
+   {
+      // Both operations are started inside the strand, so their callbacks wait until both are started.
+      mStrand.dispatch( boost::bind( &CHttpConnection::startStreaming, shared_from_this() ) );
+      return;
+   }
+
+   // Send the request headers and body without joining them into one buffer.
+   const boost::array<boost::asio::const_buffer, 2> buffers = { {
+      boost::asio::buffer( mRequestHeaders ),
+      boost::asio::buffer( mRequest.body )
+   } };
+
+   boost::asio::async_write( mSocket,
+                             buffers,
+                             mStrand.wrap( boost::bind( &CHttpConnection::onWrite,
+                                                        shared_from_this(),
+                                                        mExchange,
+                                                        boost::asio::placeholders::error ) ) );
+}
+
+void CHttpConnection::startStreaming( void )
+{
+   // Server may answer before the whole body is sent, so response is read at the same time.
+   mChunkIndex = 0;
+   writeChunk( true );
+   startRead();
+}
+
+void CHttpConnection::writeChunk( bool isFirst )
+{
+   mChunk.clear();
+   const bool isLast = !mRequest.bodySource( mChunkIndex++, mChunk );
+
+   // Empty chunk would terminate the body, so it is skipped.
+   std::size_t chunkHeaderSize = 0;
+   if ( !mChunk.empty() )
+   {
+      chunkHeaderSize = std::snprintf( mChunkHeader,
+                                       sizeof( mChunkHeader ),
+                                       "%lx\r\n",
+                                       static_cast<unsigned long>( mChunk.size() ) );
+   }
+
+   const boost::array<boost::asio::const_buffer, 5> buffers = { {
+      isFirst ? boost::asio::buffer( mRequestHeaders ) : boost::asio::const_buffer(),
+      boost::asio::buffer( mChunkHeader, chunkHeaderSize ),
+      boost::asio::buffer( mChunk ),
+      boost::asio::buffer( CRLF, mChunk.empty() ? 0 : 2 ),
+      boost::asio::buffer( LAST_CHUNK, isLast ? sizeof( LAST_CHUNK ) - 1 : 0 )
+   } };
+
+   boost::asio::async_write( mSocket,
+                             buffers,
+                             mStrand.wrap( boost::bind( &CHttpConnection::onChunkWritten,
+                                                        shared_from_this(),
+                                                        mExchange,
+                                                        isLast,
+                                                        boost::asio::placeholders::error,
+                                                        boost::asio::placeholders::bytes_transferred ) ) );
+}
+
+void CHttpConnection::onWrite( std::size_t exchange, const boost::system::error_code& error )
+{
+   if ( exchange != mExchange )
+   {
+      return;
+   }
+   if ( error )
+   {
+      onSocketError( error );
+      return;
+   }
+   recordPhase( CNodeMetrics::PHASE_WRITE );
+   if ( mMetrics )
+   {
+      mMetrics->addBytesSent( mRequestHeaders.size() + mRequest.body.size() );
+   }
+
+   mIsWritten = true;
+   startRead();
+}
+
+void CHttpConnection::onChunkWritten( std::size_t exchange,
+                                      bool isLast,
+                                      const boost::system::error_code& error,
+                                      std::size_t size )
+{
+   if ( exchange != mExchange )
+   {
+      return;
+   }
+   if ( error )
+   {
+      onSocketError( error );
+      return;
+   }
+   if ( mMetrics )
+   {
+      mMetrics->addBytesSent( size );
+   }
+
+   if ( !isLast )
+   {
+      writeChunk( false );
+      return;
+   }
+
+   mIsWritten = true;
+   if ( mIsRead )
+   {
+      complete( boost::exception_ptr() );
+   }
+}
+
+void CHttpConnection::startRead( void )
+{
+   // Read the response status line and headers, which are terminated by a blank line.
+   boost::asio::async_read_until( mSocket,
+                                  mResponseBuffer,
+                                  CLimitedMatch( HEADERS_END, MAX_HEADERS_SIZE ),
+                                  mStrand.wrap( boost::bind( &CHttpConnection::onHeaders,
+                                                             shared_from_this(),
+                                                             mExchange,
+                                                             boost::asio::placeholders::error,
+                                                             boost::asio::placeholders::bytes_transferred ) ) );
+}
+
+void CHttpConnection::onHeaders( std::size_t exchange, const boost::system::error_code& error, std::size_t headersSize )
+{
+   if ( exchange != mExchange )
+   {
+      return;
+   }
+   if ( error )
+   {
+      onSocketError( error );
+      return;
+   }
+   mHasResponse = true;
+   if ( !isComplete( mResponseBuffer, headersSize, HEADERS_END ) )
+   {
+      complete( boost::copy_exception( std::runtime_error( "Response headers exceed the limit" ) ) );
+      return;
+   }
+   recordPhase( CNodeMetrics::PHASE_FIRST_BYTE );
+   if ( mMetrics )
+   {
+      mMetrics->addBytesReceived( headersSize );
+   }
+
+   try
+   {
+      const char* data = boost::asio::buffer_cast<const char*>( mResponseBuffer.data() );
+      parseHeaders( data, data + headersSize );
+   }
+   catch ( ... )
+   {
+      complete( boost::current_exception() );
+      return;
+   }
+
+   // Headers are not needed anymore, body starts at the beginning of the buffer.
+   mResponseBuffer.consume( headersSize );
+
+   if ( mIsChunked )
+   {
+      mChunkedBody.clear();
+      mResponse.isStreamed = ( mResponse.statusCode == 200 && mRequest.bodySink );
+      readChunkSize();
+   }
+   else if ( !mHasContentLength )
+   {
+      // Body is delimited by connection close, the buffer limit bounds it.
+      boost::asio::async_read( mSocket,
+                               mResponseBuffer,
+                               boost::asio::transfer_all(),
+                               mStrand.wrap( boost::bind( &CHttpConnection::onBody,
+                                                          shared_from_this(),
+                                                          mExchange,
+                                                          boost::asio::placeholders::error ) ) );
+   }
+   else if ( mResponseBuffer.size() < mContentLength )
+   {
+      // Read exactly Content-Length bytes, some of them may already be buffered.
+      boost::asio::async_read( mSocket,
+                               mResponseBuffer,
+                               boost::asio::transfer_exactly( mContentLength - mResponseBuffer.size() ),
+                               mStrand.wrap( boost::bind( &CHttpConnection::onBody,
+                                                          shared_from_this(),
+                                                          mExchange,
+                                                          boost::asio::placeholders::error ) ) );
+   }
+   else
+   {
+      onBody( mExchange, boost::system::error_code() );
+   }
+}
+
+void CHttpConnection::onBody( std::size_t exchange, const boost::system::error_code& error )
+{
+   if ( exchange != mExchange )
+   {
+      return;
+   }
+   if ( !mHasContentLength )
+   {
+      if ( !error || mResponseBuffer.size() > MAX_BODY_SIZE )
+      {
+         // Read of the full buffer finishes without an error.
+         complete( boost::copy_exception( std::runtime_error( "Response body exceeds the limit" ) ) );
+         return;
+      }
+      if ( error != boost::asio::error::eof )
+      {
+         complete( boost::copy_exception( boost::system::system_error( error ) ) );
+         return;
+      }
+      mContentLength = mResponseBuffer.size();
+   }
+   else if ( error )
+   {
+      complete( boost::copy_exception( boost::system::system_error( error ) ) );
+      return;
+   }
+
+   if ( mMetrics )
+   {
+      mMetrics->addBytesReceived( mContentLength );
+   }
+
+   // Body is handed to the handler right inside the receive buffer.
+   mResponse.body = boost::asio::buffer_cast<const char*>( mResponseBuffer.data() );
+   mResponse.bodySize = mContentLength;
+
+   finishResponse();
+}
+
+void CHttpConnection::readChunkSize( void )
+{
+   boost::asio::async_read_until( mSocket,
+                                  mResponseBuffer,
+                                  CLimitedMatch( CRLF, MAX_CHUNK_LINE ),
+                                  mStrand.wrap( boost::bind( &CHttpConnection::onChunkSize,
+                                                             shared_from_this(),
+                                                             mExchange,
+                                                             boost::asio::placeholders::error,
+                                                             boost::asio::placeholders::bytes_transferred ) ) );
+}
+
+void CHttpConnection::onChunkSize( std::size_t exchange, const boost::system::error_code& error, std::size_t lineSize )
+{
+   if ( exchange != mExchange )
+   {
+      return;
+   }
+   if ( error )
+   {
+      complete( boost::copy_exception( boost::system::system_error( error ) ) );
+      return;
+   }
+
+   // Size line: hexadecimal size, optionally followed by extensions after ';'.
+   const char* line = boost::asio::buffer_cast<const char*>( mResponseBuffer.data() );
+   const char* lineEnd = line + lineSize - 2;
+   mChunkSize = 0;
+   bool isValid = ( line != lineEnd && isComplete( mResponseBuffer, lineSize, CRLF ) );
+   for ( const char* digit = line; isValid && digit != lineEnd && *digit != ';'; ++digit )
+   {
+      const int value = std::isxdigit( static_cast<unsigned char>( *digit ) )
+                        ? ( std::isdigit( static_cast<unsigned char>( *digit ) )
+                            ? *digit - '0'
+                            : std::tolower( static_cast<unsigned char>( *digit ) ) - 'a' + 10 )
+                        : -1;
+      isValid = ( value >= 0 && mChunkSize <= ( MAX_BODY_SIZE - value ) / 16 );
+      mChunkSize = mChunkSize * 16 + value;
+   }
+   if ( !isValid )
+   {
+      complete( boost::copy_exception( std::runtime_error( "Invalid chunk size" ) ) );
+      return;
+   }
+   if ( !mResponse.isStreamed && mChunkedBody.size() + mChunkSize > MAX_BODY_SIZE )
+   {
+      complete( boost::copy_exception( std::runtime_error( "Chunked response body exceeds the limit" ) ) );
+      return;
+   }
+   mResponseBuffer.consume( lineSize );
+   if ( mMetrics )
+   {
+      mMetrics->addBytesReceived( lineSize );
+   }
+
+   if ( mChunkSize == 0 )
+   {
+      readTrailer();
+   }
+   else if ( mResponseBuffer.size() < mChunkSize + 2 )
+   {
+      // Chunk data is followed by CRLF, some of them may already be buffered.
+      boost::asio::async_read( mSocket,
+                               mResponseBuffer,
+                               boost::asio::transfer_exactly( mChunkSize + 2 - mResponseBuffer.size() ),
+                               mStrand.wrap( boost::bind( &CHttpConnection::onChunkData,
+                                                          shared_from_this(),
+                                                          mExchange,
+                                                          boost::asio::placeholders::error ) ) );
+   }
+   else
+   {
+      onChunkData( mExchange, boost::system::error_code() );
+   }
+}
+
+void CHttpConnection::onChunkData( std::size_t exchange, const boost::system::error_code& error )
+{
+   if ( exchange != mExchange )
+   {
+      return;
+   }
+   if ( error )
+   {
+      complete( boost::copy_exception( boost::system::system_error( error ) ) );
+      return;
+   }
+
+   const char* data = boost::asio::buffer_cast<const char*>( mResponseBuffer.data() );
+   if ( std::memcmp( data + mChunkSize, CRLF, 2 ) != 0 )
+   {
+      complete( boost::copy_exception( std::runtime_error( "Invalid chunk" ) ) );
+      return;
+   }
+
+   // Chunk is passed on right from the receive buffer, so only one chunk is buffered at a time.
+   if ( mResponse.isStreamed )
+   {
+      mRequest.bodySink( data, mChunkSize );
+   }
+   else
+   {
+      mChunkedBody.append( data, mChunkSize );
+   }
+   mResponseBuffer.consume( mChunkSize + 2 );
+   if ( mMetrics )
+   {
+      mMetrics->addBytesReceived( mChunkSize + 2 );
+   }
+
+   readChunkSize();
+}
+
+void CHttpConnection::readTrailer( void )
+{
+   boost::asio::async_read_until( mSocket,
+                                  mResponseBuffer,
+                                  CLimitedMatch( CRLF, MAX_HEADERS_SIZE ),
+                                  mStrand.wrap( boost::bind( &CHttpConnection::onTrailer,
+                                                             shared_from_this(),
+                                                             mExchange,
+                                                             boost::asio::placeholders::error,
+                                                             boost::asio::placeholders::bytes_transferred ) ) );
+}
+
+void CHttpConnection::onTrailer( std::size_t exchange, const boost::system::error_code& error, std::size_t lineSize )
+{
+   if ( exchange != mExchange )
+   {
+      return;
+   }
+   if ( error )
+   {
+      complete( boost::copy_exception( boost::system::system_error( error ) ) );
+      return;
+   }
+
+   if ( !isComplete( mResponseBuffer, lineSize, CRLF ) )
+   {
+      complete( boost::copy_exception( std::runtime_error( "Response trailer exceeds the limit" ) ) );
+      return;
+   }
+
+   // Trailer fields are not used, the blank line finishes the body.
+   mResponseBuffer.consume( lineSize );
+   if ( lineSize > 2 )
+   {
+      readTrailer();
+      return;
+   }
+
+   mResponse.body = mResponse.isStreamed ? 0 : mChunkedBody.data();
+   mResponse.bodySize = mResponse.isStreamed ? 0 : mChunkedBody.size();
+   finishResponse();
+}
+
+void CHttpConnection::finishResponse( void )
+{
+   recordPhase( CNodeMetrics::PHASE_BODY );
+   mReused = true;
+   mIsRead = true;
+
+   if ( !mIsWritten )
+   {
+      if ( mResponse.statusCode == 200 )
+      {
+         // Exchange finishes when the rest of the request is sent.
+         return;
+      }
+      // Server has rejected request without reading it, the rest of it can not be sent anymore.
+      mKeepAlive = false;
+   }
+
+   complete( boost::exception_ptr() );
+}
+
+void CHttpConnection::onSocketError( const boost::system::error_code& error )
+{
+   if ( mReused && !mRetried && !mHasResponse && mResponseBuffer.size() == 0 )
+   {
+      // Server has dropped idle connection. Reconnect and try once again.
+      ++mExchange;
+      close();
+      mRetried = true;
+      if ( mMetrics )
+      {
+         mMetrics->addRetry();
+      }
+      startConnect();
+      return;
+   }
+
+   complete( boost::copy_exception( boost::system::system_error( error ) ) );
+}
+
+/**
+ * @brief Compare header name ignoring case
+ * @param begin - header name begin
+ * @param end - header name end
+ * @param name - lowercase name to compare with
+ * @return True - if names are equal, false - otherwise
+ */
+static bool isHeader( const char* begin, const char* end, const char* name )
+{
+   for ( ; begin != end; ++begin, ++name )
+   {
+      if ( *name == '\0' || std::tolower( static_cast<unsigned char>( *begin ) ) != *name )
+      {
+         return false;
+      }
+   }
+   return *name == '\0';
+}
+
+/**
+ * @brief Compare header value ignoring case
+ * @param begin - header value begin
+ * @param end - header value end
+ * @param value - lowercase value to compare with
+ * @return True - if values are equal, false - otherwise
+ */
+static bool isValue( const char* begin, const char* end, const char* value )
+{
+   return isHeader( begin, end, value );
+}
+
+void CHttpConnection::parseHeaders( const char* begin, const char* end )
+{
+   // Status line: "HTTP/x.y code message"
+   const char* lineEnd = std::search( begin, end, CRLF, CRLF + 2 );
+   if ( lineEnd - begin < 12 || std::memcmp( begin, "HTTP/", 5 ) != 0 || begin[8] != ' ' )
+   {
+      throw std::runtime_error( "Invalid HTTP response" );
+   }
+
+   mResponse.statusCode = 0;
+   for ( const char* digit = begin + 9; digit != begin + 12; ++digit )
+   {
+      if ( *digit < '0' || *digit > '9' )
+      {
+         throw std::runtime_error( "Invalid HTTP response" );
+      }
+      mResponse.statusCode = mResponse.statusCode * 10 + ( *digit - '0' );
+   }
+
+   mKeepAlive = ( std::memcmp( begin + 5, "1.0", 3 ) != 0 );
+   mHasContentLength = false;
+   mContentLength = 0;
+   mIsChunked = false;
+   mResponse.contentType.clear();
+   mResponse.body = 0;
+   mResponse.bodySize = 0;
+   mResponse.isStreamed = false;
+
+   for ( const char* line = lineEnd + 2; line < end; line = lineEnd + 2 )
+   {
+      lineEnd = std::search( line, end, CRLF, CRLF + 2 );
+      const char* colon = std::find( line, lineEnd, ':' );
+      if ( colon == lineEnd )
+      {
+         continue;
+      }
+
+      const char* value = colon + 1;
+      const char* valueEnd = lineEnd;
+      while ( value != valueEnd && ( *value == ' ' || *value == '\t' ) )
+      {
+         ++value;
+      }
+      while ( valueEnd != value && ( valueEnd[-1] == ' ' || valueEnd[-1] == '\t' ) )
+      {
+         --valueEnd;
+      }
+
+      if ( isHeader( line, colon, "content-length" ) )
+      {
+         if ( value == valueEnd )
+         {
+            throw std::runtime_error( "Invalid Content-Length header" );
+         }
+         for ( ; value != valueEnd; ++value )
+         {
+            if ( *value < '0' || *value > '9' )
+            {
+               throw std::runtime_error( "Invalid Content-Length header" );
+            }
+            // Checked before it overflows, so that hostile length does not make the buffer grow unbounded.
+            const std::size_t digit = static_cast<std::size_t>( *value - '0' );
+            if ( mContentLength > ( MAX_BODY_SIZE - digit ) / 10 )
+            {
+               throw std::runtime_error( "Content-Length header exceeds the limit" );
+            }
+            mContentLength = mContentLength * 10 + digit;
+         }
+         mHasContentLength = true;
+      }
+      else if ( isHeader( line, colon, "content-type" ) )
+      {
+         mResponse.contentType.assign( value, valueEnd );
+      }
+      else if ( isHeader( line, colon, "connection" ) )
+      {
+         mKeepAlive = !isValue( value, valueEnd, "close" );
+      }
+      else if ( isHeader( line, colon, "transfer-encoding" ) )
+      {
+         mIsChunked = isValue( value, valueEnd, "chunked" );
+         if ( !mIsChunked && !isValue( value, valueEnd, "identity" ) )
+         {
+            throw std::runtime_error( "Unsupported transfer encoding: " + std::string( value, valueEnd ) );
+         }
+      }
+   }
+
+   if ( mIsChunked )
+   {
+      // Chunked coding takes precedence over Content-Length.
+      mHasContentLength = false;
+   }
+   else if ( !mHasContentLength )
+   {
+      mKeepAlive = false;
+   }
+}
+
+void CHttpConnection::complete( const boost::exception_ptr& error )
+{
+   // Callbacks of operations which are still in flight belong to the finished exchange now.
+   ++mExchange;
+
+   if ( mCancelToken )
+   {
+      mCancelToken->unsubscribe( mCancelId );
+      mCancelToken.reset();
+      mCancelId = 0;
+   }
+
+   ResponseHandler handler;
+   handler.swap( mHandler );
+   mResponse.requestBody = &mRequest.body;
+
+   if ( error )
+   {
+      mResponse.body = 0;
+      mResponse.bodySize = 0;
+      mResponse.isStreamed = false;
+   }
+
+   if ( mMetrics && ( error || mResponse.statusCode != 200 ) )
+   {
+      mMetrics->addError();
+   }
+
+   handler( error, mResponse );
+
+   // Body was parsed in place, so the buffer is released only after handler.
+   if ( error )
+   {
+      close();
+   }
+   else
+   {
+      if ( !mIsChunked )
+      {
+         mResponseBuffer.consume( mResponse.bodySize );
+      }
+      if ( !mKeepAlive )
+      {
+         close();
+      }
+   }
+
+   // Source and sink may hold the caller state, which is not needed anymore.
+   mRequest.bodySource.clear();
+   mRequest.bodySink.clear();
+
+   if ( mReleased )
+   {
+      mReleased( shared_from_this() );
+   }
+}
+
+void CHttpConnection::takeRequestBody( std::string& body )
+{
+   mRequest.body.swap( body );
+   body.clear();
+}
+void CHttpConnection::recordPhase( CNodeMetrics::Phase phase )
+{
+   if ( mMetrics )
+   {
+      mPhaseStart = mMetrics->record( phase, mPhaseStart );
+   }
+}
+/** @}*/
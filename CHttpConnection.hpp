@@ -0,0 +1,315 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CHttpConnection.hpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CHttpConnection class declaration
+ ************************************************************************/
+#ifndef CHTTPCONNECTION_HPP
+#define CHTTPCONNECTION_HPP
+
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include <string>
+
+#include <boost/asio.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/exception_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include "CCancelToken.hpp"
+#include "CNodeMetrics.hpp"
+
+/**
+ * @brief POST request to the remote service
+ */
+struct HttpRequest
+{
+   /**
+    * @brief Producer of the body sent with chunked transfer coding. \n
+    * It appends chunk with the given index to the buffer and returns \n
+    * false for the last one. If request is resent, chunks start over from 0.
+    */
+   typedef boost::function<bool( std::size_t index, std::string& chunk )> BodySource;
+
+   /**
+    * @brief Consumer of the chunked response body, receives its pieces as they arrive
+    */
+   typedef boost::function<void( const char* data, std::size_t size )> BodySink;
+
+   HttpRequest( void )
+      : uri( "/" )
+      , contentType( "" )
+      , accept( "" )
+      , body()
+      , bodySource()
+      , bodySink()
+      , cancelToken()
+   {
+
+   }
+
+   const char* uri;           ///< URI of remote REST method, static string
+   const char* contentType;   ///< Request body content type, static string
+   const char* accept;        ///< Acceptable response content types, static string
+   std::string body;          ///< Request body
+   BodySource bodySource;     ///< Produces body in chunks instead of the body string, may be empty
+   BodySink bodySink;         ///< Receives body of successful chunked response, empty - body is collected
+   CancelTokenPtr cancelToken;///< Aborts the exchange when cancelled, may be null
+};
+
+/**
+ * @brief Response of the remote service
+ */
+struct HttpResponse
+{
+   unsigned int statusCode;   ///< HTTP status code
+   std::string contentType;   ///< Value of Content-Type header
+   const char* body;          ///< Response body inside the receive buffer
+   std::size_t bodySize;      ///< Response body size
+   bool isStreamed;           ///< Whether body was passed to the body sink instead
+   const std::string* requestBody; ///< Body of the answered request
+};
+
+/**
+ * @brief This class represents single persistent HTTP/1.1 \n
+ * keep-alive connection to the remote service. \n
+ * Connection performs one request/response exchange at a time \n
+ * and never blocks the calling thread. \n
+ * Body may be sent and received with chunked transfer coding, \n
+ * then the response is read while the request is still being sent. \n
+ * Exchange of the request with cancel token is aborted when the token \n
+ * is cancelled: socket is closed and handler gets CCancelledError.
+ */
+class CHttpConnection : public boost::enable_shared_from_this<CHttpConnection>
+                      , private boost::noncopyable
+{
+public:
+   /**
+    * @brief Exchange completion callback type. \n
+    * Error is null if response was received. Response body points \n
+    * into the connection buffer and, as well as the request body, \n
+    * is valid only during the call.
+    */
+   typedef boost::function<void( const boost::exception_ptr& error,
+                                 const HttpResponse& response )> ResponseHandler;
+
+   /**
+    * @brief Callback which is called after every exchange, \n
+    * when connection is ready for the next request
+    */
+   typedef boost::function<void( const boost::shared_ptr<CHttpConnection>& connection )> ReleaseHandler;
+
+   /**
+    * @brief Constructor. Connection is not established until first request.
+    * @param service - io_service which drives socket operations
+    * @param host - remote service host name
+    * @param port - remote service port
+    * @param metrics - metrics which receive phase durations and traffic counters, may be null
+    * @param released - called after every exchange, may be empty
+    */
+   CHttpConnection( boost::asio::io_service& service,
+                    const std::string& host,
+                    const std::string& port,
+                    const boost::shared_ptr<CNodeMetrics>& metrics = boost::shared_ptr<CNodeMetrics>(),
+                    const ReleaseHandler& released = ReleaseHandler() );
+
+   /**
+    * @brief Destructor. Closes connection.
+    */
+   ~CHttpConnection( void );
+
+   /**
+    * @brief Check whether connection is established
+    * @return True - if socket is open, false - otherwise
+    */
+   bool isOpen( void ) const;
+
+   /**
+    * @brief Close connection. It will be reestablished on next request.
+    */
+   void close( void );
+
+   /**
+    * @brief Asynchronously send POST request and read response. \n
+    * Response body is delimited by Content-Length header, so connection \n
+    * stays open for the next request unless server asks to close it. \n
+    * If reused connection turns out to be closed by the server, \n
+    * it is reestablished and request is sent again. \n
+    * Request is started inside the strand, so that it never races late callbacks of the previous one \n
+    * or its own cancellation.
+    * @param request - request to send, moved into the connection
+    * @param handler - completion callback, called from the io_service thread
+    */
+   void asyncPost( HttpRequest& request, ResponseHandler& handler );
+
+   /**
+    * @brief Take body of the finished request, so that its memory may be reused
+    * @param[out] body - swapped with the request body
+    */
+   void takeRequestBody( std::string& body );
+
+private:
+   /**
+    * @brief Request and its callback handed over to the strand
+    */
+   struct PostedRequest
+   {
+      HttpRequest request;       ///< Request to send
+      ResponseHandler handler;   ///< Completion callback
+   };
+
+   /**
+    * @brief Take the posted request as the current one and start its exchange. Runs in the strand.
+    * @param posted - posted request
+    */
+   void startPost( const boost::shared_ptr<PostedRequest>& posted );
+
+   /**
+    * @brief Subscribe to the cancel token and start sending request
+    */
+   void startExchange( void );
+
+   /**
+    * @brief Cancel token callback. Hands cancellation over to the strand.
+    * @param connection - connection of the exchange
+    * @param requestId - number of the cancelled request
+    * @param token - cancelled token
+    */
+   static void onCancelRequested( const boost::weak_ptr<CHttpConnection>& connection,
+                                  std::size_t requestId,
+                                  const CancelTokenPtr& token );
+
+   /**
+    * @brief Abort exchange of the cancelled request, if it is still in flight
+    * @param requestId - number of the cancelled request
+    * @param token - cancelled token
+    */
+   void onCancelled( std::size_t requestId, const CancelTokenPtr& token );
+
+   /**
+    * @brief Resolve host name and establish connection
+    */
+   void startConnect( void );
+
+   /**
+    * @brief Send request over opened socket
+    */
+   void startWrite( void );
+
+   /**
+    * @brief Start sending chunked request body and reading response at the same time
+    */
+   void startStreaming( void );
+
+   /**
+    * @brief Send next chunk of the request body
+    * @param isFirst - whether headers should be sent before the chunk
+    */
+   void writeChunk( bool isFirst );
+
+   /**
+    * @brief Start reading response
+    */
+   void startRead( void );
+
+   /**
+    * @brief Start reading size line of the next response chunk
+    */
+   void readChunkSize( void );
+
+   /**
+    * @brief Start reading line of the response trailer
+    */
+   void readTrailer( void );
+
+   // Socket callbacks. Exchange is the number of the exchange
+   // which started operation, callbacks of finished exchanges are ignored.
+   void onResolve( std::size_t exchange,
+                   const boost::system::error_code& error,
+                   boost::asio::ip::tcp::resolver::iterator endpointIterator );
+   void onConnect( std::size_t exchange, const boost::system::error_code& error );
+   void onWrite( std::size_t exchange, const boost::system::error_code& error );
+   void onChunkWritten( std::size_t exchange, bool isLast, const boost::system::error_code& error, std::size_t size );
+   void onHeaders( std::size_t exchange, const boost::system::error_code& error, std::size_t headersSize );
+   void onBody( std::size_t exchange, const boost::system::error_code& error );
+   void onChunkSize( std::size_t exchange, const boost::system::error_code& error, std::size_t lineSize );
+   void onChunkData( std::size_t exchange, const boost::system::error_code& error );
+   void onTrailer( std::size_t exchange, const boost::system::error_code& error, std::size_t lineSize );
+
+   /**
+    * @brief Handle fully received response. \n
+    * Exchange is finished when request is sent as well, unless \n
+    * server has already rejected it.
+    */
+   void finishResponse( void );
+
+   /**
+    * @brief Handle failure of socket operation. \n
+    * If nothing was received over reused connection, it is considered \n
+    * dropped by the server and the request is resent over the new one.
+    * @param error - socket operation error
+    */
+   void onSocketError( const boost::system::error_code& error );
+
+   /**
+    * @brief Parse status line and headers right inside the response buffer
+    * @param begin - status line begin
+    * @param end - end of the blank line which terminates headers
+    */
+   void parseHeaders( const char* begin, const char* end );
+
+   /**
+    * @brief Finish exchange and call completion handler
+    * @param error - exchange error or null on success
+    */
+   void complete( const boost::exception_ptr& error );
+
+   /**
+    * @brief Record finished phase and start the next one
+    * @param phase - finished phase
+    */
+   void recordPhase( CNodeMetrics::Phase phase );
+
+private:
+   std::string mHost;                              ///< Remote service host name
+   std::string mPort;                              ///< Remote service port
+   boost::asio::ip::tcp::resolver mResolver;       ///< Host name resolver
+   boost::asio::ip::tcp::socket mSocket;           ///< Connection socket
+   boost::asio::io_service::strand mStrand;        ///< Serializes callbacks of simultaneous read and write
+   boost::asio::streambuf mResponseBuffer;         ///< Buffer for incoming data
+   bool mReused;                                   ///< Whether connection has already served a request
+   bool mRetried;                                  ///< Whether current request was already resent
+
+   std::string mRequestHeaders;                    ///< Serialized headers of current request
+   HttpRequest mRequest;                           ///< Current request
+   ResponseHandler mHandler;                       ///< Completion callback of current request
+   ReleaseHandler mReleased;                       ///< Called when current request is finished
+   HttpResponse mResponse;                         ///< Response of current request
+   bool mKeepAlive;                                ///< Whether server allows to reuse connection
+   bool mHasContentLength;                         ///< Whether response body is delimited by Content-Length
+   std::size_t mContentLength;                     ///< Length of response body
+   bool mIsChunked;                                ///< Whether response body uses chunked transfer coding
+   std::size_t mChunkSize;                         ///< Size of response chunk being read
+   std::string mChunkedBody;                       ///< Collected chunked response body
+   std::size_t mChunkIndex;                        ///< Index of the next request chunk
+   std::string mChunk;                             ///< Request chunk being sent
+   char mChunkHeader[24];                          ///< Size line of request chunk being sent
+   std::size_t mExchange;                          ///< Number of the current exchange
+   std::size_t mRequestId;                         ///< Number of the current request, kept when it is resent
+   bool mIsWritten;                                ///< Whether request is completely sent
+   bool mIsRead;                                   ///< Whether response is completely received
+   bool mHasResponse;                              ///< Whether response headers are received
+   CancelTokenPtr mCancelToken;                    ///< Cancel token of current request, may be null
+   std::size_t mCancelId;                          ///< Subscription to the cancel token
+
+   boost::shared_ptr<CNodeMetrics> mMetrics;       ///< Remote service metrics, may be null
+   boost::posix_time::ptime mPhaseStart;           ///< Start time of the current phase
+};
+/** @}*/
+#endif // CHTTPCONNECTION_HPP
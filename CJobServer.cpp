@@ -0,0 +1,501 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CJobServer.cpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CJobServer class definition
+ ************************************************************************/
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include "CJobServer.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <istream>
+#include <stdexcept>
+
+#include <sys/stat.h>
+
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <jsoncpp/include/json/json.h>
+
+using boost::asio::local::stream_protocol;
+
+const std::size_t CJobServer::DEFAULT_JOBS_COUNT;
+
+/**
+ * @brief Remove socket file left by the server which was not stopped properly
+ * @param path - socket path
+ * @throw std::runtime_error - if path is not a socket or it is not stale
+ */
+static void removeStaleSocket( const std::string& path )
+{
+   struct stat info;
+   if ( ::lstat( path.c_str(), &info ) != 0 )
+   {
+      return;
+   }
+   if ( !S_ISSOCK( info.st_mode ) )
+   {
+      throw std::runtime_error( "Path " + path + " exists and is not a socket" );
+   }
+
+   // Only the socket nobody listens on is stale, a running server keeps its socket.
+   boost::asio::io_service service;
+   stream_protocol::socket probe( service );
+   boost::system::error_code error;
+   probe.connect( stream_protocol::endpoint( path ), error );
+   if ( !error )
+   {
+      throw std::runtime_error( "Another server is listening on " + path );
+   }
+   if ( error != boost::asio::error::connection_refused )
+   {
+      throw std::runtime_error( "Can not check socket " + path + ": " + error.message() );
+   }
+
+   std::remove( path.c_str() );
+}
+
+/**
+ * @brief Read path field of the job request
+ * @param request - job request
+ * @param name - field name
+ * @param[out] path - field value
+ * @param[out] error - description of the problem
+ * @return True - if field is a non-empty string, false - otherwise
+ */
+static bool readPath( const Json::Value& request, const char* name, std::string& path, std::string& error )
+{
+   const Json::Value& value = request[name];
+   if ( !value.isString() || value.asString().empty() )
+   {
+      error = std::string( "Job request requires \"" ) + name + "\" path";
+      return false;
+   }
+   path = value.asString();
+   return true;
+}
+
+/**
+ * @brief Read optional flag field of the job request
+ * @param request - job request
+ * @param name - field name
+ * @param[out] flag - field value, kept if field is absent
+ * @param[out] error - description of the problem
+ * @return True - if field is absent or boolean, false - otherwise
+ */
+static bool readFlag( const Json::Value& request, const char* name, bool& flag, std::string& error )
+{
+   const Json::Value& value = request[name];
+   if ( value.isNull() )
+   {
+      return true;
+   }
+   if ( !value.isBool() )
+   {
+      error = std::string( "Job request field \"" ) + name + "\" must be boolean";
+      return false;
+   }
+   flag = value.asBool();
+   return true;
+}
+
+/**
+ * @brief Fill job from the request line
+ * @param line - JSON object
+ * @param[out] job - job to fill
+ * @param[out] error - description of the problem
+ * @return True - if request is well formed, false - otherwise
+ */
+static bool parseJob( const std::string& line, CJobServer::Job& job, std::string& error )
+{
+   Json::Reader reader;
+   Json::Value request;
+   if ( !reader.parse( line, request ) || !request.isObject() )
+   {
+      error = "Job request is not a JSON object";
+      return false;
+   }
+
+   const Json::Value& mode = request["mode"];
+   if ( !mode.isNull() )
+   {
+      if ( !mode.isString() )
+      {
+         error = "Job request field \"mode\" must be a string";
+         return false;
+      }
+      job.mode = mode.asString();
+   }
+
+   return readPath( request, "matrixA", job.matrixAFile, error )
+          && readPath( request, "matrixB", job.matrixBFile, error )
+          && readPath( request, "output", job.matrixCFile, error )
+          && readFlag( request, "rbin", job.isConsumeBinary, error )
+          && readFlag( request, "otxt", job.isTxtOutput, error )
+          && readFlag( request, "mmap", job.isMapped, error )
+          && readFlag( request, "pipeline", job.isPipelined, error );
+}
+
+/**
+ * @brief Serialize answer to the client
+ * @param id - job id, 0 if job was not accepted
+ * @param status - job status
+ * @param error - error description, empty if none
+ * @param seconds - job duration, negative if job is not over
+ * @return JSON object followed by a new line
+ */
+static std::string formatAnswer( std::size_t id, const char* status, const std::string& error, double seconds )
+{
+   Json::Value answer( Json::objectValue );
+   if ( id > 0 )
+   {
+      answer["id"] = static_cast<Json::UInt64>( id );
+   }
+   answer["status"] = status;
+   if ( seconds >= 0.0 )
+   {
+      answer["seconds"] = seconds;
+   }
+   if ( !error.empty() )
+   {
+      answer["error"] = error;
+   }
+   return Json::FastWriter().write( answer );
+}
+
+/**
+ * @brief Job waiting for a job thread
+ */
+struct CJobServer::Entry
+{
+   Job job;                               ///< Submitted job
+   boost::shared_ptr<CSession> session;   ///< Client which submitted the job
+};
+
+/**
+ * @brief State shared between the server, client sessions and job threads
+ */
+struct CJobServer::State
+{
+   State( const CNodeDispatcher& dispatcher_, const Runner& runner_ )
+      : dispatcher( dispatcher_ )
+      , runner( runner_ )
+      , queue()
+      , lastId( 0 )
+      , finishedCount( 0 )
+      , failedCount( 0 )
+      , isStopped( false )
+      , guard()
+      , queueCondition()
+   {
+
+   }
+
+   CNodeDispatcher dispatcher;               ///< Dispatcher from which job dispatchers are made
+   Runner runner;                            ///< Job body
+   std::deque<Entry> queue;                  ///< Jobs waiting for a job thread
+   std::size_t lastId;                       ///< Id of the last submitted job
+   std::size_t finishedCount;                ///< Number of successful jobs
+   std::size_t failedCount;                  ///< Number of failed jobs
+   bool isStopped;                           ///< Whether server is stopped
+   boost::mutex guard;                       ///< Mutex for the queue and counters
+   boost::condition_variable queueCondition; ///< Wakes up job threads
+};
+
+/**
+ * @brief Single client connection of the job server
+ */
+class CJobServer::CSession : public boost::enable_shared_from_this<CJobServer::CSession>
+                           , private boost::noncopyable
+{
+public:
+   CSession( boost::asio::io_service& service, const boost::shared_ptr<State>& state )
+      : mSocket( service )
+      , mStrand( service )
+      , mState( state )
+      , mBuffer()
+      , mOutput()
+   {
+
+   }
+
+   stream_protocol::socket& getSocket( void )
+   {
+      return mSocket;
+   }
+
+   void start( void )
+   {
+      read();
+   }
+
+   /**
+    * @brief Send answer to the client. May be called from any thread.
+    * @param answer - serialized answer
+    */
+   void send( const std::string& answer )
+   {
+      mStrand.dispatch( boost::bind( &CSession::write, shared_from_this(), answer ) );
+   }
+
+private:
+   void read( void )
+   {
+      boost::asio::async_read_until( mSocket,
+                                     mBuffer,
+                                     '\n',
+                                     mStrand.wrap( boost::bind( &CSession::onRead,
+                                                                shared_from_this(),
+                                                                boost::asio::placeholders::error ) ) );
+   }
+
+   void onRead( const boost::system::error_code& error )
+   {
+      if ( error )
+      {
+         // Client is gone, its running jobs are finished anyway.
+         return;
+      }
+
+      std::istream stream( &mBuffer );
+      std::string line;
+      std::getline( stream, line );
+      if ( !line.empty() && line[line.size() - 1] == '\r' )
+      {
+         line.erase( line.size() - 1 );
+      }
+
+      if ( !line.empty() )
+      {
+         Job job;
+         std::string problem;
+         if ( !parseJob( line, job, problem ) )
+         {
+            write( formatAnswer( 0, "failed", problem, -1.0 ) );
+         }
+         else if ( !CJobServer::submit( mState, job, shared_from_this() ) )
+         {
+            write( formatAnswer( 0, "failed", "Server is stopping", -1.0 ) );
+         }
+         else
+         {
+            // Job thread may answer first only after this handler returns, as it goes through the strand too.
+            write( formatAnswer( job.id, "accepted", std::string(), -1.0 ) );
+         }
+      }
+
+      read();
+   }
+
+   void write( const std::string& answer )
+   {
+      mOutput.push_back( answer );
+      if ( mOutput.size() == 1 )
+      {
+         writeNext();
+      }
+   }
+
+   void writeNext( void )
+   {
+      boost::asio::async_write( mSocket,
+                                boost::asio::buffer( mOutput.front() ),
+                                mStrand.wrap( boost::bind( &CSession::onWrite,
+                                                           shared_from_this(),
+                                                           boost::asio::placeholders::error ) ) );
+   }
+
+   void onWrite( const boost::system::error_code& error )
+   {
+      mOutput.pop_front();
+      if ( error )
+      {
+         mOutput.clear();
+         return;
+      }
+      if ( !mOutput.empty() )
+      {
+         writeNext();
+      }
+   }
+
+private:
+   stream_protocol::socket mSocket;             ///< Client socket
+   boost::asio::io_service::strand mStrand;     ///< Serializes reads and answers of job threads
+   boost::shared_ptr<State> mState;             ///< Server state
+   boost::asio::streambuf mBuffer;              ///< Buffer for incoming requests
+   std::deque<std::string> mOutput;             ///< Answers being written, the first one is in progress
+};
+
+CJobServer::CJobServer( boost::asio::io_service& service,
+                        const std::string& socketPath,
+                        const CNodeDispatcher& dispatcher,
+                        const Runner& runner,
+                        std::size_t jobsCount )
+   : mService( service )
+   , mSocketPath( socketPath )
+   , mAcceptor( service )
+   , mState( new State( dispatcher, runner ) )
+   , mThreads()
+{
+   // Socket file of the server which was not stopped properly would fail bind.
+   removeStaleSocket( mSocketPath );
+
+   const stream_protocol::endpoint endpoint( mSocketPath );
+   mAcceptor.open( endpoint.protocol() );
+   mAcceptor.bind( endpoint );
+   mAcceptor.listen();
+
+   for ( std::size_t i = 0; i < std::max<std::size_t>( jobsCount, 1 ); ++i )
+   {
+      mThreads.create_thread( boost::bind( &CJobServer::runJobs, mState ) );
+   }
+
+   startAccept();
+}
+
+CJobServer::~CJobServer( void )
+{
+   stop();
+}
+
+void CJobServer::stop( void )
+{
+   std::deque<Entry> waiting;
+   {
+      boost::lock_guard<boost::mutex> lock( mState->guard );
+      mState->isStopped = true;
+      waiting.swap( mState->queue );
+   }
+   mState->queueCondition.notify_all();
+
+   for ( std::deque<Entry>::iterator it = waiting.begin(); it != waiting.end(); ++it )
+   {
+      it->session->send( formatAnswer( it->job.id, "failed", "Server is stopping", -1.0 ) );
+   }
+
+   boost::system::error_code ignored;
+   mAcceptor.close( ignored );
+   mThreads.join_all();
+   std::remove( mSocketPath.c_str() );
+}
+
+std::size_t CJobServer::getFinishedCount( void ) const
+{
+   boost::lock_guard<boost::mutex> lock( mState->guard );
+   return mState->finishedCount;
+}
+
+std::size_t CJobServer::getFailedCount( void ) const
+{
+   boost::lock_guard<boost::mutex> lock( mState->guard );
+   return mState->failedCount;
+}
+
+void CJobServer::startAccept( void )
+{
+   boost::shared_ptr<CSession> session( new CSession( mService, mState ) );
+   mAcceptor.async_accept( session->getSocket(),
+                           boost::bind( &CJobServer::onAccept,
+                                        this,
+                                        session,
+                                        boost::asio::placeholders::error ) );
+}
+
+void CJobServer::onAccept( const boost::shared_ptr<CSession>& session,
+                           const boost::system::error_code& error )
+{
+   if ( error )
+   {
+      // Acceptor was closed.
+      return;
+   }
+
+   session->start();
+   startAccept();
+}
+
+bool CJobServer::submit( const boost::shared_ptr<State>& state,
+                         Job& job,
+                         const boost::shared_ptr<CSession>& session )
+{
+   {
+      boost::lock_guard<boost::mutex> lock( state->guard );
+      if ( state->isStopped )
+      {
+         return false;
+      }
+      job.id = ++state->lastId;
+      state->queue.push_back( Entry() );
+      state->queue.back().job = job;
+      state->queue.back().session = session;
+   }
+   state->queueCondition.notify_one();
+   return true;
+}
+
+void CJobServer::runJobs( const boost::shared_ptr<State>& state )
+{
+   for ( ;; )
+   {
+      Entry entry;
+      {
+         boost::unique_lock<boost::mutex> lock( state->guard );
+         while ( state->queue.empty() && !state->isStopped )
+         {
+            state->queueCondition.wait( lock );
+         }
+         if ( state->queue.empty() )
+         {
+            return;
+         }
+         entry = state->queue.front();
+         state->queue.pop_front();
+      }
+
+      const Job& job = entry.job;
+      std::cout << "Job " << job.id << " was started: " << job.mode << " " << job.matrixAFile
+                << " " << job.matrixBFile << " -> " << job.matrixCFile << std::endl;
+
+      const boost::posix_time::ptime startTime = boost::posix_time::microsec_clock::universal_time();
+      std::string error;
+      try
+      {
+         // Nodes, connections and cache stay warm between jobs, node calls of running jobs are sent in turn.
+         state->runner( job, state->dispatcher.createJobDispatcher() );
+      }
+      catch ( const std::exception& e )
+      {
+         error = e.what();
+         if ( error.empty() )
+         {
+            error = "Unknown error";
+         }
+      }
+      catch ( ... )
+      {
+         error = "Unknown error";
+      }
+      const double seconds = static_cast<double>( ( boost::posix_time::microsec_clock::universal_time()
+                                                    - startTime ).total_microseconds() ) / 1e6;
+
+      {
+         boost::lock_guard<boost::mutex> lock( state->guard );
+         ++( error.empty() ? state->finishedCount : state->failedCount );
+      }
+
+      std::cout << "Job " << job.id << ( error.empty() ? " was finished successfully" : " was finished with error: " )
+                << error << std::endl;
+      entry.session->send( formatAnswer( job.id, error.empty() ? "finished" : "failed", error, seconds ) );
+   }
+}
+/** @}*/
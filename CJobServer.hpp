@@ -0,0 +1,163 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CJobServer.hpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CJobServer class declaration
+ ************************************************************************/
+#ifndef CJOBSERVER_HPP
+#define CJOBSERVER_HPP
+
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include <string>
+
+#include "CNodeDispatcher.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+/**
+ * @brief This class keeps the scheduler resident and runs jobs submitted \n
+ * over a Unix domain socket. Client writes one JSON object per line: \n
+ * {"matrixA": path, "matrixB": path, "output": path, "mode": "sandbox" or "gemm", \n
+ * "rbin": bool, "otxt": bool, "mmap": bool, "pipeline": bool}, where keys have \n
+ * the meaning of command line options and only the paths are required. \n
+ * Server answers {"id": N, "status": "accepted"} at once, and \n
+ * {"id": N, "status": "finished" or "failed", "seconds": S, "error": text} \n
+ * when the job is over. Several jobs run at the same time, each with \n
+ * its own job dispatcher, so that they share nodes, connections and the \n
+ * result cache, and their node calls are sent in turn.
+ * @sa CNodeDispatcher::createJobDispatcher()
+ */
+class CJobServer : private boost::noncopyable
+{
+public:
+   /**
+    * @brief Submitted job
+    */
+   struct Job
+   {
+      Job( void )
+         : id( 0 )
+         , mode( "sandbox" )
+         , matrixAFile()
+         , matrixBFile()
+         , matrixCFile()
+         , isConsumeBinary( false )
+         , isTxtOutput( false )
+         , isMapped( false )
+         , isPipelined( false )
+      {
+
+      }
+
+      std::size_t id;            ///< Job number, unique within the server
+      std::string mode;          ///< What to run: sandbox or gemm
+      std::string matrixAFile;   ///< Input file with matrix A
+      std::string matrixBFile;   ///< Input file with matrix B
+      std::string matrixCFile;   ///< Output file for matrix C
+      bool isConsumeBinary;      ///< Whether input files are binary
+      bool isTxtOutput;          ///< Whether output file is text
+      bool isMapped;             ///< Whether binary files are mapped into memory
+      bool isPipelined;          ///< Whether computation starts while inputs are read
+   };
+
+   /**
+    * @brief Job body. Runs the job with the given dispatcher and throws std::exception on failure.
+    */
+   typedef boost::function<void( const Job& job, const CNodeDispatcher& dispatcher )> Runner;
+
+   /**
+    * @brief Default number of jobs run at the same time
+    */
+   static const std::size_t DEFAULT_JOBS_COUNT = 4;
+
+   /**
+    * @brief Constructor. Starts listening and job threads. \n
+    * Stale socket file left by a previous server is replaced, \n
+    * startup fails if the path is not a socket or another server listens on it.
+    * @param service - IO service for client connections
+    * @param socketPath - path of the Unix domain socket
+    * @param dispatcher - dispatcher from which job dispatchers are made
+    * @param runner - job body
+    * @param jobsCount - number of jobs run at the same time, others wait in order of submission
+    */
+   CJobServer( boost::asio::io_service& service,
+               const std::string& socketPath,
+               const CNodeDispatcher& dispatcher,
+               const Runner& runner,
+               std::size_t jobsCount = DEFAULT_JOBS_COUNT );
+
+   /**
+    * @brief Destructor. Stops the server.
+    */
+   ~CJobServer( void );
+
+   /**
+    * @brief Stop accepting jobs, fail waiting ones and wait until running jobs are finished. \n
+    * Socket file is removed.
+    */
+   void stop( void );
+
+   /**
+    * @brief Get number of jobs finished successfully
+    * @return Jobs count
+    */
+   std::size_t getFinishedCount( void ) const;
+
+   /**
+    * @brief Get number of failed jobs
+    * @return Jobs count
+    */
+   std::size_t getFailedCount( void ) const;
+
+private:
+   class CSession;
+   struct State;
+   struct Entry;
+
+   /**
+    * @brief Start accepting next client
+    */
+   void startAccept( void );
+
+   /**
+    * @brief Accept completion callback
+    * @param session - accepted client
+    * @param error - error code
+    */
+   void onAccept( const boost::shared_ptr<CSession>& session,
+                  const boost::system::error_code& error );
+
+   /**
+    * @brief Put job to the queue. Called by the client session.
+    * @param state - server state
+    * @param job - submitted job, its id is assigned here
+    * @param session - client which submitted the job
+    * @return True - if job is queued, false - if server is stopped
+    */
+   static bool submit( const boost::shared_ptr<State>& state,
+                       Job& job,
+                       const boost::shared_ptr<CSession>& session );
+
+   /**
+    * @brief Job thread function
+    * @param state - server state
+    */
+   static void runJobs( const boost::shared_ptr<State>& state );
+
+private:
+   boost::asio::io_service& mService;                          ///< IO service for client connections
+   std::string mSocketPath;                                    ///< Path of the socket file
+   boost::asio::local::stream_protocol::acceptor mAcceptor;    ///< Listening socket
+   boost::shared_ptr<State> mState;                            ///< Queue and counters shared with sessions
+   boost::thread_group mThreads;                               ///< Job threads
+};
+/** @}*/
+#endif // CJOBSERVER_HPP
@@ -0,0 +1,150 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CMappedMatrix.cpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CMappedMatrix class definition
+ ************************************************************************/
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include "CMappedMatrix.hpp"
+
+#include <cstring>
+#include <fstream>
+
+#include <boost/interprocess/exceptions.hpp>
+
+const std::size_t CMappedMatrix::HEADER_SIZE;
+
+CMappedMatrix::CMappedMatrix( void )
+   : mFile()
+   , mRegion()
+   , mData( 0 )
+   , mRows( 0 )
+   , mCols( 0 )
+{
+
+}
+
+CMappedMatrix::~CMappedMatrix( void )
+{
+   close();
+}
+
+bool CMappedMatrix::openReadOnly( const std::string& fileName )
+{
+   return map( fileName, boost::interprocess::read_only );
+}
+
+bool CMappedMatrix::create( const std::string& fileName, std::size_t rows, std::size_t cols )
+{
+   close();
+
+   const boost::uint64_t header[2] = { rows, cols };
+   {
+      std::ofstream file( fileName.c_str(), std::ios::binary | std::ios::trunc );
+      file.write( reinterpret_cast<const char*>( header ), sizeof( header ) );
+
+      // File is extended without writing, so its pages are allocated when results arrive.
+      const std::streamoff size = static_cast<std::streamoff>( HEADER_SIZE + rows * cols * sizeof( double ) );
+      if ( size > static_cast<std::streamoff>( HEADER_SIZE ) )
+      {
+         file.seekp( size - 1 );
+         file.put( '\0' );
+      }
+      if ( !file )
+      {
+         return false;
+      }
+   }
+
+   return map( fileName, boost::interprocess::read_write );
+}
+
+bool CMappedMatrix::map( const std::string& fileName, boost::interprocess::mode_t mode )
+{
+   close();
+
+   try
+   {
+      mFile.reset( new boost::interprocess::file_mapping( fileName.c_str(), mode ) );
+      mRegion.reset( new boost::interprocess::mapped_region( *mFile, mode ) );
+   }
+   catch ( const boost::interprocess::interprocess_exception& )
+   {
+      close();
+      return false;
+   }
+
+   const std::size_t size = mRegion->get_size();
+   const char* begin = static_cast<const char*>( mRegion->get_address() );
+   boost::uint64_t header[2] = { 0, 0 };
+   if ( size < HEADER_SIZE )
+   {
+      close();
+      return false;
+   }
+   std::memcpy( header, begin, sizeof( header ) );
+
+   // Dimensions are checked against the file size before use, so corrupted header can not cause overflow.
+   const std::size_t capacity = ( size - HEADER_SIZE ) / sizeof( double );
+   if ( ( header[0] != 0 && header[1] > capacity / header[0] )
+        || header[0] * header[1] * sizeof( double ) != size - HEADER_SIZE )
+   {
+      close();
+      return false;
+   }
+
+   mRows = static_cast<std::size_t>( header[0] );
+   mCols = static_cast<std::size_t>( header[1] );
+   mData = reinterpret_cast<double*>( static_cast<char*>( mRegion->get_address() ) + HEADER_SIZE );
+
+   if ( mode == boost::interprocess::read_only )
+   {
+      // Inputs are streamed through in tile order, so read-ahead pays off.
+      mRegion->advise( boost::interprocess::mapped_region::advice_sequential );
+   }
+   return true;
+}
+
+bool CMappedMatrix::flush( void )
+{
+   return mRegion && mRegion->flush();
+}
+
+void CMappedMatrix::close( void )
+{
+   mRegion.reset();
+   mFile.reset();
+   mData = 0;
+   mRows = 0;
+   mCols = 0;
+}
+
+bool CMappedMatrix::isOpen( void ) const
+{
+   return mRegion.get() != 0;
+}
+
+std::size_t CMappedMatrix::getRowsCount( void ) const
+{
+   return mRows;
+}
+
+std::size_t CMappedMatrix::getColsCount( void ) const
+{
+   return mCols;
+}
+
+double& CMappedMatrix::operator()( std::size_t row, std::size_t col )
+{
+   return mData[row * mCols + col];
+}
+
+const double& CMappedMatrix::operator()( std::size_t row, std::size_t col ) const
+{
+   return mData[row * mCols + col];
+}
+/** @}*/
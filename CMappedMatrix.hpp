@@ -0,0 +1,119 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CMappedMatrix.hpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CMappedMatrix class declaration
+ ************************************************************************/
+#ifndef CMAPPEDMATRIX_HPP
+#define CMAPPEDMATRIX_HPP
+
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include <string>
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+/**
+ * @brief This class represents binary matrix file mapped into memory. \n
+ * File consists of uint64 rows count, uint64 columns count and row-major \n
+ * float64 values, all in host byte order. \n
+ * Elements are accessed as in matrix::CMatrix, but pages are loaded \n
+ * on first access and may be evicted by the system, so matrices larger \n
+ * than memory can be processed without reading them up front.
+ */
+class CMappedMatrix : private boost::noncopyable
+{
+public:
+   /**
+    * @brief Size of the file header in bytes
+    */
+   static const std::size_t HEADER_SIZE = 16;
+
+   /**
+    * @brief Constructor. Creates object without mapped file.
+    */
+   CMappedMatrix( void );
+
+   /**
+    * @brief Destructor. Unmaps file, changes are flushed by the system.
+    */
+   ~CMappedMatrix( void );
+
+   /**
+    * @brief Map existing matrix file for reading
+    * @param fileName - matrix file
+    * @return True - if file was mapped, false - if it can not be opened or is not a matrix file
+    */
+   bool openReadOnly( const std::string& fileName );
+
+   /**
+    * @brief Create matrix file of given size filled with zeros and map it for writing
+    * @param fileName - matrix file, overwritten if exists
+    * @param rows - rows count
+    * @param cols - columns count
+    * @return True - if file was created and mapped, false - otherwise
+    */
+   bool create( const std::string& fileName, std::size_t rows, std::size_t cols );
+
+   /**
+    * @brief Write changed pages to the file
+    * @return True - if pages were written, false - otherwise
+    */
+   bool flush( void );
+
+   /**
+    * @brief Unmap file
+    */
+   void close( void );
+
+   /**
+    * @brief Check whether file is mapped
+    * @return True - if file is mapped
+    */
+   bool isOpen( void ) const;
+
+   std::size_t getRowsCount( void ) const;   ///< Get rows count
+   std::size_t getColsCount( void ) const;   ///< Get columns count
+
+   /**
+    * @brief Access matrix element
+    * @param row - element row
+    * @param col - element column
+    * @return Element reference
+    * @remark Writing is allowed only for files opened with create()
+    */
+   double& operator()( std::size_t row, std::size_t col );
+
+   /**
+    * @brief Access matrix element
+    * @param row - element row
+    * @param col - element column
+    * @return Element value
+    */
+   const double& operator()( std::size_t row, std::size_t col ) const;
+
+private:
+   /**
+    * @brief Map whole file and read its header
+    * @param fileName - matrix file
+    * @param mode - mapping mode
+    * @return True - if file is valid matrix file
+    */
+   bool map( const std::string& fileName, boost::interprocess::mode_t mode );
+
+private:
+   boost::scoped_ptr<boost::interprocess::file_mapping> mFile;    ///< Mapped file
+   boost::scoped_ptr<boost::interprocess::mapped_region> mRegion; ///< Mapped region of the whole file
+   double* mData;                                                 ///< First element
+   std::size_t mRows;                                             ///< Rows count
+   std::size_t mCols;                                             ///< Columns count
+};
+/** @}*/
+#endif // CMAPPEDMATRIX_HPP
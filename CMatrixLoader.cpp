@@ -0,0 +1,176 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CMatrixLoader.cpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CMatrixLoader class definition
+ ************************************************************************/
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include "CMatrixLoader.hpp"
+#include "TextReader.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+
+/**
+ * @brief Number of bytes of binary file read between progress updates
+ */
+static const std::size_t BINARY_BLOCK_SIZE = 1 << 20;
+
+CMatrixLoader::CMatrixLoader( const std::string& fileName, bool isBinary, std::size_t threadsCount )
+   : mFileName( fileName )
+   , mIsBinary( isBinary )
+   , mThreadsCount( threadsCount )
+   , mMatrix()
+   , mIsSized( false )
+   , mRowsCount( 0 )
+   , mIsFinished( false )
+   , mIsSucceeded( false )
+   , mGuard()
+   , mCondition()
+   , mThread()
+{
+   mThread = boost::thread( &CMatrixLoader::load, this );
+}
+
+CMatrixLoader::~CMatrixLoader( void )
+{
+   mThread.join();
+}
+
+bool CMatrixLoader::waitForSize( void )
+{
+   boost::unique_lock<boost::mutex> lock( mGuard );
+   while ( !mIsSized && !mIsFinished )
+   {
+      mCondition.wait( lock );
+   }
+   return mIsSized && ( !mIsFinished || mIsSucceeded );
+}
+
+bool CMatrixLoader::waitForRows( std::size_t rowsCount )
+{
+   boost::unique_lock<boost::mutex> lock( mGuard );
+   mCondition.wait( lock, boost::bind( &CMatrixLoader::isRowsReady, this, rowsCount ) );
+   return mRowsCount >= rowsCount && ( !mIsFinished || mIsSucceeded );
+}
+
+bool CMatrixLoader::wait( void )
+{
+   boost::unique_lock<boost::mutex> lock( mGuard );
+   while ( !mIsFinished )
+   {
+      mCondition.wait( lock );
+   }
+   return mIsSucceeded;
+}
+
+const matrix::CMatrix& CMatrixLoader::getMatrix( void ) const
+{
+   return mMatrix;
+}
+
+bool CMatrixLoader::isRowsReady( std::size_t rowsCount ) const
+{
+   return mRowsCount >= rowsCount || mIsFinished;
+}
+
+void CMatrixLoader::load( void )
+{
+   bool isSucceeded = false;
+   try
+   {
+      isSucceeded = mIsBinary
+                    ? loadBinary()
+                    : textio::readFromTextFile( mFileName,
+                                                mMatrix,
+                                                mThreadsCount,
+                                                boost::bind( &CMatrixLoader::onProgress, this, _1 ) );
+   }
+   catch ( ... )
+   {
+      // Exception must not leave the loading thread, waiting consumers learn about the failure instead.
+      isSucceeded = false;
+   }
+
+   {
+      boost::lock_guard<boost::mutex> lock( mGuard );
+      mIsFinished = true;
+      mIsSucceeded = isSucceeded;
+      if ( isSucceeded )
+      {
+         mRowsCount = mMatrix.getRowsCount();
+      }
+   }
+   mCondition.notify_all();
+}
+
+bool CMatrixLoader::loadBinary( void )
+{
+   std::ifstream file( mFileName.c_str(), std::ios::binary | std::ios::ate );
+   const std::streamoff fileSize = file ? static_cast<std::streamoff>( file.tellg() ) : 0;
+   boost::uint64_t header[2] = { 0, 0 };
+   if ( fileSize < static_cast<std::streamoff>( sizeof( header ) )
+        || !file.seekg( 0 )
+        || !file.read( reinterpret_cast<char*>( header ), sizeof( header ) ) )
+   {
+      return false;
+   }
+
+   // Dimensions are checked against the file size before allocation, so corrupted header can not cause overflow.
+   const boost::uint64_t dataSize = static_cast<boost::uint64_t>( fileSize ) - sizeof( header );
+   const boost::uint64_t capacity = dataSize / sizeof( double );
+   if ( ( header[0] != 0 && header[1] > capacity / header[0] )
+        || header[0] * header[1] * sizeof( double ) != dataSize )
+   {
+      return false;
+   }
+
+   const std::size_t rows = static_cast<std::size_t>( header[0] );
+   const std::size_t cols = static_cast<std::size_t>( header[1] );
+   mMatrix = matrix::CMatrix( rows, cols );
+   onProgress( 0 );
+
+   // Rows are read in blocks, so that waiting consumers are not woken up for every row.
+   const std::size_t blockRows = std::max<std::size_t>( BINARY_BLOCK_SIZE / ( sizeof( double ) * std::max<std::size_t>( cols, 1 ) ), 1 );
+   std::vector<double> block;
+   for ( std::size_t rowBegin = 0; rowBegin < rows; rowBegin += blockRows )
+   {
+      const std::size_t rowEnd = std::min( rowBegin + blockRows, rows );
+      block.resize( ( rowEnd - rowBegin ) * cols );
+      if ( !file.read( reinterpret_cast<char*>( block.data() ), block.size() * sizeof( double ) ) )
+      {
+         return false;
+      }
+
+      for ( std::size_t i = rowBegin; i < rowEnd; ++i )
+      {
+         const double* row = &block[( i - rowBegin ) * cols];
+         for ( std::size_t j = 0; j < cols; ++j )
+         {
+            mMatrix( i, j ) = row[j];
+         }
+      }
+      onProgress( rowEnd * cols );
+   }
+   return true;
+}
+
+void CMatrixLoader::onProgress( std::size_t valuesCount )
+{
+   {
+      boost::lock_guard<boost::mutex> lock( mGuard );
+      mIsSized = true;
+      const std::size_t cols = mMatrix.getColsCount();
+      mRowsCount = ( cols > 0 ) ? valuesCount / cols : mMatrix.getRowsCount();
+   }
+   mCondition.notify_all();
+}
+/** @}*/
@@ -0,0 +1,110 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CMatrixLoader.hpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CMatrixLoader class declaration
+ ************************************************************************/
+#ifndef CMATRIXLOADER_HPP
+#define CMATRIXLOADER_HPP
+
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include <string>
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+
+#include "CMatrix.hpp"
+
+/**
+ * @brief This class reads matrix file in background thread. \n
+ * Rows become available in order as they are read, so consumer \n
+ * may start working on the first rows while the rest of the file is loaded.
+ */
+class CMatrixLoader : private boost::noncopyable
+{
+public:
+   /**
+    * @brief Constructor. Starts loading.
+    * @param fileName - matrix file
+    * @param isBinary - whether file is in binary format, text format otherwise
+    * @param threadsCount - number of threads parsing text file, 0 - number of CPU cores
+    */
+   CMatrixLoader( const std::string& fileName, bool isBinary, std::size_t threadsCount = 0 );
+
+   /**
+    * @brief Destructor. Waits until loading is finished.
+    */
+   ~CMatrixLoader( void );
+
+   /**
+    * @brief Wait until matrix size is known
+    * @return True - if matrix is sized, false - if loading failed
+    */
+   bool waitForSize( void );
+
+   /**
+    * @brief Wait until leading rows are loaded
+    * @param rowsCount - number of rows
+    * @return True - if rows are loaded, false - if loading failed
+    */
+   bool waitForRows( std::size_t rowsCount );
+
+   /**
+    * @brief Wait until whole matrix is loaded
+    * @return True - if matrix is loaded, false - if loading failed
+    */
+   bool wait( void );
+
+   /**
+    * @brief Get loaded matrix. \n
+    * Its size is valid after waitForSize(), its rows - after waitForRows().
+    * @return Matrix
+    */
+   const matrix::CMatrix& getMatrix( void ) const;
+
+private:
+   /**
+    * @brief Loading thread function. Exceptions of loading are reported as failure.
+    */
+   void load( void );
+
+   /**
+    * @brief Read matrix in binary format row by row
+    * @return True - if matrix was read, false - if file can not be read or its size does not match the header
+    */
+   bool loadBinary( void );
+
+   /**
+    * @brief Publish loaded values
+    * @param valuesCount - number of leading values in row-major order which are loaded
+    */
+   void onProgress( std::size_t valuesCount );
+
+   /**
+    * @brief Check whether rows are loaded or loading is finished
+    * @param rowsCount - number of rows
+    * @return True if waiting for rows is over
+    */
+   bool isRowsReady( std::size_t rowsCount ) const;
+
+private:
+   std::string mFileName;                 ///< Matrix file
+   bool mIsBinary;                        ///< Whether file is in binary format
+   std::size_t mThreadsCount;             ///< Number of text parsing threads
+
+   matrix::CMatrix mMatrix;               ///< Loaded matrix
+   bool mIsSized;                         ///< Whether matrix size is known
+   std::size_t mRowsCount;                ///< Number of loaded rows
+   bool mIsFinished;                      ///< Whether loading is finished
+   bool mIsSucceeded;                     ///< Whether whole matrix was loaded
+
+   boost::mutex mGuard;                   ///< Mutex for loading state
+   boost::condition_variable mCondition;  ///< Signalled when loading state changes
+   boost::thread mThread;                 ///< Loading thread
+};
+/** @}*/
+#endif // CMATRIXLOADER_HPP
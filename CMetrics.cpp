@@ -0,0 +1,249 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CMetrics.cpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CMetrics class definition
+ ************************************************************************/
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include "CMetrics.hpp"
+#include "CEventLoop.hpp"
+
+#include <fstream>
+#include <sstream>
+
+#include <boost/bind.hpp>
+#include <jsoncpp/include/json/json.h>
+
+CMetrics::CMetrics( boost::asio::io_service& service )
+   : mNodes()
+   , mGuard()
+   , mDumpFileName()
+   , mDumpFormat( FORMAT_JSON )
+   , mTimer( service )
+   , mInterval()
+{
+
+}
+
+CMetrics::~CMetrics( void )
+{
+   stopPeriodicDump();
+}
+
+boost::shared_ptr<CNodeMetrics> CMetrics::getNode( const std::string& name )
+{
+   boost::lock_guard<boost::mutex> lock( mGuard );
+
+   boost::shared_ptr<CNodeMetrics>& node = mNodes[name];
+   if ( !node )
+   {
+      node.reset( new CNodeMetrics( name ) );
+   }
+   return node;
+}
+
+std::string CMetrics::toString( Format format ) const
+{
+   return ( format == FORMAT_PROMETHEUS ) ? toPrometheus() : toJson();
+}
+
+std::string CMetrics::toJson( void ) const
+{
+   Json::Value root( Json::objectValue );
+   Json::Value& nodes = root["nodes"];
+   nodes = Json::Value( Json::objectValue );
+
+   boost::lock_guard<boost::mutex> lock( mGuard );
+   for ( NodesMap::const_iterator it = mNodes.begin(); it != mNodes.end(); ++it )
+   {
+      const CNodeMetrics& metrics = *it->second;
+      Json::Value& node = nodes[it->first];
+      node["requests"] = static_cast<Json::UInt64>( metrics.getRequests() );
+      node["bytesSent"] = static_cast<Json::UInt64>( metrics.getBytesSent() );
+      node["bytesReceived"] = static_cast<Json::UInt64>( metrics.getBytesReceived() );
+      node["errors"] = static_cast<Json::UInt64>( metrics.getErrors() );
+      node["retries"] = static_cast<Json::UInt64>( metrics.getRetries() );
+
+      if ( metrics.getTunedChunkValues() > 0 )
+      {
+         Json::Value& tuning = node["tuning"];
+         tuning["overheadUs"] = metrics.getTunedOverhead();
+         tuning["nsPerValue"] = 1000.0 * metrics.getTunedCostPerValue();
+         tuning["chunkValues"] = static_cast<Json::UInt64>( metrics.getTunedChunkValues() );
+         tuning["depth"] = static_cast<Json::UInt64>( metrics.getTunedDepth() );
+      }
+
+      for ( int phase = 0; phase < CNodeMetrics::PHASES_COUNT; ++phase )
+      {
+         const CHistogram& histogram = metrics.getPhase( static_cast<CNodeMetrics::Phase>( phase ) );
+         if ( histogram.getCount() == 0 )
+         {
+            continue;
+         }
+
+         Json::Value& value = node["phases"][CNodeMetrics::getPhaseName( static_cast<CNodeMetrics::Phase>( phase ) )];
+         value["count"] = static_cast<Json::UInt64>( histogram.getCount() );
+         value["sumUs"] = static_cast<Json::UInt64>( histogram.getSum() );
+         value["p50Us"] = static_cast<Json::UInt64>( histogram.getPercentile( 0.5 ) );
+         value["p99Us"] = static_cast<Json::UInt64>( histogram.getPercentile( 0.99 ) );
+      }
+   }
+
+   Json::StyledWriter writer;
+   return writer.write( root );
+}
+
+/**
+ * @brief Write Prometheus counter of all nodes
+ * @param stream - output stream
+ * @param nodes - nodes metrics
+ * @param name - metric name
+ * @param getter - counter getter
+ */
+template<typename NodesMap>
+static void writeCounter( std::ostream& stream,
+                          const NodesMap& nodes,
+                          const char* name,
+                          boost::uint64_t ( CNodeMetrics::*getter )( void ) const )
+{
+   stream << "# TYPE " << name << " counter\n";
+   for ( typename NodesMap::const_iterator it = nodes.begin(); it != nodes.end(); ++it )
+   {
+      stream << name << "{node=\"" << it->first << "\"} " << ( ( *it->second ).*getter )() << "\n";
+   }
+}
+
+/**
+ * @brief Write Prometheus gauge of all nodes
+ * @param stream - output stream
+ * @param nodes - nodes metrics
+ * @param name - metric name
+ * @param getter - gauge getter
+ */
+template<typename NodesMap, typename Value>
+static void writeGauge( std::ostream& stream,
+                        const NodesMap& nodes,
+                        const char* name,
+                        Value ( CNodeMetrics::*getter )( void ) const )
+{
+   stream << "# TYPE " << name << " gauge\n";
+   for ( typename NodesMap::const_iterator it = nodes.begin(); it != nodes.end(); ++it )
+   {
+      stream << name << "{node=\"" << it->first << "\"} " << ( ( *it->second ).*getter )() << "\n";
+   }
+}
+
+std::string CMetrics::toPrometheus( void ) const
+{
+   static const char* const PHASE_METRIC = "scheduler_node_phase_duration_microseconds";
+
+   std::ostringstream stream;
+
+   boost::lock_guard<boost::mutex> lock( mGuard );
+   writeCounter( stream, mNodes, "scheduler_node_requests_total", &CNodeMetrics::getRequests );
+   writeCounter( stream, mNodes, "scheduler_node_sent_bytes_total", &CNodeMetrics::getBytesSent );
+   writeCounter( stream, mNodes, "scheduler_node_received_bytes_total", &CNodeMetrics::getBytesReceived );
+   writeCounter( stream, mNodes, "scheduler_node_errors_total", &CNodeMetrics::getErrors );
+   writeCounter( stream, mNodes, "scheduler_node_retries_total", &CNodeMetrics::getRetries );
+   writeGauge( stream, mNodes, "scheduler_node_tuned_overhead_microseconds", &CNodeMetrics::getTunedOverhead );
+   writeGauge( stream, mNodes, "scheduler_node_tuned_value_cost_microseconds", &CNodeMetrics::getTunedCostPerValue );
+   writeGauge( stream, mNodes, "scheduler_node_tuned_chunk_values", &CNodeMetrics::getTunedChunkValues );
+   writeGauge( stream, mNodes, "scheduler_node_tuned_depth", &CNodeMetrics::getTunedDepth );
+
+   stream << "# TYPE " << PHASE_METRIC << " histogram\n";
+   for ( NodesMap::const_iterator it = mNodes.begin(); it != mNodes.end(); ++it )
+   {
+      for ( int phase = 0; phase < CNodeMetrics::PHASES_COUNT; ++phase )
+      {
+         const CHistogram& histogram = it->second->getPhase( static_cast<CNodeMetrics::Phase>( phase ) );
+         const std::string labels = "node=\"" + it->first + "\",phase=\""
+                                    + CNodeMetrics::getPhaseName( static_cast<CNodeMetrics::Phase>( phase ) ) + "\"";
+
+         boost::uint64_t cumulative = 0;
+         for ( std::size_t bucket = 0; bucket < CHistogram::BUCKETS_COUNT; ++bucket )
+         {
+            cumulative += histogram.getBucketCount( bucket );
+            stream << PHASE_METRIC << "_bucket{" << labels << ",le=\"" << CHistogram::getUpperBound( bucket ) << "\"} "
+                   << cumulative << "\n";
+         }
+         stream << PHASE_METRIC << "_bucket{" << labels << ",le=\"+Inf\"} " << cumulative << "\n";
+         stream << PHASE_METRIC << "_sum{" << labels << "} " << histogram.getSum() << "\n";
+         stream << PHASE_METRIC << "_count{" << labels << "} " << cumulative << "\n";
+      }
+   }
+
+   return stream.str();
+}
+
+void CMetrics::setDumpTarget( const std::string& fileName, Format format )
+{
+   boost::lock_guard<boost::mutex> lock( mGuard );
+   mDumpFileName = fileName;
+   mDumpFormat = format;
+}
+
+bool CMetrics::dump( void )
+{
+   std::string fileName;
+   Format format;
+   {
+      boost::lock_guard<boost::mutex> lock( mGuard );
+      fileName = mDumpFileName;
+      format = mDumpFormat;
+   }
+
+   if ( fileName.empty() )
+   {
+      return false;
+   }
+
+   const std::string text = toString( format );
+   std::ofstream file( fileName.c_str() );
+   file << text;
+   return file.good();
+}
+
+void CMetrics::startPeriodicDump( boost::posix_time::time_duration interval )
+{
+   boost::lock_guard<boost::mutex> lock( mGuard );
+   mInterval = interval;
+   mTimer.expires_from_now( mInterval );
+   mTimer.async_wait( boost::bind( &CMetrics::onTimer, this, boost::asio::placeholders::error ) );
+}
+
+void CMetrics::stopPeriodicDump( void )
+{
+   boost::lock_guard<boost::mutex> lock( mGuard );
+   mInterval = boost::posix_time::time_duration();
+   boost::system::error_code ignored;
+   mTimer.cancel( ignored );
+}
+
+void CMetrics::onTimer( const boost::system::error_code& error )
+{
+   if ( error == boost::asio::error::operation_aborted )
+   {
+      return;
+   }
+
+   dump();
+
+   boost::lock_guard<boost::mutex> lock( mGuard );
+   if ( mInterval.total_microseconds() > 0 )
+   {
+      mTimer.expires_from_now( mInterval );
+      mTimer.async_wait( boost::bind( &CMetrics::onTimer, this, boost::asio::placeholders::error ) );
+   }
+}
+
+CMetrics& CMetrics::instance( void )
+{
+   // Event loop is created first, so it outlives the registry timer.
+   static CMetrics sharedMetrics( CEventLoop::instance().getService() );
+   return sharedMetrics;
+}
+/** @}*/
@@ -0,0 +1,119 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CMetrics.hpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CMetrics class declaration
+ ************************************************************************/
+#ifndef CMETRICS_HPP
+#define CMETRICS_HPP
+
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include <map>
+#include <string>
+
+#include "CNodeMetrics.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+/**
+ * @brief This class is registry of per-node metrics. \n
+ * Metrics can be dumped as JSON or Prometheus text exposition format, \n
+ * on demand or periodically.
+ * @sa CMetrics::instance()
+ */
+class CMetrics : private boost::noncopyable
+{
+public:
+   /**
+    * @brief Dump formats
+    */
+   enum Format
+   {
+      FORMAT_JSON,         ///< JSON document
+      FORMAT_PROMETHEUS    ///< Prometheus text exposition format
+   };
+
+   /**
+    * @brief Constructor. Creates empty registry.
+    * @param service - io_service which drives periodic dump
+    */
+   explicit CMetrics( boost::asio::io_service& service );
+
+   /**
+    * @brief Destructor. Stops periodic dump.
+    */
+   ~CMetrics( void );
+
+   /**
+    * @brief Get metrics of the node, they are created on first call
+    * @param name - node name
+    * @return Node metrics
+    */
+   boost::shared_ptr<CNodeMetrics> getNode( const std::string& name );
+
+   /**
+    * @brief Serialize all metrics
+    * @param format - output format
+    * @return Serialized metrics
+    */
+   std::string toString( Format format ) const;
+
+   /**
+    * @brief Set file which dump() writes to
+    * @param fileName - file name, empty - dump() does nothing
+    * @param format - output format
+    */
+   void setDumpTarget( const std::string& fileName, Format format );
+
+   /**
+    * @brief Write all metrics to the dump target file
+    * @return True - if metrics were written, false - if there is no target or file can not be written
+    */
+   bool dump( void );
+
+   /**
+    * @brief Call dump() periodically from the event loop
+    * @param interval - time between dumps
+    */
+   void startPeriodicDump( boost::posix_time::time_duration interval );
+
+   /**
+    * @brief Stop periodic dump
+    */
+   void stopPeriodicDump( void );
+
+   /**
+    * @brief Get shared registry, it is created on first call
+    * @return Reference to the shared registry
+    */
+   static CMetrics& instance( void );
+
+private:
+   typedef std::map< std::string, boost::shared_ptr<CNodeMetrics> > NodesMap;
+
+   std::string toJson( void ) const;
+   std::string toPrometheus( void ) const;
+
+   /**
+    * @brief Periodic dump timer callback
+    * @param error - timer error
+    */
+   void onTimer( const boost::system::error_code& error );
+
+private:
+   NodesMap mNodes;                             ///< Metrics by node name
+   mutable boost::mutex mGuard;                 ///< Mutex for registry and dump settings
+   std::string mDumpFileName;                   ///< Dump target file
+   Format mDumpFormat;                          ///< Dump target format
+   boost::asio::deadline_timer mTimer;          ///< Periodic dump timer
+   boost::posix_time::time_duration mInterval;  ///< Periodic dump interval, zero if disabled
+};
+/** @}*/
+#endif // CMETRICS_HPP
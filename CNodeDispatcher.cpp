@@ -0,0 +1,1631 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CNodeDispatcher.cpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CNodeDispatcher class definition
+ ************************************************************************/
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include "CNodeDispatcher.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <list>
+#include <stdexcept>
+#include <utility>
+
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/unordered_map.hpp>
+
+#include "CCostModel.hpp"
+#include "CEventLoop.hpp"
+#include "CHistogram.hpp"
+#include "CNodeMetrics.hpp"
+
+const double CNodeDispatcher::LATENCY_SMOOTHING = 0.2;
+const std::size_t CNodeDispatcher::DEFAULT_EJECTION_FAILURES;
+const std::size_t CNodeDispatcher::DEFAULT_EJECTION_MS;
+const std::size_t CNodeDispatcher::MIN_HEDGING_SAMPLES;
+const std::size_t CNodeDispatcher::DEFAULT_MAX_CHUNK_VALUES;
+
+/**
+ * @brief Maximum number of backoff doublings
+ */
+static const std::size_t MAX_BACKOFF_DOUBLINGS = 6;
+
+/**
+ * @brief Upper bound of the failed node latency in microseconds. \n
+ * Keeps the node in rotation, so it is probed again when other nodes are busy.
+ */
+static const double MAX_FAILED_LATENCY = 10e6;
+
+/**
+ * @brief Number of blocks tracked per node after which blocks without waiting calls are forgotten. \n
+ * Forgotten block is uploaded again when it is needed.
+ */
+static const std::size_t MAX_TRACKED_BLOCKS = 4096;
+
+/**
+ * @brief Ratio by which estimated chunk size must differ from the chosen one to replace it
+ */
+static const double RETUNING_RATIO = 1.5;
+
+/**
+ * @brief Statistics of the single node
+ */
+struct NodeStatistics
+{
+   NodeStatistics( void )
+      : inFlight( 0 )
+      , latency( 0.0 )
+      , failuresCount( 0 )
+      , ejectedUntil()
+      , cost()
+      , chunkValues( 0 )
+      , depth( 0 )
+   {
+
+   }
+
+   std::size_t inFlight;                     ///< Number of calls in flight
+   double latency;                           ///< Smoothed call latency in microseconds, zero until first call is finished
+   std::size_t failuresCount;                ///< Number of failed calls in a row
+   boost::posix_time::ptime ejectedUntil;    ///< Time when ejected node gets calls again, not_a_date_time if never ejected
+   CCostModel cost;                          ///< Overhead and cost per value of the calls, filled when auto-tuning
+   std::size_t chunkValues;                  ///< Tuned values per call, 0 until estimated
+   std::size_t depth;                        ///< Tuned calls in flight, 0 until estimated
+};
+
+/**
+ * @brief Call of the job which waits for a job slot
+ */
+struct CNodeDispatcher::WaitingCall
+{
+   WaitingCall( void )
+      : operation( CComputationNode::OP_SUM )
+      , array()
+      , block()
+      , handler()
+      , token()
+      , cancelId( 0 )
+   {
+
+   }
+
+   CComputationNode::Operation operation;    ///< Operation to perform, ignored for block call
+   DoubleArray array;                        ///< Operation argument or rows of block call
+   MatrixBlockPtr block;                     ///< Block to multiply rows by, null for operation call
+   ResultHandler handler;                    ///< User completion callback
+   CancelTokenPtr token;                     ///< Cancel token of the call, may be null
+   std::size_t cancelId;                     ///< Subscription to the token while call waits, 0 if there is none
+};
+
+/**
+ * @brief Call of the block which is sent, waits for upload or is sent again
+ */
+struct CNodeDispatcher::BlockCall
+{
+   BlockCall( void )
+      : block()
+      , rows()
+      , handler()
+      , startTime()
+      , isUploadAwaited( false )
+      , token()
+      , cancelId( 0 )
+   {
+
+   }
+
+   MatrixBlockPtr block;                     ///< Block to multiply rows by
+   DoubleArray rows;                         ///< Rows, kept for the call after upload
+   ResultHandler handler;                    ///< Completion callback
+   boost::posix_time::ptime startTime;       ///< Time when call was routed or sent to the node
+   bool isUploadAwaited;                     ///< Whether call was sent after the upload of its block
+   CancelTokenPtr token;                     ///< Cancel token of the call, may be null
+   std::size_t cancelId;                     ///< Subscription to the token during the upload, 0 if there is none
+};
+
+/**
+ * @brief Calls of the single job which wait for job slots
+ */
+struct CNodeDispatcher::Job
+{
+   Job( void )
+      : calls()
+      , isWaiting( false )
+   {
+
+   }
+
+   std::deque<WaitingCall> calls;            ///< Waiting calls in order of submission
+   bool isWaiting;                           ///< Whether job is in the turn of waiting jobs
+};
+
+/**
+ * @brief State shared between copies of the dispatcher and calls in flight
+ */
+struct CNodeDispatcher::State
+{
+   /**
+    * @brief Block which node keeps or which is being uploaded to it
+    */
+   struct NodeBlock
+   {
+      NodeBlock( void )
+         : isStored( false )
+         , waitingCalls()
+         , uploadToken()
+      {
+
+      }
+
+      bool isStored;                                              ///< Whether upload has finished
+      std::vector< boost::shared_ptr<BlockCall> > waitingCalls;   ///< Calls which wait for the upload
+      CancelTokenPtr uploadToken;                                 ///< Aborts the upload, null once it has finished
+   };
+
+   typedef boost::unordered_map<std::string, NodeBlock> NodeBlocks;
+
+   std::vector<CComputationNode> nodes;      ///< Computation nodes
+   std::vector<NodeStatistics> statistics;   ///< Statistics of nodes, by node index
+   std::size_t nextNode;                     ///< Node to start the search from, rotates to break ties
+   std::size_t localNode;                    ///< Index of the local node, nodes count if there is none
+   std::size_t localThreshold;               ///< Calls with fewer values go to the local node
+   std::size_t retriesCount;                 ///< Maximum number of retries of the single call
+   boost::posix_time::time_duration backoff; ///< Delay before the first retry
+   boost::posix_time::time_duration deadline;///< Attempt deadline, zero if not limited
+   double hedgingPercentile;                 ///< Latency percentile after which call is hedged, 0 if disabled
+   std::size_t ejectionFailures;             ///< Number of failures in a row which eject node, 0 if disabled
+   boost::posix_time::time_duration ejectionTime; ///< Ejection duration
+   CHistogram latencies;                     ///< Latencies of all successful calls in microseconds
+   boost::shared_ptr<CResultCache> cache;    ///< Results of earlier calls, null if disabled
+   std::size_t jobSlots;                     ///< Limit of job calls in flight, 0 if not limited
+   std::size_t jobCallsCount;                ///< Number of job calls in flight
+   std::list< boost::shared_ptr<Job> > waitingJobs; ///< Jobs which have waiting calls, in turn order
+   std::vector<NodeBlocks> blocks;           ///< Blocks of nodes by handle, by node index
+   std::size_t uploadsCount;                 ///< Number of block uploads sent
+   bool isAutoTuning;                        ///< Whether chunk size and calls in flight are tuned
+   std::size_t maxChunkValues;               ///< Upper bound of the tuned chunk size
+   boost::mutex guard;                       ///< Mutex for statistics and settings
+};
+
+/**
+ * @brief State of the call sent with retries, deadline or hedging
+ */
+struct CNodeDispatcher::Request
+{
+   explicit Request( boost::asio::io_service& service )
+      : operation( CComputationNode::OP_SUM )
+      , array()
+      , handler()
+      , retriesCount( 0 )
+      , retriesDone( 0 )
+      , backoff()
+      , deadline()
+      , attemptsCount( 0 )
+      , isFinished( false )
+      , isHedged( false )
+      , error()
+      , token()
+      , attemptTokens()
+      , hedgeTimer( service )
+      , backoffTimer( service )
+      , guard()
+   {
+
+   }
+
+   CComputationNode::Operation operation;          ///< Operation to perform
+   DoubleArray array;                              ///< Operation argument, kept for the next attempts
+   ResultHandler handler;                          ///< User completion callback
+   std::size_t retriesCount;                       ///< Maximum number of retries
+   std::size_t retriesDone;                        ///< Number of retries sent
+   boost::posix_time::time_duration backoff;       ///< Delay before the first retry
+   boost::posix_time::time_duration deadline;      ///< Attempt deadline, zero if not limited
+   std::size_t attemptsCount;                      ///< Number of attempts in flight which are not failed yet
+   bool isFinished;                                ///< Whether result was passed to the user
+   bool isHedged;                                  ///< Whether duplicate attempt was sent
+   boost::exception_ptr error;                     ///< Error of the last failed attempt
+   CancelTokenPtr token;                           ///< Cancel token of the call, may be null
+   std::vector<CancelTokenPtr> attemptTokens;      ///< Tokens of all attempts, cancelled when one of them succeeds
+   boost::asio::deadline_timer hedgeTimer;         ///< Sends duplicate attempt
+   boost::asio::deadline_timer backoffTimer;       ///< Sends retry
+   boost::mutex guard;                             ///< Mutex for call state and timers
+};
+
+/**
+ * @brief Single attempt of the call
+ */
+struct CNodeDispatcher::Attempt
+{
+   Attempt( boost::asio::io_service& service, std::size_t index_ )
+      : index( index_ )
+      , isClosed( false )
+      , timer( service )
+      , token()
+   {
+
+   }
+
+   std::size_t index;                        ///< Index of the node which performs attempt
+   bool isClosed;                            ///< Whether attempt has failed or timed out
+   boost::asio::deadline_timer timer;        ///< Attempt deadline timer
+   CancelTokenPtr token;                     ///< Aborts attempt on timeout or when other attempt succeeds
+};
+
+/**
+ * @brief State of the connections warm up
+ */
+struct CNodeDispatcher::WarmUp
+{
+   explicit WarmUp( std::size_t nodesCount )
+      : promise()
+      , callsCount( 0 )
+      , isFailed( nodesCount, false )
+      , guard()
+   {
+
+   }
+
+   boost::promise<std::size_t> promise;   ///< Promise of the number of answered nodes
+   std::size_t callsCount;                ///< Number of calls in flight
+   std::vector<bool> isFailed;            ///< Whether any call of the node failed, by node index
+   boost::mutex guard;                    ///< Mutex for warm up state
+};
+
+/**
+ * @brief Helper function that passes result of the call to the promise
+ * @param promise - promise to fulfill
+ * @param error - call error or null on success
+ * @param result - call result
+ */
+static void fulfillPromise( const boost::shared_ptr< boost::promise<DoubleArray> >& promise,
+                            const boost::exception_ptr& error,
+                            DoubleArray& result )
+{
+   if ( error )
+   {
+      promise->set_exception( error );
+   }
+   else
+   {
+      promise->set_value( std::move( result ) );
+   }
+}
+
+/**
+ * @brief Check whether call was aborted by its cancel token
+ * @param error - call error
+ * @return True - if error is CCancelledError
+ */
+static bool isCancelled( const boost::exception_ptr& error )
+{
+   try
+   {
+      boost::rethrow_exception( error );
+   }
+   catch ( const CCancelledError& )
+   {
+      return true;
+   }
+   catch ( ... )
+   {
+
+   }
+   return false;
+}
+
+CNodeDispatcher::CNodeDispatcher( const std::vector<CComputationNode>& nodes )
+   : mState( new State() )
+   , mJob()
+   , mCancelToken()
+{
+   for ( std::vector<CComputationNode>::const_iterator it = nodes.begin(); it != nodes.end(); ++it )
+   {
+      if ( it->isValid() )
+      {
+         mState->nodes.push_back( *it );
+      }
+   }
+   mState->statistics.resize( mState->nodes.size() );
+   mState->blocks.resize( mState->nodes.size() );
+   mState->nextNode = 0;
+   mState->localNode = mState->nodes.size();
+   mState->localThreshold = 0;
+   mState->retriesCount = 0;
+   mState->backoff = boost::posix_time::time_duration();
+   mState->deadline = boost::posix_time::time_duration();
+   mState->hedgingPercentile = 0.0;
+   mState->ejectionFailures = DEFAULT_EJECTION_FAILURES;
+   mState->ejectionTime = boost::posix_time::milliseconds( DEFAULT_EJECTION_MS );
+   mState->jobSlots = 0;
+   mState->jobCallsCount = 0;
+   mState->uploadsCount = 0;
+   mState->isAutoTuning = false;
+   mState->maxChunkValues = DEFAULT_MAX_CHUNK_VALUES;
+   for ( std::size_t i = 0; i < mState->nodes.size(); ++i )
+   {
+      if ( mState->nodes[i].isLocal() )
+      {
+         mState->localNode = i;
+         break;
+      }
+   }
+}
+
+CNodeDispatcher::~CNodeDispatcher( void )
+{
+
+}
+
+std::size_t CNodeDispatcher::getNodesCount( void ) const
+{
+   return mState->nodes.size();
+}
+
+void CNodeDispatcher::setLocalThreshold( std::size_t values )
+{
+   boost::lock_guard<boost::mutex> lock( mState->guard );
+   mState->localThreshold = values;
+}
+
+void CNodeDispatcher::setRetries( std::size_t retriesCount, boost::posix_time::time_duration backoff )
+{
+   boost::lock_guard<boost::mutex> lock( mState->guard );
+   mState->retriesCount = retriesCount;
+   mState->backoff = backoff;
+}
+
+void CNodeDispatcher::setDeadline( boost::posix_time::time_duration deadline )
+{
+   boost::lock_guard<boost::mutex> lock( mState->guard );
+   mState->deadline = deadline;
+}
+
+void CNodeDispatcher::setHedging( double percentile )
+{
+   boost::lock_guard<boost::mutex> lock( mState->guard );
+   mState->hedgingPercentile = percentile;
+}
+
+void CNodeDispatcher::setEjection( std::size_t failuresCount, boost::posix_time::time_duration duration )
+{
+   boost::lock_guard<boost::mutex> lock( mState->guard );
+   mState->ejectionFailures = failuresCount;
+   mState->ejectionTime = duration;
+}
+
+void CNodeDispatcher::setCache( const boost::shared_ptr<CResultCache>& cache )
+{
+   boost::lock_guard<boost::mutex> lock( mState->guard );
+   mState->cache = cache;
+}
+
+void CNodeDispatcher::setJobSlots( std::size_t callsCount )
+{
+   boost::lock_guard<boost::mutex> lock( mState->guard );
+   mState->jobSlots = callsCount;
+}
+
+void CNodeDispatcher::setAutoTuning( bool isEnabled, std::size_t maxChunkValues )
+{
+   boost::lock_guard<boost::mutex> lock( mState->guard );
+   mState->isAutoTuning = isEnabled;
+   mState->maxChunkValues = std::max<std::size_t>( maxChunkValues, 1 );
+}
+
+bool CNodeDispatcher::isAutoTuning( void ) const
+{
+   boost::lock_guard<boost::mutex> lock( mState->guard );
+   return mState->isAutoTuning;
+}
+
+std::size_t CNodeDispatcher::getChunkValues( std::size_t index ) const
+{
+   boost::lock_guard<boost::mutex> lock( mState->guard );
+   return mState->statistics.at( index ).chunkValues;
+}
+
+std::size_t CNodeDispatcher::getChunkValues( void ) const
+{
+   boost::lock_guard<boost::mutex> lock( mState->guard );
+   std::size_t tunedCount = 0;
+   std::size_t chunkValues = 0;
+   for ( std::size_t i = 0; i < mState->statistics.size(); ++i )
+   {
+      if ( mState->statistics[i].chunkValues > 0 )
+      {
+         ++tunedCount;
+         chunkValues += mState->statistics[i].chunkValues;
+      }
+   }
+   return ( tunedCount > 0 ) ? chunkValues / tunedCount : 0;
+}
+
+std::size_t CNodeDispatcher::getInFlightDepth( std::size_t index ) const
+{
+   boost::lock_guard<boost::mutex> lock( mState->guard );
+   return mState->statistics.at( index ).depth;
+}
+
+CNodeDispatcher CNodeDispatcher::createJobDispatcher( void ) const
+{
+   CNodeDispatcher dispatcher( *this );
+   dispatcher.mJob.reset( new Job() );
+   return dispatcher;
+}
+
+CNodeDispatcher CNodeDispatcher::createCancellableDispatcher( const CancelTokenPtr& token ) const
+{
+   CNodeDispatcher dispatcher( *this );
+   dispatcher.mCancelToken = token;
+   return dispatcher;
+}
+
+bool CNodeDispatcher::isEjected( std::size_t index ) const
+{
+   const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+   boost::lock_guard<boost::mutex> lock( mState->guard );
+   const boost::posix_time::ptime& ejectedUntil = mState->statistics.at( index ).ejectedUntil;
+   return !ejectedUntil.is_not_a_date_time() && now < ejectedUntil;
+}
+
+const CComputationNode& CNodeDispatcher::getNode( std::size_t index ) const
+{
+   return mState->nodes.at( index );
+}
+
+std::size_t CNodeDispatcher::getInFlightCount( std::size_t index ) const
+{
+   boost::lock_guard<boost::mutex> lock( mState->guard );
+   return mState->statistics.at( index ).inFlight;
+}
+
+boost::posix_time::time_duration CNodeDispatcher::getLatency( std::size_t index ) const
+{
+   boost::lock_guard<boost::mutex> lock( mState->guard );
+   return boost::posix_time::microseconds( static_cast<long>( mState->statistics.at( index ).latency ) );
+}
+
+std::size_t CNodeDispatcher::acquireNode( State& state,
+                                          std::size_t valuesCount,
+                                          std::size_t excludedNode,
+                                          bool& isQueued )
+{
+   const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+   boost::lock_guard<boost::mutex> lock( state.guard );
+
+   if ( state.localNode < state.nodes.size() && valuesCount < state.localThreshold && state.localNode != excludedNode )
+   {
+      isQueued = ++state.statistics[state.localNode].inFlight > state.nodes[state.localNode].getMaxConnections();
+      return state.localNode;
+   }
+
+   const std::size_t count = state.statistics.size();
+   std::size_t best = count;
+   double bestLoad = 0.0;
+
+   // Ejected, excluded and saturated nodes are skipped on the first pass and used only if nothing else is left.
+   for ( std::size_t pass = 0; pass < 2 && best == count; ++pass )
+   {
+      for ( std::size_t i = 0; i < count; ++i )
+      {
+         const std::size_t index = ( state.nextNode + i ) % count;
+         const NodeStatistics& statistics = state.statistics[index];
+         if ( pass == 0
+              && ( index == excludedNode
+                   || ( !statistics.ejectedUntil.is_not_a_date_time() && now < statistics.ejectedUntil )
+                   || ( state.isAutoTuning && statistics.depth > 0 && statistics.inFlight >= statistics.depth ) ) )
+         {
+            continue;
+         }
+
+         // Node without history is probed first: its load is counted by calls only.
+         const double load = ( statistics.inFlight + 1 ) * ( statistics.latency > 0.0 ? statistics.latency : 1.0 );
+         if ( best == count || load < bestLoad )
+         {
+            best = index;
+            bestLoad = load;
+         }
+      }
+   }
+
+   isQueued = ++state.statistics[best].inFlight > state.nodes[best].getMaxConnections();
+   state.nextNode = ( best + 1 ) % count;
+   return best;
+}
+
+void CNodeDispatcher::onCallFinished( const boost::shared_ptr<State>& state,
+                                      std::size_t index,
+                                      std::size_t valuesCount,
+                                      boost::posix_time::ptime startTime,
+                                      const ResultHandler& handler,
+                                      const boost::exception_ptr& error,
+                                      DoubleArray& result )
+{
+   const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+   const double elapsed = static_cast<double>( ( now - startTime ).total_microseconds() );
+
+   bool isRetuned = false;
+   double overhead = 0.0;
+   double costPerValue = 0.0;
+   std::size_t chunkValues = 0;
+   std::size_t depth = 0;
+   {
+      boost::lock_guard<boost::mutex> lock( state->guard );
+      NodeStatistics& statistics = state->statistics[index];
+      --statistics.inFlight;
+      if ( error && isCancelled( error ) )
+      {
+         // Aborted call says nothing about the node, the deadline which aborted it has accounted its failure.
+      }
+      else if ( error )
+      {
+         // Failures are usually fast, so broken node is penalized instead of being preferred.
+         statistics.latency = std::min( std::max( 2.0 * statistics.latency, elapsed ), MAX_FAILED_LATENCY );
+         recordFailure( *state, index, now );
+      }
+      else
+      {
+         statistics.latency = ( statistics.latency > 0.0 )
+                              ? LATENCY_SMOOTHING * elapsed + ( 1.0 - LATENCY_SMOOTHING ) * statistics.latency
+                              : elapsed;
+         statistics.failuresCount = 0;
+         state->latencies.record( static_cast<boost::uint64_t>( elapsed ) );
+
+         if ( state->isAutoTuning && valuesCount > 0 )
+         {
+            statistics.cost.record( valuesCount, elapsed );
+            isRetuned = retune( *state, index );
+            overhead = statistics.cost.getOverhead();
+            costPerValue = statistics.cost.getCostPerValue();
+            chunkValues = statistics.chunkValues;
+            depth = statistics.depth;
+         }
+      }
+   }
+
+   if ( isRetuned )
+   {
+      // Published with the counters of the node, which are keyed by its host and port rather than by its name.
+      const boost::shared_ptr<CNodeMetrics> metrics = state->nodes[index].getMetrics();
+      if ( metrics )
+      {
+         metrics->setTuning( overhead, costPerValue, chunkValues, depth );
+      }
+   }
+
+   handler( error, result );
+}
+
+bool CNodeDispatcher::retune( State& state, std::size_t index )
+{
+   NodeStatistics& statistics = state.statistics[index];
+   if ( !statistics.cost.isKnown() )
+   {
+      return false;
+   }
+
+   const double estimate = static_cast<double>( statistics.cost.getChunkValues( state.maxChunkValues ) );
+   const double chosen = static_cast<double>( statistics.chunkValues );
+   std::size_t chunkValues = statistics.chunkValues;
+   if ( chunkValues == 0 || estimate >= RETUNING_RATIO * chosen || estimate * RETUNING_RATIO <= chosen )
+   {
+      chunkValues = static_cast<std::size_t>( estimate );
+   }
+
+   // Calls over the connections limit wait in the pool, so deeper pipeline does not help.
+   const std::size_t maxDepth = std::max<std::size_t>( state.nodes[index].getMaxConnections(), 1 );
+   const std::size_t depth = statistics.cost.getDepth( chunkValues, maxDepth );
+   if ( chunkValues == statistics.chunkValues
+        && depth + 1 >= statistics.depth && depth <= statistics.depth + 1 )
+   {
+      // Depth of the same chunk is rounded up from the estimate, so it is kept unless it moves by more than one.
+      return false;
+   }
+
+   statistics.chunkValues = chunkValues;
+   statistics.depth = depth;
+   return true;
+}
+
+void CNodeDispatcher::asyncCall( CComputationNode::Operation operation,
+                                 const DoubleArray& array,
+                                 const ResultHandler& handler ) const
+{
+   if ( mState->nodes.empty() )
+   {
+      DoubleArray empty;
+      handler( boost::copy_exception( std::runtime_error( "No computation nodes available" ) ), empty );
+      return;
+   }
+
+   if ( mCancelToken && mCancelToken->isCancelled() )
+   {
+      CEventLoop::instance().getService().post( boost::bind( &CNodeDispatcher::failCancelled, mCancelToken, handler ) );
+      return;
+   }
+
+   boost::shared_ptr<CResultCache> cache;
+   {
+      boost::lock_guard<boost::mutex> lock( mState->guard );
+      cache = mState->cache;
+   }
+
+   if ( cache )
+   {
+      const CResultCache::Key key = CResultCache::makeKey( operation, array );
+      DoubleArray result;
+      if ( cache->find( key, result ) )
+      {
+         // Answer is delivered from the event loop thread as node answers are.
+         CEventLoop::instance().getService().post( boost::bind( &CNodeDispatcher::onCacheHit, handler, result ) );
+         return;
+      }
+
+      if ( cache->hasDirectory() )
+      {
+         // Event loop threads do not wait for the disk.
+         cache->asyncFindFile( key,
+                               boost::bind( &CNodeDispatcher::onCacheFile,
+                                            *this,
+                                            operation,
+                                            array,
+                                            cache,
+                                            key,
+                                            handler,
+                                            _1,
+                                            _2 ) );
+         return;
+      }
+
+      // Retries and hedging below apply to the cache miss as to any other call.
+      asyncCallUncached( operation,
+                         array,
+                         boost::bind( &CNodeDispatcher::onCacheMiss, cache, key, handler, _1, _2 ) );
+      return;
+   }
+
+   asyncCallUncached( operation, array, handler );
+}
+
+void CNodeDispatcher::asyncCallUncached( CComputationNode::Operation operation,
+                                         const DoubleArray& array,
+                                         const ResultHandler& handler ) const
+{
+   if ( !mJob )
+   {
+      sendCall( mState, operation, array, handler, mCancelToken );
+      return;
+   }
+
+   if ( acquireJobSlot( mState, mJob, operation, array, MatrixBlockPtr(), handler, mCancelToken ) )
+   {
+      sendCall( mState,
+                operation,
+                array,
+                boost::bind( &CNodeDispatcher::onJobCallFinished, mState, handler, _1, _2 ),
+                mCancelToken );
+   }
+}
+
+bool CNodeDispatcher::acquireJobSlot( const boost::shared_ptr<State>& state,
+                                      const boost::shared_ptr<Job>& job,
+                                      CComputationNode::Operation operation,
+                                      const DoubleArray& array,
+                                      const MatrixBlockPtr& block,
+                                      const ResultHandler& handler,
+                                      const CancelTokenPtr& token )
+{
+   boost::lock_guard<boost::mutex> lock( state->guard );
+
+   // Slot freed while other jobs wait is handed over at once, so free slot means nobody waits.
+   if ( state->jobSlots == 0 || state->jobCallsCount < state->jobSlots )
+   {
+      ++state->jobCallsCount;
+      return true;
+   }
+
+   job->calls.push_back( WaitingCall() );
+   WaitingCall& call = job->calls.back();
+   call.operation = operation;
+   call.array = array;
+   call.block = block;
+   call.handler = handler;
+   call.token = token;
+   if ( token )
+   {
+      // Cancelled call leaves the queue at once, it does not wait for a slot to be freed by other jobs.
+      call.cancelId = token->subscribe( boost::bind( &CNodeDispatcher::onWaitingCallCancelled,
+                                                     boost::weak_ptr<State>( state ),
+                                                     boost::weak_ptr<Job>( job ) ) );
+      if ( call.cancelId == 0 )
+      {
+         onWaitingCallCancelled( state, job );
+      }
+   }
+   if ( !job->isWaiting )
+   {
+      job->isWaiting = true;
+      state->waitingJobs.push_back( job );
+   }
+   return false;
+}
+
+void CNodeDispatcher::onWaitingCallCancelled( const boost::weak_ptr<State>& state, const boost::weak_ptr<Job>& job )
+{
+   const boost::shared_ptr<State> lockedState = state.lock();
+   const boost::shared_ptr<Job> lockedJob = job.lock();
+   if ( lockedState && lockedJob )
+   {
+      CEventLoop::instance().getService().post( boost::bind( &CNodeDispatcher::dropCancelledCalls,
+                                                             lockedState,
+                                                             lockedJob ) );
+   }
+}
+
+void CNodeDispatcher::dropCancelledCalls( const boost::shared_ptr<State>& state, const boost::shared_ptr<Job>& job )
+{
+   std::vector<WaitingCall> cancelledCalls;
+   {
+      boost::lock_guard<boost::mutex> lock( state->guard );
+      for ( std::deque<WaitingCall>::iterator it = job->calls.begin(); it != job->calls.end(); )
+      {
+         if ( it->token && it->token->isCancelled() )
+         {
+            cancelledCalls.push_back( WaitingCall() );
+            std::swap( cancelledCalls.back(), *it );
+            it = job->calls.erase( it );
+         }
+         else
+         {
+            ++it;
+         }
+      }
+      if ( job->isWaiting && job->calls.empty() )
+      {
+         job->isWaiting = false;
+         state->waitingJobs.remove( job );
+      }
+   }
+
+   for ( std::size_t i = 0; i < cancelledCalls.size(); ++i )
+   {
+      failCancelled( cancelledCalls[i].token, cancelledCalls[i].handler );
+   }
+}
+
+void CNodeDispatcher::onJobCallFinished( const boost::shared_ptr<State>& state,
+                                         const ResultHandler& handler,
+                                         const boost::exception_ptr& error,
+                                         DoubleArray& result )
+{
+   WaitingCall next;
+   bool hasNext = false;
+   std::vector<WaitingCall> cancelledCalls;
+   {
+      boost::lock_guard<boost::mutex> lock( state->guard );
+      while ( !hasNext )
+      {
+         if ( state->waitingJobs.empty() || ( state->jobSlots > 0 && state->jobCallsCount > state->jobSlots ) )
+         {
+            --state->jobCallsCount;
+            break;
+         }
+
+         // The slot goes to the job which waits longest, and the job goes to the end of the turn.
+         const boost::shared_ptr<Job> job = state->waitingJobs.front();
+         state->waitingJobs.pop_front();
+         std::swap( next, job->calls.front() );
+         job->calls.pop_front();
+         if ( next.token )
+         {
+            next.token->unsubscribe( next.cancelId );
+         }
+         if ( job->calls.empty() )
+         {
+            job->isWaiting = false;
+         }
+         else
+         {
+            state->waitingJobs.push_back( job );
+         }
+
+         if ( next.token && next.token->isCancelled() )
+         {
+            cancelledCalls.push_back( WaitingCall() );
+            std::swap( cancelledCalls.back(), next );
+         }
+         else
+         {
+            hasNext = true;
+         }
+      }
+   }
+
+   if ( hasNext && next.block )
+   {
+      const boost::shared_ptr<BlockCall> call( new BlockCall() );
+      call->block = next.block;
+      call->rows.swap( next.array );
+      call->handler = boost::bind( &CNodeDispatcher::onJobCallFinished, state, next.handler, _1, _2 );
+      call->token = next.token;
+      sendBlockCall( state, call );
+   }
+   else if ( hasNext )
+   {
+      sendCall( state,
+                next.operation,
+                next.array,
+                boost::bind( &CNodeDispatcher::onJobCallFinished, state, next.handler, _1, _2 ),
+                next.token );
+   }
+
+   for ( std::size_t i = 0; i < cancelledCalls.size(); ++i )
+   {
+      failCancelled( cancelledCalls[i].token, cancelledCalls[i].handler );
+   }
+
+   handler( error, result );
+}
+
+void CNodeDispatcher::sendCall( const boost::shared_ptr<State>& state,
+                                CComputationNode::Operation operation,
+                                const DoubleArray& array,
+                                const ResultHandler& handler,
+                                const CancelTokenPtr& token )
+{
+   bool isResilient = false;
+   std::size_t retriesCount = 0;
+   boost::posix_time::time_duration backoff;
+   boost::posix_time::time_duration deadline;
+   {
+      boost::lock_guard<boost::mutex> lock( state->guard );
+      isResilient = state->retriesCount > 0
+                    || state->deadline > boost::posix_time::time_duration()
+                    || ( state->hedgingPercentile > 0.0 && state->nodes.size() > 1 );
+      retriesCount = state->retriesCount;
+      backoff = state->backoff;
+      deadline = state->deadline;
+   }
+
+   if ( isResilient )
+   {
+      // Plain calls do not pay for the state of attempts and timers.
+      const boost::shared_ptr<Request> request( new Request( CEventLoop::instance().getService() ) );
+      request->retriesCount = retriesCount;
+      request->backoff = backoff;
+      request->deadline = deadline;
+      request->operation = operation;
+      request->array = array;
+      request->handler = handler;
+      request->token = token;
+      startAttempt( state, request, state->nodes.size(), true );
+      return;
+   }
+
+   // Latency of the call which waits for a connection is not its cost, so it is not estimated.
+   bool isQueued = false;
+   const std::size_t index = acquireNode( *state, array.size(), state->nodes.size(), isQueued );
+   state->nodes[index].asyncCall( operation,
+                                  array,
+                                  boost::bind( &CNodeDispatcher::onCallFinished,
+                                               state,
+                                               index,
+                                               isQueued ? 0 : array.size(),
+                                               boost::posix_time::microsec_clock::universal_time(),
+                                               handler,
+                                               _1,
+                                               _2 ),
+                                  token );
+}
+
+MatrixBlockPtr CNodeDispatcher::createBlock( std::size_t depth, DoubleArray& columns )
+{
+   const boost::shared_ptr<MatrixBlock> block( new MatrixBlock() );
+   block->handle = CResultCache::toString( CResultCache::makeBlockKey( depth, columns ) );
+   block->depth = depth;
+   block->columns.swap( columns );
+   return block;
+}
+
+void CNodeDispatcher::asyncMultiplyBlock( const MatrixBlockPtr& block,
+                                          const DoubleArray& rows,
+                                          const ResultHandler& handler ) const
+{
+   if ( mState->nodes.empty() )
+   {
+      DoubleArray empty;
+      handler( boost::copy_exception( std::runtime_error( "No computation nodes available" ) ), empty );
+      return;
+   }
+
+   if ( mCancelToken && mCancelToken->isCancelled() )
+   {
+      CEventLoop::instance().getService().post( boost::bind( &CNodeDispatcher::failCancelled, mCancelToken, handler ) );
+      return;
+   }
+
+   if ( mJob
+        && !acquireJobSlot( mState, mJob, CComputationNode::OP_MULTIPLY_PAIRS, rows, block, handler, mCancelToken ) )
+   {
+      return;
+   }
+
+   const boost::shared_ptr<BlockCall> call( new BlockCall() );
+   call->block = block;
+   call->rows = rows;
+   call->handler = mJob ? ResultHandler( boost::bind( &CNodeDispatcher::onJobCallFinished, mState, handler, _1, _2 ) )
+                        : handler;
+   call->token = mCancelToken;
+   sendBlockCall( mState, call );
+}
+
+std::size_t CNodeDispatcher::getStoredBlocksCount( std::size_t index ) const
+{
+   boost::lock_guard<boost::mutex> lock( mState->guard );
+   const State::NodeBlocks& blocks = mState->blocks.at( index );
+   std::size_t count = 0;
+   for ( State::NodeBlocks::const_iterator it = blocks.begin(); it != blocks.end(); ++it )
+   {
+      if ( it->second.isStored )
+      {
+         ++count;
+      }
+   }
+   return count;
+}
+
+std::size_t CNodeDispatcher::getBlockUploadsCount( void ) const
+{
+   boost::lock_guard<boost::mutex> lock( mState->guard );
+   return mState->uploadsCount;
+}
+
+std::size_t CNodeDispatcher::acquireBlockNode( State& state, const std::string& handle, boost::posix_time::ptime now )
+{
+   const std::size_t count = state.statistics.size();
+   std::size_t best = count;
+   double bestLoad = 0.0;
+
+   for ( std::size_t pass = 0; pass < 2 && best == count; ++pass )
+   {
+      for ( std::size_t i = 0; i < count; ++i )
+      {
+         const std::size_t index = ( state.nextNode + i ) % count;
+         const NodeStatistics& statistics = state.statistics[index];
+         if ( pass == 0 && !statistics.ejectedUntil.is_not_a_date_time() && now < statistics.ejectedUntil )
+         {
+            continue;
+         }
+
+         // Node which neither keeps nor uploads the block pays for the upload as for one more call.
+         const bool isKnown = state.blocks[index].find( handle ) != state.blocks[index].end();
+         const double load = ( statistics.inFlight + ( isKnown ? 1 : 2 ) )
+                             * ( statistics.latency > 0.0 ? statistics.latency : 1.0 );
+         if ( best == count || load < bestLoad )
+         {
+            best = index;
+            bestLoad = load;
+         }
+      }
+   }
+
+   ++state.statistics[best].inFlight;
+   state.nextNode = ( best + 1 ) % count;
+   return best;
+}
+
+void CNodeDispatcher::sendBlockCall( const boost::shared_ptr<State>& state, const boost::shared_ptr<BlockCall>& call )
+{
+   const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+   const std::string& handle = call->block->handle;
+   std::size_t index = 0;
+   bool isStored = false;
+   bool isUploadStarted = false;
+   CancelTokenPtr uploadToken;
+   boost::posix_time::time_duration deadline;
+   {
+      boost::lock_guard<boost::mutex> lock( state->guard );
+      index = acquireBlockNode( *state, handle, now );
+      call->startTime = now;
+
+      State::NodeBlocks& blocks = state->blocks[index];
+      if ( blocks.size() >= MAX_TRACKED_BLOCKS && blocks.find( handle ) == blocks.end() )
+      {
+         for ( State::NodeBlocks::iterator it = blocks.begin(); it != blocks.end(); )
+         {
+            it = it->second.isStored ? blocks.erase( it ) : ++it;
+         }
+      }
+
+      // Block being uploaded always has waiting calls, the first of them has started the upload.
+      State::NodeBlock& nodeBlock = blocks[handle];
+      isStored = nodeBlock.isStored;
+      if ( !isStored )
+      {
+         isUploadStarted = nodeBlock.waitingCalls.empty();
+         nodeBlock.waitingCalls.push_back( call );
+         if ( isUploadStarted )
+         {
+            // Upload is shared by calls of any job, so it has its own token, cancelled when nobody awaits it.
+            nodeBlock.uploadToken.reset( new CCancelToken() );
+            uploadToken = nodeBlock.uploadToken;
+            deadline = state->deadline;
+            ++state->uploadsCount;
+         }
+         if ( call->token )
+         {
+            call->cancelId = call->token->subscribe( boost::bind( &CNodeDispatcher::onBlockCallCancelled,
+                                                                  boost::weak_ptr<State>( state ),
+                                                                  index,
+                                                                  boost::weak_ptr<BlockCall>( call ) ) );
+            if ( call->cancelId == 0 )
+            {
+               onBlockCallCancelled( state, index, call );
+            }
+         }
+      }
+   }
+
+   if ( isStored )
+   {
+      multiplyBlock( state, index, call );
+   }
+   else if ( isUploadStarted )
+   {
+      if ( deadline > boost::posix_time::time_duration() )
+      {
+         uploadToken->cancelAfter( deadline, "Block upload deadline exceeded" );
+      }
+      state->nodes[index].asyncStoreBlock( *call->block,
+                                           boost::bind( &CNodeDispatcher::onBlockStored,
+                                                        state,
+                                                        index,
+                                                        call->block,
+                                                        uploadToken,
+                                                        _1,
+                                                        _2 ),
+                                           uploadToken );
+   }
+}
+
+void CNodeDispatcher::onBlockCallCancelled( const boost::weak_ptr<State>& state,
+                                            std::size_t index,
+                                            const boost::weak_ptr<BlockCall>& call )
+{
+   const boost::shared_ptr<State> lockedState = state.lock();
+   const boost::shared_ptr<BlockCall> lockedCall = call.lock();
+   if ( lockedState && lockedCall )
+   {
+      CEventLoop::instance().getService().post( boost::bind( &CNodeDispatcher::dropBlockCall,
+                                                             lockedState,
+                                                             index,
+                                                             lockedCall ) );
+   }
+}
+
+void CNodeDispatcher::dropBlockCall( const boost::shared_ptr<State>& state,
+                                     std::size_t index,
+                                     const boost::shared_ptr<BlockCall>& call )
+{
+   bool isDropped = false;
+   CancelTokenPtr uploadToken;
+   {
+      boost::lock_guard<boost::mutex> lock( state->guard );
+      State::NodeBlocks& blocks = state->blocks[index];
+      const State::NodeBlocks::iterator it = blocks.find( call->block->handle );
+      if ( it != blocks.end() )
+      {
+         std::vector< boost::shared_ptr<BlockCall> >& calls = it->second.waitingCalls;
+         const std::vector< boost::shared_ptr<BlockCall> >::iterator position =
+            std::find( calls.begin(), calls.end(), call );
+         if ( position != calls.end() )
+         {
+            calls.erase( position );
+            isDropped = true;
+         }
+
+         // Upload nobody awaits is aborted, the next call of the block starts another one.
+         if ( isDropped && calls.empty() && !it->second.isStored )
+         {
+            uploadToken = it->second.uploadToken;
+            blocks.erase( it );
+         }
+      }
+   }
+
+   if ( uploadToken )
+   {
+      uploadToken->cancel( "Block upload is not awaited" );
+   }
+   if ( isDropped )
+   {
+      DoubleArray empty;
+      onCallFinished( state, index, 0, call->startTime, call->handler, call->token->getError(), empty );
+   }
+}
+
+void CNodeDispatcher::multiplyBlock( const boost::shared_ptr<State>& state,
+                                     std::size_t index,
+                                     const boost::shared_ptr<BlockCall>& call )
+{
+   // Latency of the node does not include the upload the call has waited for.
+   call->startTime = boost::posix_time::microsec_clock::universal_time();
+   state->nodes[index].asyncMultiplyBlock( *call->block,
+                                           call->rows,
+                                           boost::bind( &CNodeDispatcher::onBlockCallFinished,
+                                                        state,
+                                                        index,
+                                                        call,
+                                                        _1,
+                                                        _2 ),
+                                           call->token );
+}
+
+void CNodeDispatcher::onBlockStored( const boost::shared_ptr<State>& state,
+                                     std::size_t index,
+                                     const MatrixBlockPtr& block,
+                                     const CancelTokenPtr& uploadToken,
+                                     const boost::exception_ptr& error,
+                                     DoubleArray& /*result*/ )
+{
+   std::vector< boost::shared_ptr<BlockCall> > calls;
+   {
+      boost::lock_guard<boost::mutex> lock( state->guard );
+      State::NodeBlocks& blocks = state->blocks[index];
+      const State::NodeBlocks::iterator it = blocks.find( block->handle );
+
+      // Upload aborted because nobody awaits it may finish after the next upload of the block has started.
+      if ( it != blocks.end() && it->second.uploadToken == uploadToken )
+      {
+         calls.swap( it->second.waitingCalls );
+         for ( std::size_t i = 0; i < calls.size(); ++i )
+         {
+            if ( calls[i]->token )
+            {
+               calls[i]->token->unsubscribe( calls[i]->cancelId );
+            }
+         }
+         if ( error )
+         {
+            blocks.erase( it );
+         }
+         else
+         {
+            it->second.isStored = true;
+            it->second.uploadToken.reset();
+         }
+      }
+   }
+
+   // Upload of the awaited block is cancelled only by the deadline, which is the failure of the node.
+   boost::exception_ptr uploadError = error;
+   if ( error && isCancelled( error ) )
+   {
+      uploadError = boost::copy_exception( std::runtime_error( "Block upload deadline exceeded" ) );
+   }
+   for ( std::size_t i = 0; i < calls.size(); ++i )
+   {
+      if ( uploadError )
+      {
+         DoubleArray empty;
+         onCallFinished( state, index, 0, calls[i]->startTime, calls[i]->handler, uploadError, empty );
+      }
+      else
+      {
+         calls[i]->isUploadAwaited = true;
+         multiplyBlock( state, index, calls[i] );
+      }
+   }
+}
+
+/**
+ * @brief Check whether call failed because node does not keep its block
+ * @param error - call error
+ * @return True - if error is CUnknownBlockError
+ */
+static bool isUnknownBlock( const boost::exception_ptr& error )
+{
+   try
+   {
+      boost::rethrow_exception( error );
+   }
+   catch ( const CUnknownBlockError& )
+   {
+      return true;
+   }
+   catch ( ... )
+   {
+
+   }
+   return false;
+}
+
+void CNodeDispatcher::onBlockCallFinished( const boost::shared_ptr<State>& state,
+                                           std::size_t index,
+                                           const boost::shared_ptr<BlockCall>& call,
+                                           const boost::exception_ptr& error,
+                                           DoubleArray& result )
+{
+   if ( error && !call->isUploadAwaited && isUnknownBlock( error ) )
+   {
+      // Node has evicted the block or lost it on restart, which is not its failure. Block is uploaded again,
+      // maybe to another node. Every such resend forgets one stale block, so the call ends up waiting for an upload.
+      {
+         boost::lock_guard<boost::mutex> lock( state->guard );
+         --state->statistics[index].inFlight;
+         State::NodeBlocks& blocks = state->blocks[index];
+         const State::NodeBlocks::iterator it = blocks.find( call->block->handle );
+         if ( it != blocks.end() && it->second.isStored )
+         {
+            blocks.erase( it );
+         }
+      }
+      sendBlockCall( state, call );
+      return;
+   }
+
+   // Cost of block call depends on the block as well as on the rows, so it is not estimated.
+   onCallFinished( state, index, 0, call->startTime, call->handler, error, result );
+}
+
+void CNodeDispatcher::onCacheMiss( const boost::shared_ptr<CResultCache>& cache,
+                                   const CResultCache::Key& key,
+                                   const ResultHandler& handler,
+                                   const boost::exception_ptr& error,
+                                   DoubleArray& result )
+{
+   if ( !error )
+   {
+      cache->store( key, result );
+   }
+   handler( error, result );
+}
+
+void CNodeDispatcher::onCacheHit( const ResultHandler& handler, DoubleArray& result )
+{
+   handler( boost::exception_ptr(), result );
+}
+
+void CNodeDispatcher::onCacheFile( CComputationNode::Operation operation,
+                                   const DoubleArray& array,
+                                   const boost::shared_ptr<CResultCache>& cache,
+                                   const CResultCache::Key& key,
+                                   const ResultHandler& handler,
+                                   bool isFound,
+                                   DoubleArray& result ) const
+{
+   if ( isFound )
+   {
+      CEventLoop::instance().getService().post( boost::bind( &CNodeDispatcher::onCacheHit, handler, result ) );
+      return;
+   }
+
+   asyncCallUncached( operation,
+                      array,
+                      boost::bind( &CNodeDispatcher::onCacheMiss, cache, key, handler, _1, _2 ) );
+}
+
+CAsyncArray CNodeDispatcher::multiplyPairs( const DoubleArray& array ) const
+{
+   CAsyncArray result;
+   asyncCall( CComputationNode::OP_MULTIPLY_PAIRS, array, boost::bind( &CAsyncArray::resolve, result, _1, _2 ) );
+   return result;
+}
+
+CAsyncArray CNodeDispatcher::sum( const DoubleArray& array ) const
+{
+   CAsyncArray result;
+   asyncCall( CComputationNode::OP_SUM, array, boost::bind( &CAsyncArray::resolve, result, _1, _2 ) );
+   return result;
+}
+
+void CNodeDispatcher::recordFailure( State& state, std::size_t index, boost::posix_time::ptime now )
+{
+   NodeStatistics& statistics = state.statistics[index];
+   if ( state.ejectionFailures > 0 && ++statistics.failuresCount >= state.ejectionFailures )
+   {
+      // Node has to fail again in a row to be ejected after it returns.
+      statistics.ejectedUntil = now + state.ejectionTime;
+      statistics.failuresCount = 0;
+   }
+}
+
+void CNodeDispatcher::startAttempt( const boost::shared_ptr<State>& state,
+                                    const boost::shared_ptr<Request>& request,
+                                    std::size_t excludedNode,
+                                    bool isHedged )
+{
+   boost::posix_time::time_duration hedgeDelay;
+   if ( isHedged )
+   {
+      boost::lock_guard<boost::mutex> lock( state->guard );
+      if ( state->hedgingPercentile > 0.0 && state->latencies.getCount() >= MIN_HEDGING_SAMPLES )
+      {
+         hedgeDelay = boost::posix_time::microseconds(
+                  static_cast<long>( state->latencies.getPercentile( state->hedgingPercentile ) ) );
+      }
+   }
+
+   bool isQueued = false;
+   const std::size_t index = acquireNode( *state, request->array.size(), excludedNode, isQueued );
+   const boost::shared_ptr<Attempt> attempt( new Attempt( CEventLoop::instance().getService(), index ) );
+   attempt->token = request->token ? request->token->createChild() : CancelTokenPtr( new CCancelToken() );
+   {
+      boost::lock_guard<boost::mutex> lock( request->guard );
+      ++request->attemptsCount;
+      request->attemptTokens.push_back( attempt->token );
+      if ( request->deadline > boost::posix_time::time_duration() )
+      {
+         attempt->timer.expires_from_now( request->deadline );
+         attempt->timer.async_wait( boost::bind( &CNodeDispatcher::onAttemptTimeout,
+                                                 state,
+                                                 request,
+                                                 attempt,
+                                                 boost::asio::placeholders::error ) );
+      }
+      if ( hedgeDelay > boost::posix_time::time_duration() )
+      {
+         request->hedgeTimer.expires_from_now( hedgeDelay );
+         request->hedgeTimer.async_wait( boost::bind( &CNodeDispatcher::onAttemptTimer,
+                                                      state,
+                                                      request,
+                                                      index,
+                                                      true,
+                                                      boost::asio::placeholders::error ) );
+      }
+   }
+
+   state->nodes[index].asyncCall( request->operation,
+                                  request->array,
+                                  boost::bind( &CNodeDispatcher::onCallFinished,
+                                               state,
+                                               index,
+                                               isQueued ? 0 : request->array.size(),
+                                               boost::posix_time::microsec_clock::universal_time(),
+                                               ResultHandler( boost::bind( &CNodeDispatcher::onAttemptFinished,
+                                                                           state,
+                                                                           request,
+                                                                           attempt,
+                                                                           _1,
+                                                                           _2 ) ),
+                                               _1,
+                                               _2 ),
+                                  attempt->token );
+}
+
+void CNodeDispatcher::onAttemptFinished( const boost::shared_ptr<State>& state,
+                                         const boost::shared_ptr<Request>& request,
+                                         const boost::shared_ptr<Attempt>& attempt,
+                                         const boost::exception_ptr& error,
+                                         DoubleArray& result )
+{
+   if ( error )
+   {
+      failAttempt( state, request, attempt, error );
+      return;
+   }
+
+   std::vector<CancelTokenPtr> attemptTokens;
+   {
+      boost::lock_guard<boost::mutex> lock( request->guard );
+      if ( request->isFinished )
+      {
+         return;
+      }
+      request->isFinished = true;
+      attempt->timer.cancel();
+      request->hedgeTimer.cancel();
+      request->backoffTimer.cancel();
+      attemptTokens.swap( request->attemptTokens );
+   }
+
+   // Other attempts are aborted, so they do not hold connections of slower nodes.
+   for ( std::size_t i = 0; i < attemptTokens.size(); ++i )
+   {
+      if ( attemptTokens[i] != attempt->token )
+      {
+         attemptTokens[i]->cancel( "Call was answered by another node" );
+      }
+   }
+
+   request->handler( error, result );
+}
+
+void CNodeDispatcher::onAttemptTimeout( const boost::shared_ptr<State>& state,
+                                        const boost::shared_ptr<Request>& request,
+                                        const boost::shared_ptr<Attempt>& attempt,
+                                        const boost::system::error_code& error )
+{
+   if ( error == boost::asio::error::operation_aborted )
+   {
+      return;
+   }
+
+   {
+      boost::lock_guard<boost::mutex> lock( request->guard );
+      if ( request->isFinished || attempt->isClosed )
+      {
+         return;
+      }
+   }
+
+   {
+      boost::lock_guard<boost::mutex> lock( state->guard );
+      recordFailure( *state, attempt->index, boost::posix_time::microsec_clock::universal_time() );
+   }
+
+   failAttempt( state,
+                request,
+                attempt,
+                boost::copy_exception( std::runtime_error( "Computation node call deadline exceeded" ) ) );
+
+   // Attempt is closed already, so its abort only frees the connection.
+   attempt->token->cancel( "Computation node call deadline exceeded" );
+}
+
+void CNodeDispatcher::failAttempt( const boost::shared_ptr<State>& state,
+                                   const boost::shared_ptr<Request>& request,
+                                   const boost::shared_ptr<Attempt>& attempt,
+                                   const boost::exception_ptr& error )
+{
+   {
+      boost::lock_guard<boost::mutex> lock( request->guard );
+      if ( request->isFinished || attempt->isClosed )
+      {
+         return;
+      }
+      attempt->isClosed = true;
+      attempt->timer.cancel();
+      request->error = error;
+
+      // Call fails only when all its attempts have failed.
+      if ( --request->attemptsCount > 0 )
+      {
+         return;
+      }
+      request->hedgeTimer.cancel();
+
+      // Cancelled call is not retried, its attempts have failed because of the cancellation.
+      if ( request->retriesDone < request->retriesCount && !( request->token && request->token->isCancelled() ) )
+      {
+         const std::size_t doublings = std::min( request->retriesDone++, MAX_BACKOFF_DOUBLINGS );
+         request->backoffTimer.expires_from_now( request->backoff * ( 1 << doublings ) );
+         request->backoffTimer.async_wait( boost::bind( &CNodeDispatcher::onAttemptTimer,
+                                                        state,
+                                                        request,
+                                                        attempt->index,
+                                                        false,
+                                                        boost::asio::placeholders::error ) );
+         return;
+      }
+      request->isFinished = true;
+   }
+
+   DoubleArray empty;
+   request->handler( error, empty );
+}
+
+void CNodeDispatcher::onAttemptTimer( const boost::shared_ptr<State>& state,
+                                      const boost::shared_ptr<Request>& request,
+                                      std::size_t excludedNode,
+                                      bool isHedge,
+                                      const boost::system::error_code& error )
+{
+   if ( error == boost::asio::error::operation_aborted )
+   {
+      return;
+   }
+
+   {
+      boost::lock_guard<boost::mutex> lock( request->guard );
+      // Hedge is useless if the original attempt has already failed, retry takes its place.
+      if ( request->isFinished || ( isHedge && ( request->isHedged || request->attemptsCount == 0 ) ) )
+      {
+         return;
+      }
+      request->isHedged = request->isHedged || isHedge;
+   }
+
+   startAttempt( state, request, excludedNode, false );
+}
+
+FutureDoubleArray CNodeDispatcher::asyncRequest( CComputationNode::Operation operation,
+                                                 const DoubleArray& array ) const
+{
+   boost::shared_ptr< boost::promise<DoubleArray> > promise( new boost::promise<DoubleArray>() );
+   FutureDoubleArray result = promise->get_future();
+   asyncCall( operation, array, boost::bind( &fulfillPromise, promise, _1, _2 ) );
+   return result;
+}
+
+void CNodeDispatcher::failCancelled( const CancelTokenPtr& token, const ResultHandler& handler )
+{
+   DoubleArray empty;
+   handler( token->getError(), empty );
+}
+
+boost::future<std::size_t> CNodeDispatcher::warmUp( void ) const
+{
+   const boost::shared_ptr<WarmUp> warmUp( new WarmUp( mState->nodes.size() ) );
+   boost::future<std::size_t> result = warmUp->promise.get_future();
+
+   std::vector<std::size_t> callsCounts;
+   for ( std::size_t i = 0; i < mState->nodes.size(); ++i )
+   {
+      callsCounts.push_back( mState->nodes[i].getMaxConnections() );
+      warmUp->callsCount += callsCounts.back();
+   }
+   if ( warmUp->callsCount == 0 )
+   {
+      warmUp->promise.set_value( 0 );
+      return result;
+   }
+
+   // Calls are accounted as regular ones, so the first latency estimate comes from them.
+   const DoubleArray array( 1, 0.0 );
+   for ( std::size_t i = 0; i < mState->nodes.size(); ++i )
+   {
+      for ( std::size_t j = 0; j < callsCounts[i]; ++j )
+      {
+         {
+            boost::lock_guard<boost::mutex> lock( mState->guard );
+            ++mState->statistics[i].inFlight;
+         }
+         mState->nodes[i].asyncCall( CComputationNode::OP_SUM,
+                                     array,
+                                     boost::bind( &CNodeDispatcher::onCallFinished,
+                                                  mState,
+                                                  i,
+                                                  array.size(),
+                                                  boost::posix_time::microsec_clock::universal_time(),
+                                                  ResultHandler( boost::bind( &CNodeDispatcher::onWarmUpFinished,
+                                                                              warmUp,
+                                                                              i,
+                                                                              _1,
+                                                                              _2 ) ),
+                                                  _1,
+                                                  _2 ) );
+      }
+   }
+   return result;
+}
+
+void CNodeDispatcher::onWarmUpFinished( const boost::shared_ptr<WarmUp>& warmUp,
+                                        std::size_t index,
+                                        const boost::exception_ptr& error,
+                                        DoubleArray& /*result*/ )
+{
+   std::size_t answeredCount = 0;
+   {
+      boost::lock_guard<boost::mutex> lock( warmUp->guard );
+      if ( error )
+      {
+         warmUp->isFailed[index] = true;
+      }
+      if ( --warmUp->callsCount > 0 )
+      {
+         return;
+      }
+      answeredCount = std::count( warmUp->isFailed.begin(), warmUp->isFailed.end(), false );
+   }
+   warmUp->promise.set_value( answeredCount );
+}
+
+FutureDoubleArray CNodeDispatcher::asyncMultiplyPairs( const DoubleArray& array ) const
+{
+   return asyncRequest( CComputationNode::OP_MULTIPLY_PAIRS, array );
+}
+
+FutureDoubleArray CNodeDispatcher::asyncSum( const DoubleArray& array ) const
+{
+   return asyncRequest( CComputationNode::OP_SUM, array );
+}
+/** @}*/
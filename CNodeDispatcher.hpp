@@ -0,0 +1,670 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CNodeDispatcher.hpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CNodeDispatcher class declaration
+ ************************************************************************/
+#ifndef CNODEDISPATCHER_HPP
+#define CNODEDISPATCHER_HPP
+
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include <vector>
+
+#include "CAsyncArray.hpp"
+#include "CCancelToken.hpp"
+#include "CComputationNode.hpp"
+#include "CResultCache.hpp"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/system/error_code.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+/**
+ * @brief This class spreads computation calls between all available nodes. \n
+ * Each call is routed to the least loaded node, where load of the node is \n
+ * number of its calls in flight weighted by its smoothed (EWMA) latency. \n
+ * Nodes which fail several calls in a row are ejected for a while. \n
+ * Optionally failed calls are retried on other nodes, calls are limited \n
+ * by deadline, and slow calls are duplicated to another node (hedged). \n
+ * Repeated calls may be answered from the result cache. \n
+ * Dispatcher provides the same operations as a single CComputationNode. \n
+ * Copies of the dispatcher share nodes and their statistics. \n
+ * Concurrent jobs use dispatchers made by createJobDispatcher(), \n
+ * so that their calls are sent to nodes in turn. \n
+ * Matrix blocks are kept resident on nodes, and block calls prefer \n
+ * nodes which already keep their block. \n
+ * Optionally chunk size and calls in flight are tuned per node from its latency. \n
+ * Calls of the dispatcher made by createCancellableDispatcher() are aborted \n
+ * together when its token is cancelled, wherever they are: waiting for \n
+ * a job slot, for a connection, or in flight.
+ */
+class CNodeDispatcher
+{
+public:
+   /**
+    * @brief Weight of the latest call in the smoothed latency
+    */
+   static const double LATENCY_SMOOTHING;
+
+   /**
+    * @brief Default number of failures in a row after which node is ejected
+    */
+   static const std::size_t DEFAULT_EJECTION_FAILURES = 3;
+
+   /**
+    * @brief Default time in milliseconds for which failing node is ejected
+    */
+   static const std::size_t DEFAULT_EJECTION_MS = 5000;
+
+   /**
+    * @brief Number of finished calls after which latency percentile is trusted for hedging
+    */
+   static const std::size_t MIN_HEDGING_SAMPLES = 20;
+
+   /**
+    * @brief Default upper bound of the tuned chunk size
+    */
+   static const std::size_t DEFAULT_MAX_CHUNK_VALUES = 1 << 20;
+
+   /**
+    * @brief Constructor
+    * @param nodes - computation nodes list, invalid nodes are skipped
+    */
+   explicit CNodeDispatcher( const std::vector<CComputationNode>& nodes );
+
+   /**
+    * @brief Destructor
+    */
+   ~CNodeDispatcher( void );
+
+   /**
+    * @brief Get number of nodes calls are spread between
+    * @return Nodes count
+    */
+   std::size_t getNodesCount( void ) const;
+
+   /**
+    * @brief Route calls with fewer values than threshold to the local node, \n
+    * since network round trip costs more than their computation. \n
+    * Has no effect if nodes list does not contain local node.
+    * @param values - threshold, 0 - local node is chosen by load as any other node
+    * @sa CComputationNode::LOCAL_HOST
+    */
+   void setLocalThreshold( std::size_t values );
+
+   /**
+    * @brief Retry failed calls on other nodes
+    * @param retriesCount - maximum number of retries of the single call, 0 - failures are reported at once
+    * @param backoff - delay before the first retry, doubled for every next one
+    */
+   void setRetries( std::size_t retriesCount, boost::posix_time::time_duration backoff );
+
+   /**
+    * @brief Limit time of the single attempt of the call. \n
+    * Attempt which is not answered in time is considered failed and may be retried. \n
+    * It is aborted, so its connection is closed and is not held by the slow node.
+    * @param deadline - attempt deadline, zero - attempts are not limited
+    */
+   void setDeadline( boost::posix_time::time_duration deadline );
+
+   /**
+    * @brief Send duplicate of the call to another node if it is not answered \n
+    * within given percentile of the latency of all calls. The first answer is taken.
+    * @param percentile - latency percentile in range (0, 1), 0 - calls are not hedged
+    * @remark Percentile is estimated by histogram bucket bound, so it may be up to 2x larger.
+    */
+   void setHedging( double percentile );
+
+   /**
+    * @brief Set when failing node is ejected. Ejected nodes do not get calls \n
+    * while there are other nodes, they are probed again after ejection time.
+    * @param failuresCount - number of failures in a row, 0 - nodes are never ejected
+    * @param duration - ejection time
+    */
+   void setEjection( std::size_t failuresCount, boost::posix_time::time_duration duration );
+
+   /**
+    * @brief Answer repeated calls from the cache instead of sending them to nodes. \n
+    * Cache is consulted before a node is chosen, so cached calls do not count \n
+    * in load or latency of any node. Successful results of other calls are stored.
+    * @param cache - result cache, null - calls are not cached
+    */
+   void setCache( const boost::shared_ptr<CResultCache>& cache );
+
+   /**
+    * @brief Limit number of calls in flight of all job dispatchers. \n
+    * Calls over the limit wait, and freed slots are given to the jobs \n
+    * which have waiting calls in turn, one call each, so that a large job \n
+    * does not hold up the small ones. Calls of this dispatcher are not limited.
+    * @param callsCount - limit of calls in flight, 0 - not limited
+    * @sa createJobDispatcher()
+    */
+   void setJobSlots( std::size_t callsCount );
+
+   /**
+    * @brief Tune call granularity of every node from its observed latency. \n
+    * Fixed overhead and cost per value of the node calls are estimated while \n
+    * calls are made, and every node gets chunk size at which the overhead takes \n
+    * small share of the call, and number of calls in flight which hides the overhead. \n
+    * Estimate follows the node, so slowed down node gets larger chunks or fewer calls. \n
+    * Nodes which have their number of calls in flight get new calls only if all nodes have. \n
+    * Decisions are published to node metrics as gauges when they change. \n
+    * Chunk size is advisory: callers split their data by getChunkValues().
+    * @param isEnabled - whether nodes are tuned
+    * @param maxChunkValues - upper bound of the chunk size
+    * @sa CCostModel, CNodeMetrics::setTuning()
+    */
+   void setAutoTuning( bool isEnabled, std::size_t maxChunkValues = DEFAULT_MAX_CHUNK_VALUES );
+
+   /**
+    * @brief Check whether nodes are tuned
+    * @return True - if auto-tuning is enabled
+    */
+   bool isAutoTuning( void ) const;
+
+   /**
+    * @brief Get tuned number of values per call of the node
+    * @param index - node index
+    * @return Chunk size, 0 if node is not tuned yet
+    */
+   std::size_t getChunkValues( std::size_t index ) const;
+
+   /**
+    * @brief Get tuned number of values per call for calls which may go to any node
+    * @return Mean chunk size of tuned nodes, 0 if no node is tuned yet
+    */
+   std::size_t getChunkValues( void ) const;
+
+   /**
+    * @brief Get tuned number of calls in flight of the node
+    * @param index - node index
+    * @return Number of calls, 0 if node is not tuned yet
+    */
+   std::size_t getInFlightDepth( std::size_t index ) const;
+
+   /**
+    * @brief Create dispatcher for one of concurrent jobs. It shares nodes, \n
+    * statistics, settings and cache with this one, but its calls which are \n
+    * not answered from the cache take job slots.
+    * @return Job dispatcher
+    * @sa setJobSlots()
+    */
+   CNodeDispatcher createJobDispatcher( void ) const;
+
+   /**
+    * @brief Create dispatcher whose calls are aborted with CCancelledError \n
+    * when the token is cancelled. It shares everything with this one, \n
+    * including the job, and calls which do not start before cancellation fail at once. \n
+    * Cancelled calls are not failures of their nodes and are not retried.
+    * @param token - cancel token of the calls
+    * @return Cancellable dispatcher
+    * @sa CCancelToken::cancelAfter()
+    */
+   CNodeDispatcher createCancellableDispatcher( const CancelTokenPtr& token ) const;
+
+   /**
+    * @brief Check whether node is ejected because of failures
+    * @param index - node index
+    * @return True - if node is ejected now
+    */
+   bool isEjected( std::size_t index ) const;
+
+   /**
+    * @brief Get node by index
+    * @param index - node index, less than getNodesCount()
+    * @return Computation node
+    */
+   const CComputationNode& getNode( std::size_t index ) const;
+
+   /**
+    * @brief Get number of calls which were sent to the node and are not finished yet
+    * @param index - node index
+    * @return Number of calls in flight
+    */
+   std::size_t getInFlightCount( std::size_t index ) const;
+
+   /**
+    * @brief Get smoothed latency of the node calls
+    * @param index - node index
+    * @return Latency, zero if node has not completed any call yet
+    */
+   boost::posix_time::time_duration getLatency( std::size_t index ) const;
+
+   /**
+    * @brief Asynchronously perform operation on the least loaded node
+    * @param operation - operation to perform
+    * @param array - operation argument
+    * @param handler - completion callback, called from the event loop thread
+    * @sa CComputationNode::asyncCall()
+    */
+   void asyncCall( CComputationNode::Operation operation,
+                   const DoubleArray& array,
+                   const ResultHandler& handler ) const;
+
+   /**
+    * @brief Asynchronously multiply pairs of numbers from passed array
+    * @param array - DoubleArray with numbers to multiply
+    * @return Async calculation result
+    * @sa CComputationNode::asyncMultiplyPairs()
+    */
+   FutureDoubleArray asyncMultiplyPairs( const DoubleArray& array ) const;
+
+   /**
+    * @brief Asynchronously sum all numbers in array
+    * @param array - DoubleArray with numbers to sum
+    * @return Async calculation result
+    * @sa CComputationNode::asyncSum()
+    */
+   FutureDoubleArray asyncSum( const DoubleArray& array ) const;
+
+   /**
+    * @brief Create block whose handle is derived from its values, \n
+    * so that equal blocks of different calls and jobs are uploaded once
+    * @param depth - values per column
+    * @param[in,out] columns - columns one after another, moved into the block
+    * @return Block
+    */
+   static MatrixBlockPtr createBlock( std::size_t depth, DoubleArray& columns );
+
+   /**
+    * @brief Asynchronously multiply rows by the columns of the block kept on nodes. \n
+    * Call goes to the least loaded node, where nodes which do not keep the block yet \n
+    * are loaded by one more call for its upload. Block is uploaded to the chosen node \n
+    * before its first call, and calls made during the upload wait for it. \n
+    * Call which finds its block evicted by the node is sent again and uploads the block anew. \n
+    * Block calls are not cached, retried, hedged or limited by deadline, only the upload is limited by deadline. \n
+    * Cancelled call which waits for the upload fails at once, and upload nobody waits for is aborted.
+    * @param block - block of columns
+    * @param rows - rows one after another, each of block depth values
+    * @param handler - completion callback, result is dot product of every row with every column, row by row
+    * @sa CComputationNode::asyncMultiplyBlock()
+    */
+   void asyncMultiplyBlock( const MatrixBlockPtr& block, const DoubleArray& rows, const ResultHandler& handler ) const;
+
+   /**
+    * @brief Get number of blocks known to be kept by the node
+    * @param index - node index
+    * @return Blocks count
+    */
+   std::size_t getStoredBlocksCount( std::size_t index ) const;
+
+   /**
+    * @brief Get number of block uploads sent to all nodes
+    * @return Uploads count
+    */
+   std::size_t getBlockUploadsCount( void ) const;
+
+   /**
+    * @brief Multiply pairs of numbers on the least loaded node
+    * @param array - DoubleArray with numbers to multiply
+    * @return Result which may be composed with further calls without waiting
+    * @sa CAsyncArray::then()
+    */
+   CAsyncArray multiplyPairs( const DoubleArray& array ) const;
+
+   /**
+    * @brief Sum all numbers in array on the least loaded node
+    * @param array - DoubleArray with numbers to sum
+    * @return Result which may be composed with further calls without waiting
+    * @sa CAsyncArray::then()
+    */
+   CAsyncArray sum( const DoubleArray& array ) const;
+
+   /**
+    * @brief Open connections to all nodes before computation starts. \n
+    * Every node gets as many trivial calls as it has connections, so connections \n
+    * are established, payload format is negotiated and initial latency is measured.
+    * @return Number of nodes which answered all calls, ready when all calls are finished
+    */
+   boost::future<std::size_t> warmUp( void ) const;
+
+private:
+   struct State;
+   struct WarmUp;
+   struct Request;
+   struct Attempt;
+   struct Job;
+   struct WaitingCall;
+   struct BlockCall;
+
+   /**
+    * @brief Choose the least loaded node and account new call on it. \n
+    * Ejected and excluded nodes, and nodes which have their tuned number of calls \n
+    * in flight, are chosen only if there are no other nodes.
+    * @param state - dispatcher state
+    * @param valuesCount - number of values in the call argument
+    * @param excludedNode - index of the node to avoid, nodes count if there is none
+    * @param[out] isQueued - whether node has more calls in flight than connections, so the call waits for one
+    * @return Index of chosen node
+    */
+   static std::size_t acquireNode( State& state, std::size_t valuesCount, std::size_t excludedNode, bool& isQueued );
+
+   /**
+    * @brief Account failed call of the node and eject it if it fails too often
+    * @param state - dispatcher state, its mutex must be locked
+    * @param index - node index
+    * @param now - current time
+    */
+   static void recordFailure( State& state, std::size_t index, boost::posix_time::ptime now );
+
+   /**
+    * @brief Update tuning decision of the node from its cost estimate. \n
+    * Chunk size changes only when estimate moves far enough, so that jitter does not flip it.
+    * @param state - dispatcher state, its mutex must be locked
+    * @param index - node index
+    * @return True - if decision has changed
+    */
+   static bool retune( State& state, std::size_t index );
+
+   /**
+    * @brief Send new attempt of the call to the least loaded node
+    * @param state - dispatcher state
+    * @param request - call state
+    * @param excludedNode - node of the previous attempt, nodes count if there is none
+    * @param isHedged - whether duplicate attempt should be sent if this one is slow
+    */
+   static void startAttempt( const boost::shared_ptr<State>& state,
+                             const boost::shared_ptr<Request>& request,
+                             std::size_t excludedNode,
+                             bool isHedged );
+
+   /**
+    * @brief Attempt completion callback. Passes the first successful result further.
+    * @param state - dispatcher state
+    * @param request - call state
+    * @param attempt - finished attempt
+    * @param error - attempt error or null on success
+    * @param result - attempt result
+    */
+   static void onAttemptFinished( const boost::shared_ptr<State>& state,
+                                  const boost::shared_ptr<Request>& request,
+                                  const boost::shared_ptr<Attempt>& attempt,
+                                  const boost::exception_ptr& error,
+                                  DoubleArray& result );
+
+   /**
+    * @brief Attempt deadline callback
+    * @param state - dispatcher state
+    * @param request - call state
+    * @param attempt - timed out attempt
+    * @param error - timer error
+    */
+   static void onAttemptTimeout( const boost::shared_ptr<State>& state,
+                                 const boost::shared_ptr<Request>& request,
+                                 const boost::shared_ptr<Attempt>& attempt,
+                                 const boost::system::error_code& error );
+
+   /**
+    * @brief Close failed attempt. Retries the call or reports error \n
+    * when no other attempt is in flight.
+    * @param state - dispatcher state
+    * @param request - call state
+    * @param attempt - failed attempt
+    * @param error - attempt error
+    */
+   static void failAttempt( const boost::shared_ptr<State>& state,
+                            const boost::shared_ptr<Request>& request,
+                            const boost::shared_ptr<Attempt>& attempt,
+                            const boost::exception_ptr& error );
+
+   /**
+    * @brief Hedging or backoff timer callback. Sends next attempt of the call.
+    * @param state - dispatcher state
+    * @param request - call state
+    * @param excludedNode - node of the previous attempt
+    * @param isHedge - true for hedging timer, false for backoff timer
+    * @param error - timer error
+    */
+   static void onAttemptTimer( const boost::shared_ptr<State>& state,
+                               const boost::shared_ptr<Request>& request,
+                               std::size_t excludedNode,
+                               bool isHedge,
+                               const boost::system::error_code& error );
+
+   /**
+    * @brief Call completion callback. Updates node statistics and passes result further.
+    * @param state - dispatcher state
+    * @param index - index of the node which performed call
+    * @param valuesCount - number of values in the call argument, 0 if its latency is not accounted by cost estimate
+    * @param startTime - time when call was sent
+    * @param handler - user completion callback
+    * @param error - call error or null on success
+    * @param result - call result
+    */
+   static void onCallFinished( const boost::shared_ptr<State>& state,
+                               std::size_t index,
+                               std::size_t valuesCount,
+                               boost::posix_time::ptime startTime,
+                               const ResultHandler& handler,
+                               const boost::exception_ptr& error,
+                               DoubleArray& result );
+
+   /**
+    * @brief Perform operation on the least loaded node bypassing the cache
+    * @param operation - operation to perform
+    * @param array - operation argument
+    * @param handler - completion callback
+    */
+   void asyncCallUncached( CComputationNode::Operation operation,
+                           const DoubleArray& array,
+                           const ResultHandler& handler ) const;
+
+   /**
+    * @brief Perform operation on the least loaded node
+    * @param state - dispatcher state
+    * @param operation - operation to perform
+    * @param array - operation argument
+    * @param handler - completion callback
+    * @param token - cancel token of the call, may be null
+    */
+   static void sendCall( const boost::shared_ptr<State>& state,
+                         CComputationNode::Operation operation,
+                         const DoubleArray& array,
+                         const ResultHandler& handler,
+                         const CancelTokenPtr& token );
+
+   /**
+    * @brief Take job slot or put the call to the queue of the job. \n
+    * Queued call is dropped from the queue as soon as its token is cancelled.
+    * @param state - dispatcher state
+    * @param job - job of the call
+    * @param operation - operation to perform
+    * @param array - operation argument
+    * @param block - block to multiply rows by, null for operation call
+    * @param handler - completion callback
+    * @param token - cancel token of the call, may be null
+    * @return True - if slot is taken and call should be sent now, false - if call waits
+    */
+   static bool acquireJobSlot( const boost::shared_ptr<State>& state,
+                               const boost::shared_ptr<Job>& job,
+                               CComputationNode::Operation operation,
+                               const DoubleArray& array,
+                               const MatrixBlockPtr& block,
+                               const ResultHandler& handler,
+                               const CancelTokenPtr& token );
+
+   /**
+    * @brief Cancel callback of the call which waits for job slot. Posts drop of cancelled calls of the job.
+    * @param state - dispatcher state
+    * @param job - job of the call
+    */
+   static void onWaitingCallCancelled( const boost::weak_ptr<State>& state, const boost::weak_ptr<Job>& job );
+
+   /**
+    * @brief Drop cancelled calls from the queue of the job and fail them
+    * @param state - dispatcher state
+    * @param job - job of the calls
+    */
+   static void dropCancelledCalls( const boost::shared_ptr<State>& state, const boost::shared_ptr<Job>& job );
+
+   /**
+    * @brief Job call completion callback. Passes its slot to the next waiting job in turn. \n
+    * Waiting calls which were cancelled meanwhile fail without taking the slot.
+    * @param state - dispatcher state
+    * @param handler - user completion callback
+    * @param error - call error or null on success
+    * @param result - call result
+    */
+   static void onJobCallFinished( const boost::shared_ptr<State>& state,
+                                  const ResultHandler& handler,
+                                  const boost::exception_ptr& error,
+                                  DoubleArray& result );
+
+   /**
+    * @brief Send block call to the node chosen by load and block locality. \n
+    * Starts upload of the block if the node does not keep it.
+    * @param state - dispatcher state
+    * @param call - block call
+    */
+   static void sendBlockCall( const boost::shared_ptr<State>& state, const boost::shared_ptr<BlockCall>& call );
+
+   /**
+    * @brief Cancel callback of the call which waits for block upload. Posts drop of the call.
+    * @param state - dispatcher state
+    * @param index - node index
+    * @param call - block call
+    */
+   static void onBlockCallCancelled( const boost::weak_ptr<State>& state,
+                                     std::size_t index,
+                                     const boost::weak_ptr<BlockCall>& call );
+
+   /**
+    * @brief Drop cancelled call from the calls which wait for block upload and fail it. \n
+    * Aborts the upload if no other call waits for it.
+    * @param state - dispatcher state
+    * @param index - node index
+    * @param call - block call
+    */
+   static void dropBlockCall( const boost::shared_ptr<State>& state,
+                              std::size_t index,
+                              const boost::shared_ptr<BlockCall>& call );
+
+   /**
+    * @brief Choose node for the block call and account the call on it
+    * @param state - dispatcher state, its mutex must be locked
+    * @param handle - block handle
+    * @param now - current time
+    * @return Index of chosen node
+    */
+   static std::size_t acquireBlockNode( State& state, const std::string& handle, boost::posix_time::ptime now );
+
+   /**
+    * @brief Send multiplication of the block call to the node which keeps the block
+    * @param state - dispatcher state
+    * @param index - node index
+    * @param call - block call
+    */
+   static void multiplyBlock( const boost::shared_ptr<State>& state,
+                              std::size_t index,
+                              const boost::shared_ptr<BlockCall>& call );
+
+   /**
+    * @brief Block upload completion callback. Sends or fails calls which wait for the block.
+    * @param state - dispatcher state
+    * @param index - node index
+    * @param block - uploaded block
+    * @param uploadToken - cancel token of the upload, result of aborted upload nobody waits for is ignored
+    * @param error - upload error or null on success
+    * @param result - empty result
+    */
+   static void onBlockStored( const boost::shared_ptr<State>& state,
+                              std::size_t index,
+                              const MatrixBlockPtr& block,
+                              const CancelTokenPtr& uploadToken,
+                              const boost::exception_ptr& error,
+                              DoubleArray& result );
+
+   /**
+    * @brief Block call completion callback. Sends call of the evicted block again, \n
+    * otherwise updates node statistics and passes result further.
+    * @param state - dispatcher state
+    * @param index - node index
+    * @param call - block call
+    * @param error - call error or null on success
+    * @param result - call result
+    */
+   static void onBlockCallFinished( const boost::shared_ptr<State>& state,
+                                    std::size_t index,
+                                    const boost::shared_ptr<BlockCall>& call,
+                                    const boost::exception_ptr& error,
+                                    DoubleArray& result );
+
+   /**
+    * @brief Store successful result of the call in the cache and pass it further
+    * @param cache - result cache
+    * @param key - key of the call
+    * @param handler - user completion callback
+    * @param error - call error or null on success
+    * @param result - call result
+    */
+   static void onCacheMiss( const boost::shared_ptr<CResultCache>& cache,
+                            const CResultCache::Key& key,
+                            const ResultHandler& handler,
+                            const boost::exception_ptr& error,
+                            DoubleArray& result );
+
+   /**
+    * @brief Pass cached result to the user callback
+    * @param handler - user completion callback
+    * @param result - cached result
+    */
+   static void onCacheHit( const ResultHandler& handler, DoubleArray& result );
+
+   /**
+    * @brief Cache directory lookup callback. Passes found result to the user callback \n
+    * or performs the call on a node, called from the disk pool thread.
+    * @param operation - operation to perform
+    * @param array - operation argument
+    * @param cache - result cache
+    * @param key - key of the call
+    * @param handler - user completion callback
+    * @param isFound - whether result was read from the directory
+    * @param result - cached result
+    */
+   void onCacheFile( CComputationNode::Operation operation,
+                     const DoubleArray& array,
+                     const boost::shared_ptr<CResultCache>& cache,
+                     const CResultCache::Key& key,
+                     const ResultHandler& handler,
+                     bool isFound,
+                     DoubleArray& result ) const;
+
+   /**
+    * @brief Perform operation and return its result as future
+    * @param operation - operation to perform
+    * @param array - operation argument
+    * @return Async operation result
+    */
+   FutureDoubleArray asyncRequest( CComputationNode::Operation operation, const DoubleArray& array ) const;
+
+   /**
+    * @brief Fail call whose token was cancelled before it was sent
+    * @param token - cancelled token
+    * @param handler - user completion callback
+    */
+   static void failCancelled( const CancelTokenPtr& token, const ResultHandler& handler );
+
+   /**
+    * @brief Warm up call completion callback
+    * @param warmUp - warm up state
+    * @param index - index of the node which performed call
+    * @param error - call error or null on success
+    * @param result - call result
+    */
+   static void onWarmUpFinished( const boost::shared_ptr<WarmUp>& warmUp,
+                                 std::size_t index,
+                                 const boost::exception_ptr& error,
+                                 DoubleArray& result );
+
+private:
+   boost::shared_ptr<State> mState;    ///< Nodes and their statistics
+   boost::shared_ptr<Job> mJob;        ///< Queue of the job calls, null if dispatcher is not made for a job
+   CancelTokenPtr mCancelToken;        ///< Aborts calls of this dispatcher, null if they are not cancellable
+};
+/** @}*/
+#endif // CNODEDISPATCHER_HPP
@@ -0,0 +1,148 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CNodeMetrics.cpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CNodeMetrics class definition
+ ************************************************************************/
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include "CNodeMetrics.hpp"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+CNodeMetrics::CNodeMetrics( const std::string& name )
+   : mName( name )
+   , mRequests( 0 )
+   , mBytesSent( 0 )
+   , mBytesReceived( 0 )
+   , mErrors( 0 )
+   , mRetries( 0 )
+   , mTunedOverhead( 0.0 )
+   , mTunedCostPerValue( 0.0 )
+   , mTunedChunkValues( 0 )
+   , mTunedDepth( 0 )
+{
+
+}
+
+CNodeMetrics::~CNodeMetrics( void )
+{
+
+}
+
+const std::string& CNodeMetrics::getName( void ) const
+{
+   return mName;
+}
+
+const char* CNodeMetrics::getPhaseName( Phase phase )
+{
+   static const char* const names[PHASES_COUNT] =
+   {
+      "resolve", "connect", "write", "first_byte", "body", "parse", "total"
+   };
+   return names[phase];
+}
+
+boost::posix_time::ptime CNodeMetrics::now( void )
+{
+   return boost::posix_time::microsec_clock::universal_time();
+}
+
+boost::posix_time::ptime CNodeMetrics::record( Phase phase, boost::posix_time::ptime start )
+{
+   const boost::posix_time::ptime end = now();
+   const boost::int64_t duration = ( end - start ).total_microseconds();
+   mPhases[phase].record( duration > 0 ? static_cast<boost::uint64_t>( duration ) : 0 );
+   return end;
+}
+
+void CNodeMetrics::addRequest( void )
+{
+   mRequests.fetch_add( 1, boost::memory_order_relaxed );
+}
+
+void CNodeMetrics::addBytesSent( boost::uint64_t bytes )
+{
+   mBytesSent.fetch_add( bytes, boost::memory_order_relaxed );
+}
+
+void CNodeMetrics::addBytesReceived( boost::uint64_t bytes )
+{
+   mBytesReceived.fetch_add( bytes, boost::memory_order_relaxed );
+}
+
+void CNodeMetrics::addError( void )
+{
+   mErrors.fetch_add( 1, boost::memory_order_relaxed );
+}
+
+void CNodeMetrics::addRetry( void )
+{
+   mRetries.fetch_add( 1, boost::memory_order_relaxed );
+}
+
+boost::uint64_t CNodeMetrics::getRequests( void ) const
+{
+   return mRequests.load( boost::memory_order_relaxed );
+}
+
+boost::uint64_t CNodeMetrics::getBytesSent( void ) const
+{
+   return mBytesSent.load( boost::memory_order_relaxed );
+}
+
+boost::uint64_t CNodeMetrics::getBytesReceived( void ) const
+{
+   return mBytesReceived.load( boost::memory_order_relaxed );
+}
+
+boost::uint64_t CNodeMetrics::getErrors( void ) const
+{
+   return mErrors.load( boost::memory_order_relaxed );
+}
+
+boost::uint64_t CNodeMetrics::getRetries( void ) const
+{
+   return mRetries.load( boost::memory_order_relaxed );
+}
+
+void CNodeMetrics::setTuning( double overhead,
+                              double costPerValue,
+                              boost::uint64_t chunkValues,
+                              boost::uint64_t depth )
+{
+   mTunedOverhead.store( overhead, boost::memory_order_relaxed );
+   mTunedCostPerValue.store( costPerValue, boost::memory_order_relaxed );
+   mTunedChunkValues.store( chunkValues, boost::memory_order_relaxed );
+   mTunedDepth.store( depth, boost::memory_order_relaxed );
+}
+
+double CNodeMetrics::getTunedOverhead( void ) const
+{
+   return mTunedOverhead.load( boost::memory_order_relaxed );
+}
+
+double CNodeMetrics::getTunedCostPerValue( void ) const
+{
+   return mTunedCostPerValue.load( boost::memory_order_relaxed );
+}
+
+boost::uint64_t CNodeMetrics::getTunedChunkValues( void ) const
+{
+   return mTunedChunkValues.load( boost::memory_order_relaxed );
+}
+
+boost::uint64_t CNodeMetrics::getTunedDepth( void ) const
+{
+   return mTunedDepth.load( boost::memory_order_relaxed );
+}
+
+const CHistogram& CNodeMetrics::getPhase( Phase phase ) const
+{
+   return mPhases[phase];
+}
+/** @}*/
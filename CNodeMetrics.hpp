@@ -0,0 +1,133 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CNodeMetrics.hpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CNodeMetrics class declaration
+ ************************************************************************/
+#ifndef CNODEMETRICS_HPP
+#define CNODEMETRICS_HPP
+
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include <string>
+
+#include "CHistogram.hpp"
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+/**
+ * @brief This class collects counters and phase durations of the single computation node. \n
+ * All methods are lock-free and may be called from any thread.
+ * @sa CMetrics
+ */
+class CNodeMetrics : private boost::noncopyable
+{
+public:
+   /**
+    * @brief Phases of the node call
+    */
+   enum Phase
+   {
+      PHASE_RESOLVE,       ///< Host name resolution
+      PHASE_CONNECT,       ///< TCP connection establishment
+      PHASE_WRITE,         ///< Sending request
+      PHASE_FIRST_BYTE,    ///< Waiting for response headers after request was sent
+      PHASE_BODY,          ///< Reading response body
+      PHASE_PARSE,         ///< Decoding response payload
+      PHASE_TOTAL,         ///< Whole call, from sending to result
+      PHASES_COUNT
+   };
+
+   /**
+    * @brief Constructor
+    * @param name - node name
+    */
+   explicit CNodeMetrics( const std::string& name );
+
+   /**
+    * @brief Destructor
+    */
+   ~CNodeMetrics( void );
+
+   /**
+    * @brief Get node name
+    * @return Node name
+    */
+   const std::string& getName( void ) const;
+
+   /**
+    * @brief Get name of the phase as it appears in dumps
+    * @param phase - phase
+    * @return Phase name
+    */
+   static const char* getPhaseName( Phase phase );
+
+   /**
+    * @brief Get current time for measuring phases
+    * @return Current time
+    */
+   static boost::posix_time::ptime now( void );
+
+   /**
+    * @brief Record phase which lasted from start until now
+    * @param phase - finished phase
+    * @param start - time when phase has started
+    * @return Current time, that is start of the next phase
+    */
+   boost::posix_time::ptime record( Phase phase, boost::posix_time::ptime start );
+
+   void addRequest( void );                        ///< Account sent request
+   void addBytesSent( boost::uint64_t bytes );     ///< Account sent bytes
+   void addBytesReceived( boost::uint64_t bytes ); ///< Account received bytes
+   void addError( void );                          ///< Account failed request
+   void addRetry( void );                          ///< Account resent request
+
+   boost::uint64_t getRequests( void ) const;      ///< Get number of sent requests
+   boost::uint64_t getBytesSent( void ) const;     ///< Get number of sent bytes
+   boost::uint64_t getBytesReceived( void ) const; ///< Get number of received bytes
+   boost::uint64_t getErrors( void ) const;        ///< Get number of failed requests
+   boost::uint64_t getRetries( void ) const;       ///< Get number of resent requests
+
+   /**
+    * @brief Publish auto-tuning decision of the node
+    * @param overhead - estimated fixed overhead of the call in microseconds
+    * @param costPerValue - estimated cost of the single value in microseconds
+    * @param chunkValues - chosen number of values per call
+    * @param depth - chosen number of calls in flight
+    * @sa CNodeDispatcher::setAutoTuning()
+    */
+   void setTuning( double overhead, double costPerValue, boost::uint64_t chunkValues, boost::uint64_t depth );
+
+   double getTunedOverhead( void ) const;             ///< Get estimated call overhead in microseconds
+   double getTunedCostPerValue( void ) const;         ///< Get estimated cost per value in microseconds
+   boost::uint64_t getTunedChunkValues( void ) const; ///< Get chosen values per call, 0 if node is not tuned
+   boost::uint64_t getTunedDepth( void ) const;       ///< Get chosen calls in flight, 0 if node is not tuned
+
+   /**
+    * @brief Get durations of the phase in microseconds
+    * @param phase - phase
+    * @return Histogram of phase durations
+    */
+   const CHistogram& getPhase( Phase phase ) const;
+
+private:
+   std::string mName;                              ///< Node name
+   boost::atomic<boost::uint64_t> mRequests;       ///< Number of sent requests
+   boost::atomic<boost::uint64_t> mBytesSent;      ///< Number of sent bytes
+   boost::atomic<boost::uint64_t> mBytesReceived;  ///< Number of received bytes
+   boost::atomic<boost::uint64_t> mErrors;         ///< Number of failed requests
+   boost::atomic<boost::uint64_t> mRetries;        ///< Number of resent requests
+   boost::atomic<double> mTunedOverhead;           ///< Estimated call overhead in microseconds
+   boost::atomic<double> mTunedCostPerValue;       ///< Estimated cost per value in microseconds
+   boost::atomic<boost::uint64_t> mTunedChunkValues; ///< Chosen values per call
+   boost::atomic<boost::uint64_t> mTunedDepth;     ///< Chosen calls in flight
+   CHistogram mPhases[PHASES_COUNT];               ///< Phase durations in microseconds
+};
+/** @}*/
+#endif // CNODEMETRICS_HPP
@@ -0,0 +1,283 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CRequestBatcher.cpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CRequestBatcher class definition
+ ************************************************************************/
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include "CRequestBatcher.hpp"
+#include "WireFormat.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <boost/bind.hpp>
+
+/**
+ * @brief Status codes which mean that remote service does not provide /batch method
+ */
+static const unsigned int HTTP_NOT_FOUND = 404;
+static const unsigned int HTTP_UNSUPPORTED_MEDIA_TYPE = 415;
+
+CRequestBatcher::CRequestBatcher( boost::asio::io_service& service,
+                                  const Sender& sender,
+                                  const Fallback& fallback,
+                                  boost::posix_time::time_duration maxDelay,
+                                  std::size_t maxValues )
+   : mService( service )
+   , mSender( sender )
+   , mFallback( fallback )
+   , mMaxDelay( maxDelay )
+   , mMaxValues( maxValues )
+   , mTimer( service )
+   , mGuard()
+   , mEntries( new std::vector<EntryPtr>() )
+   , mValuesCount( 0 )
+   , mGeneration( 0 )
+   , mIsSupported( true )
+{
+
+}
+
+CRequestBatcher::~CRequestBatcher( void )
+{
+
+}
+
+bool CRequestBatcher::accepts( const DoubleArray& array ) const
+{
+   return mIsSupported && array.size() < mMaxValues;
+}
+
+void CRequestBatcher::add( CComputationNode::Operation operation,
+                           const DoubleArray& array,
+                           const ResultHandler& handler,
+                           const CancelTokenPtr& token )
+{
+   const EntryPtr entry( new Entry() );
+   entry->operation = operation;
+   entry->array = array;
+   entry->handler = handler;
+   entry->token = token;
+
+   EntriesPtr ready;
+   {
+      boost::lock_guard<boost::mutex> lock( mGuard );
+
+      mEntries->push_back( entry );
+      mValuesCount += array.size();
+      if ( token )
+      {
+         // Drop runs under the same lock, so it finds the call either in the batch or already sent.
+         entry->cancelId = token->subscribe( boost::bind( &CRequestBatcher::onCancelRequested,
+                                                          boost::weak_ptr<CRequestBatcher>( shared_from_this() ),
+                                                          boost::weak_ptr<Entry>( entry ) ) );
+         if ( entry->cancelId == 0 )
+         {
+            onCancelRequested( shared_from_this(), entry );
+         }
+      }
+
+      if ( mValuesCount >= mMaxValues )
+      {
+         ready.reset( new std::vector<EntryPtr>() );
+         ready.swap( mEntries );
+         mValuesCount = 0;
+         ++mGeneration;
+         mTimer.cancel();
+      }
+      else if ( mEntries->size() == 1 )
+      {
+         // First call of the batch starts collection window.
+         mTimer.expires_from_now( mMaxDelay );
+         mTimer.async_wait( boost::bind( &CRequestBatcher::onTimer,
+                                         shared_from_this(),
+                                         boost::asio::placeholders::error,
+                                         mGeneration ) );
+      }
+   }
+
+   if ( ready )
+   {
+      send( ready );
+   }
+}
+
+void CRequestBatcher::flush( void )
+{
+   EntriesPtr ready( new std::vector<EntryPtr>() );
+   {
+      boost::lock_guard<boost::mutex> lock( mGuard );
+      ready.swap( mEntries );
+      mValuesCount = 0;
+      ++mGeneration;
+      mTimer.cancel();
+   }
+
+   if ( !ready->empty() )
+   {
+      send( ready );
+   }
+}
+
+void CRequestBatcher::onTimer( const boost::system::error_code& error, std::size_t generation )
+{
+   if ( error == boost::asio::error::operation_aborted )
+   {
+      return;
+   }
+
+   EntriesPtr ready;
+   {
+      boost::lock_guard<boost::mutex> lock( mGuard );
+
+      // Batch may have been sent already because of its size.
+      if ( generation != mGeneration || mEntries->empty() )
+      {
+         return;
+      }
+
+      ready.reset( new std::vector<EntryPtr>() );
+      ready.swap( mEntries );
+      mValuesCount = 0;
+      ++mGeneration;
+   }
+
+   send( ready );
+}
+
+void CRequestBatcher::finishEntry( const EntryPtr& entry, const boost::exception_ptr& error, DoubleArray& result )
+{
+   // Result of the call which was cancelled after it was sent arrives late and is ignored.
+   if ( entry->isFinished.exchange( true ) )
+   {
+      return;
+   }
+   if ( entry->token )
+   {
+      entry->token->unsubscribe( entry->cancelId );
+   }
+   entry->handler( error, result );
+}
+
+void CRequestBatcher::onCancelRequested( const boost::weak_ptr<CRequestBatcher>& batcher,
+                                         const boost::weak_ptr<Entry>& entry )
+{
+   const boost::shared_ptr<CRequestBatcher> lockedBatcher = batcher.lock();
+   const EntryPtr lockedEntry = entry.lock();
+   if ( lockedBatcher && lockedEntry )
+   {
+      lockedBatcher->mService.post( boost::bind( &CRequestBatcher::dropEntry, lockedBatcher, lockedEntry ) );
+   }
+}
+
+void CRequestBatcher::dropEntry( const EntryPtr& entry )
+{
+   {
+      boost::lock_guard<boost::mutex> lock( mGuard );
+      const std::vector<EntryPtr>::iterator it = std::find( mEntries->begin(), mEntries->end(), entry );
+      if ( it != mEntries->end() )
+      {
+         mValuesCount -= entry->array.size();
+         mEntries->erase( it );
+      }
+   }
+
+   DoubleArray empty;
+   finishEntry( entry, entry->token->getError(), empty );
+}
+
+void CRequestBatcher::send( const EntriesPtr& entries )
+{
+   if ( entries->size() == 1 || !mIsSupported )
+   {
+      // Nothing to coalesce.
+      sendSeparately( entries );
+      return;
+   }
+
+   HttpRequest request;
+   request.uri = "/batch";
+   request.contentType = wire::BATCH_CONTENT_TYPE;
+   request.accept = wire::BATCH_CONTENT_TYPE;
+
+   wire::encodeBatchHeader( entries->size(), request.body );
+   for ( std::vector<EntryPtr>::iterator it = entries->begin(); it != entries->end(); ++it )
+   {
+      wire::appendBatchItem( ( *it )->operation, ( *it )->array, request.body );
+   }
+
+   CHttpConnection::ResponseHandler handler( boost::bind( &CRequestBatcher::onResponse,
+                                                          shared_from_this(),
+                                                          entries,
+                                                          _1,
+                                                          _2 ) );
+   mSender( request, handler );
+}
+
+void CRequestBatcher::onResponse( const EntriesPtr& entries,
+                                  const boost::exception_ptr& error,
+                                  const HttpResponse& response )
+{
+   DoubleArray empty;
+
+   if ( error )
+   {
+      for ( std::vector<EntryPtr>::iterator it = entries->begin(); it != entries->end(); ++it )
+      {
+         finishEntry( *it, error, empty );
+      }
+      return;
+   }
+
+   if ( response.statusCode == HTTP_NOT_FOUND || response.statusCode == HTTP_UNSUPPORTED_MEDIA_TYPE )
+   {
+      // Remote service does not provide batches. Remember it and send calls one by one.
+      mIsSupported = false;
+      sendSeparately( entries );
+      return;
+   }
+
+   std::vector<wire::BatchItem> items;
+   if ( response.statusCode != 200
+        || !wire::decodeBatch( response.body, response.body + response.bodySize, items )
+        || items.size() != entries->size() )
+   {
+      const boost::exception_ptr batchError =
+            boost::copy_exception( std::runtime_error( "Wrong batch response: \n"
+                                                       + std::string( response.body, response.bodySize ) ) );
+      for ( std::vector<EntryPtr>::iterator it = entries->begin(); it != entries->end(); ++it )
+      {
+         finishEntry( *it, batchError, empty );
+      }
+      return;
+   }
+
+   for ( std::size_t i = 0; i < items.size(); ++i )
+   {
+      if ( items[i].code != 0 )
+      {
+         finishEntry( ( *entries )[i], boost::copy_exception( std::runtime_error( "Batched call failed" ) ), empty );
+      }
+      else
+      {
+         finishEntry( ( *entries )[i], boost::exception_ptr(), items[i].values );
+      }
+   }
+}
+
+void CRequestBatcher::sendSeparately( const EntriesPtr& entries )
+{
+   for ( std::vector<EntryPtr>::iterator it = entries->begin(); it != entries->end(); ++it )
+   {
+      mFallback( ( *it )->operation,
+                 ( *it )->array,
+                 boost::bind( &CRequestBatcher::finishEntry, *it, _1, _2 ),
+                 ( *it )->token );
+   }
+}
+/** @}*/
@@ -0,0 +1,187 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CRequestBatcher.hpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CRequestBatcher class declaration
+ ************************************************************************/
+#ifndef CREQUESTBATCHER_HPP
+#define CREQUESTBATCHER_HPP
+
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include <vector>
+
+#include "CComputationNode.hpp"
+#include "CHttpConnection.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/atomic.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/noncopyable.hpp>
+
+/**
+ * @brief This class collects small node calls issued within a short \n
+ * time window and sends them as a single request to the /batch method. \n
+ * Results of the batch are split back and passed to handlers of individual calls.
+ * @sa wire::BATCH_CONTENT_TYPE
+ */
+class CRequestBatcher : public boost::enable_shared_from_this<CRequestBatcher>
+                      , private boost::noncopyable
+{
+public:
+   /**
+    * @brief Callback which sends request to the remote service, \n
+    * request body and handler are moved out
+    */
+   typedef boost::function<void( HttpRequest& request,
+                                 CHttpConnection::ResponseHandler& handler )> Sender;
+
+   /**
+    * @brief Callback which performs single call without batching
+    */
+   typedef boost::function<void( CComputationNode::Operation operation,
+                                 const DoubleArray& array,
+                                 const ResultHandler& handler,
+                                 const CancelTokenPtr& token )> Fallback;
+
+   /**
+    * @brief Constructor
+    * @param service - io_service which drives batch timer
+    * @param sender - sends batch request
+    * @param fallback - sends calls one by one if remote service does not support batches
+    * @param maxDelay - how long the first call of a batch may wait for others
+    * @param maxValues - batch is sent at once when it holds that many values
+    */
+   CRequestBatcher( boost::asio::io_service& service,
+                    const Sender& sender,
+                    const Fallback& fallback,
+                    boost::posix_time::time_duration maxDelay,
+                    std::size_t maxValues );
+
+   /**
+    * @brief Destructor
+    */
+   ~CRequestBatcher( void );
+
+   /**
+    * @brief Check whether call may be batched
+    * @param array - call argument
+    * @return True - if call is small enough and remote service supports batches
+    */
+   bool accepts( const DoubleArray& array ) const;
+
+   /**
+    * @brief Add call to the current batch. \n
+    * Cancelled call leaves the batch if it is not sent yet, otherwise its result is ignored.
+    * @param operation - operation to perform
+    * @param array - operation argument
+    * @param handler - completion callback
+    * @param token - fails the call with CCancelledError when cancelled, may be null
+    */
+   void add( CComputationNode::Operation operation,
+             const DoubleArray& array,
+             const ResultHandler& handler,
+             const CancelTokenPtr& token = CancelTokenPtr() );
+
+   /**
+    * @brief Send current batch without waiting
+    */
+   void flush( void );
+
+private:
+   /**
+    * @brief Single call in the batch
+    */
+   struct Entry
+   {
+      Entry( void )
+         : operation( CComputationNode::OP_SUM )
+         , array()
+         , handler()
+         , token()
+         , cancelId( 0 )
+         , isFinished( false )
+      {
+
+      }
+
+      CComputationNode::Operation operation;    ///< Operation to perform
+      DoubleArray array;                        ///< Operation argument
+      ResultHandler handler;                    ///< Completion callback
+      CancelTokenPtr token;                     ///< Cancel token of the call, may be null
+      std::size_t cancelId;                     ///< Subscription to the cancel token
+      boost::atomic<bool> isFinished;           ///< Whether handler was called, by result or by cancellation
+   };
+
+   typedef boost::shared_ptr<Entry> EntryPtr;
+   typedef boost::shared_ptr< std::vector<EntryPtr> > EntriesPtr;
+
+   /**
+    * @brief Call handler of the entry unless it was already called
+    * @param entry - call
+    * @param error - call error or null on success
+    * @param result - call result
+    */
+   static void finishEntry( const EntryPtr& entry, const boost::exception_ptr& error, DoubleArray& result );
+
+   /**
+    * @brief Cancel token callback of the call. Hands dropping over to the io_service.
+    * @param batcher - batcher of the call
+    * @param entry - cancelled call
+    */
+   static void onCancelRequested( const boost::weak_ptr<CRequestBatcher>& batcher,
+                                  const boost::weak_ptr<Entry>& entry );
+
+   /**
+    * @brief Remove cancelled call from the current batch, if it is not sent yet, and fail it
+    * @param entry - cancelled call
+    */
+   void dropEntry( const EntryPtr& entry );
+
+   /**
+    * @brief Batch timer callback
+    * @param error - timer error
+    * @param generation - number of the batch the timer was started for
+    */
+   void onTimer( const boost::system::error_code& error, std::size_t generation );
+
+   /**
+    * @brief Send collected calls
+    * @param entries - calls to send
+    */
+   void send( const EntriesPtr& entries );
+
+   /**
+    * @brief Batch response callback. Splits results between calls.
+    * @param entries - calls of the batch
+    * @param error - exchange error or null on success
+    * @param response - remote service response
+    */
+   void onResponse( const EntriesPtr& entries,
+                    const boost::exception_ptr& error,
+                    const HttpResponse& response );
+
+   /**
+    * @brief Send calls one by one
+    * @param entries - calls to send
+    */
+   void sendSeparately( const EntriesPtr& entries );
+
+private:
+   boost::asio::io_service& mService;           ///< IO service which runs cancellation
+   Sender mSender;                              ///< Sends batch request
+   Fallback mFallback;                          ///< Sends single call
+   boost::posix_time::time_duration mMaxDelay;  ///< Batch collection window
+   std::size_t mMaxValues;                      ///< Batch size limit
+   boost::asio::deadline_timer mTimer;          ///< Fires when collection window ends
+   boost::mutex mGuard;                         ///< Mutex for current batch
+   EntriesPtr mEntries;                         ///< Current batch
+   std::size_t mValuesCount;                    ///< Number of values in the current batch
+   std::size_t mGeneration;                     ///< Number of the current batch
+   boost::atomic<bool> mIsSupported;            ///< Whether remote service provides /batch method
+};
+/** @}*/
+#endif // CREQUESTBATCHER_HPP
@@ -0,0 +1,453 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CResultCache.cpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CResultCache class definition
+ ************************************************************************/
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include "CResultCache.hpp"
+#include "CEventLoop.hpp"
+#include "WireFormat.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+
+/**
+ * @brief Multipliers of the two hash lanes
+ */
+static const boost::uint64_t LOW_MULTIPLIER = 0x9E3779B97F4A7C15ULL;
+static const boost::uint64_t HIGH_MULTIPLIER = 0xC2B2AE3D27D4EB4FULL;
+
+/**
+ * @brief Memory used by the cache entry besides its values
+ */
+static const std::size_t ENTRY_OVERHEAD = 96;
+
+/**
+ * @brief Tag of block keys, added to block depth
+ */
+static const boost::uint64_t BLOCK_TAG = 1ULL << 32;
+
+/**
+ * @brief Extension of the files with persistent results
+ */
+static const char FILE_EXTENSION[] = ".darr";
+
+/**
+ * @brief Number of threads which read and write files with persistent results
+ */
+static const std::size_t DISK_THREADS_COUNT = 2;
+
+const std::size_t CResultCache::DEFAULT_DIRECTORY_CAPACITY;
+
+/**
+ * @brief Get pool which reads and writes files, so that event loop threads never wait for the disk
+ * @return Disk pool, created on first call
+ */
+static CEventLoop& getDiskPool( void )
+{
+   // Shared event loop is created first, so it outlives the pool whose callbacks call nodes.
+   CEventLoop::instance();
+   static CEventLoop diskPool( DISK_THREADS_COUNT );
+   return diskPool;
+}
+
+/**
+ * @brief Get disk space used by the file
+ * @param fileName - file path
+ * @param[out] size - allocated size in bytes
+ * @param[out] modified - last modification time
+ * @return True - if file exists
+ */
+static bool getFileSize( const std::string& fileName, std::size_t& size, time_t& modified )
+{
+   struct stat info;
+   if ( ::stat( fileName.c_str(), &info ) != 0 )
+   {
+      return false;
+   }
+
+   // Small results take a whole block each, so allocated size is accounted rather than length.
+   size = static_cast<std::size_t>( info.st_blocks ) * 512;
+   modified = info.st_mtime;
+   return true;
+}
+
+/**
+ * @brief Rotate bits left
+ * @param value - value to rotate
+ * @param shift - number of bits, in range (0, 64)
+ * @return Rotated value
+ */
+static inline boost::uint64_t rotateLeft( boost::uint64_t value, unsigned int shift )
+{
+   return ( value << shift ) | ( value >> ( 64 - shift ) );
+}
+
+/**
+ * @brief Final avalanche of the hash lane
+ * @param value - lane state
+ * @return Mixed value
+ */
+static inline boost::uint64_t mix( boost::uint64_t value )
+{
+   value ^= value >> 33;
+   value *= 0xFF51AFD7ED558CCDULL;
+   value ^= value >> 33;
+   value *= 0xC4CEB9FE1A85EC53ULL;
+   value ^= value >> 33;
+   return value;
+}
+
+CResultCache::CResultCache( std::size_t capacityBytes,
+                            const std::string& directory,
+                            std::size_t directoryCapacityBytes )
+   : mCapacity( capacityBytes )
+   , mDirectory( directory )
+   , mSize( 0 )
+   , mEntries()
+   , mIndex()
+   , mGuard()
+   , mHits( 0 )
+   , mMisses( 0 )
+   , mDirectoryCapacity( directoryCapacityBytes )
+   , mDirectorySize( 0 )
+   , mFiles()
+   , mFileIndex()
+   , mFilesGuard()
+{
+   if ( !mDirectory.empty() )
+   {
+      scanDirectory();
+   }
+}
+
+CResultCache::~CResultCache( void )
+{
+
+}
+
+CResultCache::Key CResultCache::makeKey( CComputationNode::Operation operation, const DoubleArray& array )
+{
+   return hashValues( static_cast<boost::uint64_t>( operation ), array );
+}
+
+CResultCache::Key CResultCache::makeBlockKey( std::size_t depth, const DoubleArray& columns )
+{
+   // Tags of blocks never coincide with operation codes.
+   return hashValues( BLOCK_TAG + depth, columns );
+}
+
+std::string CResultCache::toString( const Key& key )
+{
+   char text[33];
+   std::snprintf( text,
+                  sizeof( text ),
+                  "%016llx%016llx",
+                  static_cast<unsigned long long>( key.high ),
+                  static_cast<unsigned long long>( key.low ) );
+   return text;
+}
+
+CResultCache::Key CResultCache::hashValues( boost::uint64_t tag, const DoubleArray& array )
+{
+   // Two independent lanes over raw bits of the values, one multiplication per value each.
+   // Lanes differ in how they combine values, so a collision in one is not repeated in the other.
+   boost::uint64_t low = LOW_MULTIPLIER * ( tag + 1 );
+   boost::uint64_t high = HIGH_MULTIPLIER ^ array.size();
+   for ( DoubleArray::const_iterator it = array.begin(); it != array.end(); ++it )
+   {
+      boost::uint64_t bits = 0;
+      std::memcpy( &bits, &*it, sizeof( bits ) );
+      low = rotateLeft( low ^ bits, 31 ) * LOW_MULTIPLIER;
+      high = rotateLeft( high + bits, 27 ) * HIGH_MULTIPLIER;
+   }
+
+   Key key;
+   key.low = mix( low ^ array.size() );
+   key.high = mix( high + tag );
+   return key;
+}
+
+bool CResultCache::find( const Key& key, DoubleArray& result )
+{
+   {
+      boost::lock_guard<boost::mutex> lock( mGuard );
+      const Index::iterator it = mIndex.find( key );
+      if ( it != mIndex.end() )
+      {
+         mEntries.splice( mEntries.begin(), mEntries, it->second );
+         result = it->second->result;
+         ++mHits;
+         return true;
+      }
+   }
+
+   if ( mDirectory.empty() )
+   {
+      ++mMisses;
+   }
+   return false;
+}
+
+bool CResultCache::hasDirectory( void ) const
+{
+   return !mDirectory.empty();
+}
+
+void CResultCache::asyncFindFile( const Key& key, const FindHandler& handler )
+{
+   getDiskPool().getService().post( boost::bind( &CResultCache::readFile, shared_from_this(), key, handler ) );
+}
+
+void CResultCache::store( const Key& key, const DoubleArray& result )
+{
+   insert( key, result );
+
+   if ( !mDirectory.empty() )
+   {
+      // Compute path does not wait for the disk.
+      getDiskPool().getService().post( boost::bind( &CResultCache::writeFile, shared_from_this(), key, result ) );
+   }
+}
+
+std::size_t CResultCache::getHitsCount( void ) const
+{
+   return mHits;
+}
+
+std::size_t CResultCache::getMissesCount( void ) const
+{
+   return mMisses;
+}
+
+std::size_t CResultCache::getSize( void ) const
+{
+   boost::lock_guard<boost::mutex> lock( mGuard );
+   return mSize;
+}
+
+std::size_t CResultCache::getDirectorySize( void ) const
+{
+   boost::lock_guard<boost::mutex> lock( mFilesGuard );
+   return mDirectorySize;
+}
+
+std::size_t CResultCache::getEntrySize( const DoubleArray& result )
+{
+   return ENTRY_OVERHEAD + result.size() * sizeof( double );
+}
+
+void CResultCache::insert( const Key& key, const DoubleArray& result )
+{
+   const std::size_t entrySize = getEntrySize( result );
+   if ( entrySize > mCapacity )
+   {
+      return;
+   }
+
+   boost::lock_guard<boost::mutex> lock( mGuard );
+   if ( mIndex.find( key ) != mIndex.end() )
+   {
+      return;
+   }
+
+   while ( mSize + entrySize > mCapacity && !mEntries.empty() )
+   {
+      mSize -= getEntrySize( mEntries.back().result );
+      mIndex.erase( mEntries.back().key );
+      mEntries.pop_back();
+   }
+
+   Entry entry;
+   entry.key = key;
+   entry.result = result;
+   mEntries.push_front( entry );
+   mIndex[key] = mEntries.begin();
+   mSize += entrySize;
+}
+
+std::string CResultCache::getFileName( const Key& key ) const
+{
+   return mDirectory + "/" + toString( key ) + FILE_EXTENSION;
+}
+
+void CResultCache::scanDirectory( void )
+{
+   DIR* directory = ::opendir( mDirectory.c_str() );
+   if ( !directory )
+   {
+      return;
+   }
+
+   // Files of the previous runs are accounted from the oldest, so that they are evicted first.
+   const std::size_t nameLength = 32 + sizeof( FILE_EXTENSION ) - 1;
+   std::multimap<time_t, File> files;
+   for ( struct dirent* entry = ::readdir( directory ); entry; entry = ::readdir( directory ) )
+   {
+      const std::string name( entry->d_name );
+      if ( name.size() != nameLength
+           || name.compare( 32, std::string::npos, FILE_EXTENSION ) != 0
+           || name.find_first_not_of( "0123456789abcdef" ) != 32 )
+      {
+         continue;
+      }
+
+      File file;
+      file.key.high = std::strtoull( name.substr( 0, 16 ).c_str(), 0, 16 );
+      file.key.low = std::strtoull( name.substr( 16, 16 ).c_str(), 0, 16 );
+      time_t modified = 0;
+      if ( getFileSize( mDirectory + "/" + name, file.size, modified ) )
+      {
+         files.insert( std::make_pair( modified, file ) );
+      }
+   }
+   ::closedir( directory );
+
+   for ( std::multimap<time_t, File>::const_iterator it = files.begin(); it != files.end(); ++it )
+   {
+      addFile( it->second.key, it->second.size );
+   }
+}
+
+void CResultCache::readFile( const Key& key, const FindHandler& handler )
+{
+   bool isKnown = false;
+   {
+      // Directory is accounted as a whole, so unknown key is a miss without touching the disk.
+      boost::lock_guard<boost::mutex> lock( mFilesGuard );
+      const FileIndex::iterator it = mFileIndex.find( key );
+      if ( it != mFileIndex.end() )
+      {
+         mFiles.splice( mFiles.begin(), mFiles, it->second );
+         isKnown = true;
+      }
+   }
+
+   DoubleArray result;
+   bool isFound = false;
+   if ( isKnown )
+   {
+      std::ifstream file( getFileName( key ).c_str(), std::ios::binary );
+      if ( file )
+      {
+         const std::string payload( ( std::istreambuf_iterator<char>( file ) ), std::istreambuf_iterator<char>() );
+         isFound = wire::decodeBinary( payload.data(), payload.data() + payload.size(), result );
+      }
+      if ( isFound )
+      {
+         insert( key, result );
+      }
+      else
+      {
+         dropFile( key );
+      }
+   }
+
+   if ( isFound )
+   {
+      ++mHits;
+   }
+   else
+   {
+      ++mMisses;
+   }
+   handler( isFound, result );
+}
+
+void CResultCache::writeFile( const Key& key, const DoubleArray& result )
+{
+   {
+      boost::lock_guard<boost::mutex> lock( mFilesGuard );
+      if ( mFileIndex.find( key ) != mFileIndex.end() )
+      {
+         return;
+      }
+   }
+
+   std::string payload;
+   wire::encodeBinary( result, payload );
+
+   const std::string fileName = getFileName( key );
+   static boost::atomic<unsigned int> sWritesCount( 0 );
+   const std::string temporaryName = fileName + "." + boost::lexical_cast<std::string>( sWritesCount++ ) + ".tmp";
+   {
+      std::ofstream file( temporaryName.c_str(), std::ios::binary | std::ios::trunc );
+      if ( !file.write( payload.data(), payload.size() ) )
+      {
+         std::remove( temporaryName.c_str() );
+         return;
+      }
+   }
+   if ( std::rename( temporaryName.c_str(), fileName.c_str() ) != 0 )
+   {
+      std::remove( temporaryName.c_str() );
+      return;
+   }
+
+   std::size_t size = payload.size();
+   time_t modified = 0;
+   getFileSize( fileName, size, modified );
+   addFile( key, size );
+}
+
+void CResultCache::addFile( const Key& key, std::size_t size )
+{
+   std::vector<Key> evicted;
+   {
+      boost::lock_guard<boost::mutex> lock( mFilesGuard );
+      if ( mFileIndex.find( key ) != mFileIndex.end() )
+      {
+         return;
+      }
+
+      File file;
+      file.key = key;
+      file.size = size;
+      mFiles.push_front( file );
+      mFileIndex[key] = mFiles.begin();
+      mDirectorySize += size;
+
+      while ( mDirectorySize > mDirectoryCapacity && !mFiles.empty() )
+      {
+         evicted.push_back( mFiles.back().key );
+         mDirectorySize -= mFiles.back().size;
+         mFileIndex.erase( mFiles.back().key );
+         mFiles.pop_back();
+      }
+   }
+
+   for ( std::size_t i = 0; i < evicted.size(); ++i )
+   {
+      std::remove( getFileName( evicted[i] ).c_str() );
+   }
+}
+
+void CResultCache::dropFile( const Key& key )
+{
+   boost::lock_guard<boost::mutex> lock( mFilesGuard );
+   const FileIndex::iterator it = mFileIndex.find( key );
+   if ( it != mFileIndex.end() )
+   {
+      mDirectorySize -= it->second->size;
+      mFiles.erase( it->second );
+      mFileIndex.erase( it );
+   }
+}
+/** @}*/
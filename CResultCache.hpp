@@ -0,0 +1,277 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CResultCache.hpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CResultCache class declaration
+ ************************************************************************/
+#ifndef CRESULTCACHE_HPP
+#define CRESULTCACHE_HPP
+
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include <list>
+#include <string>
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread.hpp>
+#include <boost/unordered_map.hpp>
+
+#include "CComputationNode.hpp"
+
+/**
+ * @brief This class keeps results of node calls addressed by their content. \n
+ * Key is a 128-bit hash of the operation and its argument, so the same call \n
+ * is answered locally no matter which node computed it before. \n
+ * Recently used results are kept in memory up to the given size. \n
+ * Optionally every result is also written to a directory, so that \n
+ * it survives between scheduler runs. Files are read and written by \n
+ * a separate disk pool, so that disk never stalls the event loop, \n
+ * and least recently used files are removed over the directory size limit. \n
+ * Cache must be owned by boost::shared_ptr, disk operations hold it.
+ * @sa CNodeDispatcher::setCache()
+ */
+class CResultCache : public boost::enable_shared_from_this<CResultCache>
+                   , private boost::noncopyable
+{
+public:
+   /**
+    * @brief Default limit of disk space used by the directory
+    */
+   static const std::size_t DEFAULT_DIRECTORY_CAPACITY = static_cast<std::size_t>( 1 ) << 30;
+
+   /**
+    * @brief Callback of the lookup in the directory. \n
+    * Result is valid only if it is found.
+    */
+   typedef boost::function<void( bool isFound, DoubleArray& result )> FindHandler;
+
+   /**
+    * @brief Content address of the call
+    */
+   struct Key
+   {
+      boost::uint64_t low;    ///< Lower half of the hash
+      boost::uint64_t high;   ///< Upper half of the hash
+
+      bool operator==( const Key& other ) const
+      {
+         return low == other.low && high == other.high;
+      }
+   };
+
+   /**
+    * @brief Constructor. Files which are already in the directory are accounted, \n
+    * the oldest of them are removed if they exceed the directory limit.
+    * @param capacityBytes - limit of memory used by cached results
+    * @param directory - existing directory for persistent results, empty - results are kept only in memory
+    * @param directoryCapacityBytes - limit of disk space used by the directory
+    */
+   explicit CResultCache( std::size_t capacityBytes,
+                          const std::string& directory = std::string(),
+                          std::size_t directoryCapacityBytes = DEFAULT_DIRECTORY_CAPACITY );
+
+   /**
+    * @brief Destructor
+    */
+   ~CResultCache( void );
+
+   /**
+    * @brief Compute content address of the call
+    * @param operation - operation
+    * @param array - operation argument
+    * @return Key of the call
+    */
+   static Key makeKey( CComputationNode::Operation operation, const DoubleArray& array );
+
+   /**
+    * @brief Compute content address of the matrix block
+    * @param depth - values per column
+    * @param columns - columns one after another
+    * @return Key of the block, differs from keys of all calls
+    */
+   static Key makeBlockKey( std::size_t depth, const DoubleArray& columns );
+
+   /**
+    * @brief Format key as 32 hexadecimal digits
+    * @param key - key
+    * @return Key text
+    */
+   static std::string toString( const Key& key );
+
+   /**
+    * @brief Look up result in memory. Miss is counted only if there is no directory, \n
+    * otherwise the lookup continues with asyncFindFile().
+    * @param key - key of the call
+    * @param[out] result - cached result
+    * @return True - if result is found, false - otherwise
+    */
+   bool find( const Key& key, DoubleArray& result );
+
+   /**
+    * @brief Check whether results are kept in the directory as well
+    * @return True - if directory is set
+    */
+   bool hasDirectory( void ) const;
+
+   /**
+    * @brief Asynchronously look up result in the directory. \n
+    * Result found there is moved to memory.
+    * @param key - key of the call
+    * @param handler - completion callback, called from the disk pool thread
+    */
+   void asyncFindFile( const Key& key, const FindHandler& handler );
+
+   /**
+    * @brief Put result of the call to memory and, asynchronously, to the directory
+    * @param key - key of the call
+    * @param result - call result
+    */
+   void store( const Key& key, const DoubleArray& result );
+
+   /**
+    * @brief Get number of calls answered from the cache
+    * @return Hits count
+    */
+   std::size_t getHitsCount( void ) const;
+
+   /**
+    * @brief Get number of calls which were not found in the cache
+    * @return Misses count
+    */
+   std::size_t getMissesCount( void ) const;
+
+   /**
+    * @brief Get memory used by cached results
+    * @return Size in bytes
+    */
+   std::size_t getSize( void ) const;
+
+   /**
+    * @brief Get disk space used by the directory
+    * @return Size in bytes
+    */
+   std::size_t getDirectorySize( void ) const;
+
+private:
+   /**
+    * @brief Cached result
+    */
+   struct Entry
+   {
+      Key key;             ///< Key of the call
+      DoubleArray result;  ///< Call result
+   };
+
+   typedef std::list<Entry> Entries;
+
+   /**
+    * @brief Hash function of the key for the index
+    */
+   struct KeyHash
+   {
+      std::size_t operator()( const Key& key ) const
+      {
+         return static_cast<std::size_t>( key.low );
+      }
+   };
+
+   typedef boost::unordered_map<Key, Entries::iterator, KeyHash> Index;
+
+   /**
+    * @brief File with persistent result
+    */
+   struct File
+   {
+      Key key;             ///< Key of the call
+      std::size_t size;    ///< Disk space used by the file
+   };
+
+   typedef std::list<File> Files;
+   typedef boost::unordered_map<Key, Files::iterator, KeyHash> FileIndex;
+
+   /**
+    * @brief Hash values together with the tag
+    * @param tag - operation code or block tag
+    * @param array - values
+    * @return Key of the values
+    */
+   static Key hashValues( boost::uint64_t tag, const DoubleArray& array );
+
+   /**
+    * @brief Get memory used by the entry
+    * @param result - cached result
+    * @return Size in bytes
+    */
+   static std::size_t getEntrySize( const DoubleArray& result );
+
+   /**
+    * @brief Put result to memory and evict least recently used results over capacity
+    * @param key - key of the call
+    * @param result - call result
+    */
+   void insert( const Key& key, const DoubleArray& result );
+
+   /**
+    * @brief Get name of the file with persistent result
+    * @param key - key of the call
+    * @return File path
+    */
+   std::string getFileName( const Key& key ) const;
+
+   /**
+    * @brief Account files of the previous runs, which are found in the directory
+    */
+   void scanDirectory( void );
+
+   /**
+    * @brief Read result from the file, runs in the disk pool
+    * @param key - key of the call
+    * @param handler - completion callback
+    */
+   void readFile( const Key& key, const FindHandler& handler );
+
+   /**
+    * @brief Write result to the file, runs in the disk pool. Result is written \n
+    * to a temporary file first, so that readers never see a partial one.
+    * @param key - key of the call
+    * @param result - call result
+    */
+   void writeFile( const Key& key, const DoubleArray& result );
+
+   /**
+    * @brief Account file as the most recently used and remove least recently used files over the limit
+    * @param key - key of the call
+    * @param size - disk space used by the file
+    */
+   void addFile( const Key& key, std::size_t size );
+
+   /**
+    * @brief Forget the file which can not be read
+    * @param key - key of the call
+    */
+   void dropFile( const Key& key );
+
+private:
+   std::size_t mCapacity;              ///< Limit of memory used by cached results
+   std::string mDirectory;             ///< Directory for persistent results, empty if disabled
+   std::size_t mSize;                  ///< Memory used by cached results
+   Entries mEntries;                   ///< Cached results, most recently used first
+   Index mIndex;                       ///< Cached results by key
+   mutable boost::mutex mGuard;        ///< Mutex for memory tier
+   boost::atomic<std::size_t> mHits;   ///< Number of calls answered from the cache
+   boost::atomic<std::size_t> mMisses; ///< Number of calls not found in the cache
+   std::size_t mDirectoryCapacity;     ///< Limit of disk space used by the directory
+   std::size_t mDirectorySize;         ///< Disk space used by the directory
+   Files mFiles;                       ///< Files in the directory, most recently used first
+   FileIndex mFileIndex;               ///< Files by key
+   mutable boost::mutex mFilesGuard;   ///< Mutex for disk tier
+};
+/** @}*/
+#endif // CRESULTCACHE_HPP
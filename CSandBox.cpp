@@ -3,13 +3,23 @@
  */
 #include <iostream>
 
+#include <boost/bind.hpp>
+
 #include "CSandBox.hpp"
 
-CSandBox::CSandBox( const CMatrix& A, const CMatrix& B, CMatrix& C, const std::vector<CComputationNode>& nodes )
+CSandBox::CSandBox( const CMatrix& A,
+                    const CMatrix& B,
+                    CMatrix& C,
+                    const CNodeDispatcher& dispatcher,
+                    std::size_t workersCount,
+                    std::size_t callsPerNode )
    : mA( A )
    , mB( B )
    , mC( C )
-   , mNodes( nodes )
+   , mCancelToken( new CCancelToken() )
+   , mDispatcher( dispatcher.createCancellableDispatcher( mCancelToken ) )
+   , mScheduler( mDispatcher, workersCount, callsPerNode )
+   , mThread()
    , mFinished( false )
    , mHasError( false )
 {
@@ -18,27 +28,49 @@ CSandBox::CSandBox( const CMatrix& A, const CMatrix& B, CMatrix& C, const std::v
 
 CSandBox::~CSandBox( void )
 {
-
+   if ( mThread.joinable() )
+   {
+      mCancelToken->cancel( "SandBox is destroyed" );
+      mThread.interrupt();
+      mThread.join();
+   }
 }
 
-bool CSandBox::exec( void )
+bool CSandBox::exec( boost::posix_time::time_duration timeout )
 {
    Callback terminateCallback = boost::bind( &CSandBox::terminate, this, _1 );
 
-   boost::thread sandboxThread( &CSandBox::sandBoxMain,
-                                boost::ref( mA ),
-                                boost::ref( mB ),
-                                boost::ref( mC ),
-                                boost::ref( mNodes ),
-                                terminateCallback );
-
+   mThread = boost::thread( &CSandBox::sandBoxMain,
+                            boost::ref( mA ),
+                            boost::ref( mB ),
+                            boost::ref( mC ),
+                            boost::ref( mDispatcher ),
+                            boost::ref( mScheduler ),
+                            terminateCallback );
 
-   sandboxThread.detach();
+   bool isInTime = true;
+   {
+      boost::unique_lock<boost::mutex> lock( mWaitGuard );
+      if ( timeout > boost::posix_time::time_duration() )
+      {
+         isInTime = mWaitCondition.timed_wait( lock, timeout, boost::bind( &CSandBox::isFinished, this ) );
+      }
+      else
+      {
+         mWaitCondition.wait( lock, boost::bind( &CSandBox::isFinished, this ) );
+      }
+   }
 
-   boost::unique_lock<boost::mutex> lock( mWaitGuard );
-   mWaitCondition.wait( lock, boost::bind( &CSandBox::isFinished, this ) );
+   if ( !isInTime )
+   {
+      // Node calls fail at once and waits of the sandbox thread are interrupted, so it finishes soon.
+      std::cout << "SandBox deadline exceeded, its node calls are cancelled" << std::endl;
+      mCancelToken->cancel( "SandBox deadline exceeded" );
+      mThread.interrupt();
+   }
+   mThread.join();
 
-   return !mHasError;
+   return isInTime && !mHasError;
 }
 
 bool CSandBox::isFinished( void ) const
@@ -66,27 +98,33 @@ void CSandBox::terminate( bool hasError )
 void CSandBox::sandBoxMain( const CMatrix& A,
                             const CMatrix& B,
                             CMatrix& C,
-                            const std::vector<CComputationNode>& nodes,
+                            const CNodeDispatcher& dispatcher,
+                            CTaskScheduler& scheduler,
                             CSandBox::Callback terminate )
 {
-   std::cout << "Hello from detached thread" << std::endl;
+   std::cout << "Hello from sandbox thread" << std::endl;
    C = A;
 
-   const CComputationNode& node = nodes[0];
-
    DoubleArray array;
    array.push_back( A( 0, 0 ) );
    array.push_back( A( 1, 0 ) );
    array.push_back( A( 2, 0 ) );
    array.push_back( A( 3, 0 ) );
 
-   FutureDoubleArray result = node.asyncSum( array );
+   // Tasks run as soon as tasks they depend on are finished.
+   const CTaskScheduler::TaskId sum = scheduler.addRemote( CComputationNode::OP_SUM, array );
    try
    {
-      DoubleArray resultArray = result.get();
+      scheduler.wait();
+      DoubleArray resultArray = scheduler.getResult( sum );
 
       std::cout << resultArray.size() << std::endl;
       std::cout << resultArray[0] << std::endl;
+
+      // Single calls may also go straight to the dispatcher, without a task graph.
+      FutureDoubleArray products = dispatcher.asyncMultiplyPairs( array );
+      resultArray = products.get();
+      std::cout << resultArray.size() << std::endl;
    }
    catch( ... )
    {
@@ -14,9 +14,13 @@
 #include <vector>
 
 #include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
+#include "CCancelToken.hpp"
 #include "CMatrix.hpp"
-#include "CComputationNode.hpp"
+#include "CNodeDispatcher.hpp"
+#include "CTaskScheduler.hpp"
 
 using namespace matrix;
 
@@ -39,22 +43,34 @@ public:
     * @param A - input matrix A
     * @param B - input matrix B
     * @param[out] C - output matrix C (here computation result will be stored)
-    * @param nodes - a list of available computation nodes
+    * @param dispatcher - dispatcher of calls between available computation nodes, \n
+    * sandbox makes its cancellable copy
+    * @param workersCount - number of threads running tasks of the sandbox, 0 - number of CPU cores
+    * @param callsPerNode - limit of node calls in flight per node submitted as tasks, 0 - not limited
     */
    CSandBox( const CMatrix& A,
              const CMatrix& B,
              CMatrix& C,
-             const std::vector<CComputationNode>& nodes );
+             const CNodeDispatcher& dispatcher,
+             std::size_t workersCount = 0,
+             std::size_t callsPerNode = CTaskScheduler::DEFAULT_CALLS_PER_NODE );
 
+   /**
+    * @brief Destructor. Interrupts and joins sandbox thread if it is still running.
+    */
    ~CSandBox( void );
 
    /**
     * @brief Execute main sandbox function in separate thread and wait \n
-    * until terminate() will be called.
-    * @return True - if main sandbox function was finished successfully, false - otherwise
+    * until terminate() will be called. When timeout expires, node calls \n
+    * of the sandbox are cancelled and its thread is interrupted, so that \n
+    * waiting sandbox function fails at once. Sandbox thread is joined \n
+    * in any case, since it refers to matrices of the caller.
+    * @param timeout - time limit of the sandbox function, zero - not limited
+    * @return True - if main sandbox function was finished successfully in time, false - otherwise
     * @sa sandBoxMain();
     */
-   bool exec( void );
+   bool exec( boost::posix_time::time_duration timeout = boost::posix_time::time_duration() );
 
    /**
     * @brief Check whether main snadbox function was finished or not.
@@ -81,7 +97,10 @@ private:
    const CMatrix& mA;                              ///< Input matrix A
    const CMatrix& mB;                              ///< Input matrix B
    CMatrix& mC;                                    ///< Input matrix C
-   const std::vector<CComputationNode>& mNodes;    ///< Computation nodes list
+   CancelTokenPtr mCancelToken;                    ///< Cancels node calls of the sandbox on timeout
+   CNodeDispatcher mDispatcher;                    ///< Computation nodes dispatcher, cancelled by the token
+   CTaskScheduler mScheduler;                      ///< Runs task graphs submitted by sandbox function
+   boost::thread mThread;                          ///< Thread of the main sandbox function
 
    bool mFinished;                                 ///< Sandbox finished flag
    bool mHasError;                                 ///< Sandbox error flag
@@ -98,14 +117,17 @@ private:
     * @param A - input matrix A
     * @param B - input matrix B
     * @param[out] C - result matrix C which will be saved to file after terminate
-    * @param nodes - computation nodes list
+    * @param dispatcher - computation nodes dispatcher, routes each call to the least loaded node
+    * @param scheduler - runs graphs of local tasks and node calls in dependency order
     * @param terminate - terminate callback
     * @sa terminate();
     */
    static void sandBoxMain( const CMatrix& A,
                             const CMatrix& B,
                             CMatrix& C,
-                            const std::vector<CComputationNode>& nodes, Callback terminate );
+                            const CNodeDispatcher& dispatcher,
+                            CTaskScheduler& scheduler,
+                            Callback terminate );
 };
 /** @}*/
 #endif // CSANDBOX_HPP
@@ -0,0 +1,795 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CStubNode.cpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CStubNode class definition
+ ************************************************************************/
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include "CStubNode.hpp"
+#include "WireFormat.hpp"
+
+#include <istream>
+#include <sstream>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+
+using boost::asio::ip::tcp;
+
+/**
+ * @brief Last chunk and empty trailer of chunked body
+ */
+static const char LAST_CHUNK[] = "0\r\n\r\n";
+
+/**
+ * @brief Get parameter of the request URI query
+ * @param uri - request URI
+ * @param name - parameter name
+ * @return Parameter value, empty if there is no such parameter
+ */
+static std::string getQueryParameter( const std::string& uri, const std::string& name )
+{
+   std::string::size_type begin = uri.find( '?' );
+   while ( begin != std::string::npos )
+   {
+      ++begin;
+      const std::string::size_type end = uri.find( '&', begin );
+      const std::string parameter = uri.substr( begin, end == std::string::npos ? std::string::npos : end - begin );
+      if ( parameter.size() > name.size() && parameter[name.size()] == '=' && parameter.compare( 0, name.size(), name ) == 0 )
+      {
+         return parameter.substr( name.size() + 1 );
+      }
+      begin = end;
+   }
+   return std::string();
+}
+
+/**
+ * @brief Single client connection of the stub node
+ */
+class CStubNode::CSession : public boost::enable_shared_from_this<CStubNode::CSession>
+                          , private boost::noncopyable
+{
+public:
+   CSession( boost::asio::io_service& service,
+             bool isBinarySupported,
+             const boost::shared_ptr<CBlockStore>& blocks,
+             boost::posix_time::time_duration latency,
+             boost::posix_time::time_duration jitter )
+      : mSocket( service )
+      , mStrand( service )
+      , mIsBinarySupported( isBinarySupported )
+      , mBlocks( blocks )
+      , mLatency( latency )
+      , mJitter( jitter )
+      , mDelayTimer( service )
+      , mRandom( static_cast<boost::uint32_t>( reinterpret_cast<std::size_t>( this ) ) )
+      , mBuffer()
+      , mUri()
+      , mContentType()
+      , mAccept()
+      , mContentLength( 0 )
+      , mKeepAlive( true )
+      , mIsChunked( false )
+      , mChunkSize( 0 )
+      , mBody()
+      , mResponseHeaders()
+      , mResponseBody()
+      , mIsStreaming( false )
+      , mDecoder()
+      , mValues()
+      , mProducts()
+      , mChunk()
+      , mOutput()
+      , mPendingOutput()
+      , mIsReplyStarted( false )
+      , mIsReplyFinished( false )
+      , mIsStreamFailed( false )
+      , mIsWriting( false )
+      , mIsDelayed( false )
+   {
+
+   }
+
+   tcp::socket& getSocket( void )
+   {
+      return mSocket;
+   }
+
+   void start( void )
+   {
+      boost::system::error_code ignored;
+      mSocket.set_option( tcp::no_delay( true ), ignored );
+      readRequest();
+   }
+
+private:
+   void readRequest( void )
+   {
+      boost::asio::async_read_until( mSocket,
+                                     mBuffer,
+                                     "\r\n\r\n",
+                                     mStrand.wrap( boost::bind( &CSession::onHeaders,
+                                                                shared_from_this(),
+                                                                boost::asio::placeholders::error ) ) );
+   }
+
+   void onHeaders( const boost::system::error_code& error )
+   {
+      if ( error )
+      {
+         return;
+      }
+
+      if ( !parseHeaders() )
+      {
+         mKeepAlive = false;
+         reply( 400, "text/plain", "Malformed request" );
+         return;
+      }
+
+      if ( mIsChunked )
+      {
+         // Products of binary payload are sent back while the rest of it arrives.
+         mIsStreaming = mIsBinarySupported && mUri == "/multiply" && wire::isBinaryContentType( mContentType );
+         mBody.clear();
+         mDecoder.reset();
+         mValues.clear();
+         mIsReplyStarted = false;
+         mIsReplyFinished = false;
+         mIsStreamFailed = false;
+         readChunkSize();
+         return;
+      }
+
+      if ( mBuffer.size() < mContentLength )
+      {
+         boost::asio::async_read( mSocket,
+                                  mBuffer,
+                                  boost::asio::transfer_exactly( mContentLength - mBuffer.size() ),
+                                  mStrand.wrap( boost::bind( &CSession::onBody,
+                                                             shared_from_this(),
+                                                             boost::asio::placeholders::error ) ) );
+      }
+      else
+      {
+         onBody( boost::system::error_code() );
+      }
+   }
+
+   void onBody( const boost::system::error_code& error )
+   {
+      if ( error )
+      {
+         return;
+      }
+
+      processBody( boost::asio::buffer_cast<const char*>( mBuffer.data() ), mContentLength );
+   }
+
+   void readChunkSize( void )
+   {
+      boost::asio::async_read_until( mSocket,
+                                     mBuffer,
+                                     "\r\n",
+                                     mStrand.wrap( boost::bind( &CSession::onChunkSize,
+                                                                shared_from_this(),
+                                                                boost::asio::placeholders::error,
+                                                                boost::asio::placeholders::bytes_transferred ) ) );
+   }
+
+   void onChunkSize( const boost::system::error_code& error, std::size_t lineSize )
+   {
+      if ( error )
+      {
+         return;
+      }
+
+      std::string line( boost::asio::buffer_cast<const char*>( mBuffer.data() ), lineSize - 2 );
+      mBuffer.consume( lineSize );
+      line = line.substr( 0, line.find( ';' ) );
+
+      std::istringstream lineStream( line );
+      if ( line.empty() || !( lineStream >> std::hex >> mChunkSize ) || !lineStream.eof() )
+      {
+         mKeepAlive = false;
+         reply( 400, "text/plain", "Malformed chunk" );
+         return;
+      }
+
+      if ( mChunkSize == 0 )
+      {
+         readTrailer();
+      }
+      else if ( mBuffer.size() < mChunkSize + 2 )
+      {
+         boost::asio::async_read( mSocket,
+                                  mBuffer,
+                                  boost::asio::transfer_exactly( mChunkSize + 2 - mBuffer.size() ),
+                                  mStrand.wrap( boost::bind( &CSession::onChunkData,
+                                                             shared_from_this(),
+                                                             boost::asio::placeholders::error ) ) );
+      }
+      else
+      {
+         onChunkData( boost::system::error_code() );
+      }
+   }
+
+   void onChunkData( const boost::system::error_code& error )
+   {
+      if ( error )
+      {
+         return;
+      }
+
+      const char* data = boost::asio::buffer_cast<const char*>( mBuffer.data() );
+      if ( mIsStreaming )
+      {
+         streamChunk( data, mChunkSize );
+      }
+      else
+      {
+         mBody.append( data, mChunkSize );
+      }
+      mBuffer.consume( mChunkSize + 2 );
+
+      readChunkSize();
+   }
+
+   void readTrailer( void )
+   {
+      boost::asio::async_read_until( mSocket,
+                                     mBuffer,
+                                     "\r\n",
+                                     mStrand.wrap( boost::bind( &CSession::onTrailer,
+                                                                shared_from_this(),
+                                                                boost::asio::placeholders::error,
+                                                                boost::asio::placeholders::bytes_transferred ) ) );
+   }
+
+   void onTrailer( const boost::system::error_code& error, std::size_t lineSize )
+   {
+      if ( error )
+      {
+         return;
+      }
+
+      mBuffer.consume( lineSize );
+      if ( lineSize > 2 )
+      {
+         readTrailer();
+      }
+      else if ( mIsStreaming )
+      {
+         finishStream();
+      }
+      else
+      {
+         processBody( mBody.data(), mBody.size() );
+      }
+   }
+
+   void processBody( const char* data, std::size_t size )
+   {
+      if ( mUri == "/batch" )
+      {
+         std::vector<wire::BatchItem> items;
+         const bool isBatch = mIsBinarySupported
+                              && boost::algorithm::iequals( mContentType, wire::BATCH_CONTENT_TYPE )
+                              && wire::decodeBatch( data, data + size, items );
+         mBuffer.consume( mContentLength );
+
+         if ( !mIsBinarySupported )
+         {
+            reply( 404, "text/plain", "Unknown method " + mUri );
+         }
+         else if ( !isBatch )
+         {
+            reply( 400, "text/plain", "Malformed batch" );
+         }
+         else
+         {
+            processBatch( items );
+         }
+         return;
+      }
+
+      const bool isBinaryRequest = wire::isBinaryContentType( mContentType );
+
+      // Request is decoded and dropped from the buffer before the reply is started,
+      // because the next request may be read as soon as the reply is written.
+      DoubleArray array;
+      bool isParsed = false;
+      if ( !isBinaryRequest )
+      {
+         isParsed = wire::decodeJson( data, data + size, array );
+      }
+      else if ( mIsBinarySupported )
+      {
+         isParsed = wire::decodeBinary( data, data + size, array );
+      }
+      mBuffer.consume( mContentLength );
+
+      if ( isBinaryRequest && !mIsBinarySupported )
+      {
+         reply( 415, "text/plain", "Unsupported payload format" );
+      }
+      else if ( !isParsed )
+      {
+         reply( 400, "text/plain", "Malformed payload" );
+      }
+      else
+      {
+         process( isBinaryRequest, array );
+      }
+   }
+
+   bool parseHeaders( void )
+   {
+      std::istream requestStream( &mBuffer );
+      std::string method;
+      std::string httpVersion;
+      requestStream >> method >> mUri >> httpVersion;
+      std::string rest;
+      std::getline( requestStream, rest );
+      if ( !requestStream || httpVersion.substr( 0, 5 ) != "HTTP/" )
+      {
+         return false;
+      }
+
+      mKeepAlive = ( httpVersion != "HTTP/1.0" );
+      mContentType.clear();
+      mAccept.clear();
+      mContentLength = 0;
+      mIsChunked = false;
+
+      std::string header;
+      while ( std::getline( requestStream, header ) && header != "\r" )
+      {
+         const std::string::size_type colon = header.find( ':' );
+         if ( colon == std::string::npos )
+         {
+            continue;
+         }
+
+         const std::string name = boost::algorithm::to_lower_copy( header.substr( 0, colon ) );
+         const std::string value = boost::algorithm::trim_copy( header.substr( colon + 1 ) );
+
+         if ( name == "content-length" )
+         {
+            try
+            {
+               mContentLength = boost::lexical_cast<std::size_t>( value );
+            }
+            catch ( const boost::bad_lexical_cast& )
+            {
+               return false;
+            }
+         }
+         else if ( name == "content-type" )
+         {
+            mContentType = value;
+         }
+         else if ( name == "accept" )
+         {
+            mAccept = value;
+         }
+         else if ( name == "connection" )
+         {
+            mKeepAlive = !boost::algorithm::iequals( value, "close" );
+         }
+         else if ( name == "transfer-encoding" )
+         {
+            mIsChunked = boost::algorithm::iequals( value, "chunked" );
+         }
+      }
+
+      if ( mIsChunked )
+      {
+         // Body is consumed chunk by chunk as it is read.
+         mContentLength = 0;
+      }
+
+      return true;
+   }
+
+   void process( bool isBinaryRequest, DoubleArray& array )
+   {
+      DoubleArray result;
+      const std::string path = mUri.substr( 0, mUri.find( '?' ) );
+      if ( path == "/multiply" )
+      {
+         CStubNode::multiplyPairs( array, result );
+      }
+      else if ( path == "/sum" )
+      {
+         CStubNode::sum( array, result );
+      }
+      else if ( path == "/store" )
+      {
+         std::size_t depth = 0;
+         try
+         {
+            depth = boost::lexical_cast<std::size_t>( getQueryParameter( mUri, "depth" ) );
+         }
+         catch ( const boost::bad_lexical_cast& )
+         {
+         }
+
+         const std::string handle = getQueryParameter( mUri, "block" );
+         if ( handle.empty() || !mBlocks->store( handle, depth, array ) )
+         {
+            reply( 400, "text/plain", "Malformed block" );
+            return;
+         }
+      }
+      else if ( path == "/multiply-block" )
+      {
+         const std::string handle = getQueryParameter( mUri, "block" );
+         const CBlockStore::BlockPtr block = mBlocks->find( handle );
+         if ( !block )
+         {
+            reply( 404, "text/plain", "Unknown block " + handle );
+            return;
+         }
+         if ( !CBlockStore::multiply( *block, array, result ) )
+         {
+            reply( 400, "text/plain", "Rows do not match block depth" );
+            return;
+         }
+      }
+      else
+      {
+         reply( 404, "text/plain", "Unknown method " + mUri );
+         return;
+      }
+
+      const bool isBinaryResponse = mIsBinarySupported
+                                    && ( isBinaryRequest
+                                         || boost::algorithm::icontains( mAccept, wire::BINARY_CONTENT_TYPE ) );
+      std::string payload;
+      if ( isBinaryResponse )
+      {
+         wire::encodeBinary( result, payload );
+         reply( 200, wire::BINARY_CONTENT_TYPE, payload );
+      }
+      else
+      {
+         wire::encodeJson( result, payload );
+         reply( 200, wire::JSON_CONTENT_TYPE, payload );
+      }
+   }
+
+   void processBatch( const std::vector<wire::BatchItem>& items )
+   {
+      std::string payload;
+      wire::encodeBatchHeader( items.size(), payload );
+
+      DoubleArray result;
+      for ( std::vector<wire::BatchItem>::const_iterator it = items.begin(); it != items.end(); ++it )
+      {
+         result.clear();
+         boost::uint32_t status = 0;
+         if ( it->code == CComputationNode::OP_MULTIPLY_PAIRS )
+         {
+            CStubNode::multiplyPairs( it->values, result );
+         }
+         else if ( it->code == CComputationNode::OP_SUM )
+         {
+            CStubNode::sum( it->values, result );
+         }
+         else
+         {
+            status = 1;
+         }
+         wire::appendBatchItem( status, result, payload );
+      }
+
+      reply( 200, wire::BATCH_CONTENT_TYPE, payload );
+   }
+
+   void streamChunk( const char* data, std::size_t size )
+   {
+      if ( mIsStreamFailed || !mDecoder.feed( data, data + size, mValues ) )
+      {
+         mIsStreamFailed = true;
+         return;
+      }
+
+      mChunk.clear();
+      if ( !mIsReplyStarted && mDecoder.hasHeader() )
+      {
+         mPendingOutput.append( "HTTP/1.1 200 OK\r\n" );
+         mPendingOutput.append( "Content-Type: " ).append( wire::BINARY_CONTENT_TYPE ).append( "\r\n" );
+         mPendingOutput.append( "Transfer-Encoding: chunked\r\n" );
+         mPendingOutput.append( "Connection: " ).append( mKeepAlive ? "keep-alive" : "close" ).append( "\r\n\r\n" );
+         wire::encodeBinaryHeader( static_cast<std::size_t>( mDecoder.getCount() / 2 ), mChunk );
+         mIsReplyStarted = true;
+         startDelay();
+      }
+
+      // Unpaired value waits for the next chunk.
+      const std::size_t pairs = mValues.size() / 2;
+      mProducts.resize( pairs );
+      for ( std::size_t i = 0; i < pairs; ++i )
+      {
+         mProducts[i] = mValues[2 * i] * mValues[2 * i + 1];
+      }
+      if ( pairs > 0 )
+      {
+         wire::appendBinaryValues( &mProducts[0], pairs, mChunk );
+      }
+      mValues.erase( mValues.begin(), mValues.begin() + 2 * pairs );
+
+      if ( !mChunk.empty() )
+      {
+         std::ostringstream sizeStream;
+         sizeStream << std::hex << mChunk.size() << "\r\n";
+         mPendingOutput.append( sizeStream.str() ).append( mChunk ).append( "\r\n" );
+      }
+      flush();
+   }
+
+   void finishStream( void )
+   {
+      if ( mIsStreamFailed || !mDecoder.isComplete() )
+      {
+         if ( mIsReplyStarted )
+         {
+            // Error can not be reported in the middle of the response.
+            boost::system::error_code ignored;
+            mSocket.shutdown( tcp::socket::shutdown_both, ignored );
+            return;
+         }
+         mIsStreaming = false;
+         reply( 400, "text/plain", "Malformed payload" );
+         return;
+      }
+
+      mPendingOutput.append( LAST_CHUNK );
+      mIsReplyFinished = true;
+      flush();
+   }
+
+   void startDelay( void )
+   {
+      const boost::posix_time::time_duration delay = getDelay();
+      if ( delay.total_microseconds() > 0 )
+      {
+         mIsDelayed = true;
+         mDelayTimer.expires_from_now( delay );
+         mDelayTimer.async_wait( mStrand.wrap( boost::bind( &CSession::onDelay, shared_from_this() ) ) );
+      }
+   }
+
+   void onDelay( void )
+   {
+      mIsDelayed = false;
+      flush();
+   }
+
+   void flush( void )
+   {
+      if ( mIsWriting || mIsDelayed || mPendingOutput.empty() )
+      {
+         return;
+      }
+
+      mOutput.swap( mPendingOutput );
+      mPendingOutput.clear();
+      mIsWriting = true;
+      boost::asio::async_write( mSocket,
+                                boost::asio::buffer( mOutput ),
+                                mStrand.wrap( boost::bind( &CSession::onStreamWritten,
+                                                           shared_from_this(),
+                                                           boost::asio::placeholders::error ) ) );
+   }
+
+   void onStreamWritten( const boost::system::error_code& error )
+   {
+      mIsWriting = false;
+      if ( error )
+      {
+         boost::system::error_code ignored;
+         mSocket.shutdown( tcp::socket::shutdown_both, ignored );
+         return;
+      }
+
+      if ( !mPendingOutput.empty() )
+      {
+         flush();
+      }
+      else if ( mIsReplyFinished )
+      {
+         mIsStreaming = false;
+         onWrite( error );
+      }
+   }
+
+   boost::posix_time::time_duration getDelay( void )
+   {
+      boost::posix_time::time_duration delay = mLatency;
+      if ( mJitter.total_microseconds() > 0 )
+      {
+         boost::random::uniform_int_distribution<boost::int64_t> distribution( 0, mJitter.total_microseconds() );
+         delay += boost::posix_time::microseconds( distribution( mRandom ) );
+      }
+      return delay;
+   }
+
+   void reply( unsigned int statusCode, const std::string& contentType, const std::string& body )
+   {
+      std::ostringstream headersStream;
+      headersStream << "HTTP/1.1 " << statusCode << ( statusCode == 200 ? " OK" : " Error" ) << "\r\n";
+      headersStream << "Content-Type: " << contentType << "\r\n";
+      headersStream << "Content-Length: " << body.size() << "\r\n";
+      headersStream << "Connection: " << ( mKeepAlive ? "keep-alive" : "close" ) << "\r\n\r\n";
+
+      mResponseHeaders = headersStream.str();
+      mResponseBody = body;
+
+      const boost::posix_time::time_duration delay = getDelay();
+      if ( delay.total_microseconds() > 0 )
+      {
+         mDelayTimer.expires_from_now( delay );
+         mDelayTimer.async_wait( mStrand.wrap( boost::bind( &CSession::write, shared_from_this() ) ) );
+      }
+      else
+      {
+         write();
+      }
+   }
+
+   void write( void )
+   {
+      std::vector<boost::asio::const_buffer> buffers;
+      buffers.push_back( boost::asio::buffer( mResponseHeaders ) );
+      buffers.push_back( boost::asio::buffer( mResponseBody ) );
+
+      boost::asio::async_write( mSocket,
+                                buffers,
+                                mStrand.wrap( boost::bind( &CSession::onWrite,
+                                                           shared_from_this(),
+                                                           boost::asio::placeholders::error ) ) );
+   }
+
+   void onWrite( const boost::system::error_code& error )
+   {
+      if ( error || !mKeepAlive )
+      {
+         boost::system::error_code ignored;
+         mSocket.shutdown( tcp::socket::shutdown_both, ignored );
+         return;
+      }
+
+      readRequest();
+   }
+
+private:
+   tcp::socket mSocket;                ///< Client socket
+   boost::asio::io_service::strand mStrand;     ///< Serializes callbacks of simultaneous read and write
+   bool mIsBinarySupported;            ///< Whether binary payloads are accepted
+   boost::shared_ptr<CBlockStore> mBlocks;      ///< Blocks uploaded by clients
+   boost::posix_time::time_duration mLatency;   ///< Minimal reply delay
+   boost::posix_time::time_duration mJitter;    ///< Maximal random addition to reply delay
+   boost::asio::deadline_timer mDelayTimer;     ///< Timer which delays reply
+   boost::random::mt19937 mRandom;              ///< Jitter generator
+   boost::asio::streambuf mBuffer;     ///< Buffer for incoming data
+   std::string mUri;                   ///< URI of current request
+   std::string mContentType;           ///< Content type of current request
+   std::string mAccept;                ///< Acceptable response content types
+   std::size_t mContentLength;         ///< Length of current request body
+   bool mKeepAlive;                    ///< Whether connection stays open after response
+   bool mIsChunked;                    ///< Whether request body uses chunked transfer coding
+   std::size_t mChunkSize;             ///< Size of request chunk being read
+   std::string mBody;                  ///< Collected chunked request body
+   std::string mResponseHeaders;       ///< Serialized response headers
+   std::string mResponseBody;          ///< Response body
+   bool mIsStreaming;                  ///< Whether request is answered while it arrives
+   wire::CBinaryDecoder mDecoder;      ///< Parser of streamed request
+   DoubleArray mValues;                ///< Parsed values of streamed request which are not multiplied yet
+   DoubleArray mProducts;              ///< Products of the last streamed chunk
+   std::string mChunk;                 ///< Serialized response chunk
+   std::string mOutput;                ///< Streamed response data being written
+   std::string mPendingOutput;         ///< Streamed response data waiting for the current write
+   bool mIsReplyStarted;               ///< Whether streamed response headers are queued
+   bool mIsReplyFinished;              ///< Whether the whole streamed response is queued
+   bool mIsStreamFailed;               ///< Whether streamed request is malformed
+   bool mIsWriting;                    ///< Whether streamed response data is being written
+   bool mIsDelayed;                    ///< Whether streamed response waits for the reply delay
+};
+
+CStubNode::CStubNode( boost::asio::io_service& service,
+                      unsigned short port,
+                      bool isBinarySupported,
+                      std::size_t blockCapacity )
+   : mService( service )
+   , mAcceptor( service, tcp::endpoint( tcp::v4(), port ) )
+   , mIsBinarySupported( isBinarySupported )
+   , mBlocks( new CBlockStore( blockCapacity ) )
+   , mLatency()
+   , mJitter()
+{
+   startAccept();
+}
+
+CStubNode::~CStubNode( void )
+{
+   stop();
+}
+
+unsigned short CStubNode::getPort( void ) const
+{
+   return mAcceptor.local_endpoint().port();
+}
+
+void CStubNode::setLatency( boost::posix_time::time_duration latency,
+                            boost::posix_time::time_duration jitter )
+{
+   mLatency = latency;
+   mJitter = jitter;
+}
+
+void CStubNode::stop( void )
+{
+   boost::system::error_code ignored;
+   mAcceptor.close( ignored );
+}
+
+std::size_t CStubNode::getBlocksCount( void ) const
+{
+   return mBlocks->getBlocksCount();
+}
+
+void CStubNode::multiplyPairs( const DoubleArray& array, DoubleArray& result )
+{
+   result.resize( array.size() / 2 );
+   for ( std::size_t i = 0; i < result.size(); ++i )
+   {
+      result[i] = array[2 * i] * array[2 * i + 1];
+   }
+}
+
+void CStubNode::sum( const DoubleArray& array, DoubleArray& result )
+{
+   double total = 0.0;
+   for ( std::size_t i = 0; i < array.size(); ++i )
+   {
+      total += array[i];
+   }
+   result.assign( 1, total );
+}
+
+void CStubNode::startAccept( void )
+{
+   boost::shared_ptr<CSession> session( new CSession( mService, mIsBinarySupported, mBlocks, mLatency, mJitter ) );
+   mAcceptor.async_accept( session->getSocket(),
+                           boost::bind( &CStubNode::onAccept,
+                                        this,
+                                        session,
+                                        boost::asio::placeholders::error ) );
+}
+
+void CStubNode::onAccept( const boost::shared_ptr<CSession>& session,
+                          const boost::system::error_code& error )
+{
+   if ( error )
+   {
+      // Acceptor was closed.
+      return;
+   }
+
+   session->start();
+   startAccept();
+}
+/** @}*/
@@ -0,0 +1,121 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CStubNode.hpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CStubNode class declaration
+ ************************************************************************/
+#ifndef CSTUBNODE_HPP
+#define CSTUBNODE_HPP
+
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include "CBlockStore.hpp"
+#include "CComputationNode.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+/**
+ * @brief This class represents local in-process implementation \n
+ * of the remote computation service. \n
+ * It serves /multiply, /sum and /batch methods over HTTP/1.1 keep-alive connections \n
+ * and speaks both JSON and binary payload formats. \n
+ * Request body may use chunked transfer coding, binary /multiply requests \n
+ * sent that way are answered chunk by chunk while they arrive. \n
+ * JSON-only stub does not provide /batch method. \n
+ * Blocks uploaded by /store?block=H&depth=D are kept in memory, and \n
+ * /multiply-block?block=H multiplies request rows by the columns of block H, \n
+ * or answers 404 if the block is evicted.
+ * @sa wire::BINARY_CONTENT_TYPE, CBlockStore
+ */
+class CStubNode : private boost::noncopyable
+{
+public:
+   /**
+    * @brief Constructor. Starts accepting connections.
+    * @param service - io_service which drives connections
+    * @param port - port to listen on, 0 - pick any free port
+    * @param isBinarySupported - whether to accept binary payloads or reply 415 to them
+    * @param blockCapacity - limit of memory used by stored blocks
+    */
+   CStubNode( boost::asio::io_service& service,
+              unsigned short port,
+              bool isBinarySupported = true,
+              std::size_t blockCapacity = CBlockStore::DEFAULT_CAPACITY );
+
+   /**
+    * @brief Destructor. Stops accepting connections.
+    */
+   ~CStubNode( void );
+
+   /**
+    * @brief Get port the stub listens on
+    * @return Port number
+    */
+   unsigned short getPort( void ) const;
+
+   /**
+    * @brief Delay replies to emulate remote service processing time. \n
+    * Affects connections accepted after the call.
+    * @param latency - minimal delay of every reply
+    * @param jitter - maximal random delay added to latency
+    */
+   void setLatency( boost::posix_time::time_duration latency,
+                    boost::posix_time::time_duration jitter = boost::posix_time::time_duration() );
+
+   /**
+    * @brief Stop accepting new connections
+    */
+   void stop( void );
+
+   /**
+    * @brief Get number of blocks kept by the stub
+    * @return Blocks count
+    */
+   std::size_t getBlocksCount( void ) const;
+
+   /**
+    * @brief Multiply pairs of numbers as the remote service does
+    * @param array - numbers to multiply
+    * @param[out] result - products of adjacent pairs
+    */
+   static void multiplyPairs( const DoubleArray& array, DoubleArray& result );
+
+   /**
+    * @brief Sum numbers as the remote service does
+    * @param array - numbers to sum
+    * @param[out] result - array with single sum value
+    */
+   static void sum( const DoubleArray& array, DoubleArray& result );
+
+private:
+   class CSession;
+
+   /**
+    * @brief Start accepting next connection
+    */
+   void startAccept( void );
+
+   /**
+    * @brief Connection accept callback
+    * @param session - session of accepted connection
+    * @param error - accept error
+    */
+   void onAccept( const boost::shared_ptr<CSession>& session,
+                  const boost::system::error_code& error );
+
+private:
+   boost::asio::io_service& mService;           ///< IO service for connections
+   boost::asio::ip::tcp::acceptor mAcceptor;    ///< Listening socket
+   bool mIsBinarySupported;                     ///< Whether binary payloads are accepted
+   boost::shared_ptr<CBlockStore> mBlocks;      ///< Blocks uploaded by clients
+   boost::posix_time::time_duration mLatency;   ///< Minimal reply delay
+   boost::posix_time::time_duration mJitter;    ///< Maximal random addition to reply delay
+};
+/** @}*/
+#endif // CSTUBNODE_HPP
@@ -0,0 +1,470 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CTaskScheduler.cpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CTaskScheduler class definition
+ ************************************************************************/
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include "CTaskScheduler.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <stdexcept>
+
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/tss.hpp>
+
+const std::size_t CTaskScheduler::DEFAULT_CALLS_PER_NODE;
+
+/**
+ * @brief Node of the task graph
+ */
+struct CTaskScheduler::Task
+{
+   Task( void )
+      : isRemote( false )
+      , function()
+      , operation( CComputationNode::OP_SUM )
+      , argument()
+      , dependencies()
+      , dependents()
+      , pendingCount( 0 )
+      , isFinished( false )
+      , error()
+      , result()
+   {
+
+   }
+
+   bool isRemote;                            ///< Whether task is a node call
+   Function function;                        ///< Task body or argument builder of the node call, may be empty
+   CComputationNode::Operation operation;    ///< Node call operation
+   DoubleArray argument;                     ///< Node call argument
+   std::vector<TaskPtr> dependencies;        ///< Tasks which results are passed to this one
+   std::vector<TaskPtr> dependents;          ///< Tasks waiting for this one, cleared when it is finished
+   std::size_t pendingCount;                 ///< Number of dependencies which are not finished yet
+   bool isFinished;                          ///< Whether result is set
+   boost::exception_ptr error;               ///< Task error or error of its dependency
+   DoubleArray result;                       ///< Task result, not changed after task is finished
+};
+
+/**
+ * @brief Queue of ready tasks owned by the worker thread
+ */
+struct CTaskScheduler::Worker
+{
+   std::deque<TaskPtr> queue;                ///< Owner takes tasks from the back, thieves from the front
+   boost::mutex guard;                       ///< Mutex for queue
+};
+
+/**
+ * @brief State shared between scheduler, worker threads and node calls in flight
+ */
+struct CTaskScheduler::State
+{
+   explicit State( const CNodeDispatcher& nodes )
+      : dispatcher( nodes )
+      , workers()
+      , threads()
+      , workerIndex()
+      , nextWorker( 0 )
+      , queuedCount( 0 )
+      , isStopping( false )
+      , tasks()
+      , unfinishedCount( 0 )
+      , error()
+      , maxCalls( 0 )
+      , callsInFlight( 0 )
+      , deferred()
+   {
+
+   }
+
+   CNodeDispatcher dispatcher;                        ///< Dispatcher of node calls
+   std::vector< boost::shared_ptr<Worker> > workers;  ///< Queues of worker threads, by worker index
+   boost::thread_group threads;                       ///< Worker threads
+   boost::thread_specific_ptr<std::size_t> workerIndex; ///< Index of the worker running on the current thread
+   boost::atomic<std::size_t> nextWorker;             ///< Worker which gets the next task added by other thread
+   boost::atomic<std::size_t> queuedCount;            ///< Number of tasks in queues, counted before they are put there
+
+   bool isStopping;                                   ///< Whether workers should exit
+   boost::mutex idleGuard;                            ///< Mutex for isStopping and idle workers
+   boost::condition_variable idleCondition;           ///< Wakes idle workers
+
+   std::vector<TaskPtr> tasks;                        ///< All tasks, by task identifier
+   std::size_t unfinishedCount;                       ///< Number of tasks which are not finished yet
+   boost::exception_ptr error;                        ///< The first error of any task
+   std::size_t maxCalls;                              ///< Limit of node calls in flight, 0 if not limited
+   std::size_t callsInFlight;                         ///< Number of node calls in flight
+   std::deque<TaskPtr> deferred;                      ///< Node calls waiting for a free slot
+   boost::mutex guard;                                ///< Mutex for the graph and node call slots
+   boost::condition_variable finished;                ///< Notified when all tasks are finished
+};
+
+CTaskScheduler::CTaskScheduler( const CNodeDispatcher& dispatcher, std::size_t threadsCount, std::size_t callsPerNode )
+   : mState( new State( dispatcher ) )
+{
+   if ( threadsCount == 0 )
+   {
+      threadsCount = std::max( boost::thread::hardware_concurrency(), 1u );
+   }
+   mState->maxCalls = callsPerNode * dispatcher.getNodesCount();
+
+   for ( std::size_t i = 0; i < threadsCount; ++i )
+   {
+      mState->workers.push_back( boost::shared_ptr<Worker>( new Worker() ) );
+   }
+   for ( std::size_t i = 0; i < threadsCount; ++i )
+   {
+      mState->threads.create_thread( boost::bind( &CTaskScheduler::runWorker, mState, i ) );
+   }
+}
+
+CTaskScheduler::~CTaskScheduler( void )
+{
+   {
+      boost::unique_lock<boost::mutex> lock( mState->guard );
+      while ( mState->unfinishedCount > 0 )
+      {
+         mState->finished.wait( lock );
+      }
+   }
+
+   {
+      boost::lock_guard<boost::mutex> lock( mState->idleGuard );
+      mState->isStopping = true;
+   }
+   mState->idleCondition.notify_all();
+   mState->threads.join_all();
+}
+
+std::size_t CTaskScheduler::getThreadsCount( void ) const
+{
+   return mState->workers.size();
+}
+
+CTaskScheduler::TaskId CTaskScheduler::addLocal( const Function& function, const TaskIds& dependencies )
+{
+   const TaskPtr task( new Task() );
+   task->function = function;
+   return add( task, dependencies );
+}
+
+CTaskScheduler::TaskId CTaskScheduler::addRemote( CComputationNode::Operation operation,
+                                                  const DoubleArray& argument,
+                                                  const TaskIds& dependencies )
+{
+   const TaskPtr task( new Task() );
+   task->isRemote = true;
+   task->operation = operation;
+   task->argument = argument;
+   return add( task, dependencies );
+}
+
+CTaskScheduler::TaskId CTaskScheduler::addRemote( CComputationNode::Operation operation,
+                                                  const Function& argument,
+                                                  const TaskIds& dependencies )
+{
+   const TaskPtr task( new Task() );
+   task->isRemote = true;
+   task->operation = operation;
+   task->function = argument;
+   return add( task, dependencies );
+}
+
+CTaskScheduler::TaskId CTaskScheduler::add( const TaskPtr& task, const TaskIds& dependencies )
+{
+   TaskId id = 0;
+   {
+      boost::lock_guard<boost::mutex> lock( mState->guard );
+      for ( TaskIds::const_iterator it = dependencies.begin(); it != dependencies.end(); ++it )
+      {
+         if ( *it >= mState->tasks.size() )
+         {
+            throw std::out_of_range( "Unknown task dependency" );
+         }
+      }
+
+      for ( TaskIds::const_iterator it = dependencies.begin(); it != dependencies.end(); ++it )
+      {
+         const TaskPtr& dependency = mState->tasks[*it];
+         task->dependencies.push_back( dependency );
+         if ( !dependency->isFinished )
+         {
+            dependency->dependents.push_back( task );
+            ++task->pendingCount;
+         }
+         else if ( dependency->error && !task->error )
+         {
+            task->error = dependency->error;
+         }
+      }
+
+      id = mState->tasks.size();
+      mState->tasks.push_back( task );
+      ++mState->unfinishedCount;
+      if ( task->pendingCount > 0 )
+      {
+         return id;
+      }
+   }
+
+   if ( task->error )
+   {
+      DoubleArray empty;
+      finish( mState, task, task->error, empty );
+   }
+   else
+   {
+      enqueue( mState, task );
+   }
+   return id;
+}
+
+void CTaskScheduler::wait( void ) const
+{
+   boost::unique_lock<boost::mutex> lock( mState->guard );
+   while ( mState->unfinishedCount > 0 )
+   {
+      mState->finished.wait( lock );
+   }
+   if ( mState->error )
+   {
+      boost::rethrow_exception( mState->error );
+   }
+}
+
+DoubleArray CTaskScheduler::getResult( TaskId task ) const
+{
+   boost::lock_guard<boost::mutex> lock( mState->guard );
+   const TaskPtr& finishedTask = mState->tasks.at( task );
+   if ( !finishedTask->isFinished )
+   {
+      throw std::logic_error( "Task is not finished yet" );
+   }
+   if ( finishedTask->error )
+   {
+      boost::rethrow_exception( finishedTask->error );
+   }
+   return finishedTask->result;
+}
+
+void CTaskScheduler::runWorker( const boost::shared_ptr<State>& state, std::size_t index )
+{
+   state->workerIndex.reset( new std::size_t( index ) );
+
+   for ( ;; )
+   {
+      const TaskPtr task = takeTask( *state, index );
+      if ( task )
+      {
+         --state->queuedCount;
+         execute( state, task );
+         continue;
+      }
+
+      boost::unique_lock<boost::mutex> lock( state->idleGuard );
+      if ( state->isStopping )
+      {
+         return;
+      }
+      if ( state->queuedCount == 0 )
+      {
+         state->idleCondition.wait( lock );
+      }
+      else
+      {
+         // Task is counted but not put to the queue yet.
+         lock.unlock();
+         boost::this_thread::yield();
+      }
+   }
+}
+
+void CTaskScheduler::enqueue( const boost::shared_ptr<State>& state, const TaskPtr& task )
+{
+   // Tasks made ready by a worker stay on it, so that their inputs are likely still in its cache.
+   const std::size_t* current = state->workerIndex.get();
+   const std::size_t index = current ? *current : state->nextWorker++ % state->workers.size();
+
+   ++state->queuedCount;
+   {
+      Worker& worker = *state->workers[index];
+      boost::lock_guard<boost::mutex> lock( worker.guard );
+      worker.queue.push_back( task );
+   }
+
+   {
+      boost::lock_guard<boost::mutex> lock( state->idleGuard );
+   }
+   state->idleCondition.notify_one();
+}
+
+CTaskScheduler::TaskPtr CTaskScheduler::takeTask( State& state, std::size_t index )
+{
+   {
+      Worker& own = *state.workers[index];
+      boost::lock_guard<boost::mutex> lock( own.guard );
+      if ( !own.queue.empty() )
+      {
+         const TaskPtr task = own.queue.back();
+         own.queue.pop_back();
+         return task;
+      }
+   }
+
+   const std::size_t count = state.workers.size();
+   for ( std::size_t i = 1; i < count; ++i )
+   {
+      Worker& victim = *state.workers[( index + i ) % count];
+      boost::lock_guard<boost::mutex> lock( victim.guard );
+      if ( !victim.queue.empty() )
+      {
+         const TaskPtr task = victim.queue.front();
+         victim.queue.pop_front();
+         return task;
+      }
+   }
+   return TaskPtr();
+}
+
+void CTaskScheduler::execute( const boost::shared_ptr<State>& state, const TaskPtr& task )
+{
+   // Results of finished tasks are not changed, so they are read without lock.
+   Inputs inputs;
+   inputs.reserve( task->dependencies.size() );
+   for ( std::vector<TaskPtr>::const_iterator it = task->dependencies.begin(); it != task->dependencies.end(); ++it )
+   {
+      inputs.push_back( &( *it )->result );
+   }
+
+   DoubleArray result;
+   boost::exception_ptr error;
+   try
+   {
+      if ( !task->isRemote )
+      {
+         result = task->function( inputs );
+      }
+      else if ( task->function )
+      {
+         task->argument = task->function( inputs );
+      }
+   }
+   catch ( ... )
+   {
+      error = boost::current_exception();
+   }
+   task->function.clear();
+
+   if ( error || !task->isRemote )
+   {
+      finish( state, task, error, result );
+      return;
+   }
+
+   {
+      boost::lock_guard<boost::mutex> lock( state->guard );
+      if ( state->maxCalls > 0 && state->callsInFlight >= state->maxCalls )
+      {
+         // Worker is not blocked, call is sent when one of the calls in flight is answered.
+         state->deferred.push_back( task );
+         return;
+      }
+      ++state->callsInFlight;
+   }
+   sendCall( state, task );
+}
+
+void CTaskScheduler::sendCall( const boost::shared_ptr<State>& state, const TaskPtr& task )
+{
+   DoubleArray argument;
+   argument.swap( task->argument );
+   state->dispatcher.asyncCall( task->operation,
+                                argument,
+                                boost::bind( &CTaskScheduler::onCallFinished, state, task, _1, _2 ) );
+}
+
+void CTaskScheduler::onCallFinished( const boost::shared_ptr<State>& state,
+                                     const TaskPtr& task,
+                                     const boost::exception_ptr& error,
+                                     DoubleArray& result )
+{
+   TaskPtr next;
+   {
+      boost::lock_guard<boost::mutex> lock( state->guard );
+      if ( state->deferred.empty() )
+      {
+         --state->callsInFlight;
+      }
+      else
+      {
+         next = state->deferred.front();
+         state->deferred.pop_front();
+      }
+   }
+
+   // Slot is handed over before dependents are scheduled, so that the node does not idle.
+   if ( next )
+   {
+      sendCall( state, next );
+   }
+   finish( state, task, error, result );
+}
+
+void CTaskScheduler::finish( const boost::shared_ptr<State>& state,
+                             const TaskPtr& task,
+                             const boost::exception_ptr& error,
+                             DoubleArray& result )
+{
+   std::vector<TaskPtr> ready;
+   {
+      boost::lock_guard<boost::mutex> lock( state->guard );
+      task->error = error;
+      task->result.swap( result );
+
+      // Failure is passed down the graph without running dependents.
+      std::vector<TaskPtr> finishedTasks( 1, task );
+      for ( std::size_t i = 0; i < finishedTasks.size(); ++i )
+      {
+         const TaskPtr current = finishedTasks[i];
+         current->isFinished = true;
+         if ( current->error && !state->error )
+         {
+            state->error = current->error;
+         }
+
+         for ( std::vector<TaskPtr>::const_iterator it = current->dependents.begin(); it != current->dependents.end(); ++it )
+         {
+            const TaskPtr& dependent = *it;
+            if ( current->error && !dependent->error )
+            {
+               dependent->error = current->error;
+            }
+            if ( --dependent->pendingCount == 0 )
+            {
+               ( dependent->error ? finishedTasks : ready ).push_back( dependent );
+            }
+         }
+         current->dependents.clear();
+         --state->unfinishedCount;
+      }
+
+      if ( state->unfinishedCount == 0 )
+      {
+         state->finished.notify_all();
+      }
+   }
+
+   for ( std::vector<TaskPtr>::const_iterator it = ready.begin(); it != ready.end(); ++it )
+   {
+      enqueue( state, *it );
+   }
+}
+/** @}*/
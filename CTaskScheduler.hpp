@@ -0,0 +1,211 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CTaskScheduler.hpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CTaskScheduler class declaration
+ ************************************************************************/
+#ifndef CTASKSCHEDULER_HPP
+#define CTASKSCHEDULER_HPP
+
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include <vector>
+
+#include "CNodeDispatcher.hpp"
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+/**
+ * @brief This class executes graph of compute tasks in dependency order. \n
+ * Task is either a local function or a call of the computation node. \n
+ * Task becomes ready when all tasks it depends on are finished, and ready \n
+ * tasks are run by a pool of worker threads. Every worker takes the most recent \n
+ * task of its own queue and steals the oldest tasks of other workers when idle. \n
+ * Node calls do not occupy workers while in flight, their number is limited \n
+ * per node, and calls over the limit wait until earlier ones are answered.
+ * @sa CSandBox::sandBoxMain()
+ */
+class CTaskScheduler : private boost::noncopyable
+{
+public:
+   /**
+    * @brief Task identifier, index of the task in order of addition
+    */
+   typedef std::size_t TaskId;
+
+   /**
+    * @brief List of task identifiers
+    */
+   typedef std::vector<TaskId> TaskIds;
+
+   /**
+    * @brief Results of the tasks which task depends on, in order of its dependencies
+    */
+   typedef std::vector<const DoubleArray*> Inputs;
+
+   /**
+    * @brief Task body. It is run by worker thread and should not block.
+    */
+   typedef boost::function<DoubleArray( const Inputs& inputs )> Function;
+
+   /**
+    * @brief Default number of node calls in flight per node
+    */
+   static const std::size_t DEFAULT_CALLS_PER_NODE = 16;
+
+   /**
+    * @brief Constructor. Starts worker threads.
+    * @param dispatcher - dispatcher of node calls
+    * @param threadsCount - number of worker threads, 0 - number of CPU cores
+    * @param callsPerNode - limit of node calls in flight per node, 0 - not limited
+    */
+   explicit CTaskScheduler( const CNodeDispatcher& dispatcher,
+                            std::size_t threadsCount = 0,
+                            std::size_t callsPerNode = DEFAULT_CALLS_PER_NODE );
+
+   /**
+    * @brief Destructor. Waits until all tasks are finished and stops worker threads.
+    */
+   ~CTaskScheduler( void );
+
+   /**
+    * @brief Get number of worker threads
+    * @return Threads count
+    */
+   std::size_t getThreadsCount( void ) const;
+
+   /**
+    * @brief Add task which computes its result locally
+    * @param function - task body, receives results of dependencies
+    * @param dependencies - tasks which must be finished before this one
+    * @return Task identifier
+    * @throw std::out_of_range if dependency is unknown
+    */
+   TaskId addLocal( const Function& function, const TaskIds& dependencies = TaskIds() );
+
+   /**
+    * @brief Add node call with known argument
+    * @param operation - operation to perform
+    * @param argument - operation argument
+    * @param dependencies - tasks which must be finished before this one
+    * @return Task identifier
+    * @throw std::out_of_range if dependency is unknown
+    */
+   TaskId addRemote( CComputationNode::Operation operation,
+                     const DoubleArray& argument,
+                     const TaskIds& dependencies = TaskIds() );
+
+   /**
+    * @brief Add node call which argument is built from results of dependencies
+    * @param operation - operation to perform
+    * @param argument - builds operation argument, run by worker thread
+    * @param dependencies - tasks which must be finished before this one
+    * @return Task identifier
+    * @throw std::out_of_range if dependency is unknown
+    */
+   TaskId addRemote( CComputationNode::Operation operation,
+                     const Function& argument,
+                     const TaskIds& dependencies );
+
+   /**
+    * @brief Block until all added tasks are finished. \n
+    * Tasks which depend on failed task are not run and fail with its error.
+    * @throw std::exception - the first error of any task
+    */
+   void wait( void ) const;
+
+   /**
+    * @brief Get result of finished task
+    * @param task - task identifier
+    * @return Task result
+    * @throw std::out_of_range if task is unknown
+    * @throw std::logic_error if task is not finished yet
+    * @throw std::exception if task has failed
+    */
+   DoubleArray getResult( TaskId task ) const;
+
+private:
+   struct State;
+   struct Task;
+   struct Worker;
+   typedef boost::shared_ptr<Task> TaskPtr;
+
+   /**
+    * @brief Register task in the graph and schedule it if it is ready
+    * @param task - new task
+    * @param dependencies - tasks which must be finished before this one
+    * @return Task identifier
+    */
+   TaskId add( const TaskPtr& task, const TaskIds& dependencies );
+
+   /**
+    * @brief Worker thread function
+    * @param state - scheduler state
+    * @param index - worker index
+    */
+   static void runWorker( const boost::shared_ptr<State>& state, std::size_t index );
+
+   /**
+    * @brief Put ready task to the queue of the current worker, \n
+    * or to the queue of the next worker in turn if called by other thread
+    * @param state - scheduler state
+    * @param task - ready task
+    */
+   static void enqueue( const boost::shared_ptr<State>& state, const TaskPtr& task );
+
+   /**
+    * @brief Take the most recent task of own queue or the oldest task of other queue
+    * @param state - scheduler state
+    * @param index - worker index
+    * @return Task or null if all queues are empty
+    */
+   static TaskPtr takeTask( State& state, std::size_t index );
+
+   /**
+    * @brief Run local task or build argument of node call and send it
+    * @param state - scheduler state
+    * @param task - ready task
+    */
+   static void execute( const boost::shared_ptr<State>& state, const TaskPtr& task );
+
+   /**
+    * @brief Send node call to the dispatcher
+    * @param state - scheduler state
+    * @param task - node call task which holds one of in-flight slots
+    */
+   static void sendCall( const boost::shared_ptr<State>& state, const TaskPtr& task );
+
+   /**
+    * @brief Node call completion callback. Passes its slot to the waiting call.
+    * @param state - scheduler state
+    * @param task - finished task
+    * @param error - call error or null on success
+    * @param result - call result
+    */
+   static void onCallFinished( const boost::shared_ptr<State>& state,
+                               const TaskPtr& task,
+                               const boost::exception_ptr& error,
+                               DoubleArray& result );
+
+   /**
+    * @brief Store task result and schedule dependents which became ready
+    * @param state - scheduler state
+    * @param task - finished task
+    * @param error - task error or null on success
+    * @param result - task result, moved out
+    */
+   static void finish( const boost::shared_ptr<State>& state,
+                       const TaskPtr& task,
+                       const boost::exception_ptr& error,
+                       DoubleArray& result );
+
+private:
+   boost::shared_ptr<State> mState;    ///< Graph, queues and workers shared with callbacks
+};
+/** @}*/
+#endif // CTASKSCHEDULER_HPP
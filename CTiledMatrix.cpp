@@ -0,0 +1,131 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CTiledMatrix.cpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CTiledMatrix class definition
+ ************************************************************************/
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include "CTiledMatrix.hpp"
+
+const std::size_t CTiledMatrix::PACK_BLOCK;
+
+CTiledMatrix::CTiledMatrix( void )
+   : mValues()
+   , mRows( 0 )
+   , mCols( 0 )
+   , mTileRows( 1 )
+   , mTileCols( 1 )
+   , mLayout( ROW_MAJOR )
+{
+
+}
+
+CTiledMatrix::~CTiledMatrix( void )
+{
+
+}
+
+std::size_t CTiledMatrix::getRowsCount( void ) const
+{
+   return mRows;
+}
+
+std::size_t CTiledMatrix::getColsCount( void ) const
+{
+   return mCols;
+}
+
+std::size_t CTiledMatrix::getTileRows( void ) const
+{
+   return mTileRows;
+}
+
+std::size_t CTiledMatrix::getTileCols( void ) const
+{
+   return mTileCols;
+}
+
+std::size_t CTiledMatrix::getPanelsCount( void ) const
+{
+   return ( mRows + mTileRows - 1 ) / mTileRows;
+}
+
+std::size_t CTiledMatrix::getTilesPerPanel( void ) const
+{
+   return ( mCols + mTileCols - 1 ) / mTileCols;
+}
+
+CTiledMatrix::Layout CTiledMatrix::getLayout( void ) const
+{
+   return mLayout;
+}
+
+CTiledMatrix::Span CTiledMatrix::getTile( std::size_t panel, std::size_t tile ) const
+{
+   Span span;
+   span.begin = mValues.data() + getOffset( panel, tile );
+   span.end = span.begin + getPanelRows( panel ) * getTileWidth( tile );
+   return span;
+}
+
+CTiledMatrix::Span CTiledMatrix::getRow( std::size_t row, std::size_t tile ) const
+{
+   if ( mLayout != ROW_MAJOR )
+   {
+      throw std::logic_error( "Rows of column-major tiles are not contiguous" );
+   }
+
+   const std::size_t panel = row / mTileRows;
+   const std::size_t width = getTileWidth( tile );
+   Span span;
+   span.begin = mValues.data() + getOffset( panel, tile ) + ( row - panel * mTileRows ) * width;
+   span.end = span.begin + width;
+   return span;
+}
+
+CTiledMatrix::Span CTiledMatrix::getColumn( std::size_t panel, std::size_t col ) const
+{
+   if ( mLayout != COLUMN_MAJOR )
+   {
+      throw std::logic_error( "Columns of row-major tiles are not contiguous" );
+   }
+
+   const std::size_t tile = col / mTileCols;
+   const std::size_t height = getPanelRows( panel );
+   Span span;
+   span.begin = mValues.data() + getOffset( panel, tile ) + ( col - tile * mTileCols ) * height;
+   span.end = span.begin + height;
+   return span;
+}
+
+const double& CTiledMatrix::operator()( std::size_t row, std::size_t col ) const
+{
+   const std::size_t panel = row / mTileRows;
+   const std::size_t tile = col / mTileCols;
+   const std::size_t i = row - panel * mTileRows;
+   const std::size_t j = col - tile * mTileCols;
+   const std::size_t offset = getOffset( panel, tile );
+   return ( mLayout == ROW_MAJOR ) ? mValues[offset + i * getTileWidth( tile ) + j]
+                                   : mValues[offset + j * getPanelRows( panel ) + i];
+}
+
+std::size_t CTiledMatrix::getOffset( std::size_t panel, std::size_t tile ) const
+{
+   // All tiles of the panel have its rows count, so preceding tiles of the panel take rows * columns before them.
+   return panel * mTileRows * mCols + getPanelRows( panel ) * tile * mTileCols;
+}
+
+std::size_t CTiledMatrix::getPanelRows( std::size_t panel ) const
+{
+   return std::min( mTileRows, mRows - panel * mTileRows );
+}
+
+std::size_t CTiledMatrix::getTileWidth( std::size_t tile ) const
+{
+   return std::min( mTileCols, mCols - tile * mTileCols );
+}
+/** @}*/
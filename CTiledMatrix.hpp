@@ -0,0 +1,272 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    CTiledMatrix.hpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   CTiledMatrix class declaration
+ ************************************************************************/
+#ifndef CTILEDMATRIX_HPP
+#define CTILEDMATRIX_HPP
+
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include <algorithm>
+#include <stdexcept>
+
+#include "CComputationNode.hpp"
+
+/**
+ * @brief This class keeps copy of the matrix packed by tiles, so that every tile \n
+ * and every row or column within a tile is one contiguous span of memory. \n
+ * Tiles of the same tile row (panel) follow each other, panels follow each other. \n
+ * Values within a tile are row by row or, for transposed layout, column by column, \n
+ * so columns of B tiles are ready for dot products without a gather step. \n
+ * Spans may be passed to wire::appendBinaryValues() or copied into DoubleArray at once. \n
+ * Matrix is packed with cache-sized blocks, so column access to row-major source \n
+ * does not walk memory with a stride per value.
+ * @sa CGemmEngine
+ */
+class CTiledMatrix
+{
+public:
+   /**
+    * @brief Order of values within a tile
+    */
+   enum Layout
+   {
+      ROW_MAJOR,     ///< Tile rows are contiguous
+      COLUMN_MAJOR   ///< Tile columns are contiguous
+   };
+
+   /**
+    * @brief Contiguous values of the tile, row or column
+    */
+   struct Span
+   {
+      const double* begin;    ///< First value
+      const double* end;      ///< Value after the last one
+
+      std::size_t size( void ) const
+      {
+         return end - begin;
+      }
+   };
+
+   /**
+    * @brief Rows and columns of the square block which is packed at once
+    */
+   static const std::size_t PACK_BLOCK = 32;
+
+   /**
+    * @brief Constructor. Creates empty matrix.
+    */
+   CTiledMatrix( void );
+
+   /**
+    * @brief Constructor. Packs the matrix.
+    * @param source - matrix of any type which provides getRowsCount(), getColsCount() \n
+    * and operator()( row, col ) as matrix::CMatrix does
+    * @param tileRows - rows per tile, 0 - all rows
+    * @param tileCols - columns per tile, 0 - all columns
+    * @param layout - order of values within a tile
+    */
+   template<typename Matrix>
+   CTiledMatrix( const Matrix& source, std::size_t tileRows, std::size_t tileCols, Layout layout );
+
+   /**
+    * @brief Destructor
+    */
+   ~CTiledMatrix( void );
+
+   /**
+    * @brief Pack the matrix, previous values are dropped
+    * @param source - matrix of any type which provides getRowsCount(), getColsCount() \n
+    * and operator()( row, col ) as matrix::CMatrix does
+    * @param tileRows - rows per tile, 0 - all rows
+    * @param tileCols - columns per tile, 0 - all columns
+    * @param layout - order of values within a tile
+    */
+   template<typename Matrix>
+   void assign( const Matrix& source, std::size_t tileRows, std::size_t tileCols, Layout layout );
+
+   /**
+    * @brief Pack part of the matrix into contiguous memory
+    * @param source - matrix of any type which provides operator()( row, col )
+    * @param rowBegin - first row
+    * @param rowEnd - row after the last one
+    * @param colBegin - first column
+    * @param colEnd - column after the last one
+    * @param layout - order of values
+    * @param[out] out - ( rowEnd - rowBegin ) * ( colEnd - colBegin ) values
+    */
+   template<typename Matrix>
+   static void pack( const Matrix& source,
+                     std::size_t rowBegin,
+                     std::size_t rowEnd,
+                     std::size_t colBegin,
+                     std::size_t colEnd,
+                     Layout layout,
+                     double* out );
+
+   std::size_t getRowsCount( void ) const;      ///< Get rows count
+   std::size_t getColsCount( void ) const;      ///< Get columns count
+   std::size_t getTileRows( void ) const;       ///< Get rows per tile, last panel may have fewer
+   std::size_t getTileCols( void ) const;       ///< Get columns per tile, last tile of a panel may have fewer
+   std::size_t getPanelsCount( void ) const;    ///< Get number of tile rows
+   std::size_t getTilesPerPanel( void ) const;  ///< Get number of tile columns
+   Layout getLayout( void ) const;              ///< Get order of values within a tile
+
+   /**
+    * @brief Get tile values
+    * @param panel - tile row, less than getPanelsCount()
+    * @param tile - tile column, less than getTilesPerPanel()
+    * @return Values of the tile in its layout
+    */
+   Span getTile( std::size_t panel, std::size_t tile ) const;
+
+   /**
+    * @brief Get part of the row which lies in one tile. \n
+    * If tile has all columns, it is the whole row.
+    * @param row - row index
+    * @param tile - tile column
+    * @return Row values of the tile
+    * @throw std::logic_error if layout is not ROW_MAJOR
+    */
+   Span getRow( std::size_t row, std::size_t tile ) const;
+
+   /**
+    * @brief Get part of the column which lies in one tile. \n
+    * If tile has all rows, it is the whole column.
+    * @param panel - tile row
+    * @param col - column index
+    * @return Column values of the tile
+    * @throw std::logic_error if layout is not COLUMN_MAJOR
+    */
+   Span getColumn( std::size_t panel, std::size_t col ) const;
+
+   /**
+    * @brief Access matrix element, so that tiled matrix may be used as any other
+    * @param row - element row
+    * @param col - element column
+    * @return Element value
+    */
+   const double& operator()( std::size_t row, std::size_t col ) const;
+
+private:
+   /**
+    * @brief Get offset of the tile in packed values
+    * @param panel - tile row
+    * @param tile - tile column
+    * @return Offset of the first tile value
+    */
+   std::size_t getOffset( std::size_t panel, std::size_t tile ) const;
+
+   /**
+    * @brief Get rows count of the panel
+    * @param panel - tile row
+    * @return Rows count
+    */
+   std::size_t getPanelRows( std::size_t panel ) const;
+
+   /**
+    * @brief Get columns count of the tile
+    * @param tile - tile column
+    * @return Columns count
+    */
+   std::size_t getTileWidth( std::size_t tile ) const;
+
+private:
+   DoubleArray mValues;          ///< Packed values
+   std::size_t mRows;            ///< Rows count
+   std::size_t mCols;            ///< Columns count
+   std::size_t mTileRows;        ///< Rows per tile
+   std::size_t mTileCols;        ///< Columns per tile
+   Layout mLayout;               ///< Order of values within a tile
+};
+
+template<typename Matrix>
+CTiledMatrix::CTiledMatrix( const Matrix& source, std::size_t tileRows, std::size_t tileCols, Layout layout )
+   : mValues()
+   , mRows( 0 )
+   , mCols( 0 )
+   , mTileRows( 1 )
+   , mTileCols( 1 )
+   , mLayout( layout )
+{
+   assign( source, tileRows, tileCols, layout );
+}
+
+template<typename Matrix>
+void CTiledMatrix::assign( const Matrix& source, std::size_t tileRows, std::size_t tileCols, Layout layout )
+{
+   mRows = source.getRowsCount();
+   mCols = source.getColsCount();
+   mTileRows = std::max<std::size_t>( std::min( tileRows > 0 ? tileRows : mRows, mRows ), 1 );
+   mTileCols = std::max<std::size_t>( std::min( tileCols > 0 ? tileCols : mCols, mCols ), 1 );
+   mLayout = layout;
+   mValues.resize( mRows * mCols );
+
+   for ( std::size_t panel = 0; panel < getPanelsCount(); ++panel )
+   {
+      const std::size_t rowBegin = panel * mTileRows;
+      for ( std::size_t tile = 0; tile < getTilesPerPanel(); ++tile )
+      {
+         const std::size_t colBegin = tile * mTileCols;
+         pack( source,
+               rowBegin,
+               rowBegin + getPanelRows( panel ),
+               colBegin,
+               colBegin + getTileWidth( tile ),
+               layout,
+               mValues.data() + getOffset( panel, tile ) );
+      }
+   }
+}
+
+template<typename Matrix>
+void CTiledMatrix::pack( const Matrix& source,
+                         std::size_t rowBegin,
+                         std::size_t rowEnd,
+                         std::size_t colBegin,
+                         std::size_t colEnd,
+                         Layout layout,
+                         double* out )
+{
+   const std::size_t rows = rowEnd - rowBegin;
+   const std::size_t cols = colEnd - colBegin;
+
+   if ( layout == ROW_MAJOR )
+   {
+      // Source is read in its own order, nothing to block.
+      for ( std::size_t i = 0; i < rows; ++i )
+      {
+         for ( std::size_t j = 0; j < cols; ++j )
+         {
+            out[i * cols + j] = source( rowBegin + i, colBegin + j );
+         }
+      }
+      return;
+   }
+
+   // Transposition goes by square blocks, so that both source rows and output columns
+   // of the block stay in cache while it is copied.
+   for ( std::size_t ib = 0; ib < rows; ib += PACK_BLOCK )
+   {
+      const std::size_t ie = std::min( ib + PACK_BLOCK, rows );
+      for ( std::size_t jb = 0; jb < cols; jb += PACK_BLOCK )
+      {
+         const std::size_t je = std::min( jb + PACK_BLOCK, cols );
+         for ( std::size_t i = ib; i < ie; ++i )
+         {
+            for ( std::size_t j = jb; j < je; ++j )
+            {
+               out[j * rows + i] = source( rowBegin + i, colBegin + j );
+            }
+         }
+      }
+   }
+}
+/** @}*/
+#endif // CTILEDMATRIX_HPP
@@ -0,0 +1,220 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    Kernels.cpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   Vectorized implementation of computation node operations
+ ************************************************************************/
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include "Kernels.hpp"
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define KERNELS_X86
+#include <immintrin.h>
+#endif
+
+namespace kernels
+{
+   /**
+    * @brief Number of values summed directly, longer arrays are split in halves
+    */
+   static const std::size_t SUM_BLOCK_SIZE = 128;
+
+   typedef void ( *MultiplyPairsFunction )( const double* values, std::size_t pairsCount, double* out );
+   typedef double ( *BlockSumFunction )( const double* values, std::size_t count );
+
+   /**
+    * @brief Kernels chosen for the running CPU
+    */
+   struct Dispatch
+   {
+      const char* name;                      ///< Instruction set name
+      MultiplyPairsFunction multiplyPairs;   ///< Pairs multiplication kernel
+      BlockSumFunction blockSum;             ///< Block summation kernel
+   };
+
+   /*
+    * Block is summed in four interleaved lanes: lane l accumulates values with index l mod 4,
+    * lanes are combined as ( l0 + l1 ) + ( l2 + l3 ) and remaining values are added in order.
+    * All implementations follow this order, so their results are bit-identical.
+    */
+
+   static void multiplyPairsGeneric( const double* values, std::size_t pairsCount, double* out )
+   {
+      for ( std::size_t i = 0; i < pairsCount; ++i )
+      {
+         out[i] = values[2 * i] * values[2 * i + 1];
+      }
+   }
+
+   static double blockSumGeneric( const double* values, std::size_t count )
+   {
+      double lanes[4] = { 0.0, 0.0, 0.0, 0.0 };
+      const std::size_t alignedCount = count & ~static_cast<std::size_t>( 3 );
+      std::size_t i = 0;
+      for ( ; i < alignedCount; i += 4 )
+      {
+         lanes[0] += values[i];
+         lanes[1] += values[i + 1];
+         lanes[2] += values[i + 2];
+         lanes[3] += values[i + 3];
+      }
+
+      double total = ( lanes[0] + lanes[1] ) + ( lanes[2] + lanes[3] );
+      for ( ; i < count; ++i )
+      {
+         total += values[i];
+      }
+      return total;
+   }
+
+#ifdef KERNELS_X86
+   __attribute__(( target( "sse2" ) ))
+   static void multiplyPairsSse2( const double* values, std::size_t pairsCount, double* out )
+   {
+      std::size_t i = 0;
+      for ( ; i + 2 <= pairsCount; i += 2 )
+      {
+         const __m128d first = _mm_loadu_pd( values + 2 * i );       // a0 b0
+         const __m128d second = _mm_loadu_pd( values + 2 * i + 2 );  // a1 b1
+         _mm_storeu_pd( out + i, _mm_mul_pd( _mm_unpacklo_pd( first, second ),
+                                             _mm_unpackhi_pd( first, second ) ) );
+      }
+      multiplyPairsGeneric( values + 2 * i, pairsCount - i, out + i );
+   }
+
+   __attribute__(( target( "sse2" ) ))
+   static double blockSumSse2( const double* values, std::size_t count )
+   {
+      __m128d lanes01 = _mm_setzero_pd();
+      __m128d lanes23 = _mm_setzero_pd();
+      const std::size_t alignedCount = count & ~static_cast<std::size_t>( 3 );
+      std::size_t i = 0;
+      for ( ; i < alignedCount; i += 4 )
+      {
+         lanes01 = _mm_add_pd( lanes01, _mm_loadu_pd( values + i ) );
+         lanes23 = _mm_add_pd( lanes23, _mm_loadu_pd( values + i + 2 ) );
+      }
+
+      double lanes[4];
+      _mm_storeu_pd( lanes, lanes01 );
+      _mm_storeu_pd( lanes + 2, lanes23 );
+      double total = ( lanes[0] + lanes[1] ) + ( lanes[2] + lanes[3] );
+      for ( ; i < count; ++i )
+      {
+         total += values[i];
+      }
+      return total;
+   }
+
+   __attribute__(( target( "avx2" ) ))
+   static void multiplyPairsAvx2( const double* values, std::size_t pairsCount, double* out )
+   {
+      std::size_t i = 0;
+      for ( ; i + 4 <= pairsCount; i += 4 )
+      {
+         const __m256d first = _mm256_loadu_pd( values + 2 * i );       // a0 b0 a1 b1
+         const __m256d second = _mm256_loadu_pd( values + 2 * i + 4 );  // a2 b2 a3 b3
+         // Unpacking works inside 128-bit halves, so products come as p0 p2 p1 p3.
+         const __m256d products = _mm256_mul_pd( _mm256_unpacklo_pd( first, second ),
+                                                 _mm256_unpackhi_pd( first, second ) );
+         _mm256_storeu_pd( out + i, _mm256_permute4x64_pd( products, _MM_SHUFFLE( 3, 1, 2, 0 ) ) );
+      }
+      multiplyPairsGeneric( values + 2 * i, pairsCount - i, out + i );
+   }
+
+   __attribute__(( target( "avx2" ) ))
+   static double blockSumAvx2( const double* values, std::size_t count )
+   {
+      __m256d accumulator = _mm256_setzero_pd();
+      const std::size_t alignedCount = count & ~static_cast<std::size_t>( 3 );
+      std::size_t i = 0;
+      for ( ; i < alignedCount; i += 4 )
+      {
+         accumulator = _mm256_add_pd( accumulator, _mm256_loadu_pd( values + i ) );
+      }
+
+      double lanes[4];
+      _mm256_storeu_pd( lanes, accumulator );
+      double total = ( lanes[0] + lanes[1] ) + ( lanes[2] + lanes[3] );
+      for ( ; i < count; ++i )
+      {
+         total += values[i];
+      }
+      return total;
+   }
+#endif
+
+   /**
+    * @brief Choose kernels for the running CPU
+    * @return Chosen kernels
+    */
+   static Dispatch detect( void )
+   {
+      Dispatch dispatch = { "generic", &multiplyPairsGeneric, &blockSumGeneric };
+#ifdef KERNELS_X86
+      __builtin_cpu_init();
+      if ( __builtin_cpu_supports( "avx2" ) )
+      {
+         dispatch.name = "avx2";
+         dispatch.multiplyPairs = &multiplyPairsAvx2;
+         dispatch.blockSum = &blockSumAvx2;
+      }
+      else if ( __builtin_cpu_supports( "sse2" ) )
+      {
+         dispatch.name = "sse2";
+         dispatch.multiplyPairs = &multiplyPairsSse2;
+         dispatch.blockSum = &blockSumSse2;
+      }
+#endif
+      return dispatch;
+   }
+
+   /**
+    * @brief Get kernels for the running CPU, detected on first use
+    * @return Chosen kernels
+    */
+   static const Dispatch& getDispatch( void )
+   {
+      static const Dispatch dispatch = detect();
+      return dispatch;
+   }
+
+   /**
+    * @brief Pairwise summation
+    * @param values - numbers to sum
+    * @param count - number of values
+    * @param blockSum - kernel for short arrays
+    * @return Sum
+    */
+   static double pairwiseSum( const double* values, std::size_t count, BlockSumFunction blockSum )
+   {
+      if ( count <= SUM_BLOCK_SIZE )
+      {
+         return blockSum( values, count );
+      }
+
+      // Split point is kept multiple of block size so blocks stay full.
+      const std::size_t half = ( count / 2 + SUM_BLOCK_SIZE - 1 ) / SUM_BLOCK_SIZE * SUM_BLOCK_SIZE;
+      return pairwiseSum( values, half, blockSum ) + pairwiseSum( values + half, count - half, blockSum );
+   }
+
+   const char* getInstructionSet( void )
+   {
+      return getDispatch().name;
+   }
+
+   void multiplyPairs( const double* values, std::size_t pairsCount, double* out )
+   {
+      getDispatch().multiplyPairs( values, pairsCount, out );
+   }
+
+   double sum( const double* values, std::size_t count )
+   {
+      return pairwiseSum( values, count, getDispatch().blockSum );
+   }
+}
+/** @}*/
@@ -0,0 +1,44 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    Kernels.hpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   Vectorized implementation of computation node operations
+ ************************************************************************/
+#ifndef KERNELS_HPP
+#define KERNELS_HPP
+
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include <cstddef>
+
+namespace kernels
+{
+   /**
+    * @brief Get name of the instruction set chosen for the running CPU
+    * @return "avx2", "sse2" or "generic"
+    */
+   const char* getInstructionSet( void );
+
+   /**
+    * @brief Multiply adjacent pairs of numbers
+    * @param values - pairs of numbers, 2 * pairsCount values
+    * @param pairsCount - number of pairs
+    * @param[out] out - products, pairsCount values
+    */
+   void multiplyPairs( const double* values, std::size_t pairsCount, double* out );
+
+   /**
+    * @brief Sum numbers with pairwise summation. \n
+    * Rounding error grows as O(log n) instead of O(n) of the plain loop. \n
+    * Result does not depend on the instruction set.
+    * @param values - numbers to sum
+    * @param count - number of values
+    * @return Sum
+    */
+   double sum( const double* values, std::size_t count );
+}
+/** @}*/
+#endif // KERNELS_HPP
@@ -0,0 +1,439 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    TextReader.cpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   Parallel reader of matrices in text format
+ ************************************************************************/
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include "TextReader.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <boost/interprocess/exceptions.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace
+{
+   /**
+    * @brief Largest mantissa which is exactly representable by double
+    */
+   const boost::uint64_t MAX_EXACT_MANTISSA = boost::uint64_t( 1 ) << 53;
+
+   /**
+    * @brief Largest power of 10 which is exactly representable by double
+    */
+   const int MAX_EXACT_EXPONENT = 22;
+
+   /**
+    * @brief Approximate number of bytes parsed at once by a single thread
+    */
+   const std::size_t CHUNK_SIZE = 1 << 20;
+
+   /**
+    * @brief Exponent after which number is out of double range anyway
+    */
+   const int MAX_EXPONENT = 100000;
+
+   const double POWERS_OF_TEN[MAX_EXACT_EXPONENT + 1] =
+   {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+   };
+
+   /**
+    * @brief Part of the file parsed by a single thread
+    */
+   struct Chunk
+   {
+      const char* begin;      ///< First character
+      const char* end;        ///< Character after the last one
+      std::size_t first;      ///< Index of the first value in the matrix
+      std::size_t count;      ///< Number of values
+   };
+
+   inline bool isSpace( char c )
+   {
+      return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+   }
+
+   inline bool isDigit( char c )
+   {
+      return c >= '0' && c <= '9';
+   }
+
+   /**
+    * @brief Parse unsigned integer followed by whitespace
+    * @param[in,out] pos - position in text, moved after the number
+    * @param end - end of text
+    * @param[out] value - parsed number
+    * @return True - if number was parsed
+    */
+   bool parseSize( const char*& pos, const char* end, std::size_t& value )
+   {
+      while ( pos != end && isSpace( *pos ) )
+      {
+         ++pos;
+      }
+
+      value = 0;
+      const char* begin = pos;
+      for ( ; pos != end && isDigit( *pos ); ++pos )
+      {
+         const std::size_t digit = *pos - '0';
+         if ( value > ( static_cast<std::size_t>( -1 ) - digit ) / 10 )
+         {
+            return false;
+         }
+         value = value * 10 + digit;
+      }
+      return pos != begin && ( pos == end || isSpace( *pos ) );
+   }
+
+   /**
+    * @brief Count values of the chunk
+    * @param chunk - chunk to update
+    */
+   void countValues( Chunk& chunk )
+   {
+      std::size_t count = 0;
+      bool isInValue = false;
+      for ( const char* pos = chunk.begin; pos != chunk.end; ++pos )
+      {
+         const bool isValueChar = !isSpace( *pos );
+         count += ( isValueChar && !isInValue );
+         isInValue = isValueChar;
+      }
+      chunk.count = count;
+   }
+
+   /**
+    * @brief Parse values of the chunk into the matrix
+    * @param chunk - chunk to parse
+    * @param matrix - destination matrix
+    * @param valuesCount - number of matrix elements, extra values are ignored as by std::istream reader
+    * @return False if any value is malformed
+    */
+   bool parseValues( const Chunk& chunk, matrix::CMatrix& matrix, std::size_t valuesCount )
+   {
+      const std::size_t cols = matrix.getColsCount();
+      std::size_t index = chunk.first;
+      std::size_t row = index / cols;
+      std::size_t col = index % cols;
+
+      const char* pos = chunk.begin;
+      while ( index < valuesCount )
+      {
+         while ( pos != chunk.end && isSpace( *pos ) )
+         {
+            ++pos;
+         }
+         if ( pos == chunk.end )
+         {
+            break;
+         }
+
+         const char* valueEnd = pos;
+         while ( valueEnd != chunk.end && !isSpace( *valueEnd ) )
+         {
+            ++valueEnd;
+         }
+
+         if ( !textio::parseDouble( pos, valueEnd, matrix( row, col ) ) )
+         {
+            return false;
+         }
+
+         pos = valueEnd;
+         ++index;
+         if ( ++col == cols )
+         {
+            col = 0;
+            ++row;
+         }
+      }
+      return true;
+   }
+
+   /**
+    * @brief State of parsing shared between threads
+    */
+   struct ParseState
+   {
+      ParseState( const std::vector<Chunk>& chunks_,
+                  matrix::CMatrix& matrix_,
+                  std::size_t valuesCount_,
+                  const textio::ProgressHandler& progress_ )
+         : chunks( chunks_ )
+         , matrix( matrix_ )
+         , valuesCount( valuesCount_ )
+         , progress( progress_ )
+         , nextChunk( 0 )
+         , isFailed( false )
+         , isParsed( chunks_.size(), false )
+         , parsedCount( 0 )
+         , guard()
+      {
+
+      }
+
+      const std::vector<Chunk>& chunks;         ///< Chunks of the file
+      matrix::CMatrix& matrix;                  ///< Destination matrix
+      const std::size_t valuesCount;            ///< Number of matrix elements
+      textio::ProgressHandler progress;         ///< Progress callback, may be empty
+      boost::atomic<std::size_t> nextChunk;     ///< First chunk not taken by any thread
+      boost::atomic<bool> isFailed;             ///< Whether any value is malformed
+      std::vector<bool> isParsed;               ///< Finished chunks
+      std::size_t parsedCount;                  ///< Number of leading finished chunks
+      boost::mutex guard;                       ///< Mutex for finished chunks
+   };
+
+   /**
+    * @brief Run worker on the calling thread and threadsCount - 1 additional threads
+    * @param threadsCount - number of threads
+    * @param worker - function which takes jobs until there are no more
+    */
+   void runWorkers( std::size_t threadsCount, const boost::function<void( void )>& worker )
+   {
+      boost::thread_group threads;
+      for ( std::size_t i = 1; i < threadsCount; ++i )
+      {
+         threads.create_thread( worker );
+      }
+      worker();
+      threads.join_all();
+   }
+
+   /**
+    * @brief Count values of chunks until all of them are taken
+    * @param chunks - chunks of the file
+    * @param nextChunk - first chunk not taken by any thread
+    */
+   void countWorker( std::vector<Chunk>* chunks, boost::atomic<std::size_t>* nextChunk )
+   {
+      for ( std::size_t i = ( *nextChunk )++; i < chunks->size(); i = ( *nextChunk )++ )
+      {
+         countValues( ( *chunks )[i] );
+      }
+   }
+
+   /**
+    * @brief Parse chunks until all of them are taken or any of them fails. \n
+    * Chunks are taken in file order, so values are reported in the order they are stored.
+    * @param state - parsing state
+    */
+   void parseWorker( ParseState* state )
+   {
+      for ( std::size_t i = state->nextChunk++; i < state->chunks.size() && !state->isFailed.load(); i = state->nextChunk++ )
+      {
+         const Chunk& chunk = state->chunks[i];
+         if ( chunk.first < state->valuesCount && !parseValues( chunk, state->matrix, state->valuesCount ) )
+         {
+            state->isFailed.store( true );
+            return;
+         }
+
+         boost::lock_guard<boost::mutex> lock( state->guard );
+         state->isParsed[i] = true;
+         const std::size_t parsedCount = state->parsedCount;
+         while ( state->parsedCount < state->chunks.size() && state->isParsed[state->parsedCount] )
+         {
+            ++state->parsedCount;
+         }
+         if ( state->progress && state->parsedCount != parsedCount )
+         {
+            const Chunk& last = state->chunks[state->parsedCount - 1];
+            state->progress( std::min( last.first + last.count, state->valuesCount ) );
+         }
+      }
+   }
+}
+
+namespace textio
+{
+   bool parseDouble( const char* begin, const char* end, double& value )
+   {
+      const char* pos = begin;
+      const bool isNegative = ( pos != end && *pos == '-' );
+      if ( pos != end && ( *pos == '-' || *pos == '+' ) )
+      {
+         ++pos;
+      }
+
+      // Up to 19 significant digits fit into the mantissa, the rest are only checked.
+      boost::uint64_t mantissa = 0;
+      int exponent = 0;
+      std::size_t digitsCount = 0;
+      bool isTruncated = false;
+      for ( ; pos != end && isDigit( *pos ); ++pos, ++digitsCount )
+      {
+         if ( mantissa < 1000000000000000000ULL )
+         {
+            mantissa = mantissa * 10 + ( *pos - '0' );
+         }
+         else
+         {
+            ++exponent;
+            isTruncated |= ( *pos != '0' );
+         }
+      }
+      if ( pos != end && *pos == '.' )
+      {
+         for ( ++pos; pos != end && isDigit( *pos ); ++pos, ++digitsCount )
+         {
+            if ( mantissa < 1000000000000000000ULL )
+            {
+               mantissa = mantissa * 10 + ( *pos - '0' );
+               --exponent;
+            }
+            else
+            {
+               isTruncated |= ( *pos != '0' );
+            }
+         }
+      }
+      if ( digitsCount == 0 )
+      {
+         return false;
+      }
+
+      if ( pos != end && ( *pos == 'e' || *pos == 'E' ) )
+      {
+         ++pos;
+         const bool isNegativeExponent = ( pos != end && *pos == '-' );
+         if ( pos != end && ( *pos == '-' || *pos == '+' ) )
+         {
+            ++pos;
+         }
+         if ( pos == end || !isDigit( *pos ) )
+         {
+            return false;
+         }
+         int explicitExponent = 0;
+         for ( ; pos != end && isDigit( *pos ); ++pos )
+         {
+            explicitExponent = std::min( explicitExponent * 10 + ( *pos - '0' ), MAX_EXPONENT );
+         }
+         exponent += isNegativeExponent ? -explicitExponent : explicitExponent;
+      }
+      if ( pos != end )
+      {
+         return false;
+      }
+
+      // Both mantissa and power of ten are exact, so the single operation rounds correctly.
+      if ( !isTruncated
+           && mantissa <= MAX_EXACT_MANTISSA
+           && exponent >= -MAX_EXACT_EXPONENT
+           && exponent <= MAX_EXACT_EXPONENT )
+      {
+         const double result = ( exponent < 0 ) ? static_cast<double>( mantissa ) / POWERS_OF_TEN[-exponent]
+                                                : static_cast<double>( mantissa ) * POWERS_OF_TEN[exponent];
+         value = isNegative ? -result : result;
+         return true;
+      }
+
+      // Other numbers are rare, they are rounded by the C library as std::istream does.
+      const std::string text( begin, end );
+      char* parsedEnd = 0;
+      const double result = std::strtod( text.c_str(), &parsedEnd );
+      if ( parsedEnd != text.c_str() + text.size() || std::fabs( result ) == HUGE_VAL )
+      {
+         return false;
+      }
+      value = result;
+      return true;
+   }
+
+   bool readFromTextFile( const std::string& fileName,
+                          matrix::CMatrix& matrix,
+                          std::size_t threadsCount,
+                          const ProgressHandler& progress )
+   {
+      boost::interprocess::file_mapping file;
+      boost::interprocess::mapped_region region;
+      try
+      {
+         boost::interprocess::file_mapping( fileName.c_str(), boost::interprocess::read_only ).swap( file );
+         boost::interprocess::mapped_region( file, boost::interprocess::read_only ).swap( region );
+      }
+      catch ( const boost::interprocess::interprocess_exception& )
+      {
+         return false;
+      }
+      region.advise( boost::interprocess::mapped_region::advice_sequential );
+
+      const char* pos = static_cast<const char*>( region.get_address() );
+      const char* end = pos + region.get_size();
+
+      std::size_t rows = 0;
+      std::size_t cols = 0;
+      if ( !parseSize( pos, end, rows ) || !parseSize( pos, end, cols ) )
+      {
+         return false;
+      }
+      if ( cols != 0 && rows > static_cast<std::size_t>( -1 ) / cols )
+      {
+         return false;
+      }
+      const std::size_t valuesCount = rows * cols;
+
+      // Chunks end at line breaks, so that every line is parsed by one thread.
+      std::vector<Chunk> chunks;
+      while ( pos != end )
+      {
+         Chunk chunk = Chunk();
+         chunk.begin = pos;
+         chunk.end = ( static_cast<std::size_t>( end - pos ) <= CHUNK_SIZE ) ? end : std::find( pos + CHUNK_SIZE, end, '\n' );
+         chunks.push_back( chunk );
+         pos = chunk.end;
+      }
+
+      if ( threadsCount == 0 )
+      {
+         threadsCount = std::max( boost::thread::hardware_concurrency(), 1u );
+      }
+      threadsCount = std::max<std::size_t>( std::min( threadsCount, chunks.size() ), 1 );
+
+      boost::atomic<std::size_t> nextChunk( 0 );
+      runWorkers( threadsCount, boost::bind( &countWorker, &chunks, &nextChunk ) );
+
+      std::size_t first = 0;
+      for ( std::vector<Chunk>::iterator it = chunks.begin(); it != chunks.end(); ++it )
+      {
+         it->first = first;
+         first += it->count;
+      }
+      if ( first < valuesCount )
+      {
+         return false;
+      }
+
+      matrix = matrix::CMatrix( rows, cols );
+      if ( progress )
+      {
+         progress( 0 );
+      }
+      if ( valuesCount == 0 )
+      {
+         return true;
+      }
+
+      ParseState state( chunks, matrix, valuesCount, progress );
+      runWorkers( threadsCount, boost::bind( &parseWorker, &state ) );
+      return !state.isFailed.load();
+   }
+}
+/** @}*/
@@ -0,0 +1,57 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    TextReader.hpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   Parallel reader of matrices in text format
+ ************************************************************************/
+#ifndef TEXTREADER_HPP
+#define TEXTREADER_HPP
+
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include <cstddef>
+#include <string>
+
+#include <boost/function.hpp>
+
+#include "CMatrix.hpp"
+
+namespace textio
+{
+   /**
+    * @brief Parsing progress callback. \n
+    * Called with 0 once matrix is sized, then with number of leading values \n
+    * in row-major order which are already stored into the matrix.
+    */
+   typedef boost::function<void( std::size_t valuesCount )> ProgressHandler;
+
+   /**
+    * @brief Read matrix in text format on several threads. \n
+    * File is split into chunks at line ends, values of every chunk are counted \n
+    * and then parsed in parallel straight into the matrix. Result is bit-identical \n
+    * to matrix::io::readFromTextFile, since numbers are rounded correctly by both.
+    * @param fileName - file with rows count, columns count and whitespace separated values
+    * @param[out] matrix - read matrix
+    * @param threadsCount - number of parsing threads, 0 - number of CPU cores
+    * @param progress - progress callback, called from parsing threads, may be empty
+    * @return True - if matrix was read, false - if file can not be read or has wrong format
+    */
+   bool readFromTextFile( const std::string& fileName,
+                          matrix::CMatrix& matrix,
+                          std::size_t threadsCount = 0,
+                          const ProgressHandler& progress = ProgressHandler() );
+
+   /**
+    * @brief Parse a number in the format of std::istream
+    * @param begin - first character of the number
+    * @param end - character after the number
+    * @param[out] value - parsed number
+    * @return True - if whole range is a valid number in double range
+    */
+   bool parseDouble( const char* begin, const char* end, double& value );
+}
+/** @}*/
+#endif // TEXTREADER_HPP
@@ -0,0 +1,448 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    WireFormat.cpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   Serialization of DoubleArray payloads
+ ************************************************************************/
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include "WireFormat.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/predef/other/endian.h>
+
+namespace wire
+{
+   const char* const JSON_CONTENT_TYPE = "application/json";
+   const char* const BINARY_CONTENT_TYPE = "application/octet-stream";
+   const char* const BATCH_CONTENT_TYPE = "application/x-double-array-batch";
+
+   /**
+    * @brief Binary payload magic
+    */
+   static const char BINARY_MAGIC[4] = { 'D', 'A', 'R', 'R' };
+
+   /**
+    * @brief Batched payload magic
+    */
+   static const char BATCH_MAGIC[4] = { 'D', 'B', 'A', 'T' };
+
+   /**
+    * @brief Size of batch item header in bytes
+    */
+   static const std::size_t BATCH_ITEM_HEADER_SIZE = 16;
+
+   /**
+    * @brief Binary payload format version
+    */
+   static const boost::uint32_t BINARY_VERSION = 1;
+
+   /**
+    * @brief Copy bytes reversing their order on big-endian hosts
+    * @param[out] dst - destination
+    * @param src - source
+    * @param size - size of single value in bytes
+    * @param count - number of values
+    */
+   static void copyLittleEndian( char* dst, const char* src, std::size_t size, std::size_t count )
+   {
+#if BOOST_ENDIAN_BIG_BYTE
+      for ( std::size_t i = 0; i < count; ++i )
+      {
+         for ( std::size_t j = 0; j < size; ++j )
+         {
+            dst[i * size + j] = src[i * size + size - 1 - j];
+         }
+      }
+#else
+      std::memcpy( dst, src, size * count );
+#endif
+   }
+
+   /**
+    * @brief Write 16 bytes header of binary or batched payload
+    * @param magic - payload magic
+    * @param count - number of values or items
+    * @param[out] out - header destination
+    */
+   static void writeHeader( const char* magic, boost::uint64_t count, char* out )
+   {
+      std::memcpy( out, magic, 4 );
+      copyLittleEndian( out + 4, reinterpret_cast<const char*>( &BINARY_VERSION ), sizeof( BINARY_VERSION ), 1 );
+      copyLittleEndian( out + 8, reinterpret_cast<const char*>( &count ), sizeof( count ), 1 );
+   }
+
+   bool isBinaryContentType( const std::string& contentType )
+   {
+      return boost::algorithm::istarts_with( contentType, BINARY_CONTENT_TYPE );
+   }
+
+   void encodeJson( const DoubleArray& array, std::string& out )
+   {
+      out.clear();
+      out.reserve( array.size() * 24 + 2 );
+      out.push_back( '[' );
+
+      char buffer[32];
+      for ( std::size_t i = 0; i < array.size(); ++i )
+      {
+         if ( i != 0 )
+         {
+            out.append( ", " );
+         }
+         const int length = std::snprintf( buffer, sizeof( buffer ), "%.17g", array[i] );
+         out.append( buffer, length );
+      }
+
+      out.push_back( ']' );
+   }
+
+   /**
+    * @brief Skip JSON whitespace
+    * @param begin - current position
+    * @param end - payload end
+    * @return First non-whitespace position
+    */
+   static const char* skipSpaces( const char* begin, const char* end )
+   {
+      while ( begin != end && ( *begin == ' ' || *begin == '\t' || *begin == '\r' || *begin == '\n' ) )
+      {
+         ++begin;
+      }
+      return begin;
+   }
+
+   /**
+    * @brief Check whether character may be a part of number token
+    * @param c - character
+    * @return True - if character belongs to number token
+    */
+   static bool isNumberChar( char c )
+   {
+      return std::isalnum( static_cast<unsigned char>( c ) ) || c == '+' || c == '-' || c == '.';
+   }
+
+   bool decodeJson( const char* begin, const char* end, DoubleArray& out )
+   {
+      out.clear();
+
+      const char* it = skipSpaces( begin, end );
+      if ( it == end || *it != '[' )
+      {
+         return false;
+      }
+      it = skipSpaces( it + 1, end );
+
+      if ( it != end && *it == ']' )
+      {
+         return skipSpaces( it + 1, end ) == end;
+      }
+
+      // Number tokens are short, so each one is copied into a terminated stack buffer
+      // because strtod must not run past the payload end.
+      char token[64];
+
+      while ( it != end )
+      {
+         const char* tokenEnd = it;
+         while ( tokenEnd != end && isNumberChar( *tokenEnd ) )
+         {
+            ++tokenEnd;
+         }
+
+         const std::size_t tokenSize = tokenEnd - it;
+         if ( tokenSize == 0 || tokenSize >= sizeof( token ) )
+         {
+            return false;
+         }
+
+         std::memcpy( token, it, tokenSize );
+         token[tokenSize] = '\0';
+
+         char* parsedEnd = 0;
+         const double value = std::strtod( token, &parsedEnd );
+         if ( parsedEnd != token + tokenSize )
+         {
+            return false;
+         }
+         out.push_back( value );
+
+         it = skipSpaces( tokenEnd, end );
+         if ( it == end )
+         {
+            return false;
+         }
+         if ( *it == ']' )
+         {
+            return skipSpaces( it + 1, end ) == end;
+         }
+         if ( *it != ',' )
+         {
+            return false;
+         }
+         it = skipSpaces( it + 1, end );
+      }
+
+      return false;
+   }
+
+   void encodeBinary( const DoubleArray& array, std::string& out )
+   {
+      const boost::uint64_t count = array.size();
+
+      out.resize( BINARY_HEADER_SIZE + array.size() * sizeof( double ) );
+      char* data = &out[0];
+
+      writeHeader( BINARY_MAGIC, count, data );
+
+      if ( !array.empty() )
+      {
+         copyLittleEndian( data + BINARY_HEADER_SIZE,
+                           reinterpret_cast<const char*>( &array[0] ),
+                           sizeof( double ),
+                           array.size() );
+      }
+   }
+
+   bool decodeBinary( const char* begin, const char* end, DoubleArray& out )
+   {
+      const std::size_t size = end - begin;
+      if ( size < BINARY_HEADER_SIZE || std::memcmp( begin, BINARY_MAGIC, sizeof( BINARY_MAGIC ) ) != 0 )
+      {
+         return false;
+      }
+
+      boost::uint32_t version = 0;
+      boost::uint64_t count = 0;
+      copyLittleEndian( reinterpret_cast<char*>( &version ), begin + 4, sizeof( version ), 1 );
+      copyLittleEndian( reinterpret_cast<char*>( &count ), begin + 8, sizeof( count ), 1 );
+
+      if ( version != BINARY_VERSION || ( size - BINARY_HEADER_SIZE ) / sizeof( double ) != count
+           || ( size - BINARY_HEADER_SIZE ) % sizeof( double ) != 0 )
+      {
+         return false;
+      }
+
+      out.resize( count );
+      if ( count != 0 )
+      {
+         copyLittleEndian( reinterpret_cast<char*>( &out[0] ),
+                           begin + BINARY_HEADER_SIZE,
+                           sizeof( double ),
+                           count );
+      }
+
+      return true;
+   }
+
+   void encodeBinaryHeader( std::size_t count, std::string& out )
+   {
+      const std::size_t offset = out.size();
+      out.resize( offset + BINARY_HEADER_SIZE );
+      writeHeader( BINARY_MAGIC, count, &out[offset] );
+   }
+
+   void appendBinaryValues( const double* values, std::size_t count, std::string& out )
+   {
+      if ( count == 0 )
+      {
+         return;
+      }
+
+      const std::size_t offset = out.size();
+      out.resize( offset + count * sizeof( double ) );
+      copyLittleEndian( &out[offset], reinterpret_cast<const char*>( values ), sizeof( double ), count );
+   }
+
+   CBinaryDecoder::CBinaryDecoder( void )
+      : mPartialSize( 0 )
+      , mHasHeader( false )
+      , mCount( 0 )
+      , mDecoded( 0 )
+   {
+
+   }
+
+   void CBinaryDecoder::reset( void )
+   {
+      mPartialSize = 0;
+      mHasHeader = false;
+      mCount = 0;
+      mDecoded = 0;
+   }
+
+   bool CBinaryDecoder::feed( const char* begin, const char* end, DoubleArray& out )
+   {
+      while ( begin != end )
+      {
+         if ( !mHasHeader || mPartialSize > 0 )
+         {
+            // Header or value split between pieces is collected byte by byte.
+            const std::size_t expected = mHasHeader ? sizeof( double ) : BINARY_HEADER_SIZE;
+            if ( mHasHeader && mDecoded == mCount )
+            {
+               return false;
+            }
+            const std::size_t taken = std::min<std::size_t>( expected - mPartialSize, end - begin );
+            std::memcpy( mPartial + mPartialSize, begin, taken );
+            mPartialSize += taken;
+            begin += taken;
+            if ( mPartialSize < expected )
+            {
+               break;
+            }
+            mPartialSize = 0;
+
+            if ( mHasHeader )
+            {
+               double value = 0.0;
+               copyLittleEndian( reinterpret_cast<char*>( &value ), mPartial, sizeof( double ), 1 );
+               out.push_back( value );
+               ++mDecoded;
+               continue;
+            }
+
+            boost::uint32_t version = 0;
+            copyLittleEndian( reinterpret_cast<char*>( &version ), mPartial + 4, sizeof( version ), 1 );
+            copyLittleEndian( reinterpret_cast<char*>( &mCount ), mPartial + 8, sizeof( mCount ), 1 );
+            if ( std::memcmp( mPartial, BINARY_MAGIC, sizeof( BINARY_MAGIC ) ) != 0 || version != BINARY_VERSION )
+            {
+               return false;
+            }
+            mHasHeader = true;
+            continue;
+         }
+
+         const std::size_t available = static_cast<std::size_t>( end - begin ) / sizeof( double );
+         const std::size_t count = static_cast<std::size_t>( std::min<boost::uint64_t>( available, mCount - mDecoded ) );
+         if ( count == 0 && mDecoded == mCount )
+         {
+            return false;
+         }
+
+         if ( count > 0 )
+         {
+            const std::size_t offset = out.size();
+            out.resize( offset + count );
+            copyLittleEndian( reinterpret_cast<char*>( &out[offset] ), begin, sizeof( double ), count );
+            begin += count * sizeof( double );
+            mDecoded += count;
+         }
+         else
+         {
+            // Tail of the piece is the beginning of the next value.
+            mPartialSize = end - begin;
+            std::memcpy( mPartial, begin, mPartialSize );
+            begin = end;
+         }
+      }
+
+      return true;
+   }
+
+   bool CBinaryDecoder::hasHeader( void ) const
+   {
+      return mHasHeader;
+   }
+
+   boost::uint64_t CBinaryDecoder::getCount( void ) const
+   {
+      return mCount;
+   }
+
+   bool CBinaryDecoder::isComplete( void ) const
+   {
+      return mHasHeader && mDecoded == mCount && mPartialSize == 0;
+   }
+
+   void encodeBatchHeader( std::size_t count, std::string& out )
+   {
+      out.resize( BINARY_HEADER_SIZE );
+      writeHeader( BATCH_MAGIC, count, &out[0] );
+   }
+
+   void appendBatchItem( boost::uint32_t code, const DoubleArray& values, std::string& out )
+   {
+      const std::size_t offset = out.size();
+      const boost::uint64_t count = values.size();
+      const boost::uint32_t reserved = 0;
+
+      out.resize( offset + BATCH_ITEM_HEADER_SIZE + values.size() * sizeof( double ) );
+      char* data = &out[offset];
+
+      copyLittleEndian( data, reinterpret_cast<const char*>( &code ), sizeof( code ), 1 );
+      copyLittleEndian( data + 4, reinterpret_cast<const char*>( &reserved ), sizeof( reserved ), 1 );
+      copyLittleEndian( data + 8, reinterpret_cast<const char*>( &count ), sizeof( count ), 1 );
+
+      if ( !values.empty() )
+      {
+         copyLittleEndian( data + BATCH_ITEM_HEADER_SIZE,
+                           reinterpret_cast<const char*>( &values[0] ),
+                           sizeof( double ),
+                           values.size() );
+      }
+   }
+
+   bool decodeBatch( const char* begin, const char* end, std::vector<BatchItem>& items )
+   {
+      if ( static_cast<std::size_t>( end - begin ) < BINARY_HEADER_SIZE
+           || std::memcmp( begin, BATCH_MAGIC, sizeof( BATCH_MAGIC ) ) != 0 )
+      {
+         return false;
+      }
+
+      boost::uint32_t version = 0;
+      boost::uint64_t count = 0;
+      copyLittleEndian( reinterpret_cast<char*>( &version ), begin + 4, sizeof( version ), 1 );
+      copyLittleEndian( reinterpret_cast<char*>( &count ), begin + 8, sizeof( count ), 1 );
+      if ( version != BINARY_VERSION )
+      {
+         return false;
+      }
+
+      items.clear();
+      const char* it = begin + BINARY_HEADER_SIZE;
+      for ( boost::uint64_t i = 0; i < count; ++i )
+      {
+         if ( static_cast<std::size_t>( end - it ) < BATCH_ITEM_HEADER_SIZE )
+         {
+            return false;
+         }
+
+         boost::uint32_t code = 0;
+         boost::uint64_t valuesCount = 0;
+         copyLittleEndian( reinterpret_cast<char*>( &code ), it, sizeof( code ), 1 );
+         copyLittleEndian( reinterpret_cast<char*>( &valuesCount ), it + 8, sizeof( valuesCount ), 1 );
+         it += BATCH_ITEM_HEADER_SIZE;
+
+         if ( static_cast<std::size_t>( end - it ) / sizeof( double ) < valuesCount )
+         {
+            return false;
+         }
+
+         items.push_back( BatchItem() );
+         items.back().code = code;
+         items.back().values.resize( valuesCount );
+         if ( valuesCount != 0 )
+         {
+            copyLittleEndian( reinterpret_cast<char*>( &items.back().values[0] ),
+                              it,
+                              sizeof( double ),
+                              valuesCount );
+         }
+         it += valuesCount * sizeof( double );
+      }
+
+      return it == end;
+   }
+}
+/** @}*/
@@ -0,0 +1,194 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    WireFormat.hpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   Serialization of DoubleArray payloads
+ ************************************************************************/
+#ifndef WIREFORMAT_HPP
+#define WIREFORMAT_HPP
+
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+#include "CComputationNode.hpp"
+
+namespace wire
+{
+   /**
+    * @brief Content type of JSON array payload
+    */
+   extern const char* const JSON_CONTENT_TYPE;
+
+   /**
+    * @brief Content type of binary payload. \n
+    * Binary payload is 16 bytes header followed by raw little-endian float64 values. \n
+    * Header consists of "DARR" magic, uint32 format version and uint64 number of values, \n
+    * all integers are little-endian.
+    */
+   extern const char* const BINARY_CONTENT_TYPE;
+
+   /**
+    * @brief Size of binary payload header in bytes
+    */
+   const std::size_t BINARY_HEADER_SIZE = 16;
+
+   /**
+    * @brief Content type of batched payload. \n
+    * Batched payload is 16 bytes header ("DBAT" magic, uint32 version, uint64 number of items) \n
+    * followed by items. Each item is uint32 code, uint32 reserved field, uint64 number of values \n
+    * and raw float64 values, all little-endian.
+    */
+   extern const char* const BATCH_CONTENT_TYPE;
+
+   /**
+    * @brief Single item of batched payload. \n
+    * In request code is CComputationNode::Operation, in response it is status, 0 means success.
+    */
+   struct BatchItem
+   {
+      boost::uint32_t code;   ///< Operation or status code
+      DoubleArray values;     ///< Item values
+   };
+
+   /**
+    * @brief Check whether content type denotes binary payload
+    * @param contentType - value of Content-Type header
+    * @return True - if payload is binary, false - otherwise
+    */
+   bool isBinaryContentType( const std::string& contentType );
+
+   /**
+    * @brief Serialize array as JSON. Values are printed with enough digits to be restored exactly.
+    * @param array - values to serialize
+    * @param[out] out - serialized payload
+    */
+   void encodeJson( const DoubleArray& array, std::string& out );
+
+   /**
+    * @brief Parse JSON array of numbers. \n
+    * Numbers are decoded straight into the output array, so reserving \n
+    * its capacity beforehand avoids any allocation.
+    * @param begin - serialized payload begin
+    * @param end - serialized payload end
+    * @param[out] out - parsed values
+    * @return True - if payload is valid JSON array of numbers, false - otherwise
+    */
+   bool decodeJson( const char* begin, const char* end, DoubleArray& out );
+
+   /**
+    * @brief Serialize array in binary format
+    * @param array - values to serialize
+    * @param[out] out - serialized payload
+    */
+   void encodeBinary( const DoubleArray& array, std::string& out );
+
+   /**
+    * @brief Parse binary payload
+    * @param begin - serialized payload begin
+    * @param end - serialized payload end
+    * @param[out] out - parsed values
+    * @return True - if payload is valid, false - otherwise
+    */
+   bool decodeBinary( const char* begin, const char* end, DoubleArray& out );
+
+   /**
+    * @brief Start binary payload which values are appended separately
+    * @param count - number of values which will be appended
+    * @param[out] out - payload, header is appended to it
+    */
+   void encodeBinaryHeader( std::size_t count, std::string& out );
+
+   /**
+    * @brief Append values to binary payload
+    * @param values - values to append
+    * @param count - number of values
+    * @param[out] out - payload
+    */
+   void appendBinaryValues( const double* values, std::size_t count, std::string& out );
+
+   /**
+    * @brief This class parses binary payload which arrives in pieces. \n
+    * Pieces may split header and values at any byte, complete values \n
+    * are appended to the output as soon as they arrive.
+    */
+   class CBinaryDecoder
+   {
+   public:
+      /**
+       * @brief Constructor
+       */
+      CBinaryDecoder( void );
+
+      /**
+       * @brief Forget parsed data and wait for the new payload
+       */
+      void reset( void );
+
+      /**
+       * @brief Parse next piece of payload
+       * @param begin - piece begin
+       * @param end - piece end
+       * @param[out] out - complete values of the piece are appended to it
+       * @return True - if payload is valid so far, false - otherwise
+       */
+      bool feed( const char* begin, const char* end, DoubleArray& out );
+
+      /**
+       * @brief Check whether header is parsed
+       * @return True - if number of values is known, false - otherwise
+       */
+      bool hasHeader( void ) const;
+
+      /**
+       * @brief Get number of values declared by the header
+       * @return Values count, 0 until header is parsed
+       */
+      boost::uint64_t getCount( void ) const;
+
+      /**
+       * @brief Check whether all declared values are parsed
+       * @return True - if payload is complete, false - otherwise
+       */
+      bool isComplete( void ) const;
+
+   private:
+      char mPartial[BINARY_HEADER_SIZE];  ///< Bytes of incomplete header or value
+      std::size_t mPartialSize;           ///< Number of buffered bytes
+      bool mHasHeader;                    ///< Whether header is parsed
+      boost::uint64_t mCount;             ///< Number of declared values
+      boost::uint64_t mDecoded;           ///< Number of parsed values
+   };
+
+   /**
+    * @brief Start batched payload
+    * @param count - number of items which will be appended
+    * @param[out] out - serialized payload
+    */
+   void encodeBatchHeader( std::size_t count, std::string& out );
+
+   /**
+    * @brief Append item to batched payload
+    * @param code - operation or status code
+    * @param values - item values
+    * @param[out] out - serialized payload
+    */
+   void appendBatchItem( boost::uint32_t code, const DoubleArray& values, std::string& out );
+
+   /**
+    * @brief Parse batched payload
+    * @param begin - serialized payload begin
+    * @param end - serialized payload end
+    * @param[out] items - parsed items
+    * @return True - if payload is valid, false - otherwise
+    */
+   bool decodeBatch( const char* begin, const char* end, std::vector<BatchItem>& items );
+}
+/** @}*/
+#endif // WIREFORMAT_HPP
@@ -0,0 +1,1091 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    bench.cpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   Benchmarks of the scheduler against embedded stub nodes
+ ************************************************************************/
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/config.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/program_options.hpp>
+#include <boost/thread/barrier.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <jsoncpp/include/json/json.h>
+
+#include "CAsyncArray.hpp"
+#include "CComputationNode.hpp"
+#include "CEventLoop.hpp"
+#include "CGemmEngine.hpp"
+#include "CNodeDispatcher.hpp"
+#include "CResultCache.hpp"
+#include "CStubNode.hpp"
+#include "CTaskScheduler.hpp"
+#include "CTiledMatrix.hpp"
+#include "WireFormat.hpp"
+
+#include "CMatrix.hpp"
+
+namespace po = boost::program_options;
+
+/**
+ * @brief Number of heap allocations made by counted threads
+ */
+static boost::atomic<std::size_t> sAllocationsCount( 0 );
+
+/**
+ * @brief Whether allocations of the current thread are counted. \n
+ * Threads of embedded stubs are not counted, so that only the client side is measured.
+ */
+static thread_local bool tIsCounted = false;
+
+BOOST_NOINLINE void* operator new( std::size_t size )
+{
+   if ( tIsCounted )
+   {
+      sAllocationsCount.fetch_add( 1, boost::memory_order_relaxed );
+   }
+   void* pointer = std::malloc( size ? size : 1 );
+   if ( !pointer )
+   {
+      throw std::bad_alloc();
+   }
+   return pointer;
+}
+
+// Not inlined, so that the compiler never pairs free() with operator new.
+BOOST_NOINLINE void operator delete( void* pointer ) noexcept
+{
+   std::free( pointer );
+}
+
+BOOST_NOINLINE void operator delete( void* pointer, std::size_t ) noexcept
+{
+   std::free( pointer );
+}
+
+/**
+ * @brief Stub nodes running in the benchmark process
+ */
+typedef std::vector< boost::shared_ptr<CStubNode> > StubNodes;
+
+/**
+ * @brief Get current time
+ * @return Current time
+ */
+static boost::posix_time::ptime now( void )
+{
+   return boost::posix_time::microsec_clock::universal_time();
+}
+
+/**
+ * @brief Get time elapsed since passed moment in seconds
+ * @param start - start time
+ * @return Elapsed seconds
+ */
+static double secondsSince( boost::posix_time::ptime start )
+{
+   return ( now() - start ).total_microseconds() * 1e-6;
+}
+
+/**
+ * @brief Create array of pseudo-random values
+ * @param size - number of values
+ * @param seed - generator seed
+ * @return Array
+ */
+static DoubleArray makeArray( std::size_t size, boost::uint32_t seed )
+{
+   boost::random::mt19937 generator( seed );
+   boost::random::uniform_real_distribution<double> distribution( -1000.0, 1000.0 );
+   DoubleArray array( size );
+   for ( std::size_t i = 0; i < size; ++i )
+   {
+      array[i] = distribution( generator );
+   }
+   return array;
+}
+
+/**
+ * @brief Start stub nodes on free ports
+ * @param service - io_service which drives stubs
+ * @param count - number of stubs
+ * @param latency - reply delay
+ * @param jitter - random addition to reply delay
+ * @param[out] stubs - started stubs
+ * @param[out] nodes - computation nodes connected to the stubs
+ */
+static void startStubs( boost::asio::io_service& service,
+                        std::size_t count,
+                        boost::posix_time::time_duration latency,
+                        boost::posix_time::time_duration jitter,
+                        StubNodes& stubs,
+                        std::vector<CComputationNode>& nodes )
+{
+   for ( std::size_t i = 0; i < count; ++i )
+   {
+      stubs.push_back( boost::shared_ptr<CStubNode>( new CStubNode( service, 0 ) ) );
+      stubs.back()->setLatency( latency, jitter );
+      nodes.push_back( CComputationNode( "127.0.0.1:" + boost::lexical_cast<std::string>( stubs.back()->getPort() ) ) );
+   }
+}
+
+/**
+ * @brief Get percentile of sorted samples
+ * @param samples - sorted samples
+ * @param percentile - percentile in range [0, 1]
+ * @return Sample value
+ */
+static double percentile( const std::vector<double>& samples, double percentile )
+{
+   if ( samples.empty() )
+   {
+      return 0.0;
+   }
+   const std::size_t index = static_cast<std::size_t>( percentile * ( samples.size() - 1 ) + 0.5 );
+   return samples[std::min( index, samples.size() - 1 )];
+}
+
+/**
+ * @brief Measure number of calls per second with many calls in flight
+ * @param node - computation node
+ * @param arraySize - number of values per call
+ * @param concurrency - number of calls in flight
+ * @param callsCount - total number of calls
+ * @return Benchmark result
+ */
+static Json::Value benchThroughput( const CComputationNode& node,
+                                    std::size_t arraySize,
+                                    std::size_t concurrency,
+                                    std::size_t callsCount )
+{
+   const DoubleArray array = makeArray( arraySize, 1 );
+
+   const boost::posix_time::ptime start = now();
+   std::size_t failures = 0;
+   for ( std::size_t sent = 0; sent < callsCount; )
+   {
+      std::vector<FutureDoubleArray> results;
+      for ( std::size_t i = 0; i < concurrency && sent < callsCount; ++i, ++sent )
+      {
+         results.push_back( node.asyncSum( array ) );
+      }
+      for ( std::size_t i = 0; i < results.size(); ++i )
+      {
+         try
+         {
+            results[i].get();
+         }
+         catch ( ... )
+         {
+            ++failures;
+         }
+      }
+   }
+   const double seconds = secondsSince( start );
+
+   Json::Value result;
+   result["arraySize"] = static_cast<Json::UInt64>( arraySize );
+   result["concurrency"] = static_cast<Json::UInt64>( concurrency );
+   result["calls"] = static_cast<Json::UInt64>( callsCount );
+   result["failures"] = static_cast<Json::UInt64>( failures );
+   result["seconds"] = seconds;
+   result["callsPerSecond"] = callsCount / seconds;
+   return result;
+}
+
+/**
+ * @brief Completion of the single call awaited by the benchmark
+ */
+struct CallWaiter
+{
+   CallWaiter( void )
+      : isFinished( false )
+      , isFailed( false )
+   {
+
+   }
+
+   bool isFinished;                    ///< Whether call is finished
+   bool isFailed;                      ///< Whether call has failed
+   boost::mutex guard;                 ///< Mutex for flags
+   boost::condition_variable finished; ///< Notified when call is finished
+};
+
+/**
+ * @brief Call completion callback which wakes waiting benchmark
+ * @param waiter - call completion
+ * @param error - call error or null on success
+ */
+static void onCallFinished( CallWaiter* waiter, const boost::exception_ptr& error, DoubleArray& )
+{
+   {
+      boost::lock_guard<boost::mutex> lock( waiter->guard );
+      waiter->isFinished = true;
+      waiter->isFailed = static_cast<bool>( error );
+   }
+   waiter->finished.notify_all();
+}
+
+/**
+ * @brief Count allocations of the current event loop thread
+ * @param barrier - keeps thread busy until every thread is marked
+ */
+static void markCountedThread( boost::barrier* barrier )
+{
+   tIsCounted = true;
+   barrier->wait();
+}
+
+/**
+ * @brief Count allocations of the calling thread and of the shared event loop threads
+ */
+static void startCountingAllocations( void )
+{
+   tIsCounted = true;
+   const std::size_t threadsCount = CEventLoop::instance().getThreadsCount();
+   boost::barrier barrier( static_cast<unsigned int>( threadsCount + 1 ) );
+   for ( std::size_t i = 0; i < threadsCount; ++i )
+   {
+      CEventLoop::instance().getService().post( boost::bind( &markCountedThread, &barrier ) );
+   }
+   barrier.wait();
+}
+
+/**
+ * @brief Measure client side heap allocations of sequential calls in steady state
+ * @param dispatcher - dispatcher of calls
+ * @param arraySize - number of values per call
+ * @param callsCount - number of measured calls
+ * @return Benchmark result
+ */
+static Json::Value benchAllocations( const CNodeDispatcher& dispatcher, std::size_t arraySize, std::size_t callsCount )
+{
+   const DoubleArray array = makeArray( arraySize, 2 );
+
+   std::size_t failures = 0;
+   std::size_t allocationsCount = 0;
+   // The first pass opens connections and fills buffers, the second one is measured.
+   for ( std::size_t pass = 0; pass < 2; ++pass )
+   {
+      const std::size_t countBefore = sAllocationsCount;
+      for ( std::size_t i = 0; i < callsCount; ++i )
+      {
+         CallWaiter waiter;
+         dispatcher.asyncCall( CComputationNode::OP_MULTIPLY_PAIRS, array, boost::bind( &onCallFinished, &waiter, _1, _2 ) );
+
+         boost::unique_lock<boost::mutex> lock( waiter.guard );
+         while ( !waiter.isFinished )
+         {
+            waiter.finished.wait( lock );
+         }
+         failures += waiter.isFailed ? 1 : 0;
+      }
+      allocationsCount = sAllocationsCount - countBefore;
+   }
+
+   Json::Value result;
+   result["arraySize"] = static_cast<Json::UInt64>( arraySize );
+   result["calls"] = static_cast<Json::UInt64>( callsCount );
+   result["failures"] = static_cast<Json::UInt64>( failures );
+   result["allocationsPerCall"] = static_cast<double>( allocationsCount ) / callsCount;
+   return result;
+}
+
+/**
+ * @brief Measure latency of sequential calls
+ * @param node - computation node
+ * @param arraySize - number of values per call
+ * @param callsCount - number of calls
+ * @return Benchmark result
+ */
+static Json::Value benchLatency( const CComputationNode& node, std::size_t arraySize, std::size_t callsCount )
+{
+   const DoubleArray array = makeArray( arraySize, 2 );
+
+   std::vector<double> samples;
+   samples.reserve( callsCount );
+   for ( std::size_t i = 0; i < callsCount; ++i )
+   {
+      const boost::posix_time::ptime start = now();
+      try
+      {
+         node.asyncMultiplyPairs( array ).get();
+      }
+      catch ( ... )
+      {
+         continue;
+      }
+      samples.push_back( secondsSince( start ) * 1e6 );
+   }
+   std::sort( samples.begin(), samples.end() );
+
+   double total = 0.0;
+   for ( std::size_t i = 0; i < samples.size(); ++i )
+   {
+      total += samples[i];
+   }
+
+   Json::Value result;
+   result["arraySize"] = static_cast<Json::UInt64>( arraySize );
+   result["calls"] = static_cast<Json::UInt64>( samples.size() );
+   result["meanUs"] = samples.empty() ? 0.0 : total / samples.size();
+   result["p50Us"] = percentile( samples, 0.5 );
+   result["p99Us"] = percentile( samples, 0.99 );
+   return result;
+}
+
+/**
+ * @brief Measure sequential calls with large arguments sent at once or streamed in chunks
+ * @param host - address of the stub node
+ * @param arraySize - number of values per call
+ * @param callsCount - number of calls
+ * @param chunkValues - number of values per chunk, 0 - calls are not streamed
+ * @return Benchmark result
+ */
+static Json::Value benchStreaming( const std::string& host,
+                                   std::size_t arraySize,
+                                   std::size_t callsCount,
+                                   std::size_t chunkValues )
+{
+   CComputationNode node( host );
+   node.setWireFormat( CComputationNode::WIRE_BINARY );
+   if ( chunkValues > 0 )
+   {
+      node.enableStreaming( chunkValues );
+   }
+
+   const DoubleArray array = makeArray( arraySize, 2 );
+   DoubleArray expected;
+   CStubNode::multiplyPairs( array, expected );
+
+   Json::Value result;
+   result["arraySize"] = static_cast<Json::UInt64>( arraySize );
+   result["chunkValues"] = static_cast<Json::UInt64>( chunkValues );
+
+   double maxError = 0.0;
+   const boost::posix_time::ptime start = now();
+   try
+   {
+      for ( std::size_t i = 0; i < callsCount; ++i )
+      {
+         const DoubleArray products = node.asyncMultiplyPairs( array ).get();
+         if ( products.size() != expected.size() )
+         {
+            throw std::runtime_error( "Wrong number of products" );
+         }
+         for ( std::size_t j = 0; j < products.size(); ++j )
+         {
+            maxError = std::max( maxError, std::fabs( products[j] - expected[j] ) );
+         }
+      }
+   }
+   catch ( const std::exception& e )
+   {
+      result["error"] = e.what();
+      return result;
+   }
+
+   result["meanSeconds"] = secondsSince( start ) / callsCount;
+   result["maxError"] = maxError;
+   return result;
+}
+
+/**
+ * @brief Measure payload encoding and decoding cost
+ * @param arraySize - number of values
+ * @param isBinary - whether to measure binary or JSON format
+ * @param minValues - minimal total number of values to process
+ * @return Benchmark result
+ */
+static Json::Value benchSerialization( std::size_t arraySize, bool isBinary, std::size_t minValues )
+{
+   const DoubleArray array = makeArray( arraySize, 3 );
+   const std::size_t repeats = std::max<std::size_t>( minValues / arraySize, 1 );
+
+   std::string payload;
+   boost::posix_time::ptime start = now();
+   for ( std::size_t i = 0; i < repeats; ++i )
+   {
+      payload.clear();
+      isBinary ? wire::encodeBinary( array, payload ) : wire::encodeJson( array, payload );
+   }
+   const double encodeSeconds = secondsSince( start );
+
+   DoubleArray decoded;
+   bool isValid = true;
+   start = now();
+   for ( std::size_t i = 0; i < repeats; ++i )
+   {
+      decoded.clear();
+      const char* begin = payload.data();
+      isValid = ( isBinary ? wire::decodeBinary( begin, begin + payload.size(), decoded )
+                           : wire::decodeJson( begin, begin + payload.size(), decoded ) ) && isValid;
+   }
+   const double decodeSeconds = secondsSince( start );
+
+   const double values = static_cast<double>( repeats * arraySize );
+   Json::Value result;
+   result["format"] = isBinary ? "binary" : "json";
+   result["arraySize"] = static_cast<Json::UInt64>( arraySize );
+   result["payloadBytes"] = static_cast<Json::UInt64>( payload.size() );
+   result["encodeNsPerValue"] = encodeSeconds * 1e9 / values;
+   result["decodeNsPerValue"] = decodeSeconds * 1e9 / values;
+   result["isRoundTripExact"] = isValid && decoded == array;
+   return result;
+}
+
+/**
+ * @brief Build payload of the tile of C by reading elements of A and B one by one
+ * @param A - matrix A
+ * @param B - matrix B
+ * @param rowBegin - first row of the tile
+ * @param rowEnd - row after the last one
+ * @param colBegin - first column of the tile
+ * @param colEnd - column after the last one
+ * @param[out] values - gathered values
+ * @param[out] payload - rows of A followed by columns of B
+ */
+static void gatherTile( const matrix::CMatrix& A,
+                        const matrix::CMatrix& B,
+                        std::size_t rowBegin,
+                        std::size_t rowEnd,
+                        std::size_t colBegin,
+                        std::size_t colEnd,
+                        DoubleArray& values,
+                        std::string& payload )
+{
+   const std::size_t depth = A.getColsCount();
+   values.clear();
+   for ( std::size_t i = rowBegin; i < rowEnd; ++i )
+   {
+      for ( std::size_t k = 0; k < depth; ++k )
+      {
+         values.push_back( A( i, k ) );
+      }
+   }
+   for ( std::size_t j = colBegin; j < colEnd; ++j )
+   {
+      for ( std::size_t k = 0; k < depth; ++k )
+      {
+         values.push_back( B( k, j ) );
+      }
+   }
+   payload.clear();
+   wire::encodeBinary( values, payload );
+}
+
+/**
+ * @brief Build payload of the tile of C from spans of packed matrices
+ * @param A - matrix A packed by panels of tile rows
+ * @param B - matrix B packed by column-major tiles of all rows
+ * @param panel - panel of A
+ * @param tile - tile of B
+ * @param[out] payload - rows of A followed by columns of B
+ */
+static void serializeTile( const CTiledMatrix& A,
+                           const CTiledMatrix& B,
+                           std::size_t panel,
+                           std::size_t tile,
+                           std::string& payload )
+{
+   const CTiledMatrix::Span rows = A.getTile( panel, 0 );
+   const CTiledMatrix::Span columns = B.getTile( 0, tile );
+   payload.clear();
+   wire::encodeBinaryHeader( rows.size() + columns.size(), payload );
+   wire::appendBinaryValues( rows.begin, rows.size(), payload );
+   wire::appendBinaryValues( columns.begin, columns.size(), payload );
+}
+
+/**
+ * @brief Measure building of binary payloads for all tiles of C = A * B, \n
+ * each holding rows of A and columns of B the tile needs. Gather variant reads \n
+ * elements of row-major matrices one by one for every tile, tiled variant packs \n
+ * both matrices once and serializes contiguous spans.
+ * @param size - rows and columns count of square matrices
+ * @param tileSize - rows and columns of the tile of C
+ * @return Benchmark result
+ */
+static Json::Value benchTiling( std::size_t size, std::size_t tileSize )
+{
+   matrix::CMatrix A( size, size );
+   matrix::CMatrix B( size, size );
+   const DoubleArray values = makeArray( 2 * size * size, 5 );
+   for ( std::size_t i = 0; i < size; ++i )
+   {
+      for ( std::size_t j = 0; j < size; ++j )
+      {
+         A( i, j ) = values[i * size + j];
+         B( i, j ) = values[size * size + i * size + j];
+      }
+   }
+
+   DoubleArray gathered;
+   std::string payload;
+   std::size_t gatherBytes = 0;
+   boost::posix_time::ptime start = now();
+   for ( std::size_t rowBegin = 0; rowBegin < size; rowBegin += tileSize )
+   {
+      for ( std::size_t colBegin = 0; colBegin < size; colBegin += tileSize )
+      {
+         gatherTile( A,
+                     B,
+                     rowBegin,
+                     std::min( rowBegin + tileSize, size ),
+                     colBegin,
+                     std::min( colBegin + tileSize, size ),
+                     gathered,
+                     payload );
+         gatherBytes += payload.size();
+      }
+   }
+   const double gatherSeconds = secondsSince( start );
+
+   std::size_t tiledBytes = 0;
+   start = now();
+   const CTiledMatrix packedA( A, tileSize, 0, CTiledMatrix::ROW_MAJOR );
+   const CTiledMatrix packedB( B, 0, tileSize, CTiledMatrix::COLUMN_MAJOR );
+   const double packSeconds = secondsSince( start );
+   for ( std::size_t panel = 0; panel < packedA.getPanelsCount(); ++panel )
+   {
+      for ( std::size_t tile = 0; tile < packedB.getTilesPerPanel(); ++tile )
+      {
+         serializeTile( packedA, packedB, panel, tile, payload );
+         tiledBytes += payload.size();
+      }
+   }
+   const double tiledSeconds = secondsSince( start );
+
+   // Payloads of the first and the last tile are compared outside of the timed loops.
+   std::string expected;
+   const std::size_t last = ( size - 1 ) / tileSize;
+   gatherTile( A, B, 0, std::min( tileSize, size ), 0, std::min( tileSize, size ), gathered, expected );
+   serializeTile( packedA, packedB, 0, 0, payload );
+   bool isEqual = ( payload == expected );
+   gatherTile( A, B, last * tileSize, size, last * tileSize, size, gathered, expected );
+   serializeTile( packedA, packedB, last, last, payload );
+   isEqual = isEqual && payload == expected && gatherBytes == tiledBytes;
+
+   Json::Value result;
+   result["size"] = static_cast<Json::UInt64>( size );
+   result["tileSize"] = static_cast<Json::UInt64>( tileSize );
+   result["payloadBytes"] = static_cast<Json::UInt64>( tiledBytes );
+   result["gatherSeconds"] = gatherSeconds;
+   result["tiledSeconds"] = tiledSeconds;
+   result["packSeconds"] = packSeconds;
+   result["speedup"] = tiledSeconds > 0.0 ? gatherSeconds / tiledSeconds : 0.0;
+   result["isEqual"] = isEqual;
+   return result;
+}
+
+/**
+ * @brief Measure end-to-end matrix multiplication
+ * @param nodes - computation nodes
+ * @param size - rows and columns count of square matrices
+ * @param isResident - whether columns of B are kept on nodes instead of sending pairs
+ * @param isAutoTuned - whether tile size and tiles in flight are tuned from node latency
+ * @return Benchmark result
+ */
+static Json::Value benchGemm( const std::vector<CComputationNode>& nodes,
+                              std::size_t size,
+                              bool isResident,
+                              bool isAutoTuned )
+{
+   matrix::CMatrix A( size, size );
+   matrix::CMatrix B( size, size );
+   const DoubleArray values = makeArray( 2 * size * size, 4 );
+   for ( std::size_t i = 0; i < size; ++i )
+   {
+      for ( std::size_t j = 0; j < size; ++j )
+      {
+         A( i, j ) = values[i * size + j];
+         B( i, j ) = values[size * size + i * size + j];
+      }
+   }
+
+   CNodeDispatcher dispatcher( nodes );
+   dispatcher.setAutoTuning( isAutoTuned );
+   CGemmEngine engine( dispatcher );
+   engine.setResidentBlocks( isResident );
+   matrix::CMatrix C;
+
+   Json::Value result;
+   result["size"] = static_cast<Json::UInt64>( size );
+   result["nodes"] = static_cast<Json::UInt64>( nodes.size() );
+   result["resident"] = isResident;
+   result["autoTuned"] = isAutoTuned;
+
+   const boost::posix_time::ptime start = now();
+   try
+   {
+      engine.multiply( A, B, C );
+   }
+   catch ( const std::exception& e )
+   {
+      result["error"] = e.what();
+      return result;
+   }
+   result["seconds"] = secondsSince( start );
+   result["blockUploads"] = static_cast<Json::UInt64>( dispatcher.getBlockUploadsCount() );
+   if ( isAutoTuned )
+   {
+      result["chunkValues"] = static_cast<Json::UInt64>( dispatcher.getChunkValues() );
+      for ( std::size_t i = 0; i < dispatcher.getNodesCount(); ++i )
+      {
+         result["depths"].append( static_cast<Json::UInt64>( dispatcher.getInFlightDepth( i ) ) );
+      }
+   }
+
+   double maxError = 0.0;
+   for ( std::size_t i = 0; i < size; ++i )
+   {
+      for ( std::size_t j = 0; j < size; ++j )
+      {
+         double expected = 0.0;
+         for ( std::size_t k = 0; k < size; ++k )
+         {
+            expected += A( i, k ) * B( k, j );
+         }
+         maxError = std::max( maxError, std::fabs( expected - C( i, j ) ) );
+      }
+   }
+   result["maxError"] = maxError;
+   return result;
+}
+
+/**
+ * @brief Measure dot products computed as /multiply followed by /sum. \n
+ * Blocking variant waits for every stage, composed variant chains stages \n
+ * with continuations and waits only for all results at once.
+ * @param nodes - computation nodes
+ * @param size - number of values in each vector
+ * @param count - number of dot products
+ * @param isComposed - whether to use continuations instead of waiting for futures
+ * @return Benchmark result
+ */
+static Json::Value benchComposition( const std::vector<CComputationNode>& nodes,
+                                     std::size_t size,
+                                     std::size_t count,
+                                     bool isComposed )
+{
+   std::vector<DoubleArray> pairs;
+   DoubleArray expected;
+   for ( std::size_t i = 0; i < count; ++i )
+   {
+      pairs.push_back( makeArray( 2 * size, static_cast<boost::uint32_t>( 5 + i ) ) );
+      double dot = 0.0;
+      for ( std::size_t k = 0; k < size; ++k )
+      {
+         dot += pairs.back()[2 * k] * pairs.back()[2 * k + 1];
+      }
+      expected.push_back( dot );
+   }
+
+   CNodeDispatcher dispatcher( nodes );
+
+   Json::Value result;
+   result["variant"] = isComposed ? "composed" : "blocking";
+   result["size"] = static_cast<Json::UInt64>( size );
+   result["count"] = static_cast<Json::UInt64>( count );
+   result["nodes"] = static_cast<Json::UInt64>( nodes.size() );
+
+   DoubleArray dots;
+   const boost::posix_time::ptime start = now();
+   try
+   {
+      if ( isComposed )
+      {
+         std::vector<CAsyncArray> results;
+         for ( std::size_t i = 0; i < count; ++i )
+         {
+            results.push_back( dispatcher.multiplyPairs( pairs[i] )
+                               .then( boost::bind( &CNodeDispatcher::sum, &dispatcher, _1 ) ) );
+         }
+         dots = CAsyncArray::whenAll( results ).get();
+      }
+      else
+      {
+         for ( std::size_t i = 0; i < count; ++i )
+         {
+            dots.push_back( dispatcher.asyncSum( dispatcher.asyncMultiplyPairs( pairs[i] ).get() ).get().at( 0 ) );
+         }
+      }
+   }
+   catch ( const std::exception& e )
+   {
+      result["error"] = e.what();
+      return result;
+   }
+   result["seconds"] = secondsSince( start );
+
+   double maxError = ( dots.size() == expected.size() ) ? 0.0 : HUGE_VAL;
+   for ( std::size_t i = 0; i < dots.size() && i < expected.size(); ++i )
+   {
+      maxError = std::max( maxError, std::fabs( expected[i] - dots[i] ) );
+   }
+   result["maxError"] = maxError;
+   return result;
+}
+
+/**
+ * @brief Measure the same matrix multiplication repeated with result cache
+ * @param nodes - computation nodes
+ * @param size - rows and columns count of square matrices
+ * @return Benchmark result
+ */
+static Json::Value benchCache( const std::vector<CComputationNode>& nodes, std::size_t size )
+{
+   matrix::CMatrix A( size, size );
+   matrix::CMatrix B( size, size );
+   const DoubleArray values = makeArray( 2 * size * size, 4 );
+   for ( std::size_t i = 0; i < size; ++i )
+   {
+      for ( std::size_t j = 0; j < size; ++j )
+      {
+         A( i, j ) = values[i * size + j];
+         B( i, j ) = values[size * size + i * size + j];
+      }
+   }
+
+   CNodeDispatcher dispatcher( nodes );
+   const boost::shared_ptr<CResultCache> cache( new CResultCache( 64 << 20 ) );
+   dispatcher.setCache( cache );
+   CGemmEngine engine( dispatcher );
+
+   Json::Value result;
+   result["size"] = static_cast<Json::UInt64>( size );
+   result["nodes"] = static_cast<Json::UInt64>( nodes.size() );
+
+   matrix::CMatrix first;
+   matrix::CMatrix second;
+   try
+   {
+      boost::posix_time::ptime start = now();
+      engine.multiply( A, B, first );
+      result["coldSeconds"] = secondsSince( start );
+
+      start = now();
+      engine.multiply( A, B, second );
+      result["warmSeconds"] = secondsSince( start );
+   }
+   catch ( const std::exception& e )
+   {
+      result["error"] = e.what();
+      return result;
+   }
+
+   double maxError = 0.0;
+   for ( std::size_t i = 0; i < size; ++i )
+   {
+      for ( std::size_t j = 0; j < size; ++j )
+      {
+         maxError = std::max( maxError, std::fabs( first( i, j ) - second( i, j ) ) );
+      }
+   }
+   result["maxError"] = maxError;
+   result["hits"] = static_cast<Json::UInt64>( cache->getHitsCount() );
+   result["misses"] = static_cast<Json::UInt64>( cache->getMissesCount() );
+   return result;
+}
+
+/**
+ * @brief Task body which passes result of its only dependency further
+ * @param inputs - results of dependencies
+ * @return Result of the first dependency
+ */
+static DoubleArray forwardInput( const CTaskScheduler::Inputs& inputs )
+{
+   return *inputs.at( 0 );
+}
+
+/**
+ * @brief Task body which adds up the first values of its dependencies
+ * @param inputs - results of dependencies
+ * @return Single value
+ */
+static DoubleArray addInputs( const CTaskScheduler::Inputs& inputs )
+{
+   double total = 0.0;
+   for ( CTaskScheduler::Inputs::const_iterator it = inputs.begin(); it != inputs.end(); ++it )
+   {
+      total += ( *it )->at( 0 );
+   }
+   return DoubleArray( 1, total );
+}
+
+/**
+ * @brief Measure task graph of dot products reduced by a local task
+ * @param nodes - computation nodes
+ * @param size - number of values in each vector
+ * @param count - number of dot products
+ * @param workersCount - number of scheduler worker threads
+ * @return Benchmark result
+ */
+static Json::Value benchTaskGraph( const std::vector<CComputationNode>& nodes,
+                                   std::size_t size,
+                                   std::size_t count,
+                                   std::size_t workersCount )
+{
+   std::vector<DoubleArray> pairs;
+   double expected = 0.0;
+   for ( std::size_t i = 0; i < count; ++i )
+   {
+      pairs.push_back( makeArray( 2 * size, static_cast<boost::uint32_t>( 5 + i ) ) );
+      for ( std::size_t k = 0; k < size; ++k )
+      {
+         expected += pairs.back()[2 * k] * pairs.back()[2 * k + 1];
+      }
+   }
+
+   CNodeDispatcher dispatcher( nodes );
+   CTaskScheduler scheduler( dispatcher, workersCount );
+
+   Json::Value result;
+   result["size"] = static_cast<Json::UInt64>( size );
+   result["count"] = static_cast<Json::UInt64>( count );
+   result["nodes"] = static_cast<Json::UInt64>( nodes.size() );
+   result["workers"] = static_cast<Json::UInt64>( scheduler.getThreadsCount() );
+
+   double total = 0.0;
+   const boost::posix_time::ptime start = now();
+   try
+   {
+      CTaskScheduler::TaskIds sums;
+      for ( std::size_t i = 0; i < count; ++i )
+      {
+         const CTaskScheduler::TaskId products = scheduler.addRemote( CComputationNode::OP_MULTIPLY_PAIRS, pairs[i] );
+         sums.push_back( scheduler.addRemote( CComputationNode::OP_SUM,
+                                              &forwardInput,
+                                              CTaskScheduler::TaskIds( 1, products ) ) );
+      }
+      const CTaskScheduler::TaskId reduction = scheduler.addLocal( &addInputs, sums );
+      scheduler.wait();
+      total = scheduler.getResult( reduction ).at( 0 );
+   }
+   catch ( const std::exception& e )
+   {
+      result["error"] = e.what();
+      return result;
+   }
+   result["seconds"] = secondsSince( start );
+   result["maxError"] = std::fabs( expected - total );
+   return result;
+}
+
+/**
+ * @brief Measure how long a small job waits behind a large one which shares the nodes
+ * @param nodes - computation nodes
+ * @param jobSlots - limit of job calls in flight, 0 - not limited
+ * @param largeCalls - number of calls issued by the large job at once
+ * @param smallCalls - number of calls issued by the small job right after it
+ * @return Benchmark result
+ */
+static Json::Value benchJobSharing( const std::vector<CComputationNode>& nodes,
+                                    std::size_t jobSlots,
+                                    std::size_t largeCalls,
+                                    std::size_t smallCalls )
+{
+   CNodeDispatcher dispatcher( nodes );
+   dispatcher.setJobSlots( jobSlots );
+   dispatcher.warmUp().wait();
+   const CNodeDispatcher largeJob = dispatcher.createJobDispatcher();
+   const CNodeDispatcher smallJob = dispatcher.createJobDispatcher();
+   const DoubleArray array = makeArray( 256, 11 );
+
+   const boost::posix_time::ptime start = now();
+   std::vector<FutureDoubleArray> largeResults;
+   for ( std::size_t i = 0; i < largeCalls; ++i )
+   {
+      largeResults.push_back( largeJob.asyncMultiplyPairs( array ) );
+   }
+
+   const boost::posix_time::ptime smallStart = now();
+   std::vector<FutureDoubleArray> smallResults;
+   for ( std::size_t i = 0; i < smallCalls; ++i )
+   {
+      smallResults.push_back( smallJob.asyncMultiplyPairs( array ) );
+   }
+
+   std::size_t failures = 0;
+   for ( std::size_t i = 0; i < smallResults.size(); ++i )
+   {
+      failures += smallResults[i].get().size() == array.size() / 2 ? 0 : 1;
+   }
+   const double smallSeconds = secondsSince( smallStart );
+   for ( std::size_t i = 0; i < largeResults.size(); ++i )
+   {
+      failures += largeResults[i].get().size() == array.size() / 2 ? 0 : 1;
+   }
+   const double largeSeconds = secondsSince( start );
+
+   Json::Value result;
+   result["nodes"] = static_cast<Json::UInt64>( nodes.size() );
+   result["jobSlots"] = static_cast<Json::UInt64>( jobSlots );
+   result["largeCalls"] = static_cast<Json::UInt64>( largeCalls );
+   result["smallCalls"] = static_cast<Json::UInt64>( smallCalls );
+   result["failures"] = static_cast<Json::UInt64>( failures );
+   result["smallJobSeconds"] = smallSeconds;
+   result["largeJobSeconds"] = largeSeconds;
+   return result;
+}
+
+/**
+ * @brief The main function
+ * @param argc
+ * @param argv
+ * @return Application exit code
+ */
+int main( int argc, char* argv[] )
+{
+   po::options_description optDescr( "Allowed options" );
+   optDescr.add_options()
+       ( "help,h", "show this help message" )
+       ( "latency-us", po::value<long>()->default_value( 200 ), "stub reply delay in microseconds" )
+       ( "jitter-us", po::value<long>()->default_value( 50 ), "maximal random addition to stub reply delay" )
+       ( "stub-threads", po::value<std::size_t>()->default_value( CEventLoop::DEFAULT_THREADS_COUNT ),
+         "number of threads serving embedded stub nodes" )
+       ( "quick", "run fewer iterations" )
+       ( "output,o", po::value<std::string>(), "write JSON results to this file instead of standard output" );
+
+   po::variables_map options;
+   try
+   {
+       po::store( po::parse_command_line( argc, argv, optDescr ), options );
+       po::notify( options );
+   }
+   catch ( ... )
+   {
+       std::cout << "Unrecognized options" << std::endl;
+       std::cout << optDescr << std::endl;
+       return -1;
+   }
+
+   if ( options.count( "help" ) )
+   {
+       std::cout << optDescr << std::endl;
+       return 0;
+   }
+
+   const bool isQuick = options.count( "quick" ) != 0;
+   const std::size_t scale = isQuick ? 1 : 10;
+   const boost::posix_time::time_duration latency = boost::posix_time::microseconds( options["latency-us"].as<long>() );
+   const boost::posix_time::time_duration jitter = boost::posix_time::microseconds( options["jitter-us"].as<long>() );
+
+   CEventLoop stubLoop( options["stub-threads"].as<std::size_t>() );
+
+   Json::Value report;
+   report["config"]["latencyUs"] = static_cast<Json::Int64>( latency.total_microseconds() );
+   report["config"]["jitterUs"] = static_cast<Json::Int64>( jitter.total_microseconds() );
+   report["config"]["ioThreads"] = static_cast<Json::UInt64>( CEventLoop::instance().getThreadsCount() );
+   report["config"]["stubThreads"] = static_cast<Json::UInt64>( stubLoop.getThreadsCount() );
+   report["config"]["quick"] = isQuick;
+
+   {
+      StubNodes stubs;
+      std::vector<CComputationNode> nodes;
+      startStubs( stubLoop.getService(), 1, latency, jitter, stubs, nodes );
+
+      const std::size_t concurrencies[] = { 1, 8, 64 };
+      for ( std::size_t i = 0; i < sizeof( concurrencies ) / sizeof( concurrencies[0] ); ++i )
+      {
+         report["throughput"].append( benchThroughput( nodes[0], 16, concurrencies[i], 200 * scale ) );
+      }
+
+      startCountingAllocations();
+      CNodeDispatcher dispatcher( nodes );
+      report["allocations"].append( benchAllocations( dispatcher, 16, 100 * scale ) );
+      report["allocations"].append( benchAllocations( dispatcher, 4096, 100 * scale ) );
+
+      const std::size_t latencySizes[] = { 16, 4096, 262144 };
+      for ( std::size_t i = 0; i < sizeof( latencySizes ) / sizeof( latencySizes[0] ); ++i )
+      {
+         report["latency"].append( benchLatency( nodes[0], latencySizes[i], ( latencySizes[i] > 4096 ? 10 : 100 ) * scale ) );
+      }
+
+      const std::string host = "127.0.0.1:" + boost::lexical_cast<std::string>( stubs[0]->getPort() );
+      const std::size_t streamSize = isQuick ? 1 << 20 : 1 << 23;
+      report["streaming"].append( benchStreaming( host, streamSize, 3, 0 ) );
+      report["streaming"].append( benchStreaming( host, streamSize, 3, CComputationNode::DEFAULT_STREAM_CHUNK_VALUES ) );
+   }
+
+   const std::size_t serializationSizes[] = { 16, 1024, 65536, 1048576 };
+   for ( std::size_t i = 0; i < sizeof( serializationSizes ) / sizeof( serializationSizes[0] ); ++i )
+   {
+      report["serialization"].append( benchSerialization( serializationSizes[i], false, 100000 * scale ) );
+      report["serialization"].append( benchSerialization( serializationSizes[i], true, 100000 * scale ) );
+   }
+
+   const std::size_t tilingSize = isQuick ? 512 : 1024;
+   report["tiling"].append( benchTiling( tilingSize, 64 ) );
+   report["tiling"].append( benchTiling( tilingSize, 256 ) );
+
+   {
+      StubNodes stubs;
+      std::vector<CComputationNode> nodes;
+      startStubs( stubLoop.getService(), 2, latency, jitter, stubs, nodes );
+
+      report["composition"].append( benchComposition( nodes, 256, 50 * scale, false ) );
+      report["composition"].append( benchComposition( nodes, 256, 50 * scale, true ) );
+      report["taskGraph"].append( benchTaskGraph( nodes, 256, 50 * scale, 1 ) );
+      report["taskGraph"].append( benchTaskGraph( nodes, 256, 50 * scale, 4 ) );
+      report["cache"].append( benchCache( nodes, 64 ) );
+
+      std::size_t jobSlots = 0;
+      for ( std::size_t i = 0; i < nodes.size(); ++i )
+      {
+         jobSlots += 2 * nodes[i].getMaxConnections();
+      }
+      report["jobSharing"].append( benchJobSharing( nodes, 0, 200 * scale, 10 ) );
+      report["jobSharing"].append( benchJobSharing( nodes, jobSlots, 200 * scale, 10 ) );
+   }
+
+   const std::size_t matrixSizes[] = { 16, 64, 128 };
+   const std::size_t nodeCounts[] = { 1, 2, 4 };
+   for ( std::size_t n = 0; n < sizeof( nodeCounts ) / sizeof( nodeCounts[0] ); ++n )
+   {
+      StubNodes stubs;
+      std::vector<CComputationNode> nodes;
+      startStubs( stubLoop.getService(), nodeCounts[n], latency, jitter, stubs, nodes );
+
+      for ( std::size_t m = 0; m < sizeof( matrixSizes ) / sizeof( matrixSizes[0] ); ++m )
+      {
+         if ( isQuick && matrixSizes[m] > 64 )
+         {
+            continue;
+         }
+         report["gemm"].append( benchGemm( nodes, matrixSizes[m], false, false ) );
+         report["gemm"].append( benchGemm( nodes, matrixSizes[m], false, true ) );
+         report["gemm"].append( benchGemm( nodes, matrixSizes[m], true, false ) );
+      }
+   }
+
+   Json::StyledWriter writer;
+   const std::string json = writer.write( report );
+   if ( options.count( "output" ) )
+   {
+      std::ofstream file( options["output"].as<std::string>().c_str() );
+      file << json;
+   }
+   else
+   {
+      std::cout << json;
+   }
+
+   return 0;
+}
+/** @}*/
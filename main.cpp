@@ -12,14 +12,31 @@
 #include <iostream>
 #include <string>
 #include <exception>
+#include <stdexcept>
 #include <vector>
 #include <fstream>
+#include <sstream>
 
+#include <sys/stat.h>
+
+#include <boost/asio/signal_set.hpp>
 #include <boost/program_options.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <jsoncpp/include/json/json.h>
 
+#include "CCheckpoint.hpp"
 #include "CComputationNode.hpp"
+#include "CEventLoop.hpp"
+#include "CGemmEngine.hpp"
+#include "CJobServer.hpp"
+#include "CMappedMatrix.hpp"
+#include "CMatrixLoader.hpp"
+#include "CMetrics.hpp"
+#include "CNodeDispatcher.hpp"
+#include "CResultCache.hpp"
 #include "CSandBox.hpp"
+#include "CTaskScheduler.hpp"
+#include "TextReader.hpp"
 
 #include "CMatrix.hpp"
 #include "MatrixIO.hpp"
@@ -55,7 +72,77 @@ void prepareOptionsDescription( void )
         ( "matrixA,A", po::value<std::string>(), "file with matrix A data (by default assumes text format)" )
         ( "matrixB,B", po::value<std::string>(), "file with matrix B data (by default assumes text format)" )
         ( "output,o", po::value<std::string>(), "place result matrix to this output file (by default - binary format)" )
-        ( "hosts", po::value<std::string>(), "path to the json file with computation nodes host names or IPs" )
+        ( "hosts", po::value<std::string>(), "path to the json file with computation nodes host names or IPs, \"local\" - in-process node" )
+        ( "connections", po::value<std::size_t>()->default_value( CComputationNode::DEFAULT_CONNECTIONS_COUNT ),
+          "maximum number of persistent connections per computation node" )
+        ( "wire", po::value<std::string>()->default_value( "auto" ),
+          "payload format for computation nodes: auto (binary with JSON fallback), json or binary" )
+        ( "io-threads", po::value<std::size_t>()->default_value( CEventLoop::DEFAULT_THREADS_COUNT ),
+          "number of threads serving network requests of all computation nodes" )
+        ( "batch-delay-us", po::value<std::size_t>()->default_value( 0 ),
+          "coalesce small node calls issued within this many microseconds into one request, 0 - disabled" )
+        ( "batch-values", po::value<std::size_t>()->default_value( CComputationNode::DEFAULT_BATCH_VALUES ),
+          "send batch at once when it holds that many values, larger calls are not batched" )
+        ( "stream-chunk-values", po::value<std::size_t>()->default_value( 0 ),
+          "send binary node calls with more values in chunks of that many values "
+          "and receive their results while they are computed, 0 - disabled" )
+        ( "local-threshold", po::value<std::size_t>()->default_value( 0 ),
+          "send calls with fewer values to the \"local\" node of the hosts list, 0 - balance them by load" )
+        ( "auto-tune", "estimate call overhead and cost per value of every node while running, "
+          "choose chunk size and calls in flight per node from them and publish the decisions to --metrics, "
+          "gemm mode sizes its tiles by the chosen chunk" )
+        ( "retries", po::value<std::size_t>()->default_value( 0 ),
+          "retry failed node call on another node up to this many times" )
+        ( "retry-backoff-ms", po::value<std::size_t>()->default_value( 10 ),
+          "delay before the first retry, doubled for every next one" )
+        ( "deadline-ms", po::value<std::size_t>()->default_value( 0 ),
+          "consider node call failed if it is not answered in time and close its connection, 0 - wait forever" )
+        ( "job-timeout-ms", po::value<std::size_t>()->default_value( 0 ),
+          "fail the job if it is not finished in time, its node calls in flight are aborted, 0 - not limited" )
+        ( "hedge-percentile", po::value<double>()->default_value( 0.0 ),
+          "duplicate node call to another node once it is slower than this latency percentile, e.g. 0.95, 0 - disabled" )
+        ( "eject-failures", po::value<std::size_t>()->default_value( CNodeDispatcher::DEFAULT_EJECTION_FAILURES ),
+          "stop sending calls to the node after this many failures in a row, 0 - never" )
+        ( "eject-ms", po::value<std::size_t>()->default_value( CNodeDispatcher::DEFAULT_EJECTION_MS ),
+          "time for which failing node gets no calls" )
+        ( "cache-mb", po::value<std::size_t>()->default_value( 0 ),
+          "answer repeated node calls from results kept in this many megabytes of memory, 0 - disabled" )
+        ( "cache-dir", po::value<std::string>(),
+          "also keep results of node calls in this existing directory between runs, requires --cache-mb" )
+        ( "cache-dir-mb", po::value<std::size_t>()->default_value( CResultCache::DEFAULT_DIRECTORY_CAPACITY >> 20 ),
+          "limit of the cache directory in megabytes, least recently used files are removed" )
+        ( "mode", po::value<std::string>()->default_value( "sandbox" ),
+          "what to run: sandbox (CSandBox::sandBoxMain) or gemm (built-in C = A * B)" )
+        ( "workers", po::value<std::size_t>()->default_value( 0 ),
+          "sandbox mode: number of threads running submitted tasks, 0 - number of CPU cores" )
+        ( "calls-per-node", po::value<std::size_t>()->default_value( CTaskScheduler::DEFAULT_CALLS_PER_NODE ),
+          "sandbox mode: limit of node calls in flight per node submitted as tasks, 0 - not limited" )
+        ( "tile-values", po::value<std::size_t>()->default_value( CGemmEngine::DEFAULT_TILE_VALUES ),
+          "gemm mode: maximum number of values sent for a single tile of matrix C" )
+        ( "resident-b", "gemm mode: upload columns of matrix B to nodes once and send only rows of matrix A, "
+          "nodes return cells of matrix C instead of products" )
+        ( "metrics", po::value<std::string>(), "write per-node metrics to this file when computation is finished, "
+          "serve mode writes them when the server stops" )
+        ( "metrics-format", po::value<std::string>()->default_value( "json" ), "metrics format: json or prometheus" )
+        ( "metrics-interval-ms", po::value<std::size_t>()->default_value( 0 ),
+          "also rewrite metrics file with this period, 0 - only at the end" )
+        ( "checkpoint-ms", po::value<std::size_t>()->default_value( 0 ),
+          "gemm mode: save finished tiles of matrix C next to the output file with this period, 0 - disabled" )
+        ( "resume", "gemm mode: continue the previous run of the same job from its checkpoint, "
+          "enables checkpointing if --checkpoint-ms is not given" )
+        ( "mmap", "gemm mode: map binary input files into memory and write result directly into mapped output file" )
+        ( "parse-threads", po::value<std::size_t>()->default_value( 0 ),
+          "number of threads parsing text input files, 0 - number of CPU cores" )
+        ( "pipeline", "connect to computation nodes and read both input files at the same time, "
+          "gemm mode starts on the first rows of matrix A while the rest is read" )
+        ( "serve", po::value<std::string>(),
+          "keep running and accept jobs on this Unix domain socket instead of a single job, "
+          "matrix files, mode and formats are given by each job" )
+        ( "jobs", po::value<std::size_t>()->default_value( CJobServer::DEFAULT_JOBS_COUNT ),
+          "serve mode: number of jobs run at the same time" )
+        ( "job-slots", po::value<std::size_t>()->default_value( 0 ),
+          "serve mode: limit of node calls in flight of all jobs, given to jobs with waiting calls in turn, "
+          "0 - twice the connections of all nodes" )
         ( "otxt", "produce output in plain text format" )
         ( "rbin", "consume input in binary format ( by default assume text format)" );
 }
@@ -113,7 +200,9 @@ bool parseCommandLineArguments( std::string& matrixAFile,
        isConsumeBinary = true;
    }
 
-   return ( ( inputParametersMask & requiredParamsMask ) == requiredParamsMask );
+   // Server takes matrix files from the jobs.
+   const uint32_t mask = options.count( "serve" ) ? static_cast<uint32_t>( Parameters::HOSTS ) : requiredParamsMask;
+   return ( ( inputParametersMask & mask ) == mask );
 }
 
 /**
@@ -127,13 +216,324 @@ void printHelp( void )
 /**
  * @brief Helper function to fill computation nodes vector
  * @param[out] nodes - computation nodes vector to fill
+ * @param maxConnections - maximum number of persistent connections per node
+ * @param wireFormat - payload format
  * @param jsonValue - json value with computation node host name
  * @sa main()
  */
 void populateComputationNodesHelper( std::vector<CComputationNode>& nodes,
+                                     std::size_t maxConnections,
+                                     CComputationNode::WireFormat wireFormat,
                                      Json::Value& jsonValue )
 {
-   nodes.push_back( CComputationNode( jsonValue.asString() ) );
+   nodes.push_back( CComputationNode( jsonValue.asString(), maxConnections ) );
+   nodes.back().setWireFormat( wireFormat );
+}
+
+/**
+ * @brief Convert payload format name to enum value
+ * @param name - format name
+ * @param[out] wireFormat - format value
+ * @return True - if name is known, false - otherwise
+ */
+bool parseWireFormat( const std::string& name, CComputationNode::WireFormat& wireFormat )
+{
+   if ( name == "auto" )
+   {
+      wireFormat = CComputationNode::WIRE_AUTO;
+   }
+   else if ( name == "json" )
+   {
+      wireFormat = CComputationNode::WIRE_JSON;
+   }
+   else if ( name == "binary" )
+   {
+      wireFormat = CComputationNode::WIRE_BINARY;
+   }
+   else
+   {
+      return false;
+   }
+   return true;
+}
+
+/**
+ * @brief Check that options of the job are consistent
+ * @param job - job to check
+ * @param[out] error - description of the problem
+ * @return True - if job can be run, false - otherwise
+ */
+bool checkJob( const CJobServer::Job& job, std::string& error )
+{
+   if ( job.mode != "sandbox" && job.mode != "gemm" )
+   {
+      error = "Error. Unknown mode: " + job.mode;
+      return false;
+   }
+
+   if ( job.isMapped && ( job.mode != "gemm" || !job.isConsumeBinary || job.isTxtOutput ) )
+   {
+      error = "Error. Memory mapping requires gemm mode, binary input and binary output.";
+      return false;
+   }
+
+   if ( options.count( "resume" ) && job.mode != "gemm" )
+   {
+      error = "Error. Resume requires gemm mode.";
+      return false;
+   }
+   return true;
+}
+
+/**
+ * @brief Describe input files of the job, so that checkpoint is not resumed after they change
+ * @param job - job to describe
+ * @return Names, sizes and modification times of the input files
+ */
+std::string describeInputs( const CJobServer::Job& job )
+{
+   std::ostringstream inputs;
+   const std::string* files[] = { &job.matrixAFile, &job.matrixBFile };
+   for ( std::size_t i = 0; i < 2; ++i )
+   {
+      struct stat status;
+      if ( ::stat( files[i]->c_str(), &status ) != 0 )
+      {
+         throw std::runtime_error( "Can not get status of input file " + *files[i] );
+      }
+      inputs << *files[i] << ' ' << status.st_size << ' ' << status.st_mtime << ';';
+   }
+   return inputs.str();
+}
+
+/**
+ * @brief Create checkpoint of the gemm job if checkpointing is enabled
+ * @param job - job to checkpoint
+ * @return Checkpoint or null
+ */
+boost::shared_ptr<CCheckpoint> createCheckpoint( const CJobServer::Job& job )
+{
+   const bool isResume = ( options.count( "resume" ) != 0 );
+   std::size_t interval = options["checkpoint-ms"].as<std::size_t>();
+   if ( interval == 0 && isResume )
+   {
+      interval = CCheckpoint::DEFAULT_INTERVAL_MS;
+   }
+   if ( interval == 0 )
+   {
+      return boost::shared_ptr<CCheckpoint>();
+   }
+
+   return boost::shared_ptr<CCheckpoint>( new CCheckpoint( job.matrixCFile,
+                                                           describeInputs( job ),
+                                                           boost::posix_time::milliseconds( interval ),
+                                                           isResume ) );
+}
+
+/**
+ * @brief Read input matrices, compute the result and write it to the output file
+ * @param job - job to run
+ * @param dispatcher - dispatcher of node calls
+ * @throw std::exception - if job is malformed or any of its steps fails, output is not written then
+ * @sa CJobServer::Runner
+ */
+void runJob( const CJobServer::Job& job, const CNodeDispatcher& dispatcher )
+{
+   std::string error;
+   if ( !checkJob( job, error ) )
+   {
+      throw std::invalid_argument( error );
+   }
+
+   const std::size_t parseThreads = options["parse-threads"].as<std::size_t>();
+
+   matrix::CMatrix matrixA;
+   matrix::CMatrix matrixB;
+   matrix::CMatrix matrixC;
+
+   CMappedMatrix mappedA;
+   CMappedMatrix mappedB;
+   CMappedMatrix mappedC;
+
+   boost::scoped_ptr<CMatrixLoader> loaderA;
+   boost::scoped_ptr<CMatrixLoader> loaderB;
+
+   if ( job.isPipelined )
+   {
+      // Connections are opened while inputs are read, computation starts on the first loaded rows.
+      dispatcher.warmUp();
+   }
+
+   if ( job.isMapped )
+   {
+      if ( !mappedA.openReadOnly( job.matrixAFile ) )
+      {
+         throw std::runtime_error( "Error while mapping matrix A binary file." );
+      }
+      if ( !mappedB.openReadOnly( job.matrixBFile ) )
+      {
+         throw std::runtime_error( "Error while mapping matrix B binary file." );
+      }
+   }
+   else if ( job.isPipelined )
+   {
+      loaderA.reset( new CMatrixLoader( job.matrixAFile, job.isConsumeBinary, parseThreads ) );
+      loaderB.reset( new CMatrixLoader( job.matrixBFile, job.isConsumeBinary, parseThreads ) );
+      if ( !loaderA->waitForSize() )
+      {
+         throw std::runtime_error( "Error while reading matrix A." );
+      }
+      if ( !loaderB->wait() )
+      {
+         throw std::runtime_error( "Error while reading matrix B." );
+      }
+      if ( job.mode != "gemm" && !loaderA->wait() )
+      {
+         throw std::runtime_error( "Error while reading matrix A." );
+      }
+   }
+   else if ( job.isConsumeBinary )
+   {
+      if ( !matrix::io::readFromBinFile( job.matrixAFile, matrixA ) )
+      {
+         throw std::runtime_error( "Error while reading matrix A from binary file." );
+      }
+      if ( !matrix::io::readFromBinFile( job.matrixBFile, matrixB ) )
+      {
+         throw std::runtime_error( "Error while reading matrix B from binary file." );
+      }
+   }
+   else
+   {
+      if ( !textio::readFromTextFile( job.matrixAFile, matrixA, parseThreads ) )
+      {
+         throw std::runtime_error( "Error while reading matrix A from text file." );
+      }
+      if ( !textio::readFromTextFile( job.matrixBFile, matrixB, parseThreads ) )
+      {
+         throw std::runtime_error( "Error while reading matrix B from text file." );
+      }
+   }
+   std::cout << ( loaderA ? "Input matrices are being read." : "Input matrices were read successfully." ) << std::endl;
+
+   const matrix::CMatrix& inputA = loaderA ? loaderA->getMatrix() : matrixA;
+   const matrix::CMatrix& inputB = loaderB ? loaderB->getMatrix() : matrixB;
+
+   // Calls of the job which runs out of time fail at once, so the job does not hang on slow nodes.
+   const boost::posix_time::time_duration jobTimeout =
+         boost::posix_time::milliseconds( options["job-timeout-ms"].as<std::size_t>() );
+
+   boost::shared_ptr<CCheckpoint> checkpoint;
+   if ( job.mode == "gemm" )
+   {
+      CNodeDispatcher jobDispatcher( dispatcher );
+      CancelTokenPtr jobToken;
+      if ( jobTimeout > boost::posix_time::time_duration() )
+      {
+         jobToken.reset( new CCancelToken() );
+         jobToken->cancelAfter( jobTimeout, "Job deadline exceeded" );
+         jobDispatcher = dispatcher.createCancellableDispatcher( jobToken );
+      }
+
+      try
+      {
+         CGemmEngine engine( jobDispatcher, options["tile-values"].as<std::size_t>() );
+         engine.setResidentBlocks( options.count( "resident-b" ) > 0 );
+         checkpoint = createCheckpoint( job );
+         engine.setCheckpoint( checkpoint );
+         if ( job.isMapped )
+         {
+            // Sizes are checked before the output file is created, so that it is not left truncated.
+            if ( mappedA.getColsCount() != mappedB.getRowsCount() )
+            {
+               throw std::invalid_argument( "Matrix A columns count differs from matrix B rows count" );
+            }
+            // Result cells are stored straight into the page cache of the output file.
+            if ( !mappedC.create( job.matrixCFile, mappedA.getRowsCount(), mappedB.getColsCount() ) )
+            {
+               throw std::runtime_error( "Can not create mapped output file " + job.matrixCFile );
+            }
+            engine.multiplyInto( mappedA, mappedB, mappedC );
+            if ( !mappedC.flush() )
+            {
+               throw std::runtime_error( "Can not flush mapped output file " + job.matrixCFile );
+            }
+         }
+         else if ( loaderA )
+         {
+            // Tiles wait only for rows of A they use, matrix B is already loaded.
+            if ( inputA.getColsCount() != inputB.getRowsCount() )
+            {
+               throw std::invalid_argument( "Matrix A columns count differs from matrix B rows count" );
+            }
+            matrixC = matrix::CMatrix( inputA.getRowsCount(), inputB.getColsCount() );
+            engine.multiplyInto( inputA,
+                                 inputB,
+                                 matrixC,
+                                 boost::bind( &CMatrixLoader::waitForRows, loaderA.get(), _1 ) );
+            if ( !loaderA->wait() )
+            {
+               throw std::runtime_error( "Error while reading matrix A" );
+            }
+         }
+         else
+         {
+            engine.multiply( matrixA, matrixB, matrixC );
+         }
+      }
+      catch ( const std::exception& e )
+      {
+         if ( checkpoint )
+         {
+            std::cout << "Finished tiles are kept in checkpoint " << checkpoint->getFileName() << std::endl;
+            // Queued tiles are written before the error is reported.
+            checkpoint.reset();
+         }
+         throw std::runtime_error( std::string( "GEMM was finished with error: " ) + e.what() );
+      }
+      std::cout << "GEMM was finished successfully" << std::endl;
+   }
+   else
+   {
+      CSandBox sandBox( inputA,
+                        inputB,
+                        matrixC,
+                        dispatcher,
+                        options["workers"].as<std::size_t>(),
+                        options["calls-per-node"].as<std::size_t>() );
+      if ( !sandBox.exec( jobTimeout ) )
+      {
+         throw std::runtime_error( "SandBox was finished with error" );
+      }
+      std::cout << "SandBox was finished successfully" << std::endl;
+   }
+
+   if ( !job.isMapped )
+   {
+      if ( job.isTxtOutput )
+      {
+         matrix::io::writeToTextFile( job.matrixCFile, matrixC );
+      }
+      else
+      {
+         matrix::io::writeToBinFile( job.matrixCFile, matrixC );
+      }
+   }
+
+   if ( checkpoint )
+   {
+      // Output is complete, so the checkpoint is not needed anymore.
+      checkpoint->remove();
+   }
+}
+
+/**
+ * @brief Signal handler which unblocks main thread
+ * @param stopped - promise to fulfill
+ */
+void onSignal( boost::promise<void>* stopped )
+{
+   stopped->set_value();
 }
 
 /**
@@ -184,37 +584,23 @@ int main( int argc, char* argv[] )
       return -1;
    }
 
-   matrix::CMatrix matrixA;
-   matrix::CMatrix matrixB;
-   matrix::CMatrix matrixC;
-
-   if ( isConsumeBinary )
-   {
-      if ( !matrix::io::readFromBinFile( matrixAFile, matrixA ) )
-      {
-         std::cout << "Error while reading matrix A from binary file." << std::endl;
-         return -1;
-      }
-      if ( !matrix::io::readFromBinFile( matrixBFile, matrixB ) )
-      {
-         std::cout << "Error while reading matrix B from binary file." << std::endl;
-         return -1;
-      }
-   }
-   else
+   CJobServer::Job job;
+   job.mode = options["mode"].as<std::string>();
+   job.matrixAFile = matrixAFile;
+   job.matrixBFile = matrixBFile;
+   job.matrixCFile = matrixCFile;
+   job.isConsumeBinary = isConsumeBinary;
+   job.isTxtOutput = isTxtOutput;
+   job.isMapped = options.count( "mmap" ) > 0;
+   job.isPipelined = options.count( "pipeline" ) > 0;
+
+   const bool isServer = options.count( "serve" ) > 0;
+   std::string jobError;
+   if ( !isServer && !checkJob( job, jobError ) )
    {
-      if ( !matrix::io::readFromTextFile( matrixAFile, matrixA ) )
-      {
-         std::cout << "Error while reading matrix A from text file." << std::endl;
-         return -1;
-      }
-      if ( !matrix::io::readFromTextFile( matrixBFile, matrixB ) )
-      {
-         std::cout << "Error while reading matrix B from text file." << std::endl;
-         return -1;
-      }
+      std::cout << jobError << std::endl;
+      return -1;
    }
-   std::cout << "Input matrices were read successfully." << std::endl;
 
    Json::Reader reader;
    Json::Value hostsArray;
@@ -229,29 +615,155 @@ int main( int argc, char* argv[] )
 
    fileStream.close();
 
+   CComputationNode::WireFormat wireFormat = CComputationNode::WIRE_AUTO;
+   if ( !parseWireFormat( options["wire"].as<std::string>(), wireFormat ) )
+   {
+      std::cout << "Error. Unknown payload format: " << options["wire"].as<std::string>() << std::endl;
+      return -1;
+   }
+
+   CEventLoop::setSharedThreadsCount( options["io-threads"].as<std::size_t>() );
+
+   if ( options.count( "metrics" ) )
+   {
+      const std::string metricsFormat = options["metrics-format"].as<std::string>();
+      if ( metricsFormat != "json" && metricsFormat != "prometheus" )
+      {
+         std::cout << "Error. Unknown metrics format: " << metricsFormat << std::endl;
+         return -1;
+      }
+
+      CMetrics::instance().setDumpTarget( options["metrics"].as<std::string>(),
+                                          metricsFormat == "json" ? CMetrics::FORMAT_JSON : CMetrics::FORMAT_PROMETHEUS );
+
+      const std::size_t metricsInterval = options["metrics-interval-ms"].as<std::size_t>();
+      if ( metricsInterval > 0 )
+      {
+         CMetrics::instance().startPeriodicDump( boost::posix_time::milliseconds( metricsInterval ) );
+      }
+   }
+
    std::vector<CComputationNode> compNodes;
 
    std::for_each( hostsArray.begin(),
                   hostsArray.end(),
-                  boost::bind( &populateComputationNodesHelper, boost::ref( compNodes ), _1 ) );
+                  boost::bind( &populateComputationNodesHelper,
+                               boost::ref( compNodes ),
+                               options["connections"].as<std::size_t>(),
+                               wireFormat,
+                               _1 ) );
+
+   const std::size_t batchDelay = options["batch-delay-us"].as<std::size_t>();
+   if ( batchDelay > 0 )
+   {
+      for ( std::vector<CComputationNode>::iterator it = compNodes.begin(); it != compNodes.end(); ++it )
+      {
+         it->enableBatching( boost::posix_time::microseconds( batchDelay ),
+                             options["batch-values"].as<std::size_t>() );
+      }
+   }
 
-   CSandBox sandBox( matrixA, matrixB, matrixC, compNodes );
+   const std::size_t streamChunkValues = options["stream-chunk-values"].as<std::size_t>();
+   if ( streamChunkValues > 0 )
+   {
+      for ( std::vector<CComputationNode>::iterator it = compNodes.begin(); it != compNodes.end(); ++it )
+      {
+         it->enableStreaming( streamChunkValues );
+      }
+   }
 
-   if ( sandBox.exec() )
+   CNodeDispatcher dispatcher( compNodes );
+   dispatcher.setLocalThreshold( options["local-threshold"].as<std::size_t>() );
+   dispatcher.setAutoTuning( options.count( "auto-tune" ) != 0 );
+   dispatcher.setRetries( options["retries"].as<std::size_t>(),
+                          boost::posix_time::milliseconds( options["retry-backoff-ms"].as<std::size_t>() ) );
+   dispatcher.setDeadline( boost::posix_time::milliseconds( options["deadline-ms"].as<std::size_t>() ) );
+   dispatcher.setEjection( options["eject-failures"].as<std::size_t>(),
+                           boost::posix_time::milliseconds( options["eject-ms"].as<std::size_t>() ) );
+
+   boost::shared_ptr<CResultCache> cache;
+   const std::size_t cacheMegabytes = options["cache-mb"].as<std::size_t>();
+   if ( cacheMegabytes > 0 )
    {
-      std::cout << "SandBox was finished successfully" << std::endl;
-      if ( isTxtOutput )
+      cache.reset( new CResultCache( cacheMegabytes << 20,
+                                     options.count( "cache-dir" ) ? options["cache-dir"].as<std::string>() : std::string(),
+                                     options["cache-dir-mb"].as<std::size_t>() << 20 ) );
+      dispatcher.setCache( cache );
+   }
+   else if ( options.count( "cache-dir" ) )
+   {
+      std::cout << "Error. Cache directory requires --cache-mb." << std::endl;
+      return -1;
+   }
+
+   const double hedgePercentile = options["hedge-percentile"].as<double>();
+   if ( hedgePercentile < 0.0 || hedgePercentile >= 1.0 )
+   {
+      std::cout << "Error. Hedge percentile must be in range [0, 1)." << std::endl;
+      return -1;
+   }
+   dispatcher.setHedging( hedgePercentile );
+
+   if ( isServer )
+   {
+      std::size_t jobSlots = options["job-slots"].as<std::size_t>();
+      if ( jobSlots == 0 )
       {
-         matrix::io::writeToTextFile( matrixCFile, matrixC );
+         for ( std::vector<CComputationNode>::const_iterator it = compNodes.begin(); it != compNodes.end(); ++it )
+         {
+            jobSlots += 2 * it->getMaxConnections();
+         }
       }
-      else
+      dispatcher.setJobSlots( jobSlots );
+
+      boost::promise<void> stopped;
+      boost::asio::signal_set signals( CEventLoop::instance().getService(), SIGINT, SIGTERM );
+      signals.async_wait( boost::bind( &onSignal, &stopped ) );
+
+      try
+      {
+         // Connections are opened before the first job arrives and stay open between jobs.
+         dispatcher.warmUp();
+         CJobServer server( CEventLoop::instance().getService(),
+                            options["serve"].as<std::string>(),
+                            dispatcher,
+                            &runJob,
+                            options["jobs"].as<std::size_t>() );
+
+         std::cout << "Scheduler is serving jobs on " << options["serve"].as<std::string>() << std::endl;
+
+         stopped.get_future().wait();
+         server.stop();
+         // Metrics of all jobs are written once, jobs do not overwrite them with each other's counters.
+         CMetrics::instance().dump();
+         std::cout << "Jobs: " << server.getFinishedCount() << " finished, "
+                   << server.getFailedCount() << " failed" << std::endl;
+      }
+      catch ( const std::exception& e )
       {
-         matrix::io::writeToBinFile( matrixCFile, matrixC );
+         std::cout << "Error while serving jobs: " << e.what() << std::endl;
+         return -1;
       }
    }
    else
    {
-      std::cout << "SandBox was finished with error" << std::endl;
+      try
+      {
+         runJob( job, dispatcher );
+      }
+      catch ( const std::exception& e )
+      {
+         CMetrics::instance().dump();
+         std::cout << e.what() << std::endl;
+         return -1;
+      }
+      CMetrics::instance().dump();
+   }
+
+   if ( cache )
+   {
+      std::cout << "Result cache: " << cache->getHitsCount() << " hits, "
+                << cache->getMissesCount() << " misses" << std::endl;
    }
 
    return 0;
@@ -0,0 +1,98 @@
+/*************************************************************************
+ * scheduler
+ *************************************************************************
+ * @file    stubnode.cpp
+ * @date    18.10.26
+ * @author  Hlieb Romanov <rgewebppc@gmail.com>
+ * @brief   Local stub of the remote computation service
+ ************************************************************************/
+/** @addtogroup scheduler Distributed operations scheduler
+ *  @{
+ */
+#include <iostream>
+#include <string>
+
+#include <boost/asio.hpp>
+#include <boost/program_options.hpp>
+
+#include "CEventLoop.hpp"
+#include "CStubNode.hpp"
+
+namespace po = boost::program_options;
+
+/**
+ * @brief Signal handler which unblocks main thread
+ * @param stopped - promise to fulfill
+ */
+static void onSignal( boost::promise<void>* stopped )
+{
+   stopped->set_value();
+}
+
+/**
+ * @brief The main function
+ * @param argc
+ * @param argv
+ * @return Application exit code
+ */
+int main( int argc, char* argv[] )
+{
+   po::options_description optDescr( "Allowed options" );
+   optDescr.add_options()
+       ( "help,h", "show this help message" )
+       ( "port,p", po::value<unsigned short>()->default_value( 8080 ), "port to listen on" )
+       ( "threads", po::value<std::size_t>()->default_value( CEventLoop::DEFAULT_THREADS_COUNT ),
+         "number of threads serving connections" )
+       ( "latency-us", po::value<long>()->default_value( 0 ), "delay every reply by this many microseconds" )
+       ( "jitter-us", po::value<long>()->default_value( 0 ), "add random delay up to this many microseconds" )
+       ( "json-only", "reject binary payloads as a service without binary format support does" )
+       ( "block-mb", po::value<std::size_t>()->default_value( CBlockStore::DEFAULT_CAPACITY >> 20 ),
+         "keep uploaded matrix blocks in this many megabytes, least recently used ones are evicted" );
+
+   po::variables_map options;
+   try
+   {
+       po::store( po::parse_command_line( argc, argv, optDescr ), options );
+       po::notify( options );
+   }
+   catch ( ... )
+   {
+       std::cout << "Unrecognized options" << std::endl;
+       std::cout << optDescr << std::endl;
+       return -1;
+   }
+
+   if ( options.count( "help" ) )
+   {
+       std::cout << optDescr << std::endl;
+       return 0;
+   }
+
+   CEventLoop eventLoop( options["threads"].as<std::size_t>() );
+
+   boost::promise<void> stopped;
+   boost::asio::signal_set signals( eventLoop.getService(), SIGINT, SIGTERM );
+   signals.async_wait( boost::bind( &onSignal, &stopped ) );
+
+   try
+   {
+      CStubNode stub( eventLoop.getService(),
+                      options["port"].as<unsigned short>(),
+                      options.count( "json-only" ) == 0,
+                      options["block-mb"].as<std::size_t>() << 20 );
+      stub.setLatency( boost::posix_time::microseconds( options["latency-us"].as<long>() ),
+                       boost::posix_time::microseconds( options["jitter-us"].as<long>() ) );
+
+      std::cout << "Stub node is listening on port " << stub.getPort() << std::endl;
+
+      stopped.get_future().wait();
+   }
+   catch ( const std::exception& e )
+   {
+      std::cout << "Error while starting stub node: " << e.what() << std::endl;
+      return -1;
+   }
+
+   return 0;
+}
+/** @}*/